@@ -0,0 +1,44 @@
+#include "decimator.h"
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Throughput of the decimation filter of the companion streams
+// usage: benchdecimator [factor] [number of channels] [seconds of 20 kHz data]
+int main(int argc, char **argv) {
+	const uint32_t factor = argc > 1 ? std::stoul(argv[1]) : 20;
+	const uint32_t n_channels = argc > 2 ? std::stoul(argv[2]) : 64;
+	const std::size_t n_samples = (argc > 3 ? std::stoull(argv[3]) : 10) * 20000;
+	const std::size_t chunk_samples = 200;
+
+	// one chunk of noisy sines, filtered over and over
+	std::vector<float> chunk(chunk_samples * n_channels);
+	for (std::size_t s = 0; s < chunk_samples; ++s)
+		for (uint32_t c = 0; c < n_channels; ++c)
+			chunk[s * n_channels + c] = static_cast<float>(std::sin(0.01 * s * (c + 1)) + c);
+	std::vector<double> timestamps(chunk_samples);
+	std::vector<float> out;
+	std::vector<double> out_timestamps;
+
+	decimator filter(factor, n_channels);
+	std::size_t n_out = 0;
+	const auto start = std::chrono::steady_clock::now();
+	for (std::size_t done = 0; done < n_samples; done += chunk_samples) {
+		for (std::size_t s = 0; s < chunk_samples; ++s) timestamps[s] = (done + s) / 20000.0;
+		out.clear();
+		out_timestamps.clear();
+		filter.process(chunk.data(), timestamps.data(), chunk_samples, out, out_timestamps);
+		n_out += out_timestamps.size();
+	}
+	const double seconds =
+		std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	std::cout << "Decimated " << n_samples << " samples of " << n_channels << " channels by "
+			  << factor << " (" << filter.taps().size() << " taps) in " << seconds * 1000
+			  << " ms: " << n_samples / seconds / 1e6 << " M samples/s, "
+			  << n_samples * n_channels / seconds / 1e6 << " M channel samples/s, " << n_out
+			  << " samples out" << std::endl;
+	return 0;
+}
@@ -0,0 +1,35 @@
+#include "signalstats.h"
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Throughput of the per-channel signal statistics
+// usage: benchsignalstats [number of channels] [seconds of 1 kHz data]
+int main(int argc, char **argv) {
+	const uint32_t n_channels = argc > 1 ? std::stoul(argv[1]) : 1024;
+	const std::size_t n_samples = (argc > 2 ? std::stoull(argv[2]) : 60) * 1000;
+	const std::size_t chunk_samples = 100;
+
+	// one chunk of sines, summarized over and over as the recording does once per second
+	std::vector<float> chunk(chunk_samples * n_channels);
+	for (std::size_t s = 0; s < chunk_samples; ++s)
+		for (uint32_t c = 0; c < n_channels; ++c)
+			chunk[s * n_channels + c] = static_cast<float>(100 * std::sin(0.01 * s * (c + 1)));
+
+	channel_stats<float> stats(n_channels, 1000);
+	stream_summary summary;
+	const auto start = std::chrono::steady_clock::now();
+	for (std::size_t done = 0; done < n_samples; done += chunk_samples) {
+		stats.update(chunk.data(), chunk_samples);
+		if (done % 1000 == 0) stats.summarize(summary);
+	}
+	const double seconds =
+		std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	std::cout << "Summarized " << n_samples << " samples of " << n_channels << " channels in "
+			  << seconds * 1000 << " ms: " << seconds * 1e9 / n_samples / n_channels
+			  << " ns per value, " << seconds * 1e6 / n_samples << " us per sample" << std::endl;
+	return 0;
+}
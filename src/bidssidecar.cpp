@@ -0,0 +1,232 @@
+#include "bidssidecar.h"
+#include "channelselection.h"
+#include "jsonformat.h"
+#include "xdfreader.h"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+std::string upper(std::string str) {
+	for (char &c : str) c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+	return str;
+}
+
+/// the BIDS channel type for the type of a channel (or its stream) in the header
+std::string channel_type(const std::string &type) {
+	static const std::set<std::string> bids_types{"AUDIO", "ECG", "EEG", "EMG", "EOG", "EYEGAZE",
+		"GSR", "HEOG", "MISC", "PPG", "PUPIL", "REF", "RESP", "SYSCLOCK", "TEMP", "TRIG", "VEOG"};
+	const std::string t = upper(type);
+	if (t == "MARKERS" || t == "TRIGGER") return "TRIG";
+	if (t == "GAZE") return "EYEGAZE";
+	return bids_types.count(t) ? t : "MISC";
+}
+
+/// the BIDS unit for the unit of a channel in the header
+std::string channel_unit(const std::string &unit) {
+	if (unit.empty()) return "n/a";
+	if (unit == "microvolts") return "uV";
+	if (unit == "millivolts") return "mV";
+	if (unit == "volts") return "V";
+	return unit;
+}
+
+/// a TSV field, without tabs and line breaks
+std::string tsv_field(std::string str) {
+	for (char &c : str)
+		if (c == '\t' || c == '\n' || c == '\r') c = ' ';
+	return str.empty() ? "n/a" : str;
+}
+
+} // namespace
+
+bids_sidecars::bids_sidecars(const std::string &filename) : modality_("eeg") {
+	const std::filesystem::path path(filename);
+	// sub-<label>[_ses-<label>]_task-<label>..._<suffix>
+	std::string stem = path.stem().string();
+	const auto suffix = stem.rfind('_');
+	if (stem.rfind("sub-", 0) == 0 && suffix != std::string::npos &&
+		stem.find('-', suffix) == std::string::npos) {
+		modality_ = stem.substr(suffix + 1);
+		stem.erase(suffix);
+	}
+	base_ = (path.parent_path() / stem).string();
+	const auto task = stem.find("_task-");
+	if (task != std::string::npos)
+		task_ = stem.substr(task + 6, stem.find('_', task + 6) - task - 6);
+}
+
+void bids_sidecars::add_stream(uint32_t streamid, const std::string &header_xml) {
+	stream s;
+	s.name = xml_value(header_xml, "name");
+	s.type = xml_value(header_xml, "type");
+	s.header = header_xml;
+	try {
+		s.nominal_srate = std::stod(xml_value(header_xml, "nominal_srate"));
+	} catch (std::exception &) {}
+	s.numeric = xml_value(header_xml, "channel_format") != "string";
+	s.channel_count =
+		static_cast<uint32_t>(std::stoul("0" + xml_value(header_xml, "channel_count")));
+	std::lock_guard<std::mutex> lock(mut_);
+	streams_[streamid] = std::move(s);
+}
+
+void bids_sidecars::add_markers(uint32_t streamid, const double *timestamps,
+	const std::string *samples, std::size_t n_samples, uint32_t n_channels) {
+	std::lock_guard<std::mutex> lock(mut_);
+	for (std::size_t s = 0; s < n_samples; ++s)
+		events_.push_back({timestamps[s], streamid, samples[s * n_channels]});
+}
+
+void bids_sidecars::set_clock_offset(uint32_t streamid, double offset) {
+	std::lock_guard<std::mutex> lock(mut_);
+	auto it = streams_.find(streamid);
+	if (it != streams_.end()) it->second.clock_offset = offset;
+}
+
+void bids_sidecars::finish_stream(
+	uint32_t streamid, double first_timestamp, double last_timestamp, uint64_t sample_count) {
+	std::lock_guard<std::mutex> lock(mut_);
+	auto it = streams_.find(streamid);
+	if (it == streams_.end()) return;
+	it->second.first_timestamp = first_timestamp;
+	it->second.last_timestamp = last_timestamp;
+	it->second.sample_count = sample_count;
+}
+
+uint32_t bids_sidecars::primary() const {
+	uint32_t best = 0;
+	uint32_t best_channels = 0;
+	bool best_matches = false;
+	for (const auto &entry : streams_) {
+		const stream &s = entry.second;
+		if (!s.numeric || s.nominal_srate <= 0) continue;
+		const bool matches = upper(s.type) == upper(modality_);
+		if (!best || (matches && !best_matches) ||
+			(matches == best_matches && s.channel_count > best_channels)) {
+			best = entry.first;
+			best_channels = s.channel_count;
+			best_matches = matches;
+		}
+	}
+	return best;
+}
+
+std::vector<std::string> bids_sidecars::write() const {
+	std::lock_guard<std::mutex> lock(mut_);
+	const uint32_t primary_id = primary();
+	const stream *primary_stream = primary_id ? &streams_.at(primary_id) : nullptr;
+
+	// the event onsets are relative to the first sample of the primary stream (or of the
+	// earliest stream), in the recording computer's clock
+	double start = NAN;
+	if (primary_stream && primary_stream->sample_count)
+		start = primary_stream->first_timestamp + primary_stream->clock_offset;
+	else
+		for (const auto &entry : streams_)
+			if (entry.second.sample_count)
+				start = std::fmin(start, entry.second.first_timestamp + entry.second.clock_offset);
+	if (std::isnan(start)) start = 0;
+
+	// the channels of the regular numeric streams, the primary stream's first
+	std::vector<uint32_t> ids;
+	if (primary_id) ids.push_back(primary_id);
+	for (const auto &entry : streams_)
+		if (entry.first != primary_id && entry.second.numeric && entry.second.nominal_srate > 0)
+			ids.push_back(entry.first);
+	std::ostringstream channels;
+	channels << "name\ttype\tunits\tsampling_frequency\tstream\n";
+	std::map<std::string, int> type_counts;
+	std::set<std::string> names;
+	for (const uint32_t id : ids) {
+		const stream &s = streams_.at(id);
+		const auto descriptions = channel_descriptions(s.header);
+		for (uint32_t c = 0; c < s.channel_count; ++c) {
+			const std::string description = c < descriptions.size() ? descriptions[c] : "";
+			// channel names are unique, even if several streams have the same labels
+			std::string name = xml_value(description, "label");
+			if (name.empty()) name = s.name + '_' + std::to_string(c + 1);
+			if (names.count(name)) name = s.name + '_' + name;
+			names.insert(name);
+			const std::string type = xml_value(description, "type");
+			const std::string bids_type = channel_type(type.empty() ? s.type : type);
+			type_counts[bids_type]++;
+			channels << tsv_field(name) << '\t' << bids_type << '\t'
+					 << channel_unit(xml_value(description, "unit")) << '\t'
+					 << json_number(s.nominal_srate) << '\t' << tsv_field(s.name) << '\n';
+		}
+	}
+
+	// the markers of the string streams, in time order
+	std::vector<const event *> sorted;
+	for (const auto &e : events_) sorted.push_back(&e);
+	const auto corrected = [this](const event *e) {
+		auto it = streams_.find(e->streamid);
+		return e->timestamp + (it != streams_.end() ? it->second.clock_offset : 0);
+	};
+	std::stable_sort(sorted.begin(), sorted.end(),
+		[&](const event *a, const event *b) { return corrected(a) < corrected(b); });
+	std::ostringstream events;
+	events << "onset\tduration\ttrial_type\tstream\n";
+	events.setf(std::ios::fixed);
+	events.precision(6);
+	for (const event *e : sorted) {
+		auto it = streams_.find(e->streamid);
+		events << corrected(e) - start << "\tn/a\t" << tsv_field(e->value) << '\t'
+			   << tsv_field(it != streams_.end() ? it->second.name : std::string()) << '\n';
+	}
+
+	// the recording parameters, and all streams with their rates and sample counts
+	std::ostringstream json;
+	const std::string manufacturer =
+		primary_stream ? xml_value(primary_stream->header, "manufacturer") : std::string();
+	json << "{\n\t\"TaskName\": " << json_string(task_.empty() ? "n/a" : task_)
+		 << ",\n\t\"SamplingFrequency\": "
+		 << (primary_stream ? json_number(primary_stream->nominal_srate, "\"n/a\"") : "\"n/a\"")
+		 << ",\n\t\"EEGReference\": \"n/a\",\n\t\"PowerLineFrequency\": \"n/a\""
+		 << ",\n\t\"SoftwareFilters\": \"n/a\"";
+	if (!manufacturer.empty()) json << ",\n\t\"Manufacturer\": " << json_string(manufacturer);
+	json << ",\n\t\"EEGChannelCount\": " << type_counts["EEG"]
+		 << ",\n\t\"EOGChannelCount\": "
+		 << type_counts["EOG"] + type_counts["HEOG"] + type_counts["VEOG"]
+		 << ",\n\t\"ECGChannelCount\": " << type_counts["ECG"]
+		 << ",\n\t\"EMGChannelCount\": " << type_counts["EMG"]
+		 << ",\n\t\"MiscChannelCount\": " << type_counts["MISC"]
+		 << ",\n\t\"TriggerChannelCount\": " << type_counts["TRIG"];
+	if (primary_stream && primary_stream->sample_count)
+		json << ",\n\t\"RecordingDuration\": "
+			 << json_number(primary_stream->last_timestamp - primary_stream->first_timestamp);
+	json << ",\n\t\"RecordingType\": \"continuous\",\n\t\"RecordedStreams\": [";
+	bool first = true;
+	for (const auto &entry : streams_) {
+		const stream &s = entry.second;
+		const double duration = s.last_timestamp - s.first_timestamp;
+		const double effective_srate =
+			s.sample_count > 1 && duration > 0 ? (s.sample_count - 1) / duration : NAN;
+		json << (first ? "\n" : ",\n") << "\t\t{\"StreamId\": " << entry.first
+			 << ", \"Name\": " << json_string(s.name) << ", \"Type\": " << json_string(s.type)
+			 << ", \"ChannelCount\": " << s.channel_count
+			 << ", \"NominalSamplingFrequency\": " << json_number(s.nominal_srate)
+			 << ", \"EffectiveSamplingFrequency\": " << json_number(effective_srate)
+			 << ", \"SampleCount\": " << s.sample_count << '}';
+		first = false;
+	}
+	json << "\n\t]\n}\n";
+
+	const std::vector<std::pair<std::string, std::string>> files{
+		{base_ + '_' + modality_ + ".json", json.str()}, {base_ + "_channels.tsv", channels.str()},
+		{base_ + "_events.tsv", events.str()}};
+	std::vector<std::string> written;
+	for (const auto &file : files) {
+		std::ofstream out(file.first, std::ios::binary | std::ios::trunc);
+		out << file.second;
+		if (!out) throw std::runtime_error("Could not write " + file.first);
+		written.push_back(file.first);
+	}
+	return written;
+}
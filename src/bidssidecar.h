@@ -0,0 +1,75 @@
+#ifndef BIDSSIDECAR_H
+#define BIDSSIDECAR_H
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * The BIDS sidecar files of a recording (_eeg.json, _channels.tsv and _events.tsv next to the
+ * .xdf file), written when it's stopped.
+ *
+ * Everything they need is gathered while recording: the stream headers as written into the file,
+ * the sample counts and first / last time stamps of the footers, the latest clock offsets and the
+ * markers of the string streams, so the file doesn't have to be read again afterwards.
+ *
+ * The primary stream (that SamplingFrequency and the event onsets refer to) is the regular
+ * numeric stream whose type matches the modality of the file name (e.g. EEG for _eeg.xdf), or
+ * else the one with the most channels. All regular numeric streams are listed in _channels.tsv,
+ * the markers of all string streams in _events.tsv.
+ */
+class bids_sidecars {
+public:
+	/// @param filename The recording, e.g. sub-01/ses-01/eeg/sub-01_ses-01_task-rest_run-1_eeg.xdf
+	explicit bids_sidecars(const std::string &filename);
+
+	/// a stream with the header that was written into the file
+	void add_stream(uint32_t streamid, const std::string &header_xml);
+
+	/// the first channel of n_samples multiplexed samples of a string stream are events
+	void add_markers(uint32_t streamid, const double *timestamps, const std::string *samples,
+		std::size_t n_samples, uint32_t n_channels);
+
+	/// the latest clock offset of a stream, to map its time stamps to the recording computer's
+	void set_clock_offset(uint32_t streamid, double offset);
+
+	/// the stream has ended, with the same numbers as in its footer
+	void finish_stream(
+		uint32_t streamid, double first_timestamp, double last_timestamp, uint64_t sample_count);
+
+	/// write the sidecar files, returns their names
+	std::vector<std::string> write() const;
+
+	/// the file names without the suffix (e.g. .../sub-01_ses-01_task-rest_run-001) and the suffix
+	/// (e.g. eeg; eeg if the file isn't named like in BIDS)
+	const std::string &base() const { return base_; }
+	const std::string &modality() const { return modality_; }
+
+private:
+	struct stream {
+		std::string name, type, header;
+		double nominal_srate = 0;
+		uint32_t channel_count = 0;
+		bool numeric = true;
+		double first_timestamp = 0, last_timestamp = 0;
+		uint64_t sample_count = 0;
+		double clock_offset = 0;
+	};
+	struct event {
+		double timestamp;
+		uint32_t streamid;
+		std::string value;
+	};
+
+	std::string base_, modality_, task_;
+	std::map<uint32_t, stream> streams_;
+	std::vector<event> events_;
+	mutable std::mutex mut_; // a mutex to protect the streams and events
+
+	/// the id of the primary stream (0 if there's no regular numeric stream)
+	uint32_t primary() const;
+};
+
+#endif
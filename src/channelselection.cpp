@@ -0,0 +1,107 @@
+#include "channelselection.h"
+#include "xdfreader.h"
+#include <stdexcept>
+
+namespace {
+/// the positions of the <channel> elements in desc/channels (begin and end of each element)
+std::vector<std::pair<std::size_t, std::size_t>> channel_elements(const std::string &xml) {
+	std::vector<std::pair<std::size_t, std::size_t>> elements;
+	const auto channels = xml.find("<channels>");
+	if (channels == std::string::npos) return elements;
+	const auto channels_end = xml.find("</channels>", channels);
+	for (auto begin = xml.find("<channel>", channels);
+		 begin != std::string::npos && begin < channels_end;
+		 begin = xml.find("<channel>", elements.back().second)) {
+		const auto end = xml.find("</channel>", begin);
+		if (end == std::string::npos) break;
+		elements.emplace_back(begin, end + 10);
+	}
+	return elements;
+}
+
+bool is_index(const std::string &s) {
+	return !s.empty() && s.find_first_not_of("0123456789") == std::string::npos;
+}
+} // namespace
+
+std::vector<std::string> channel_descriptions(const std::string &header_xml) {
+	std::vector<std::string> descriptions;
+	for (const auto &element : channel_elements(header_xml))
+		descriptions.push_back(header_xml.substr(element.first, element.second - element.first));
+	return descriptions;
+}
+
+channel_selection::channel_selection(
+	const std::vector<std::string> &spec, const std::string &header_xml)
+	: n_in_(static_cast<uint32_t>(std::stoul(xml_value(header_xml, "channel_count")))) {
+	std::vector<std::string> labels;
+	for (const auto &channel : channel_descriptions(header_xml))
+		labels.push_back(xml_value(channel, "label"));
+
+	const auto select = [&](uint64_t channel, const std::string &item) {
+		if (channel >= n_in_)
+			throw std::invalid_argument("The stream has no channel " + item + " (it has " +
+										std::to_string(n_in_) + " channels)");
+		channels_.push_back(static_cast<uint32_t>(channel));
+	};
+	for (const auto &item : spec) {
+		const auto dash = item.find('-');
+		if (is_index(item))
+			select(std::stoull(item), item);
+		else if (dash != std::string::npos && is_index(item.substr(0, dash)) &&
+				 is_index(item.substr(dash + 1))) {
+			const uint64_t first = std::stoull(item.substr(0, dash)),
+						   last = std::stoull(item.substr(dash + 1));
+			// "31-0" would silently select nothing
+			if (first > last)
+				throw std::invalid_argument("The channel range " + item + " is descending");
+			for (uint64_t c = first; c <= last; ++c) select(c, item);
+		} else {
+			const auto label = std::find(labels.begin(), labels.end(), item);
+			if (label == labels.end())
+				throw std::invalid_argument("The stream has no channel labeled " + item);
+			select(label - labels.begin(), item);
+		}
+	}
+	if (channels_.empty())
+		for (uint32_t c = 0; c < n_in_; ++c) channels_.push_back(c);
+
+	all_ = channels_.size() == n_in_;
+	for (std::size_t i = 0; i < channels_.size(); ++i) {
+		if (channels_[i] != i) all_ = false;
+		if (!runs_.empty() && runs_.back().first + runs_.back().second == channels_[i])
+			runs_.back().second++;
+		else
+			runs_.emplace_back(channels_[i], 1);
+	}
+}
+
+std::string channel_selection::rewrite_header(const std::string &header_xml) const {
+	if (all_) return header_xml;
+	std::string xml = header_xml;
+	const auto count = xml.find("<channel_count>"), count_end = xml.find("</channel_count>");
+	if (count != std::string::npos && count_end != std::string::npos)
+		xml.replace(count + 15, count_end - count - 15, std::to_string(channels_.size()));
+
+	// the descriptions of the selected channels, in their order and with the original spacing
+	const auto elements = channel_elements(xml);
+	if (elements.size() == n_in_) {
+		const std::string separator =
+			n_in_ > 1 ? xml.substr(elements[0].second, elements[1].first - elements[0].second)
+					  : std::string();
+		std::string channels;
+		for (std::size_t i = 0; i < channels_.size(); ++i) {
+			const auto &element = elements[channels_[i]];
+			if (i) channels += separator;
+			channels += xml.substr(element.first, element.second - element.first);
+		}
+		xml.replace(elements.front().first, elements.back().second - elements.front().first,
+			channels);
+	}
+
+	// the original channel indices, so the recorded channels can be mapped to the amplifier's
+	std::string indices;
+	for (const auto c : channels_) indices += (indices.empty() ? "" : " ") + std::to_string(c);
+	insert_into_desc(xml, "<selected_channels>" + indices + "</selected_channels>");
+	return xml;
+}
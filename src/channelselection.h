@@ -0,0 +1,57 @@
+#ifndef CHANNELSELECTION_H
+#define CHANNELSELECTION_H
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+/// the <channel> elements of a stream header's desc/channels, in order
+std::vector<std::string> channel_descriptions(const std::string &header_xml);
+
+/**
+ * The channels of a wide stream that are recorded, e.g. 32 of the 256 channels of an amplifier.
+ *
+ * The selection is resolved once against the stream header, into a gather map of runs of
+ * consecutive channels, so a chunk is reduced with one block copy per run and sample (a single
+ * memcpy per sample for an index range) before it's serialized.
+ */
+class channel_selection {
+public:
+	/**
+	 * @param spec Channel indices (counted from 0), index ranges ("0-31") and channel labels
+	 * (from the header's desc/channels/channel/label), in the order they are to be recorded.
+	 * Empty: all channels.
+	 * @param header_xml The stream header as received from the outlet
+	 * @throws std::invalid_argument if an index is out of range, a range is descending ("31-0")
+	 * or a label doesn't exist
+	 */
+	channel_selection(const std::vector<std::string> &spec, const std::string &header_xml);
+
+	/// the selected channels of the stream, in the recorded order
+	const std::vector<uint32_t> &channels() const { return channels_; }
+
+	/// whether every channel is recorded in its original order, so nothing needs to be gathered
+	bool all() const { return all_; }
+
+	/// the header with the channel count and channel descriptions of the selected channels, the
+	/// original indices are listed in desc/selected_channels
+	std::string rewrite_header(const std::string &header_xml) const;
+
+	/// gather the selected channels of n_samples multiplexed samples into out
+	template <class T> void gather(const T *in, std::size_t n_samples, std::vector<T> &out) const {
+		out.resize(n_samples * channels_.size());
+		T *dst = out.data();
+		for (std::size_t s = 0; s < n_samples; ++s, in += n_in_)
+			for (const auto &run : runs_) dst = std::copy_n(in + run.first, run.second, dst);
+	}
+
+private:
+	uint32_t n_in_;					 // channels in the stream
+	std::vector<uint32_t> channels_; // selected channel indices
+	bool all_;
+	std::vector<std::pair<uint32_t, uint32_t>> runs_; // first channel and length of each run
+};
+
+#endif
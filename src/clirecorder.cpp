@@ -1,17 +1,151 @@
+#include "recorderdaemon.h"
 #include "recording.h"
 #include "xdfwriter.h"
+#include <filesystem>
+
+static int usage(const char *name) {
+	std::cout << "Usage: " << name
+			  << " [options] outputfile.xdf 'searchstr' ['searchstr2' ...]\n"
+			  << "       " << name
+			  << " --daemon [--config=LabRecorder.cfg] ['searchstr' ...]\n\n"
+			  << "searchstr can be anything accepted by lsl_resolve_bypred\n";
+	std::cout << "Options:\n"
+			  << "\t--mirror=copy.xdf\twrite an additional copy of the file, e.g. to another disk\n"
+			  << "\t--spill-budget-mb=N\tbuffer up to N MiB in memory when the disk stalls\n"
+			  << "\t--durability=none|periodic|group_commit\twhen to sync data to the disk\n"
+			  << "\t--sync-interval-ms=N\tsync at least every N ms (default 1000)\n"
+			  << "\t--sync-mb=N\tgroup_commit: also sync after N MiB\n"
+			  << "\t--interleave-ms=N\twrite chunks in time order, delaying them up to N ms\n"
+			  << "\t--interleave-mb=N\tmemory for reordering chunks (default 64)\n"
+			  << "\t--tap=name\tpublish the samples in shared memory for local programs\n"
+			  << "\t--tap-mb=N\tsize of the shared memory ring (default 64)\n"
+			  << "\t--watermark\tpublish the committed size in outputfile.xdf.committed\n"
+			  << "\t--checksums\twrite chunk CRCs (.crc32c) and the SHA-256 (.sha256) of the file\n"
+			  << "\t--bids-sidecars\twrite the BIDS _eeg.json, _channels.tsv and _events.tsv\n"
+			  << "\t--resume\trepair an interrupted outputfile.xdf and append to it\n"
+			  << "\t--shard='query'@file.xdf\trecord the matching streams into a separate file\n"
+			  << "Daemon mode (the searchstrs select the streams, default: all):\n"
+			  << "\t--daemon\twait for remote control commands, stop on SIGINT/SIGTERM\n"
+			  << "\t--config=file.cfg\tthe settings (default: LabRecorder.cfg, if it exists)\n"
+			  << "\t--rcs-port=N\tthe remote control port (0: off, default from the config)\n"
+			  << "\t--metrics-port=N\tserve Prometheus metrics on http://host:N/metrics\n"
+			  << "\tthe options above override the config, --mirror and --shard name folders\n";
+	std::cout << "Keep in mind that your shell might remove quotes\n";
+	std::cout << "Examples:\n\t" << name << " foo.xdf 'type=\"EEG\"' ";
+	std::cout << " 'host=\"LabPC1\" or host=\"LabPC2\"'\n\t";
+	std::cout << name << " foo.xdf'name=\"Tobii and type=\"Eyetracker\"'\n";
+	return 1;
+}
 
 int main(int argc, char **argv) {
-	if (argc < 3 || (argc == 2 && std::string(argv[1]) == "-h")) {
-		std::cout << "Usage: " << argv[0] << " outputfile.xdf 'searchstr' ['searchstr2' ...]\n\n"
-				  << "searchstr can be anything accepted by lsl_resolve_bypred\n";
-		std::cout << "Keep in mind that your shell might remove quotes\n";
-		std::cout << "Examples:\n\t" << argv[0] << " foo.xdf 'type=\"EEG\"' ";
-		std::cout << " 'host=\"LabPC1\" or host=\"LabPC2\"'\n\t";
-		std::cout << argv[0] << " foo.xdf'name=\"Tobii and type=\"Eyetracker\"'\n";
+	// daemon mode: the settings come from the config file, the recording is remote controlled
+	bool daemon = false;
+	std::string config_file;
+	for (int i = 1; i < argc; ++i) {
+		const std::string arg(argv[i]);
+		if (arg == "--daemon")
+			daemon = true;
+		else if (arg.rfind("--config=", 0) == 0)
+			config_file = arg.substr(9);
+	}
+	recorder_config config;
+	if (daemon) {
+		if (config_file.empty() && std::filesystem::exists("LabRecorder.cfg"))
+			config_file = "LabRecorder.cfg";
+		try {
+			if (!config_file.empty()) config = read_config(config_file);
+		} catch (std::exception &e) {
+			std::cerr << "Problem parsing config file: " << e.what() << std::endl;
+			return 2;
+		}
+	}
+
+	// options (--name=value) may appear anywhere, everything else is positional; in daemon mode
+	// they override the config file's settings
+	recording_options cli_options;
+	recording_options &options = daemon ? config.options : cli_options;
+	int rcs_port = -1, metrics_port = -1;
+	std::vector<char *> args;
+	// a malformed number or mode shows the usage instead of ending the program
+	int i = 0;
+	try {
+		for (; i < argc; ++i) {
+			std::string arg(argv[i]);
+			if (arg.rfind("--mirror=", 0) == 0)
+				options.mirror_files.push_back(arg.substr(9));
+			else if (arg.rfind("--spill-budget-mb=", 0) == 0) {
+				options.spill_budget = std::stoul(arg.substr(18)) * 1024 * 1024;
+				options.spill_alarm = options.spill_budget / 8;
+			} else if (arg.rfind("--durability=", 0) == 0)
+				options.durability.mode = parse_durability_mode(arg.substr(13));
+			else if (arg.rfind("--sync-interval-ms=", 0) == 0)
+				options.durability.interval = std::stod(arg.substr(19)) / 1000;
+			else if (arg.rfind("--sync-mb=", 0) == 0)
+				options.durability.max_unsynced_bytes = std::stoul(arg.substr(10)) * 1024 * 1024;
+			else if (arg.rfind("--interleave-ms=", 0) == 0)
+				options.interleave_window = std::stod(arg.substr(16)) / 1000;
+			else if (arg.rfind("--interleave-mb=", 0) == 0)
+				options.interleave_buffer = std::stoul(arg.substr(16)) * 1024 * 1024;
+			else if (arg.rfind("--tap=", 0) == 0)
+				options.tap_name = arg.substr(6);
+			else if (arg.rfind("--tap-mb=", 0) == 0)
+				options.tap_size = std::stoul(arg.substr(9)) * 1024 * 1024;
+			else if (arg == "--watermark")
+				options.watermark = true;
+			else if (arg == "--checksums")
+				options.integrity = true;
+			else if (arg == "--bids-sidecars")
+				options.bids_sidecars = true;
+			else if (arg == "--resume")
+				options.resume = true;
+			else if (arg == "--daemon" || arg.rfind("--config=", 0) == 0)
+				continue;
+			else if (arg.rfind("--rcs-port=", 0) == 0)
+				rcs_port = std::stoi(arg.substr(11));
+			else if (arg.rfind("--metrics-port=", 0) == 0)
+				metrics_port = std::stoi(arg.substr(15));
+			else if (arg.rfind("--shard=", 0) == 0 && arg.rfind('@') > 8) {
+				// the query may contain '@' (e.g. in a hostname), the filename rarely does
+				const auto at = arg.rfind('@');
+				options.shards.push_back({arg.substr(8, at - 8), arg.substr(at + 1)});
+			} else
+				args.push_back(argv[i]);
+		}
+	} catch (std::exception &e) {
+		std::cerr << "Invalid option " << argv[i] << ": " << e.what() << std::endl;
+		return usage(argv[0]);
+	}
+	argc = static_cast<int>(args.size());
+	argv = args.data();
+	if (options.durability.max_unsynced_bytes &&
+		options.durability.mode != durability_mode::group_commit) {
+		std::cerr << "--sync-mb requires --durability=group_commit" << std::endl;
 		return 1;
 	}
 
+	if (daemon) {
+		if (options.resume) {
+			std::cerr << "--resume can't be used with --daemon, every recording starts a new file"
+					  << std::endl;
+			return 1;
+		}
+		// every recording gets its own file name, so mirrors and shards name folders
+		for (auto &mirror : options.mirror_files) config.mirror_roots.push_back(std::move(mirror));
+		for (auto &shard : options.shards)
+			config.shard_roots.emplace_back(std::move(shard.query), std::move(shard.filename));
+		options.mirror_files.clear();
+		options.shards.clear();
+		if (rcs_port >= 0) {
+			config.rcs_enabled = rcs_port > 0;
+			config.rcs_port = static_cast<uint16_t>(rcs_port);
+		}
+		if (metrics_port >= 0) config.metrics_port = static_cast<uint16_t>(metrics_port);
+		// the remaining arguments select the streams to record
+		return recorder_daemon(config, std::vector<std::string>(argv + 1, argv + argc)).run();
+	}
+
+	if (argc < 3 || (argc == 2 && std::string(argv[1]) == "-h")) return usage(argv[0]);
+
 	std::vector<lsl::stream_info> infos = lsl::resolve_streams(), recordstreams;
 
 	for (int i = 2; i < argc; ++i) {
@@ -33,7 +167,13 @@ int main(int argc, char **argv) {
 	std::vector<std::string> watchfor;
 	std::map<std::string, int> sync_options;
 	std::cout << "Starting the recording, press Enter to quit" << std::endl;
-	recording r(argv[1], recordstreams, watchfor, sync_options, true);
-	std::cin.get();
+	try {
+		recording r(argv[1], recordstreams, watchfor, sync_options, true, options);
+		std::cin.get();
+	} catch (std::exception &e) {
+		// e.g. the file or a mirror can't be opened, or resuming failed
+		std::cerr << "Error: " << e.what() << std::endl;
+		return 3;
+	}
 	return 0;
 }
@@ -0,0 +1,75 @@
+#include "decimator.h"
+#include <cmath>
+#include <stdexcept>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define DECIMATOR_SSE
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+#define DECIMATOR_NEON
+#include <arm_neon.h>
+#endif
+
+float fir_dot(const float *taps, const float *x, std::size_t n) {
+	std::size_t i = 0;
+	float sum = 0;
+#if defined(DECIMATOR_SSE)
+	// two independent accumulators, so the additions of consecutive steps don't wait for each other
+	__m128 acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps();
+	for (; i + 8 <= n; i += 8) {
+		acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(taps + i), _mm_loadu_ps(x + i)));
+		acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(taps + i + 4), _mm_loadu_ps(x + i + 4)));
+	}
+	float lanes[4];
+	_mm_storeu_ps(lanes, _mm_add_ps(acc0, acc1));
+	sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#elif defined(DECIMATOR_NEON)
+	float32x4_t acc0 = vdupq_n_f32(0), acc1 = vdupq_n_f32(0);
+	for (; i + 8 <= n; i += 8) {
+		acc0 = vmlaq_f32(acc0, vld1q_f32(taps + i), vld1q_f32(x + i));
+		acc1 = vmlaq_f32(acc1, vld1q_f32(taps + i + 4), vld1q_f32(x + i + 4));
+	}
+	const float32x4_t acc = vaddq_f32(acc0, acc1);
+	sum = (vgetq_lane_f32(acc, 0) + vgetq_lane_f32(acc, 1)) +
+		  (vgetq_lane_f32(acc, 2) + vgetq_lane_f32(acc, 3));
+#endif
+	for (; i < n; ++i) sum += taps[i] * x[i];
+	return sum;
+}
+
+decimator::decimator(uint32_t factor, uint32_t n_channels)
+	: factor_(factor), n_channels_(n_channels), channels_(n_channels) {
+	if (factor < 2) throw std::invalid_argument("The decimation factor must be at least 2");
+	// windowed sinc with the cutoff at the new Nyquist frequency; aliases only fold into the
+	// transition band above it
+	const std::size_t n_taps = 16 * static_cast<std::size_t>(factor) + 1;
+	const double pi = 3.14159265358979323846, cutoff = 0.5 / factor, center = (n_taps - 1) / 2.0;
+	double sum = 0;
+	taps_.resize(n_taps);
+	for (std::size_t k = 0; k < n_taps; ++k) {
+		const double t = k - center;
+		const double sinc = t == 0 ? 2 * cutoff : std::sin(2 * pi * cutoff * t) / (pi * t);
+		const double window = 0.54 - 0.46 * std::cos(2 * pi * k / (n_taps - 1));
+		taps_[k] = static_cast<float>(sinc * window);
+		sum += taps_[k];
+	}
+	// unity gain for constant signals
+	for (auto &tap : taps_) tap = static_cast<float>(tap / sum);
+	next_ = n_taps - 1;
+}
+
+void decimator::filter(std::vector<float> &out, std::vector<double> &out_timestamps) {
+	const std::size_t n_taps = taps_.size();
+	for (; next_ < timestamps_.size(); next_ += factor_) {
+		const std::size_t first = next_ + 1 - n_taps;
+		for (const auto &channel : channels_)
+			out.push_back(fir_dot(taps_.data(), channel.data() + first, n_taps));
+		out_timestamps.push_back(timestamps_[next_ - delay()]);
+	}
+	// the samples before the next output's window aren't needed anymore
+	const std::size_t drop = next_ + 1 - n_taps;
+	if (drop == 0) return;
+	for (auto &channel : channels_) channel.erase(channel.begin(), channel.begin() + drop);
+	timestamps_.erase(timestamps_.begin(), timestamps_.begin() + drop);
+	next_ -= drop;
+}
@@ -0,0 +1,66 @@
+#ifndef DECIMATOR_H
+#define DECIMATOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/// the dot product of n filter taps and samples (SSE / NEON where available)
+float fir_dot(const float *taps, const float *x, std::size_t n);
+
+/**
+ * Anti-aliased downsampling of a numeric stream by an integer factor, e.g. for a quick-look
+ * companion of a 20 kHz recording.
+ *
+ * The lowpass is a linear phase FIR (Hamming windowed sinc, 16 taps per unit of the factor) with
+ * its cutoff at the new Nyquist frequency. Only every factor-th output is computed (the
+ * polyphase form of a decimating FIR), as a dot product of the taps with the newest samples of
+ * each channel. The samples are kept per channel (not multiplexed) so that product runs over
+ * contiguous memory. Chunks are filtered incrementally: the last taps - 1 samples are kept for
+ * the next chunk, so the output doesn't depend on how the input was split into chunks.
+ */
+class decimator {
+public:
+	/**
+	 * @param factor Keep every factor-th sample (at least 2)
+	 * @param n_channels Number of channels in the stream
+	 */
+	decimator(uint32_t factor, uint32_t n_channels);
+
+	uint32_t factor() const { return factor_; }
+	const std::vector<float> &taps() const { return taps_; }
+	/// the delay of the filter in input samples, the output time stamps are corrected for it
+	std::size_t delay() const { return (taps_.size() - 1) / 2; }
+
+	/**
+	 * @brief process Filter n_samples multiplexed samples
+	 * @param timestamps the time stamps of the input samples
+	 * @param out the decimated samples are appended (multiplexed)
+	 * @param out_timestamps the time stamps of the decimated samples are appended
+	 */
+	template <class T>
+	void process(const T *in, const double *timestamps, std::size_t n_samples,
+		std::vector<float> &out, std::vector<double> &out_timestamps) {
+		for (uint32_t c = 0; c < n_channels_; ++c) {
+			auto &channel = channels_[c];
+			const std::size_t old = channel.size();
+			channel.resize(old + n_samples);
+			for (std::size_t s = 0; s < n_samples; ++s)
+				channel[old + s] = static_cast<float>(in[s * n_channels_ + c]);
+		}
+		timestamps_.insert(timestamps_.end(), timestamps, timestamps + n_samples);
+		filter(out, out_timestamps);
+	}
+
+private:
+	const uint32_t factor_, n_channels_;
+	std::vector<float> taps_;				  // symmetric, so they needn't be reversed
+	std::vector<std::vector<float>> channels_; // the last taps - 1 samples and the new ones
+	std::vector<double> timestamps_;		  // the time stamps of the samples in channels_
+	std::size_t next_;						  // the newest sample of the next output window
+
+	/// compute the outputs that are due and drop the samples that are no longer needed
+	void filter(std::vector<float> &out, std::vector<double> &out_timestamps);
+};
+
+#endif
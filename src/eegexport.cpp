@@ -0,0 +1,418 @@
+#include "eegexport.h"
+#include "channelselection.h"
+#include "conversions.h"
+#include "xdfreader.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+export_format parse_export_format(const std::string &format) {
+	if (format == "brainvision") return export_format::brainvision;
+	if (format == "edf") return export_format::edf;
+	throw std::invalid_argument("Unknown export format " + format + " (brainvision or edf)");
+}
+
+namespace {
+// the channels of the exported stream, from its header
+struct export_channels {
+	std::vector<std::string> labels, units;
+	double srate;
+	std::string channel_format;
+};
+
+/// the file name without its folder, for references between the files
+std::string basename(const std::string &filename) {
+	const auto slash = filename.find_last_of("/\\");
+	return slash == std::string::npos ? filename : filename.substr(slash + 1);
+}
+
+std::string number(double v) {
+	std::ostringstream out;
+	out << v;
+	return out.str();
+}
+
+std::tm local_tm(std::chrono::system_clock::time_point t) {
+	const std::time_t tt = std::chrono::system_clock::to_time_t(t);
+	std::tm tm{};
+#ifdef _WIN32
+	localtime_s(&tm, &tt);
+#else
+	localtime_r(&tt, &tm);
+#endif
+	return tm;
+}
+
+/// local time of a time point, formatted with strftime (only for numeric fields, the names of
+/// months and days depend on the locale)
+std::string local_time(std::chrono::system_clock::time_point t, const char *format) {
+	const std::tm tm = local_tm(t);
+	char buf[64];
+	return std::string(buf, std::strftime(buf, sizeof(buf), format, &tm));
+}
+
+/// the local date as EDF+ wants it in the recording field, e.g. 02-AUG-1951, in any locale
+std::string edf_startdate(std::chrono::system_clock::time_point t) {
+	static const char *const months[] = {
+		"JAN", "FEB", "MAR", "APR", "MAY", "JUN", "JUL", "AUG", "SEP", "OCT", "NOV", "DEC"};
+	const std::tm tm = local_tm(t);
+	char buf[16];
+	std::snprintf(
+		buf, sizeof(buf), "%02d-%s-%04d", tm.tm_mday, months[tm.tm_mon], tm.tm_year + 1900);
+	return buf;
+}
+
+/**
+ * BrainVision Core Data Format 1.0: the header (.vhdr) is written right away, the samples are
+ * appended to the .eeg file as float32 and the markers to the .vmrk file as they come in.
+ */
+class brainvision_file : public export_file {
+public:
+	brainvision_file(const std::string &base, const export_channels &channels)
+		: srate_(channels.srate), n_channels_(channels.labels.size()),
+		  eeg_(base + ".eeg", std::ios::binary | std::ios::trunc),
+		  vmrk_(base + ".vmrk", std::ios::binary | std::ios::trunc) {
+		std::ofstream vhdr(base + ".vhdr", std::ios::binary | std::ios::trunc);
+		vhdr << "Brain Vision Data Exchange Header File Version 1.0\n"
+			 << "; Data written by LabRecorder while recording\n\n"
+			 << "[Common Infos]\nCodepage=UTF-8\nDataFile=" << basename(base) << ".eeg\n"
+			 << "MarkerFile=" << basename(base) << ".vmrk\nDataFormat=BINARY\n"
+			 << "DataOrientation=MULTIPLEXED\nNumberOfChannels=" << n_channels_ << '\n'
+			 << "; Sampling interval in microseconds\nSamplingInterval=" << number(1e6 / srate_)
+			 << "\n\n[Binary Infos]\nBinaryFormat=IEEE_FLOAT_32\n\n[Channel Infos]\n"
+			 << "; Ch<Channel number>=<Name>,<Reference channel name>,<Resolution in \"Unit\">,"
+				"<Unit>\n";
+		for (std::size_t c = 0; c < n_channels_; ++c)
+			vhdr << "Ch" << c + 1 << '=' << escape(channels.labels[c]) << ",,1,"
+				 << escape(channels.units[c]) << '\n';
+		vmrk_ << "Brain Vision Data Exchange Marker File, Version 1.0\n\n[Common Infos]\n"
+			  << "Codepage=UTF-8\nDataFile=" << basename(base) << ".eeg\n\n[Marker Infos]\n"
+			  << "; Mk<Marker number>=<Type>,<Description>,<Position in data points>,"
+				 "<Size in data points>,<Channel number (0 = marker is related to all channels)>\n";
+		if (!vhdr || !eeg_ || !vmrk_) throw std::runtime_error("Could not create " + base);
+	}
+
+	void write_samples(const float *samples, std::size_t n_samples) override {
+		// the recording starts with the first sample
+		if (!started_) {
+			vmrk_ << "Mk1=New Segment,,1,1,0,"
+				  << local_time(std::chrono::system_clock::now(), "%Y%m%d%H%M%S") << "000000\n";
+			started_ = true;
+		}
+		write_sample_values(eeg_, samples, n_samples * n_channels_);
+		if (!eeg_) throw std::runtime_error("Could not write the samples");
+	}
+
+	void write_marker(double onset, const std::string &text) override {
+		const long long position = std::max(0LL, std::llround(onset * srate_)) + 1;
+		vmrk_ << "Mk" << ++markers_ << "=Stimulus," << escape(text) << ',' << position
+			  << ",1,0\n";
+		vmrk_.flush();
+		if (!vmrk_) throw std::runtime_error("Could not write the markers");
+	}
+
+	void close() override {
+		eeg_.close();
+		vmrk_.close();
+		if (!eeg_ || !vmrk_) throw std::runtime_error("Could not complete the files");
+	}
+
+private:
+	/// commas separate the fields, in names and descriptions they're written as \1
+	static std::string escape(const std::string &str) {
+		std::string escaped;
+		for (char c : str)
+			if (c == ',')
+				escaped += "\\1";
+			else
+				escaped += (c == '\n' || c == '\r') ? ' ' : c;
+		return escaped;
+	}
+
+	const double srate_;
+	const std::size_t n_channels_;
+	std::ofstream eeg_, vmrk_;
+	bool started_ = false;
+	uint64_t markers_ = 1; // Mk1 is the start of the recording
+};
+
+/**
+ * EDF+C: fixed size data records of one second (or as many seconds as one sample takes), each
+ * with the channels' samples one after another and the annotations signal with the markers.
+ * The number of records and the start time are filled in when the file is closed.
+ */
+class edf_file : public export_file {
+public:
+	edf_file(const std::string &base, const export_channels &channels, double edf_range)
+		: n_channels_(channels.labels.size()),
+		  samples_per_record_(std::max<std::size_t>(1, std::lround(channels.srate))),
+		  record_duration_(samples_per_record_ / channels.srate),
+		  record_(n_channels_ * samples_per_record_), labels_(channels.labels),
+		  units_(channels.units), start_(std::chrono::system_clock::now()),
+		  edf_(base + ".edf", std::ios::binary | std::ios::trunc) {
+		// integer samples are exported as they are, others are scaled to the 16 bit range
+		if (channels.channel_format == "int16") {
+			physical_max_ = digital_max_ = 32767;
+			physical_min_ = digital_min_ = -32768;
+		} else if (channels.channel_format == "int8") {
+			physical_max_ = digital_max_ = 127;
+			physical_min_ = digital_min_ = -128;
+		} else {
+			physical_max_ = edf_range;
+			physical_min_ = -edf_range;
+			digital_max_ = 32767;
+			digital_min_ = -32767;
+		}
+		scale_ = digital_max_ / physical_max_;
+		edf_ << header(-1);
+		if (!edf_) throw std::runtime_error("Could not create " + base + ".edf");
+	}
+
+	void write_samples(const float *samples, std::size_t n_samples) override {
+		if (!records_ && !filled_) start_ = std::chrono::system_clock::now();
+		for (std::size_t s = 0; s < n_samples; ++s, samples += n_channels_) {
+			for (std::size_t c = 0; c < n_channels_; ++c) {
+				const double digital = std::round(samples[c] * scale_);
+				record_[c * samples_per_record_ + filled_] = static_cast<int16_t>(
+					std::min<double>(digital_max_, std::max<double>(digital_min_, digital)));
+			}
+			if (++filled_ == samples_per_record_) write_record();
+		}
+	}
+
+	void write_marker(double onset, const std::string &text) override {
+		// the markers are stored with the next data record
+		std::string tal = '+' + seconds(std::max(0.0, onset)) + '\x14';
+		for (char c : text) tal += (c == '\x14' || c == '\x15' || c == '\0') ? ' ' : c;
+		// a marker must fit into a record's annotations next to the time keeping
+		if (tal.size() + 34 > annotation_bytes) tal.resize(annotation_bytes - 34);
+		tal += "\x14";
+		tal += '\0';
+		pending_.push_back(std::move(tal));
+	}
+
+	void close() override {
+		// the last record is completed with zeros, and the markers still need records
+		if (filled_ || !pending_.empty()) {
+			for (std::size_t c = 0; c < n_channels_; ++c)
+				std::fill(record_.begin() + c * samples_per_record_ + filled_,
+					record_.begin() + (c + 1) * samples_per_record_, int16_t(0));
+			filled_ = samples_per_record_;
+			write_record();
+		}
+		while (!pending_.empty()) {
+			std::fill(record_.begin(), record_.end(), int16_t(0));
+			write_record();
+		}
+		edf_.seekp(0);
+		edf_ << header(static_cast<long long>(records_));
+		edf_.close();
+		if (!edf_) throw std::runtime_error("Could not complete the file");
+	}
+
+private:
+	// the annotations per record (time keeping and markers)
+	static const std::size_t annotation_bytes = 512;
+
+	/// seconds in the EDF+ annotation format (no exponent, no trailing zeros)
+	static std::string seconds(double t) {
+		char buf[32];
+		std::snprintf(buf, sizeof(buf), "%.6f", t);
+		std::string s(buf);
+		s.erase(s.find_last_not_of('0') + 1);
+		if (s.back() == '.') s.pop_back();
+		return s;
+	}
+
+	/// a header field: ASCII, padded with spaces
+	static std::string field(const std::string &value, std::size_t width) {
+		std::string f = value.substr(0, width);
+		for (char &c : f)
+			if (c < 32 || c > 126) c = '_';
+		f.resize(width, ' ');
+		return f;
+	}
+
+	std::string header(long long records) const {
+		const std::size_t ns = n_channels_ + 1;
+		std::string h;
+		h += field("0", 8);
+		h += field("X X X X", 80);
+		h += field("Startdate " + edf_startdate(start_) + " X X LabRecorder", 80);
+		h += field(local_time(start_, "%d.%m.%y"), 8);
+		h += field(local_time(start_, "%H.%M.%S"), 8);
+		h += field(std::to_string(256 * (ns + 1)), 8);
+		h += field("EDF+C", 44);
+		h += field(std::to_string(records), 8);
+		h += field(number(record_duration_), 8);
+		h += field(std::to_string(ns), 4);
+		const auto each = [&](std::size_t width, const std::string &value,
+							  const std::string &annotations) {
+			for (std::size_t c = 0; c < n_channels_; ++c) h += field(value, width);
+			h += field(annotations, width);
+		};
+		for (const auto &label : labels_) h += field(label, 16);
+		h += field("EDF Annotations", 16);
+		each(80, "", "");
+		for (const auto &unit : units_) h += field(unit == "µV" ? "uV" : unit, 8);
+		h += field("", 8);
+		each(8, number(physical_min_), "-1");
+		each(8, number(physical_max_), "1");
+		each(8, number(digital_min_), "-32768");
+		each(8, number(digital_max_), "32767");
+		each(80, "", "");
+		each(8, std::to_string(samples_per_record_), std::to_string(annotation_bytes / 2));
+		each(32, "", "");
+		return h;
+	}
+
+	void write_record() {
+		write_sample_values(edf_, record_.data(), record_.size());
+		// the time keeping annotation, then as many markers as fit
+		std::string annotations = '+' + seconds(records_ * record_duration_) + "\x14\x14";
+		annotations += '\0';
+		while (!pending_.empty() &&
+			   annotations.size() + pending_.front().size() <= annotation_bytes) {
+			annotations += pending_.front();
+			pending_.pop_front();
+		}
+		annotations.resize(annotation_bytes, '\0');
+		edf_.write(annotations.data(), annotations.size());
+		if (!edf_) throw std::runtime_error("Could not write the samples");
+		++records_;
+		filled_ = 0;
+	}
+
+	const std::size_t n_channels_, samples_per_record_;
+	const double record_duration_;
+	std::vector<int16_t> record_; // the current record, channel by channel
+	std::size_t filled_ = 0;	  // samples in the current record
+	uint64_t records_ = 0;
+	std::vector<std::string> labels_, units_;
+	double physical_min_, physical_max_, digital_min_, digital_max_, scale_;
+	std::chrono::system_clock::time_point start_; // the time of the first sample
+	std::deque<std::string> pending_;			  // the markers for the next records
+	std::ofstream edf_;
+};
+} // namespace
+
+eeg_export::eeg_export(const std::string &base, const export_spec &spec,
+	const std::string &header_xml, std::size_t max_queued_bytes)
+	: n_channels_(static_cast<uint32_t>(std::stoul("0" + xml_value(header_xml, "channel_count")))),
+	  srate_(std::stod("0" + xml_value(header_xml, "nominal_srate"))),
+	  max_queued_bytes_(max_queued_bytes) {
+	export_channels channels;
+	channels.srate = srate_;
+	channels.channel_format = xml_value(header_xml, "channel_format");
+	if (channels.channel_format == "string" || srate_ <= 0 || !n_channels_)
+		throw std::invalid_argument("only regular numeric streams can be exported");
+	const auto descriptions = channel_descriptions(header_xml);
+	for (uint32_t c = 0; c < n_channels_; ++c) {
+		const std::string description = c < descriptions.size() ? descriptions[c] : "";
+		std::string label = xml_value(description, "label");
+		if (label.empty()) label = "Ch" + std::to_string(c + 1);
+		std::string unit = xml_value(description, "unit");
+		if (unit.empty() || unit == "microvolts") unit = "µV";
+		if (unit == "millivolts") unit = "mV";
+		if (unit == "volts") unit = "V";
+		channels.labels.push_back(label);
+		channels.units.push_back(unit);
+	}
+	if (spec.format == export_format::brainvision) {
+		file_ = std::make_unique<brainvision_file>(base, channels);
+		filenames_ = {base + ".vhdr", base + ".vmrk", base + ".eeg"};
+	} else {
+		file_ = std::make_unique<edf_file>(base, channels, spec.edf_range);
+		filenames_ = {base + ".edf"};
+	}
+	thread_ = std::thread(&eeg_export::writer_loop, this);
+}
+
+eeg_export::~eeg_export() {
+	{
+		std::lock_guard<std::mutex> lock(mut_);
+		shutdown_ = true;
+	}
+	cv_.notify_all();
+	thread_.join();
+}
+
+void eeg_export::push_marker(double timestamp, const std::string &text) {
+	queued entry;
+	entry.timestamp = timestamp;
+	entry.marker = text;
+	push(std::move(entry));
+}
+
+uint64_t eeg_export::dropped_samples() const {
+	std::lock_guard<std::mutex> lock(mut_);
+	return dropped_;
+}
+
+void eeg_export::push(queued &&entry) {
+	{
+		std::lock_guard<std::mutex> lock(mut_);
+		queue_.push_back(std::move(entry));
+	}
+	cv_.notify_one();
+}
+
+void eeg_export::writer_loop() {
+	double first_timestamp = NAN; // the markers are placed relative to the first sample
+	std::vector<queued> early_markers;
+	std::vector<float> zeros;
+	bool failed = false;
+	std::unique_lock<std::mutex> lock(mut_);
+	for (;;) {
+		cv_.wait(lock, [this]() { return shutdown_ || !queue_.empty(); });
+		if (queue_.empty()) break;
+		queued entry = std::move(queue_.front());
+		queue_.pop_front();
+		queued_bytes_ -= entry.samples.size() * sizeof(float);
+		lock.unlock();
+		try {
+			if (failed) {
+				// the queue is only drained
+			} else if (entry.n_samples) {
+				const bool first = std::isnan(first_timestamp);
+				if (first) first_timestamp = entry.timestamp;
+				if (entry.samples.empty()) {
+					zeros.assign(entry.n_samples * n_channels_, 0.f);
+					file_->write_samples(zeros.data(), entry.n_samples);
+					file_->write_marker(
+						entry.timestamp - first_timestamp, "LabRecorder: samples dropped");
+				} else
+					file_->write_samples(entry.samples.data(), entry.n_samples);
+				// the markers that came before the first sample are placed at its start
+				if (first) {
+					for (const auto &marker : early_markers) file_->write_marker(0, marker.marker);
+					early_markers.clear();
+				}
+			} else if (std::isnan(first_timestamp))
+				early_markers.push_back(std::move(entry));
+			else
+				file_->write_marker(entry.timestamp - first_timestamp, entry.marker);
+		} catch (std::exception &e) {
+			std::cerr << "Error in the export " << filenames_.front() << ", it's incomplete: "
+					  << e.what() << std::endl;
+			failed = true;
+		}
+		lock.lock();
+	}
+	lock.unlock();
+	try {
+		if (!failed) {
+			for (const auto &marker : early_markers) file_->write_marker(0, marker.marker);
+			file_->close();
+		}
+	} catch (std::exception &e) {
+		std::cerr << "Error in the export " << filenames_.front() << ", it's incomplete: "
+				  << e.what() << std::endl;
+	}
+}
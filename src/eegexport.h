@@ -0,0 +1,128 @@
+#ifndef EEGEXPORT_H
+#define EEGEXPORT_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// the formats of the live exports
+enum class export_format {
+	brainvision, // BrainVision Core Data Format: .vhdr, .vmrk and multiplexed float32 .eeg
+	edf			 // EDF+ (continuous): 16 bit samples, the markers in an annotations signal
+};
+
+/// parse "brainvision" or "edf", throws std::invalid_argument otherwise
+export_format parse_export_format(const std::string &format);
+
+/// a live export of a stream, configured per stream
+struct export_spec {
+	export_format format = export_format::brainvision;
+	/// EDF+: the physical range (±) of floating point samples, mapped to the 16 bit sample range
+	/// (integer samples of up to 16 bits are exported as they are)
+	double edf_range = 3276.7;
+};
+
+/// the format specific output of an export (used on its writer thread only)
+class export_file {
+public:
+	virtual ~export_file() = default;
+	/// append n_samples multiplexed samples
+	virtual void write_samples(const float *samples, std::size_t n_samples) = 0;
+	/// a marker, at onset seconds after the first sample
+	virtual void write_marker(double onset, const std::string &text) = 0;
+	/// complete the files
+	virtual void close() = 0;
+};
+
+/**
+ * A copy of a regular numeric stream in a format that clinical tools read (BrainVision or EDF+),
+ * written while recording, with the markers of the string streams.
+ *
+ * The recording hands over the samples it has already pulled for the XDF file; they're queued
+ * and written on the export's own thread, so a slow export never delays the XDF file. When the
+ * queue exceeds its budget, samples are dropped, and zeros are written in their place so the
+ * samples and markers that follow stay aligned in time.
+ */
+class eeg_export {
+public:
+	/**
+	 * @param base The file name without extension (BrainVision: .vhdr, .vmrk and .eeg are
+	 * appended, EDF+: .edf)
+	 * @param spec The format
+	 * @param header_xml The stream header as written into the XDF file
+	 * @param max_queued_bytes Samples that may wait for the disk before they are dropped
+	 * @throws std::invalid_argument for irregular or string streams, std::runtime_error if the
+	 * files can't be created
+	 */
+	eeg_export(const std::string &base, const export_spec &spec, const std::string &header_xml,
+		std::size_t max_queued_bytes = 64 * 1024 * 1024);
+	/// writes the queued samples and markers and completes the files
+	~eeg_export();
+
+	/// queue n_samples multiplexed samples, the time stamps in the stream's clock
+	template <class T>
+	void push_samples(const T *samples, const double *timestamps, std::size_t n_samples) {
+		if (!n_samples) return;
+		queued entry;
+		entry.n_samples = n_samples;
+		entry.timestamp = timestamps[0];
+		const std::size_t bytes = n_samples * n_channels_ * sizeof(float);
+		bool keep;
+		{
+			std::lock_guard<std::mutex> lock(mut_);
+			keep = queued_bytes_ + bytes <= max_queued_bytes_;
+			if (keep)
+				queued_bytes_ += bytes;
+			else
+				dropped_ += n_samples;
+		}
+		// dropped samples are queued without data, the writer fills the gap
+		if (keep) {
+			entry.samples.resize(n_samples * n_channels_);
+			for (std::size_t i = 0; i < entry.samples.size(); ++i)
+				entry.samples[i] = static_cast<float>(samples[i]);
+		}
+		push(std::move(entry));
+	}
+
+	/// queue a marker, its time stamp in the exported stream's clock
+	void push_marker(double timestamp, const std::string &text);
+
+	/// the samples that were replaced by zeros because the queue was full
+	uint64_t dropped_samples() const;
+
+	/// the files that are written
+	const std::vector<std::string> &filenames() const { return filenames_; }
+
+private:
+	struct queued {
+		std::vector<float> samples; // multiplexed, empty if the samples were dropped
+		std::size_t n_samples = 0;	// 0 for a marker
+		double timestamp = 0;		// of the first sample or the marker
+		std::string marker;
+	};
+
+	void push(queued &&entry);
+	void writer_loop();
+
+	const uint32_t n_channels_;
+	const double srate_;
+	const std::size_t max_queued_bytes_;
+	std::vector<std::string> filenames_;
+	std::unique_ptr<export_file> file_; // only used by the writer thread
+
+	mutable std::mutex mut_;
+	std::condition_variable cv_;
+	std::deque<queued> queue_;
+	std::size_t queued_bytes_ = 0;
+	uint64_t dropped_ = 0;
+	bool shutdown_ = false;
+	std::thread thread_;
+};
+
+#endif
@@ -14,17 +14,21 @@
 using QRegExp = QRegularExpression;
 #endif
 
+#include <algorithm>
 #include <string>
 #include <vector>
 
 // recording class
+#include "recorderconfig.h"
 #include "recording.h"
+#include "sessionhost.h"
 #include "tcpinterface.h"
 
 const QStringList bids_modalities_default = QStringList({"eeg", "ieeg", "meg", "beh"});
 
 MainWindow::MainWindow(QWidget *parent, const char *config_file)
-	: QMainWindow(parent), ui(new Ui::MainWindow) {
+	: QMainWindow(parent), sessions(std::make_unique<session_host>()),
+	  config(std::make_unique<recorder_config>()), ui(new Ui::MainWindow) {
 	ui->setupUi(this);
 	connect(ui->actionLoad_Configuration, &QAction::triggered, this, [this]() {
 		load_config(QFileDialog::getOpenFileName(
@@ -42,6 +46,7 @@ MainWindow::MainWindow(QWidget *parent, const char *config_file)
 	connect(ui->selectNoneButton, &QPushButton::clicked, this, &MainWindow::selectNoStreams);
 	connect(ui->startButton, &QPushButton::clicked, this, &MainWindow::startRecording);
 	connect(ui->stopButton, &QPushButton::clicked, this, &MainWindow::stopRecording);
+	connect(ui->streamList, &QListWidget::itemChanged, this, &MainWindow::streamItemChanged);
 	connect(ui->actionAbout, &QAction::triggered, this, [this]() {
 		QString infostr = QStringLiteral("LSL library version: ") +
 						  QString::number(lsl::library_version()) +
@@ -88,6 +93,12 @@ MainWindow::MainWindow(QWidget *parent, const char *config_file)
 
 	timer = std::make_unique<QTimer>(this);
 	connect(&*timer, &QTimer::timeout, this, &MainWindow::statusUpdate);
+	// close a recording with a scheduled stop once all its streams have been cut
+	connect(&*timer, &QTimer::timeout, this, [this]() {
+		if (currentRecording && currentRecording->cut_finished()) stopRecording();
+	});
+	// new and lost streams from the background resolver
+	connect(&*timer, &QTimer::timeout, this, [this]() { refreshStreams(); });
 	timer->start(1000);
 
 	QString cfgfilepath = find_config_file(config_file);
@@ -105,7 +116,116 @@ void MainWindow::statusUpdate() const {
 								 .arg(QDir::toNativeSeparators(recFilename),
 									 QTime(0,0).addSecs(elapsed).toString("hh:mm:ss"),
 									 QString::number(size / 1000));
+		const auto sinks = currentRecording->sink_statistics();
+		const auto &main = sinks.front();
+		QString alarm;
+		if (main.failed)
+			alarm = QStringLiteral("WRITE ERROR, recording is not saved");
+		else if (main.chunks_dropped)
+			alarm = QStringLiteral("spill budget exhausted, %1 chunks LOST")
+						.arg(main.chunks_dropped);
+		else if (main.alarm)
+			alarm = QStringLiteral("disk stalling, %1 MiB buffered in memory")
+						.arg(main.bytes_queued / (1024 * 1024));
+		if (!alarm.isEmpty()) timeString.prepend("WARNING: " + alarm + " | ");
+		if (rcs && main.alarm != writerAlarm)
+			rcs->broadcast(main.alarm ? "ALARM " + alarm : QStringLiteral("ALARM cleared"));
+		writerAlarm = main.alarm;
+		QStringList details;
+		for (const auto &sink : sinks)
+			details << QStringLiteral("%1: %2 MB/s, %3 MiB buffered, %4 syncs (%5 ms avg, %6 ms max)")
+						   .arg(QString::fromStdString(sink.filename))
+						   .arg(sink.throughput() / 1e6, 0, 'f', 2)
+						   .arg(sink.bytes_queued / (1024 * 1024))
+						   .arg(sink.syncs)
+						   .arg(sink.mean_sync_latency() * 1000, 0, 'f', 1)
+						   .arg(sink.max_sync_latency * 1000, 0, 'f', 1);
+		if (!config->options.tap_name.empty()) {
+			const auto tap = currentRecording->tap_statistics();
+			details << QStringLiteral("Tap %1: %2 readers, %3 KiB max lag, %4 dropped")
+						   .arg(QString::fromStdString(config->options.tap_name))
+						   .arg(tap.consumers)
+						   .arg(tap.max_lag / 1024)
+						   .arg(tap.consumers_dropped);
+		}
+		if (config->options.interleave_window > 0) {
+			const auto interleave = currentRecording->interleave_statistics();
+			details << QStringLiteral("Interleaving: %1 KiB buffered, %2 ms added latency (%3 ms "
+									  "max), %4 late chunks")
+						   .arg(interleave.bytes_buffered / 1024)
+						   .arg(interleave.mean_delay() * 1000, 0, 'f', 1)
+						   .arg(interleave.max_delay * 1000, 0, 'f', 1)
+						   .arg(interleave.chunks_late);
+		}
+		statusBar()->setToolTip(details.join('\n'));
+		for (std::size_t i = 1; i < sinks.size(); ++i) {
+			if (sinks[i].failed)
+				timeString += QStringLiteral("; mirror %1 failed").arg(i);
+			else if (sinks[i].chunks_dropped)
+				timeString += QStringLiteral("; mirror %1 dropped %2 chunks")
+								  .arg(i)
+								  .arg(sinks[i].chunks_dropped);
+		}
 		statusBar()->showMessage(timeString);
+		showSignalSummaries();
+	}
+}
+
+/// a short list of channel numbers (1-based) for the tooltips, e.g. "1, 4, 7 and 12 more"
+static QString channelList(const std::vector<int> &channels) {
+	const std::size_t shown = 8;
+	QStringList list;
+	for (std::size_t i = 0; i < std::min(shown, channels.size()); ++i)
+		list << QString::number(channels[i] + 1);
+	QString result = list.join(", ");
+	if (channels.size() > shown)
+		result += QStringLiteral(" and %1 more").arg(channels.size() - shown);
+	return result;
+}
+
+/// the lines of a stream's tooltip that describe the stream, the signal summaries follow them
+static QStringList streamDescription(const lsl::stream_info &s) {
+	return {"Name: " + QString::fromStdString(s.name()),
+		"Type: " + QString::fromStdString(s.type()),
+		"Source ID: " + QString::fromStdString(s.source_id()),
+		"Hostname: " + QString::fromStdString(s.hostname())};
+}
+
+void MainWindow::showSignalSummaries() const {
+	const QBrush good_brush(QColor(0, 128, 0)), warn_brush(QColor(255, 128, 0));
+	std::map<uint32_t, stream_health> health;
+	for (auto &h : currentRecording->stream_health_statistics()) health[h.streamid] = std::move(h);
+	for (const auto &summary : currentRecording->signal_summaries()) {
+		std::vector<int> flat, saturated;
+		for (std::size_t c = 0; c < summary.channels.size(); ++c) {
+			if (summary.channels[c].flat) flat.push_back(static_cast<int>(c));
+			if (summary.channels[c].saturated) saturated.push_back(static_cast<int>(c));
+		}
+		QStringList lines;
+		lines << QStringLiteral("Signal: %1 samples in the last %2 s")
+					 .arg(summary.samples)
+					 .arg(summary.duration, 0, 'f', 1);
+		if (!flat.empty()) lines << "Flat channels: " + channelList(flat);
+		if (!saturated.empty()) lines << "Saturated channels: " + channelList(saturated);
+		bool timing_problems = false;
+		const auto h = health.find(summary.streamid);
+		if (h != health.end() && h->second.problems()) {
+			timing_problems = true;
+			lines << QStringLiteral("Timing: %1 gaps (%2 samples missing), %3 clock resets, "
+									"%4 reconnects")
+						 .arg(h->second.gaps)
+						 .arg(h->second.missing_samples)
+						 .arg(h->second.clock_resets)
+						 .arg(h->second.reconnects);
+		}
+		const bool ok = flat.empty() && saturated.empty() && !timing_problems;
+		const stream_key key{summary.name, summary.type, summary.source_id, summary.hostname};
+		const auto known = knownStreams.find(key);
+		if (known == knownStreams.end()) continue;
+		const auto *info = directory.find(key);
+		const QStringList description = info ? streamDescription(*info) : QStringList();
+		known->second->setToolTip((description + lines).join('\n'));
+		known->second->setForeground(ok ? good_brush : warn_brush);
 	}
 }
 
@@ -128,47 +248,16 @@ void MainWindow::load_config(QString filename) {
 	bool auto_start = false;
 	try {
 		QSettings pt(QDir::cleanPath(filename), QSettings::Format::IniFormat);
+		// the settings shared with the recorder without the GUI (see recorderconfig.h)
+		*config = QFileInfo::exists(filename) ? read_config(QDir::cleanPath(filename).toStdString())
+											  : recorder_config();
 
 		// ----------------------------
 		// required streams
 		// ----------------------------
-		auto required = pt.value("RequiredStreams").toStringList();
-#if QT_VERSION >= QT_VERSION_CHECK(5,14,0)
-		missingStreams = QSet<QString>(required.begin(), required.end());
-#else
-		missingStreams = required.toSet();
-#endif
-
-		// ----------------------------
-		// online sync streams
-		// ----------------------------
-		QStringList onlineSyncStreams = pt.value("OnlineSync", QStringList()).toStringList();
-		for (QString &oss : onlineSyncStreams) {
-#if QT_VERSION >= QT_VERSION_CHECK(5,14,0)
-			auto skipEmpty = Qt::SkipEmptyParts;
-#else
-			auto skipEmpty = QString::SkipEmptyParts;
-#endif
-
-			QStringList words = oss.split(' ', skipEmpty);
-			// The first two words ("StreamName (PC)") are the stream identifier
-			if (words.length() < 2) {
-				qInfo() << "Invalid sync stream config: " << oss;
-				continue;
-			}
-			QString key = words.takeFirst() + ' ' + words.takeFirst();
-
-			int val = 0;
-			for (const auto &word : std::as_const(words)) {
-				if (word == "post_clocksync") { val |= lsl::post_clocksync; }
-				if (word == "post_dejitter") { val |= lsl::post_dejitter; }
-				if (word == "post_monotonize") { val |= lsl::post_monotonize; }
-				if (word == "post_threadsafe") { val |= lsl::post_threadsafe; }
-				if (word == "post_ALL") { val = lsl::post_ALL; }
-			}
-			syncOptionsByStreamName[key.toStdString()] = val;
-			qInfo() << "stream sync options: " << key << ": " << val;
-		}
+		missingStreams.clear();
+		for (const auto &required : config->required_streams)
+			missingStreams.insert(QString::fromStdString(required));
 
 		// ----------------------------
 		// Block/Task Names
@@ -257,15 +346,18 @@ void MainWindow::load_config(QString filename) {
 			}
 		}
 
-		if (pt.contains("AutoStart")) {
-			auto_start = pt.value("AutoStart").toBool();
-		}
+		// BIDS sidecars (by default for recordings in the BIDS layout)
+		bidsSidecars =
+			pt.contains("BidsSidecars") ? (pt.value("BidsSidecars").toBool() ? 1 : 0) : -1;
+
+		auto_start = config->auto_start;
 
 	} catch (std::exception &e) { qWarning() << "Problem parsing config file: " << e.what(); }
 	// std::cout << "refreshing streams ..." <<std::endl;
 	refreshStreams();
 
-	if (auto_start) { startRecording(); }
+	// give the background resolver a second to find the streams before starting
+	if (auto_start) { QTimer::singleShot(1000, this, &MainWindow::startRecording); }
  }
 
 void MainWindow::save_config(QString filename) {
@@ -275,8 +367,8 @@ void MainWindow::save_config(QString filename) {
 		settings.setValue("PathTemplate", QDir::cleanPath(ui->lineEdit_template->text()));
 	// Build QStringList from missingStreams and knownStreams that are missing.
 	QStringList requiredStreams = missingStreams.values();
-	for (auto &k : knownStreams) {
-		if (k.checked) { requiredStreams.append(k.listName()); }
+	for (const auto &k : knownStreams) {
+		if (k.second->checkState() == Qt::Checked) { requiredStreams.append(k.second->text()); }
 	}
 	qInfo() << missingStreams;
 	settings.setValue("RequiredStreams", requiredStreams);
@@ -288,87 +380,57 @@ QString info_to_listName(const lsl::stream_info& info) {
 }
 
 /**
- * @brief MainWindow::refreshStreams Find streams, generate a list of missing streams
- * and fill the UI streamlist.
- * @return A vector of found stream_infos
+ * @brief MainWindow::refreshStreams Update the UI streamlist with the streams that came online or
+ * went offline since the last call and the list of missing streams. The streams are discovered by
+ * a background resolver, so this doesn't block.
+ * @return A vector of the checked streams that are online
  */
 std::vector<lsl::stream_info> MainWindow::refreshStreams() {
-	const std::vector<lsl::stream_info> resolvedStreams = lsl::resolve_streams(1.0);
-
-	// For each item in resolvedStreams, ignore if already in knownStreams, otherwise add to knownStreams.
-	// if in missingStreams then also mark it as required (--> checked by default) and remove from missingStreams.
-	for (const auto& s : resolvedStreams) {
-		bool known = false;
-		for (auto &k : knownStreams) {
-			known |= s.name() == k.name && s.type() == k.type && s.source_id() == k.id;
-		}
-		if (!known) {
-			bool found = missingStreams.contains(info_to_listName(s));
-			knownStreams << StreamItem(s.name(), s.type(), s.source_id(), s.hostname(), found);
-			if (found) { missingStreams.remove(info_to_listName(s)); }
-		}
+	const QBrush good_brush(QColor(0, 128, 0)), bad_brush(QColor(255, 0, 0));
+	// updating the list doesn't add or remove streams of a running recording
+	const QSignalBlocker blocker(ui->streamList);
+	const stream_changes changes = directory.update();
+
+	// A checked stream that went offline is required, so it's missing until it's back.
+	for (const auto &key : changes.removed) {
+		auto it = knownStreams.find(key);
+		if (it == knownStreams.end()) continue;
+		if (it->second->checkState() == Qt::Checked) missingStreams += it->second->text();
+		delete it->second;
+		knownStreams.erase(it);
 	}
-	// For each item in knownStreams, update its checked status from GUI. (only works for streams found on a previous refresh)
-	// Because we search by name + host, entries aren't guaranteed to be unique, so checking one entry with matching name and host checks them all.
-	for (auto &k : knownStreams) {
-		QList<QListWidgetItem *> foundItems = ui->streamList->findItems(k.listName(), Qt::MatchCaseSensitive);
-		if (foundItems.count() > 0) {
-			bool checked = false;
-			for (auto &fi : foundItems) { checked |= fi->checkState() == Qt::Checked; }
-			k.checked = checked;
-		}
+	// A new stream is checked by default if it was missing.
+	for (const auto &s : changes.added) {
+		const bool found = missingStreams.remove(info_to_listName(s));
+		auto *item = new QListWidgetItem(info_to_listName(s), ui->streamList);
+		item->setCheckState(found ? Qt::Checked : Qt::Unchecked);
+		item->setForeground(good_brush);
+		item->setToolTip(streamDescription(s).join('\n'));
+		knownStreams.emplace(key_of(s), item);
 	}
-	// For each item in knownStreams; if it is not resolved then drop it. If it was checked then add back to missingStreams.
-	int k_ind = 0;
-	while (k_ind < knownStreams.count()) {
-		StreamItem k = knownStreams.at(k_ind);
-		bool resolved = false;
-		size_t r_ind = 0;
-		while (!resolved && r_ind < resolvedStreams.size()) {
-			const lsl::stream_info r = resolvedStreams[r_ind];
-			resolved |= (r.name() == k.name) && (r.type() == k.type) && (r.source_id() == k.id);
-			r_ind++;
-		}
-		if (!resolved) {
-			if (k.checked) { missingStreams += k.listName(); }
-			knownStreams.removeAt(k_ind);
-		} else {
-			k_ind++;
+	// The missing streams are listed first (the set also changes when a config is loaded).
+	for (auto it = missingItems.begin(); it != missingItems.end();)
+		if (missingStreams.contains(it.key()))
+			++it;
+		else {
+			delete it.value();
+			it = missingItems.erase(it);
 		}
-	}
-	// Clear the streamList
-	// Add missing items first.
-	// Then add knownStreams (only in list if resolved).
-	const QBrush good_brush(QColor(0, 128, 0)), bad_brush(QColor(255, 0, 0));
-	ui->streamList->clear();
 	for (auto& m : std::as_const(missingStreams)) {
-		auto *item = new QListWidgetItem(m, ui->streamList);
+		if (missingItems.contains(m)) continue;
+		auto *item = new QListWidgetItem(m);
 		item->setCheckState(Qt::Checked);
 		item->setForeground(bad_brush);
-		ui->streamList->addItem(item);
-	}
-	for (auto& k : knownStreams) {
-		auto *item = new QListWidgetItem(k.listName(), ui->streamList);
-		item->setCheckState(k.checked ? Qt::Checked : Qt::Unchecked);
-		item->setForeground(good_brush);
-	    item->setToolTip(QString("Name: %1\nType: %2\nSource ID: %3\nHostname: %4")
-            .arg(QString::fromStdString(k.name),
-                 QString::fromStdString(k.type),
-                 QString::fromStdString(k.id),
-                 QString::fromStdString(k.host)));
-		ui->streamList->addItem(item);
+		ui->streamList->insertItem(0, item);
+		missingItems.insert(m, item);
 	}
 
 	// return a std::vector of streams of checked and not missing streams.
 	std::vector<lsl::stream_info> requestedAndAvailableStreams;
-	for (const auto &r : resolvedStreams) {
-		for (auto &k : knownStreams) {
-			if ((r.name() == k.name) && (r.type() == k.type) && (r.source_id() == k.id)) {
-				if (k.checked) { requestedAndAvailableStreams.push_back(r); }
-				break;
-			}
-		}
-	}
+	for (const auto &k : knownStreams)
+		if (k.second->checkState() == Qt::Checked)
+			if (const auto *info = directory.find(k.first))
+				requestedAndAvailableStreams.push_back(*info);
 	return requestedAndAvailableStreams;
 }
 
@@ -411,29 +473,18 @@ void MainWindow::startRecording() {
 				"Please set a Study Root before recording.");
 			return;
 		}
+		const QString relFilename = recFilename;
 		recFilename.prepend(QDir::cleanPath(ui->rootEdit->text()) + '/');
 
 		QFileInfo recFileInfo(recFilename);
-		if (recFileInfo.exists()) {
-			if (recFileInfo.isDir()) {
-				QMessageBox::warning(
-					this, "Error", "Recording path already exists and is a directory");
-				return;
-			}
-			QString rename_to = recFileInfo.absolutePath() + '/' + recFileInfo.baseName() +
-								"_old%1." + recFileInfo.suffix();
-			// search for highest _oldN
-			int i = 1;
-			while (QFileInfo::exists(rename_to.arg(i))) i++;
-			QString newname = rename_to.arg(i);
-			if (!QFile::rename(recFileInfo.absoluteFilePath(), newname)) {
-				QMessageBox::warning(this, "Permissions issue",
-					"Cannot rename the file " + recFilename + " to " + newname);
-				return;
-			}
-			qInfo() << "Moved existing file to " << newname;
-			recFileInfo.refresh();
+		try {
+			move_existing(recFilename.toStdString());
+		} catch (std::exception &e) {
+			QMessageBox::warning(this, "Error",
+				"Cannot move the existing file " + recFilename + " away: " + e.what());
+			return;
 		}
+		recFileInfo.refresh();
 
 		// regardless, we need to create the directory if it doesn't exist
 		if (!recFileInfo.dir().mkpath(".")) {
@@ -444,30 +495,21 @@ void MainWindow::startRecording() {
 		}
 
 		std::vector<std::string> watchfor;
-		for (const QString &missing : std::as_const(missingStreams)) {
-            std::string query;
-			// Convert missing to query expected by lsl::resolve_stream
-			// name='BioSemi' and hostname=AASDFSDF
-			QRegularExpression re("(.+)\\s+\\((\\S+)\\)");
-            QRegularExpressionMatch match = re.match(missing);
-            if (match.hasMatch())
-            {
-                QString name = match.captured(1);
-                QString host = match.captured(2);
-                query = "name='" + match.captured(1).toStdString() + "'";
-                if (host.size() > 1) {
-                    query += " and hostname='" + host.toStdString() + "'";
-                }
-            } else {
-                // Regexp failed but we can try using the entire string as the stream name.
-                query = "name='" + missing.toStdString() + "'";
-            }
-			watchfor.push_back(query);
-		}
+		for (const QString &missing : std::as_const(missingStreams))
+			watchfor.push_back(listname_to_query(missing.toStdString()));
 		qInfo() << "Missing: " << missingStreams;
 
-		currentRecording = std::make_unique<recording>(recFilename.toStdString(),
-			requestedAndAvailableStreams, watchfor, syncOptionsByStreamName, true);
+		recording_options options = recordingOptions();
+		options.tap_name = config->options.tap_name;
+		options.start_at = scheduledStart;
+		try {
+			config->add_copies(options, relFilename.toStdString());
+			currentRecording = std::make_unique<recording>(recFilename.toStdString(),
+				requestedAndAvailableStreams, watchfor, config->sync_options, true, options);
+		} catch (std::exception &e) {
+			QMessageBox::critical(this, "Error", QString("Could not start the recording: ") + e.what());
+			return;
+		}
 		ui->stopButton->setEnabled(true);
 		ui->startButton->setEnabled(false);
 		startTime = (int)lsl::local_clock();
@@ -478,6 +520,16 @@ void MainWindow::startRecording() {
 	}
 }
 
+recording_options MainWindow::recordingOptions() const {
+	recording_options options = config->options;
+	// the shared memory tap belongs to the main recording
+	options.tap_name.clear();
+	options.bids_sidecars = bidsSidecars < 0 ? ui->check_bids->isChecked() : bidsSidecars > 0;
+	// streams that are also recorded by a session are received only once
+	options.inlets = sessions->inlets();
+	return options;
+}
+
 void MainWindow::stopRecording() {
 
 	if (currentRecording) {
@@ -644,9 +696,27 @@ void MainWindow::enableRcs(bool bEnable) {
 		connect(rcs.get(), &RemoteControlSocket::refresh_streams, this, &MainWindow::refreshStreams);
 		connect(rcs.get(), &RemoteControlSocket::start, this, &MainWindow::rcsStartRecording);
 		connect(rcs.get(), &RemoteControlSocket::stop, this, &MainWindow::rcsStopRecording);
+		connect(rcs.get(), &RemoteControlSocket::start_at, this, &MainWindow::rcsStartRecordingAt);
+		connect(rcs.get(), &RemoteControlSocket::stop_at, this, &MainWindow::rcsStopRecordingAt);
 		connect(rcs.get(), &RemoteControlSocket::filename, this, &MainWindow::rcsUpdateFilename);
 		connect(rcs.get(), &RemoteControlSocket::select_all, this, &MainWindow::selectAllStreams);
 		connect(rcs.get(), &RemoteControlSocket::select_none, this, &MainWindow::selectNoStreams);
+		connect(rcs.get(), &RemoteControlSocket::add_stream, this, &MainWindow::rcsAddStream);
+		connect(rcs.get(), &RemoteControlSocket::remove_stream, this, &MainWindow::rcsRemoveStream);
+		connect(rcs.get(), &RemoteControlSocket::start_session, this, &MainWindow::rcsStartSession);
+		connect(rcs.get(), &RemoteControlSocket::stop_session, this, &MainWindow::rcsStopSession);
+		rcs->addQuery("summary", [this]() {
+			if (!currentRecording) return QStringLiteral("{\"streams\":[]}");
+			return QString::fromStdString(summaries_to_json(currentRecording->signal_summaries()));
+		});
+		rcs->addQuery("sessions", [this]() {
+			return QString::fromStdString(sessions_to_json(sessions->sessions()));
+		});
+		rcs->addQuery("health", [this]() {
+			if (!currentRecording) return QStringLiteral("{\"streams\":[]}");
+			return QString::fromStdString(
+				health_to_json(currentRecording->stream_health_statistics()));
+		});
 	}
 	bool oldState = ui->rcsCheckBox->blockSignals(true);
 	ui->rcsCheckBox->setChecked(bEnable);
@@ -673,6 +743,74 @@ void MainWindow::rcsStopRecording() {
 	stopRecording();
 }
 
+void MainWindow::rcsStartRecordingAt(double lsl_time) {
+	// arm the recording right away, so it only has to drop the samples before lsl_time
+	scheduledStart = lsl_time;
+	rcsStartRecording();
+	scheduledStart = 0;
+}
+
+void MainWindow::rcsStopRecordingAt(double lsl_time) {
+	if (currentRecording) currentRecording->set_stop_at(lsl_time);
+}
+
+void MainWindow::rcsAddStream(QString query) {
+	if (!currentRecording) return;
+	refreshStreams();
+	for (const auto &info : directory.matching(query.toStdString()))
+		currentRecording->add_stream(info);
+}
+
+void MainWindow::rcsRemoveStream(QString query) {
+	if (currentRecording) currentRecording->remove_streams(query.toStdString());
+}
+
+void MainWindow::rcsStartSession(QString name, QString file, QString query) {
+	// a session records the streams matching the query (default: the checked streams) into a file
+	// below the study root, e.g. one file per subject next to the joint main recording
+	std::vector<lsl::stream_info> streams = refreshStreams();
+	if (!query.isEmpty()) streams = directory.matching(query.toStdString());
+	QFileInfo fileInfo(QDir::cleanPath(ui->rootEdit->text()) + '/' + file);
+	try {
+		move_existing(fileInfo.filePath().toStdString());
+	} catch (std::exception &e) {
+		qWarning() << "Cannot move the existing session file " << fileInfo.filePath() << " away: "
+				   << e.what();
+		return;
+	}
+	if (!fileInfo.dir().mkpath(".")) {
+		qWarning() << "Cannot create the session directory " << fileInfo.dir().path();
+		return;
+	}
+	try {
+		sessions->start(name.toStdString(), fileInfo.absoluteFilePath().toStdString(), streams, {},
+			config->sync_options, true, recordingOptions());
+	} catch (std::exception &e) {
+		qWarning() << "Could not start the session " << name << ": " << e.what();
+	}
+}
+
+void MainWindow::rcsStopSession(QString name) {
+	if (!sessions->stop(name.toStdString())) qWarning() << "There is no session named " << name;
+}
+
+void MainWindow::streamItemChanged(QListWidgetItem *item) {
+	// while recording, checking a stream adds it to the recording and unchecking removes it
+	if (!currentRecording) return;
+	const std::string query = listname_to_query(item->text().toStdString());
+	if (item->checkState() != Qt::Checked)
+		currentRecording->remove_streams(query);
+	else {
+		const lsl::stream_info *found = nullptr;
+		for (const auto &k : knownStreams)
+			if (k.second == item) found = directory.find(k.first);
+		if (!found)
+			statusBar()->showMessage("Stream not found: " + item->text());
+		else
+			currentRecording->add_stream(*found);
+	}
+}
+
 void MainWindow::rcsUpdateFilename(QString s) {
 	//
 	// format: "filename {option:value}{option:value}
@@ -2,38 +2,29 @@
 #define MAINWINDOW_H
 #include <QCloseEvent>
 #include <QComboBox>
+#include <QHash>
 #include <QListWidget>
 #include <QMainWindow>
 #include <QStringList>
 #include <QTimer>
 #include <memory> //for std::unique_ptr
+#include <unordered_map>
 
 // LSL
 #include <lsl_cpp.h>
 
+#include "streamdirectory.h"
+
 namespace Ui {
 class MainWindow;
 }
 
 class recording;
+class session_host;
+struct recorder_config;
+struct recording_options;
 class RemoteControlSocket;
 
-class StreamItem {
-	
-public:
-	StreamItem(std::string stream_name, std::string stream_type, std::string source_id,
-		std::string hostname, bool required)
-		: name(stream_name), type(stream_type), id(source_id), host(hostname), checked(required) {}
-	
-	QString listName() { return QString::fromStdString(name + " (" + host + ")"); }
-	std::string name;
-	std::string type;
-	std::string id;
-	std::string host;
-	bool checked;
-};
-
-
 class MainWindow : public QMainWindow {
 	Q_OBJECT
 
@@ -43,6 +34,7 @@ public:
 
 private slots:
 	void statusUpdate(void) const;
+	void showSignalSummaries() const;
 	void closeEvent(QCloseEvent *ev) override;
 	void blockSelected(const QString &block);
 	std::vector<lsl::stream_info> refreshStreams(void);
@@ -58,6 +50,13 @@ private slots:
 	void rcsUpdateFilename(QString s);
 	void rcsStartRecording();
 	void rcsStopRecording();
+	void rcsStartRecordingAt(double lsl_time);
+	void rcsStopRecordingAt(double lsl_time);
+	void rcsAddStream(QString query);
+	void rcsRemoveStream(QString query);
+	void rcsStartSession(QString name, QString file, QString query);
+	void rcsStopSession(QString name);
+	void streamItemChanged(QListWidgetItem *item);
 	void rcsportValueChangedInt(int value);
 
 private:
@@ -67,16 +66,31 @@ private:
 	QString counterPlaceholder() const;
 	void load_config(QString filename);
 	void save_config(QString filename);
+	/// the recording settings from the config file (without mirrors, shards and the tap)
+	recording_options recordingOptions() const;
 
+	// additional recordings started by the remote control; the main recording shares their inlets
+	std::unique_ptr<session_host> sessions;
+	// the settings shared with the recorder without the GUI; the study root and file name template
+	// come from the window
+	std::unique_ptr<recorder_config> config;
 	std::unique_ptr<recording> currentRecording;
 	std::unique_ptr<RemoteControlSocket> rcs;
 
 	int startTime;
+	// the scheduled start of the next recording (0: right away), see recording_options::start_at
+	double scheduledStart = 0;
 	std::unique_ptr<QTimer> timer;
 
-	QList<StreamItem> knownStreams;
+	// the streams on the network, found by a background resolver
+	stream_directory directory;
+	// the list entries of the streams that are online and of the missing (required) ones
+	std::unordered_map<stream_key, QListWidgetItem *, stream_key_hash> knownStreams;
 	QSet<QString> missingStreams;
-	std::map<std::string, int> syncOptionsByStreamName;
+	QHash<QString, QListWidgetItem *> missingItems;
+	int bidsSidecars = -1; // -1: with the BIDS layout (as checked in the window)
+	// whether the writer alarm was active on the last status update
+	mutable bool writerAlarm = false;
 
 	// QString recFilename;
 	QString legacyTemplate;
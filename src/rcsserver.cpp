@@ -0,0 +1,194 @@
+#include "rcsserver.h"
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#define poll WSAPoll
+#define close_socket closesocket
+#else
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#define close_socket close
+#endif
+
+// the platform's socket type (int or SOCKET), kept as socket_t in the header
+using native_socket = decltype(pollfd::fd);
+// longest line (or HTTP request head) a client may send
+const std::size_t max_request = 64 * 1024;
+// output a client may leave unread before it's disconnected
+const std::size_t max_pending = 1024 * 1024;
+
+static void set_nonblocking(native_socket s) {
+#ifdef _WIN32
+	u_long enabled = 1;
+	ioctlsocket(s, FIONBIO, &enabled);
+#else
+	fcntl(s, F_SETFL, fcntl(s, F_GETFL) | O_NONBLOCK);
+#endif
+}
+
+/// whether the last socket call failed only because it would have blocked
+static bool would_block() {
+#ifdef _WIN32
+	return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+	return errno == EAGAIN || errno == EWOULDBLOCK;
+#endif
+}
+
+rcs_server::rcs_server() {
+#ifdef _WIN32
+	WSADATA data;
+	WSAStartup(MAKEWORD(2, 2), &data);
+#endif
+}
+
+rcs_server::~rcs_server() {
+	for (const auto &c : clients_) close_socket(static_cast<native_socket>(c.socket));
+	for (const auto &l : listeners_) close_socket(static_cast<native_socket>(l.socket));
+#ifdef _WIN32
+	WSACleanup();
+#endif
+}
+
+void rcs_server::listen_lines(uint16_t port, line_handler handler) {
+	line_handler_ = std::move(handler);
+	listen(port, false);
+}
+
+void rcs_server::listen_http(uint16_t port, http_handler handler) {
+	http_handler_ = std::move(handler);
+	listen(port, true);
+}
+
+void rcs_server::listen(uint16_t port, bool http) {
+	const native_socket s = ::socket(AF_INET, SOCK_STREAM, 0);
+	if (static_cast<socket_t>(s) < 0) throw std::runtime_error("Can't create a socket");
+	const int reuse = 1;
+	setsockopt(
+		s, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char *>(&reuse), sizeof(reuse));
+	sockaddr_in addr;
+	std::memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	addr.sin_port = htons(port);
+	if (bind(s, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 || ::listen(s, 8) != 0) {
+		close_socket(s);
+		throw std::runtime_error("Can't listen on port " + std::to_string(port));
+	}
+	listeners_.push_back({static_cast<socket_t>(s), http});
+}
+
+void rcs_server::broadcast(const std::string &line) {
+	for (auto it = clients_.begin(); it != clients_.end();)
+		if (!it->http && !send_queued(*it, line + '\n')) {
+			close_socket(static_cast<native_socket>(it->socket));
+			it = clients_.erase(it);
+		} else
+			++it;
+}
+
+void rcs_server::poll(std::chrono::milliseconds timeout) {
+	std::vector<pollfd> fds;
+	for (const auto &l : listeners_)
+		fds.push_back({static_cast<native_socket>(l.socket), POLLIN, 0});
+	for (const auto &c : clients_) {
+		// answered HTTP clients are only waited for until their response is sent
+		short events = c.done ? 0 : POLLIN;
+		if (!c.pending.empty()) events |= POLLOUT;
+		fds.push_back({static_cast<native_socket>(c.socket), events, 0});
+	}
+	if (fds.empty()) {
+		std::this_thread::sleep_for(timeout);
+		return;
+	}
+	const int timeout_ms = static_cast<int>(timeout.count());
+	if (::poll(fds.data(), static_cast<unsigned>(fds.size()), timeout_ms) <= 0) return;
+
+	// the sockets are in the same order as in fds, new clients are polled from the next call on
+	std::size_t i = 0;
+	std::list<client> accepted;
+	for (const auto &l : listeners_)
+		if (fds[i++].revents & POLLIN) {
+			const native_socket s = accept(static_cast<native_socket>(l.socket), nullptr, nullptr);
+			if (static_cast<socket_t>(s) < 0) continue;
+			// a client that doesn't read its replies must not block the poll loop
+			set_nonblocking(s);
+			accepted.emplace_back(static_cast<socket_t>(s), l.http);
+		}
+	for (auto it = clients_.begin(); it != clients_.end(); ++i) {
+		const auto revents = fds[i].revents;
+		bool keep = true;
+		if (revents & POLLOUT) keep = send_queued(*it);
+		// errors and hangups are detected by recv()
+		if (keep && (revents & ~POLLOUT)) keep = !it->done && receive(*it);
+		if (keep && (!it->done || !it->pending.empty()))
+			++it;
+		else {
+			close_socket(static_cast<native_socket>(it->socket));
+			it = clients_.erase(it);
+		}
+	}
+	clients_.splice(clients_.end(), accepted);
+}
+
+bool rcs_server::receive(client &c) {
+	char buffer[4096];
+	const auto n = recv(static_cast<native_socket>(c.socket), buffer, sizeof(buffer), 0);
+	if (n <= 0) return false;
+	c.received.append(buffer, static_cast<std::size_t>(n));
+	if (c.http) {
+		// "GET /path HTTP/1.1" followed by headers and an empty line
+		if (c.received.find("\r\n\r\n") == std::string::npos)
+			return c.received.size() < max_request;
+		const auto path_end = c.received.find(' ', 4);
+		const bool get = c.received.compare(0, 4, "GET ") == 0 && path_end != std::string::npos;
+		const std::string body =
+			get && http_handler_ ? http_handler_(c.received.substr(4, path_end - 4)) : "";
+		c.done = true;
+		return send_queued(c, (body.empty() ? std::string("HTTP/1.1 404 Not Found\r\n")
+											: std::string("HTTP/1.1 200 OK\r\n")) +
+								  "Content-Type: text/plain; version=0.0.4\r\nContent-Length: " +
+								  std::to_string(body.size()) +
+								  "\r\nConnection: close\r\n\r\n" + body);
+	}
+	// handle the complete lines (like QTcpSocket::readLine() and QString::trimmed() in the GUI)
+	for (auto eol = c.received.find('\n'); eol != std::string::npos; eol = c.received.find('\n')) {
+		std::string line = c.received.substr(0, eol);
+		c.received.erase(0, eol + 1);
+		const auto begin = line.find_first_not_of(" \t\r");
+		line = begin == std::string::npos
+				   ? std::string()
+				   : line.substr(begin, line.find_last_not_of(" \t\r") + 1 - begin);
+		if (line_handler_ && !send_queued(c, line_handler_(line))) return false;
+	}
+	return c.received.size() < max_request;
+}
+
+bool rcs_server::send_queued(client &c, const std::string &data) {
+	c.pending += data;
+	std::size_t sent = 0;
+	while (sent < c.pending.size()) {
+		const auto n = send(static_cast<native_socket>(c.socket), c.pending.data() + sent,
+			static_cast<int>(c.pending.size() - sent), 0);
+		if (n > 0)
+			sent += static_cast<std::size_t>(n);
+		else if (n < 0 && would_block())
+			break; // the rest is sent when poll() reports the socket writable
+		else
+			return false;
+	}
+	c.pending.erase(0, sent);
+	if (c.pending.size() <= max_pending) return true;
+	std::cerr << "Disconnecting a remote control client that doesn't read its replies ("
+			  << c.pending.size() / 1024 << " KiB pending)" << std::endl;
+	return false;
+}
@@ -0,0 +1,68 @@
+#ifndef RCSSERVER_H
+#define RCSSERVER_H
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <string>
+
+/**
+ * The remote control socket without Qt: a TCP server for the line based remote control protocol
+ * (see README.md) and, optionally, plain HTTP GET requests (e.g. for a metrics scraper).
+ *
+ * All sockets are served by the thread that calls poll(), so the handlers run on that thread and
+ * need no locking of their own. The client sockets are non-blocking: replies are queued per client
+ * and sent as the client reads them, and a client that lets too much output pile up is dropped.
+ */
+class rcs_server {
+public:
+	/// returns the reply to a command line (sent as is, so it includes a line break if needed)
+	using line_handler = std::function<std::string(const std::string &line)>;
+	/// returns the body for a GET request of a path (empty: 404)
+	using http_handler = std::function<std::string(const std::string &path)>;
+
+	rcs_server();
+	~rcs_server();
+	rcs_server(const rcs_server &) = delete;
+	rcs_server &operator=(const rcs_server &) = delete;
+
+	/// accept remote control clients on the port
+	/// @throws std::runtime_error if the port can't be bound
+	void listen_lines(uint16_t port, line_handler handler);
+	/// accept HTTP clients on the port (one request per connection)
+	void listen_http(uint16_t port, http_handler handler);
+
+	/// queue a line (e.g. an alarm) for all connected remote control clients
+	void broadcast(const std::string &line);
+
+	/// wait up to timeout for connections or data and handle them
+	void poll(std::chrono::milliseconds timeout);
+
+private:
+	using socket_t = std::intptr_t;
+	struct listener {
+		socket_t socket;
+		bool http;
+	};
+	struct client {
+		client(socket_t s, bool is_http) : socket(s), http(is_http) {}
+		socket_t socket;
+		bool http;
+		std::string received; // data after the last complete line (or the partial request)
+		std::string pending;  // output the client hasn't read yet
+		bool done = false;	  // close the connection once the pending output is sent
+	};
+	std::list<listener> listeners_;
+	std::list<client> clients_;
+	line_handler line_handler_;
+	http_handler http_handler_;
+
+	void listen(uint16_t port, bool http);
+	/// read from a client and handle its complete lines, false if it's to be disconnected
+	bool receive(client &c);
+	/// queue data for a client and send what the socket takes, false if it's to be disconnected
+	static bool send_queued(client &c, const std::string &data = std::string());
+};
+
+#endif
@@ -0,0 +1,269 @@
+#include "recorderconfig.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+std::string trim(const std::string &s) {
+	const auto begin = s.find_first_not_of(" \t\r\n");
+	if (begin == std::string::npos) return std::string();
+	return s.substr(begin, s.find_last_not_of(" \t\r\n") + 1 - begin);
+}
+
+/// the strings of a value like `"a", "b"` (quotes removed, backslash escapes resolved)
+std::vector<std::string> parse_list(const std::string &value) {
+	std::vector<std::string> list;
+	std::string item;
+	bool quoted = false, pending = false;
+	for (std::size_t i = 0; i < value.size(); ++i) {
+		const char c = value[i];
+		if (c == '\\' && i + 1 < value.size())
+			item += value[++i];
+		else if (c == '"')
+			quoted = !quoted;
+		else if (c == ',' && !quoted) {
+			list.push_back(trim(item));
+			item.clear();
+		} else
+			item += c;
+		pending = true;
+	}
+	if (pending) list.push_back(trim(item));
+	return list;
+}
+
+bool to_bool(const std::string &value) {
+	std::string lower(value);
+	std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+	return lower == "1" || lower == "true";
+}
+
+/// an entry "StreamName (PC) word ..." of a per-stream setting
+struct stream_entry {
+	std::string stream;
+	std::vector<std::string> words;
+};
+
+/// the entries with at least min_words after the stream (the others are reported and skipped)
+std::vector<stream_entry> stream_entries(
+	const std::vector<std::string> &list, const char *what, std::size_t min_words) {
+	std::vector<stream_entry> entries;
+	for (const auto &item : list) {
+		std::istringstream words(item);
+		std::string name, host, word;
+		stream_entry entry;
+		if (words >> name >> host)
+			while (words >> word) entry.words.push_back(word);
+		if (host.empty() || entry.words.size() < min_words) {
+			std::cerr << "Invalid " << what << ": " << item << std::endl;
+			continue;
+		}
+		entry.stream = name + ' ' + host;
+		entries.push_back(std::move(entry));
+	}
+	return entries;
+}
+
+void replace_all(std::string &s, const std::string &placeholder, const std::string &value) {
+	for (auto pos = s.find(placeholder); pos != std::string::npos;
+		 pos = s.find(placeholder, pos + value.size()))
+		s.replace(pos, placeholder.size(), value);
+}
+} // namespace
+
+recorder_config read_config(const std::string &filename) {
+	std::ifstream in(filename);
+	if (!in) throw std::runtime_error("Can't read the config file " + filename);
+	std::map<std::string, std::vector<std::string>> values;
+	std::string line;
+	for (bool first = true; std::getline(in, line); first = false) {
+		if (first && line.compare(0, 3, "\xEF\xBB\xBF") == 0) line.erase(0, 3);
+		line = trim(line);
+		if (line.empty() || line[0] == ';' || line[0] == '#' || line[0] == '[') continue;
+		const auto eq = line.find('=');
+		if (eq == std::string::npos) continue;
+		values[trim(line.substr(0, eq))] = parse_list(trim(line.substr(eq + 1)));
+	}
+	const auto has = [&](const char *key) { return values.count(key) != 0; };
+	const auto get = [&](const char *key, const std::string &fallback = std::string()) {
+		auto it = values.find(key);
+		return it == values.end() || it->second.empty() ? fallback : it->second.front();
+	};
+	const auto list = [&](const char *key) {
+		auto it = values.find(key);
+		return it == values.end() ? std::vector<std::string>() : it->second;
+	};
+
+	recorder_config config;
+	if (has("StorageLocation")) {
+		if (has("StudyRoot"))
+			throw std::runtime_error(
+				"StorageLocation cannot be used if StudyRoot is also specified.");
+		if (has("PathTemplate"))
+			throw std::runtime_error(
+				"StorageLocation cannot be used if PathTemplate is also specified.");
+		// the root is the folder before the first placeholder, as in the GUI
+		const std::string location = get("StorageLocation");
+		const std::string root =
+			std::filesystem::path(location.substr(0, location.find('%'))).parent_path().string();
+		config.study_root = root;
+		config.path_template = location.substr(root.empty() ? 0 : root.size() + 1);
+	}
+	config.study_root = get("StudyRoot", config.study_root);
+	config.path_template = get("PathTemplate", config.path_template);
+	config.required_streams = list("RequiredStreams");
+	// "StreamName (PC) post_flag ..."
+	for (const auto &entry : stream_entries(list("OnlineSync"), "sync stream config", 0)) {
+		int flags = 0;
+		for (const auto &word : entry.words) {
+			if (word == "post_clocksync") flags |= lsl::post_clocksync;
+			if (word == "post_dejitter") flags |= lsl::post_dejitter;
+			if (word == "post_monotonize") flags |= lsl::post_monotonize;
+			if (word == "post_threadsafe") flags |= lsl::post_threadsafe;
+			if (word == "post_ALL") flags = lsl::post_ALL;
+		}
+		config.sync_options[entry.stream] = flags;
+	}
+	// "StreamName (PC) 0-31 Cz ..."
+	for (auto &entry : stream_entries(list("ChannelSelection"), "channel selection", 1))
+		config.options.channel_selections[entry.stream] = std::move(entry.words);
+	// "StreamName (PC) 20"
+	for (const auto &entry : stream_entries(list("Decimation"), "decimation", 1)) {
+		const std::string &word = entry.words[0];
+		const bool digits = std::all_of(word.begin(), word.end(), ::isdigit);
+		const unsigned long factor = digits ? std::strtoul(word.c_str(), nullptr, 10) : 0;
+		if (factor < 2 || factor > UINT32_MAX || entry.words.size() > 1) {
+			std::cerr << "Invalid decimation of " << entry.stream << std::endl;
+			continue;
+		}
+		config.options.decimations[entry.stream] = static_cast<uint32_t>(factor);
+	}
+	// "StreamName (PC) edf [range]"
+	for (const auto &entry : stream_entries(list("Export"), "export", 1)) {
+		export_spec spec;
+		try {
+			spec.format = parse_export_format(entry.words[0]);
+			if (entry.words.size() > 2) throw std::invalid_argument("too many words");
+			if (entry.words.size() == 2 && !((spec.edf_range = std::stod(entry.words[1])) > 0))
+				throw std::invalid_argument("the range must be positive");
+		} catch (std::logic_error &e) {
+			std::cerr << "Invalid export of " << entry.stream << " (" << e.what() << ")"
+					  << std::endl;
+			continue;
+		}
+		config.options.exports[entry.stream] = spec;
+	}
+	config.mirror_roots = list("MirrorLocations");
+	for (const auto &shard : list("Shards")) {
+		const auto at = shard.rfind('@');
+		if (at != std::string::npos && at > 0)
+			config.shard_roots.emplace_back(shard.substr(0, at), shard.substr(at + 1));
+		else
+			std::cerr << "Ignoring the shard " << shard << " (expected query@folder)" << std::endl;
+	}
+
+	auto &options = config.options;
+	options.spill_budget = std::stoul(get("SpillBudgetMB", "1024")) * 1024 * 1024;
+	options.spill_alarm = options.spill_budget / 8;
+	options.durability.mode = parse_durability_mode(get("Durability", "none"));
+	options.durability.interval = std::stod(get("SyncIntervalMs", "1000")) / 1000;
+	options.durability.max_unsynced_bytes = std::stoul(get("SyncMB", "0")) * 1024 * 1024;
+	if (options.durability.max_unsynced_bytes &&
+		options.durability.mode != durability_mode::group_commit) {
+		std::cerr << "Ignoring SyncMB, it requires Durability=group_commit" << std::endl;
+		options.durability.max_unsynced_bytes = 0;
+	}
+	options.tap_name = get("SharedMemoryTap");
+	options.tap_size = std::stoul(get("SharedMemoryTapMB", "64")) * 1024 * 1024;
+	options.watermark = to_bool(get("CommitWatermark", "false"));
+	options.integrity = to_bool(get("Checksums", "false"));
+	// only for the BIDS layout, unless requested explicitly
+	options.bids_sidecars =
+		to_bool(get("BidsSidecars", config.path_template.empty() ? "true" : "false"));
+	options.interleave_window = std::stod(get("InterleaveWindowMs", "0")) / 1000;
+	options.interleave_buffer = std::stoul(get("InterleaveMB", "64")) * 1024 * 1024;
+	options.signal_summaries = to_bool(get("SignalSummaries", "true"));
+	options.saturation_level = std::stod(get("SaturationLevel", "0"));
+
+	config.rcs_enabled = to_bool(get("RCSEnabled", "1"));
+	config.rcs_port = static_cast<uint16_t>(std::stoul(get("RCSPort", "22345")));
+	config.metrics_port = static_cast<uint16_t>(std::stoul(get("MetricsPort", "0")));
+	config.auto_start = to_bool(get("AutoStart", "0"));
+	return config;
+}
+
+std::string recorder_config::relative_filename() const {
+	std::string filename = path_template;
+	if (filename.empty()) {
+		// path/to/StudyRoot/sub-%p/ses-%s/eeg/sub-%p_ses-%s_task-%b[_acq-%a]_run-%r_eeg.xdf
+		filename = "sub-%p/ses-%s/%m/sub-%p_ses-%s_task-%b";
+		if (!acquisition.empty()) filename += "_acq-%a";
+		filename += "_run-%r_%m.xdf";
+	}
+	replace_all(filename, "%b", task);
+	replace_all(filename, "%p", participant);
+	replace_all(filename, "%s", session);
+	replace_all(filename, "%a", acquisition);
+	replace_all(filename, "%m", modality);
+	std::string counter = std::to_string(run);
+	if (counter.size() < 3) counter.insert(0, 3 - counter.size(), '0');
+	replace_all(filename, path_template.empty() ? "%r" : "%n", counter);
+	return trim(filename);
+}
+
+void recorder_config::add_copies(recording_options &options, const std::string &relative) const {
+	namespace fs = std::filesystem;
+	const fs::path rel(relative);
+	// mirrors get the same path relative to their own root
+	for (const auto &root : mirror_roots) {
+		const fs::path mirror = fs::path(root) / rel;
+		try {
+			move_existing(mirror.string());
+			fs::create_directories(mirror.parent_path());
+			options.mirror_files.push_back(mirror.string());
+		} catch (std::exception &e) {
+			std::cerr << "Warning: no mirror in " << root << ": " << e.what() << std::endl;
+		}
+	}
+	// shards get the same relative path below their root, with the shard number appended
+	for (std::size_t i = 0; i < shard_roots.size(); ++i) {
+		const fs::path shard = fs::path(shard_roots[i].second) / rel.parent_path() /
+							   (rel.stem().string() + "_shard" + std::to_string(i + 1) +
+								   rel.extension().string());
+		move_existing(shard.string());
+		fs::create_directories(shard.parent_path());
+		options.shards.push_back({shard_roots[i].first, shard.string()});
+	}
+}
+
+std::string listname_to_query(const std::string &listname) {
+	// "BioSemi (AASDFSDF)" -> name='BioSemi' and hostname='AASDFSDF'
+	const auto open = listname.rfind(" (");
+	if (open == std::string::npos || listname.back() != ')')
+		return "name='" + listname + "'";
+	const std::string host = listname.substr(open + 2, listname.size() - open - 3);
+	std::string query = "name='" + trim(listname.substr(0, open)) + "'";
+	if (host.size() > 1) query += " and hostname='" + host + "'";
+	return query;
+}
+
+void move_existing(const std::string &filename) {
+	namespace fs = std::filesystem;
+	const fs::path file(filename);
+	if (!fs::exists(file)) return;
+	if (fs::is_directory(file))
+		throw std::runtime_error("Recording path already exists and is a directory");
+	fs::path old;
+	for (int i = 1;; i++) {
+		old = file.parent_path() /
+			  (file.stem().string() + "_old" + std::to_string(i) + file.extension().string());
+		if (!fs::exists(old)) break;
+	}
+	fs::rename(file, old);
+	std::cout << "Moved existing file to " << old.string() << std::endl;
+}
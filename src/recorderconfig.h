@@ -0,0 +1,59 @@
+#ifndef RECORDERCONFIG_H
+#define RECORDERCONFIG_H
+
+#include "recording.h"
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+/// the settings of LabRecorder.cfg (see the comments there), read by the GUI and the daemon
+struct recorder_config {
+	std::string study_root = "CurrentStudy";
+	std::string path_template; // PathTemplate (empty: the BIDS layout)
+	std::vector<std::string> required_streams; // "name (hostname)", watched for if missing
+	std::map<std::string, int> sync_options;	 // OnlineSync flags by "name (hostname)"
+	std::vector<std::string> mirror_roots;
+	std::vector<std::pair<std::string, std::string>> shard_roots; // query, folder
+	recording_options options; // spill budget, durability, sidecars, tap, interleaving, summaries
+	bool rcs_enabled = true;
+	uint16_t rcs_port = 22345;
+	uint16_t metrics_port = 0; // HTTP port for the metrics (0: off)
+	bool auto_start = false;
+
+	// the placeholders of the file name, set by the "filename" remote control command
+	std::string task = "Default", participant = "P001", session = "S001", acquisition;
+	std::string modality = "eeg";
+	int run = 1;
+
+	/// the file name below the study root, with the placeholders replaced
+	std::string relative_filename() const;
+
+	/**
+	 * @brief add_copies Add the mirror and shard files of a recording to its options. Existing
+	 * files are moved away (see move_existing()) and missing folders are created.
+	 * @param relative The recording's file name below the study root
+	 * @throws std::exception if a shard can't be created (a mirror is skipped with a warning)
+	 */
+	void add_copies(recording_options &options, const std::string &relative) const;
+};
+
+/**
+ * @brief read_config Read the settings the GUI also reads (QSettings' INI format: key=value,
+ * comments starting with ';', lists of quoted strings separated by commas)
+ * @throws std::runtime_error if the file can't be read or the StorageLocation is ambiguous
+ */
+recorder_config read_config(const std::string &filename);
+
+/// the lsl::stream_info::matches_query() query for a stream list entry "name (hostname)"
+std::string listname_to_query(const std::string &listname);
+
+/**
+ * @brief move_existing Move an existing file to name_oldN.ext with the lowest free N, so a new
+ * recording never overwrites an old one
+ * @throws std::runtime_error if the path is a directory, std::filesystem::filesystem_error if the
+ * file can't be renamed
+ */
+void move_existing(const std::string &filename);
+
+#endif
@@ -0,0 +1,361 @@
+#include "recorderdaemon.h"
+#include "rcsserver.h"
+#include <algorithm>
+#include <csignal>
+#include <cstdlib>
+#include <filesystem>
+#include <regex>
+#include <sstream>
+
+namespace fs = std::filesystem;
+
+namespace {
+// set by SIGINT and SIGTERM
+volatile std::sig_atomic_t stop_signal = 0;
+extern "C" void on_stop_signal(int) { stop_signal = 1; }
+
+// how often the main loop checks for a stop signal and the writer alarm
+const auto poll_interval = std::chrono::milliseconds(200);
+// time for discovering the streams that are online before the automatic start, in seconds
+const double discovery_time = 1.0;
+
+/// escape a label value of the Prometheus text format
+std::string label(const std::string &value) {
+	std::string escaped;
+	for (char c : value)
+		if (c == '\\' || c == '"')
+			(escaped += '\\') += c;
+		else if (c == '\n')
+			escaped += "\\n";
+		else
+			escaped += c;
+	return escaped;
+}
+
+std::string lower(std::string s) {
+	std::transform(s.begin(), s.end(), s.begin(), ::tolower);
+	return s;
+}
+
+/// the LSL time argument of start_at and stop_at (0 if it isn't a positive number)
+double lsl_time_arg(const std::string &arg) {
+	char *end = nullptr;
+	const double time = std::strtod(arg.c_str(), &end);
+	if (end == arg.c_str() || *end != '\0' || !(time > 0)) {
+		std::cerr << "Invalid LSL time: " << arg << std::endl;
+		return 0;
+	}
+	return time;
+}
+} // namespace
+
+recorder_daemon::recorder_daemon(recorder_config config, std::vector<std::string> queries)
+	: config_(std::move(config)), queries_(std::move(queries)), started_(lsl::local_clock()) {
+	// start with the first free run number, as the GUI does when loading the config
+	if (config_.path_template.empty() || config_.path_template.find("%n") != std::string::npos)
+		while (config_.run < 1000 &&
+			   fs::exists(fs::path(config_.study_root) / config_.relative_filename()))
+			config_.run++;
+}
+
+recorder_daemon::~recorder_daemon() {
+	stop();
+	// wait for all files to be closed
+	closing_.clear();
+	sessions_.stop_all();
+}
+
+std::vector<lsl::stream_info> recorder_daemon::selected_streams() {
+	directory_.update();
+	std::vector<lsl::stream_info> selected;
+	for (const auto &info : directory_.streams()) {
+		bool matches = queries_.empty();
+		for (const auto &query : queries_) matches = matches || info.matches_query(query.c_str());
+		if (matches) selected.push_back(info);
+	}
+	return selected;
+}
+
+bool recorder_daemon::start(double start_at) {
+	if (current_) return false;
+	try {
+		const fs::path relative(config_.relative_filename());
+		const fs::path file = fs::path(config_.study_root) / relative;
+		move_existing(file.string());
+		fs::create_directories(file.parent_path());
+
+		recording_options options = config_.options;
+		config_.add_copies(options, relative.string());
+		// streams that are also recorded by a session are received only once
+		options.inlets = sessions_.inlets();
+		options.start_at = start_at;
+
+		const auto streams = selected_streams();
+		std::vector<std::string> watchfor;
+		for (const auto &required : config_.required_streams) {
+			bool online = false;
+			for (const auto &info : streams)
+				online = online || info.name() + " (" + info.hostname() + ")" == required;
+			if (!online) watchfor.push_back(listname_to_query(required));
+		}
+		current_ = std::make_unique<recording>(
+			file.string(), streams, watchfor, config_.sync_options, true, options);
+		current_file_ = file.string();
+		recordings_++;
+		std::cout << "Recording " << streams.size() << " streams to " << current_file_ << std::endl;
+		return true;
+	} catch (std::exception &e) {
+		std::cerr << "Could not start the recording: " << e.what() << std::endl;
+		return false;
+	}
+}
+
+void recorder_daemon::stop() {
+	if (!current_) return;
+	// destroying the recording waits for its threads to write the footers
+	closing_.push_back(std::async(std::launch::async,
+		[rec = std::move(current_), file = current_file_]() mutable {
+			try {
+				rec.reset();
+			} catch (std::exception &e) {
+				std::cerr << "Exception on stop: " << e.what() << std::endl;
+			}
+			std::cout << "Stopped the recording to " << file << std::endl;
+		}));
+	current_file_.clear();
+}
+
+void recorder_daemon::update_filename(const std::string &command) {
+	// "filename {option:value}{option:value}...", see MainWindow::rcsUpdateFilename()
+	static const std::regex option_re("\\{(\\w+?):([^}]*)\\}");
+	for (std::sregex_iterator it(command.begin(), command.end(), option_re), end; it != end; ++it) {
+		const std::string option = lower((*it)[1]), value = (*it)[2];
+		if (option == "root")
+			config_.study_root = value;
+		else if (option == "template")
+			config_.path_template = lower(value);
+		else if (option == "task")
+			config_.task = value;
+		else if (option == "run")
+			config_.run = std::atoi(value.c_str());
+		else if (option == "participant")
+			config_.participant = value;
+		else if (option == "session")
+			config_.session = value;
+		else if (option == "acquisition")
+			config_.acquisition = value;
+		else if (option == "modality")
+			config_.modality = lower(value);
+	}
+	std::cout << "The next recording goes to "
+			  << (fs::path(config_.study_root) / config_.relative_filename()).string() << std::endl;
+}
+
+std::string recorder_daemon::handle_command(const std::string &s) {
+	std::cout << s << std::endl;
+	// queries, answered with a line
+	if (s == "summary")
+		return (current_ ? summaries_to_json(current_->signal_summaries())
+						 : std::string("{\"streams\":[]}")) +
+			   '\n';
+	if (s == "health")
+		return (current_ ? health_to_json(current_->stream_health_statistics())
+						 : std::string("{\"streams\":[]}")) +
+			   '\n';
+	if (s == "sessions") return sessions_to_json(sessions_.sessions()) + '\n';
+
+	// commands, answered with "OK" like in the GUI
+	if (s == "start")
+		start();
+	else if (s == "stop")
+		stop();
+	else if (s.rfind("start_at ", 0) == 0) {
+		// arm the recording right away, it writes the samples from that time on
+		if (const double time = lsl_time_arg(s.substr(9))) start(time);
+	} else if (s.rfind("stop_at ", 0) == 0) {
+		// the recording is closed in run() once all streams have been cut
+		if (const double time = lsl_time_arg(s.substr(8)))
+			if (current_) current_->set_stop_at(time);
+	} else if (s.rfind("add_stream ", 0) == 0) {
+		if (current_) {
+			directory_.update();
+			for (const auto &info : directory_.matching(s.substr(11))) current_->add_stream(info);
+		}
+	} else if (s.rfind("remove_stream ", 0) == 0) {
+		if (current_) current_->remove_streams(s.substr(14));
+	} else if (s.rfind("session_start ", 0) == 0) {
+		// session_start <name> <file> [<query>]
+		std::istringstream args(s.substr(14));
+		std::string name, file, query;
+		args >> name >> file;
+		std::getline(args >> std::ws, query);
+		std::vector<lsl::stream_info> streams;
+		if (query.empty())
+			streams = selected_streams();
+		else {
+			directory_.update();
+			streams = directory_.matching(query);
+		}
+		try {
+			const fs::path path = fs::path(config_.study_root) / file;
+			move_existing(path.string());
+			fs::create_directories(path.parent_path());
+			// the shared memory tap belongs to the main recording
+			recording_options options = config_.options;
+			options.tap_name.clear();
+			sessions_.start(name, path.string(), streams, {}, config_.sync_options, true, options);
+		} catch (std::exception &e) {
+			std::cerr << "Could not start the session " << name << ": " << e.what() << std::endl;
+		}
+	} else if (s.rfind("session_stop ", 0) == 0) {
+		if (!sessions_.stop(s.substr(13)))
+			std::cerr << "There is no session named " << s.substr(13) << std::endl;
+	} else if (s.find("filename") != std::string::npos)
+		update_filename(s);
+	// "update" and "select all|none" change the GUI's stream list; without it, every stream that
+	// matches the queries on the command line is recorded
+	return "OK";
+}
+
+std::string recorder_daemon::alarm() const {
+	if (!current_) return std::string();
+	const auto sinks = current_->sink_statistics();
+	const auto &main = sinks.front();
+	if (main.failed) return "WRITE ERROR, recording is not saved";
+	if (!main.alarm) return std::string();
+	if (main.chunks_dropped)
+		return "spill budget exhausted, " + std::to_string(main.chunks_dropped) + " chunks LOST";
+	return "disk stalling, " + std::to_string(main.bytes_queued / (1024 * 1024)) +
+		   " MiB buffered in memory";
+}
+
+int recorder_daemon::run() {
+	std::signal(SIGINT, on_stop_signal);
+	std::signal(SIGTERM, on_stop_signal);
+#ifndef _WIN32
+	// a client that disconnects before it gets the reply must not end the recording
+	std::signal(SIGPIPE, SIG_IGN);
+#endif
+	rcs_server server;
+	try {
+		if (config_.rcs_enabled) {
+			server.listen_lines(
+				config_.rcs_port, [this](const std::string &line) { return handle_command(line); });
+			std::cout << "Remote control on port " << config_.rcs_port << std::endl;
+		}
+		if (config_.metrics_port) {
+			server.listen_http(config_.metrics_port, [this](const std::string &path) {
+				return path == "/metrics" ? metrics() : std::string();
+			});
+			std::cout << "Metrics on http://localhost:" << config_.metrics_port << "/metrics"
+					  << std::endl;
+		}
+	} catch (std::exception &e) {
+		std::cerr << e.what() << std::endl;
+		return 3;
+	}
+	bool auto_start = config_.auto_start;
+
+	std::string last_alarm;
+	while (!stop_signal) {
+		server.poll(poll_interval);
+		if (auto_start && lsl::local_clock() - started_ > discovery_time) {
+			start();
+			auto_start = false;
+		}
+		if (current_ && current_->cut_finished()) stop();
+		closing_.remove_if([](const std::future<void> &closed) {
+			return closed.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+		});
+		const std::string current_alarm = alarm();
+		if (current_alarm != last_alarm)
+			server.broadcast(current_alarm.empty() ? "ALARM cleared" : "ALARM " + current_alarm);
+		last_alarm = current_alarm;
+	}
+	std::cout << "Stop signal received, closing the files." << std::endl;
+	stop();
+	closing_.clear();
+	sessions_.stop_all();
+	return 0;
+}
+
+std::string recorder_daemon::metrics() const {
+	// the files and streams of the main recording (session "") and of the sessions
+	std::vector<std::pair<std::string, const recording *>> recordings;
+	std::vector<std::shared_ptr<recording>> running; // the sessions can't end while they're read
+	if (current_) recordings.emplace_back("", current_.get());
+	for (const auto &session : sessions_.sessions())
+		if (auto rec = sessions_.find(session.name)) {
+			running.push_back(rec);
+			recordings.emplace_back(session.name, rec.get());
+		}
+	std::vector<std::pair<std::string, sink_stats>> files;
+	std::vector<std::pair<std::string, stream_health>> streams;
+	for (const auto &rec : recordings) {
+		const std::string session = "session=\"" + label(rec.first) + '"';
+		for (const auto &sink : rec.second->sink_statistics())
+			files.emplace_back(session + ",file=\"" + label(sink.filename) + '"', sink);
+		for (const auto &health : rec.second->stream_health_statistics())
+			streams.emplace_back(session + ",stream=\"" + label(health.name) + "\",host=\"" +
+									 label(health.hostname) + '"',
+				health);
+	}
+
+	std::ostringstream out;
+	out.precision(10);
+	const auto header = [&](const char *name, const char *type, const char *help) {
+		out << "# HELP " << name << ' ' << help << "\n# TYPE " << name << ' ' << type << '\n';
+	};
+	const auto scalar = [&](const char *name, const char *type, const char *help, double value) {
+		header(name, type, help);
+		out << name << ' ' << value << '\n';
+	};
+	const auto per_file = [&](const char *name, const char *type, const char *help, auto value) {
+		header(name, type, help);
+		for (const auto &file : files)
+			out << name << '{' << file.first << "} " << value(file.second) << '\n';
+	};
+	const auto per_stream = [&](const char *name, const char *type, const char *help, auto value) {
+		header(name, type, help);
+		for (const auto &stream : streams)
+			out << name << '{' << stream.first << "} " << value(stream.second) << '\n';
+	};
+	scalar("labrecorder_uptime_seconds", "gauge", "Time since the recorder was started.",
+		lsl::local_clock() - started_);
+	scalar("labrecorder_recording", "gauge", "Whether the main recording is running.",
+		current_ ? 1 : 0);
+	scalar("labrecorder_recordings_total", "counter", "Main recordings started.",
+		static_cast<double>(recordings_));
+	scalar("labrecorder_sessions", "gauge", "Running recording sessions.",
+		static_cast<double>(running.size()));
+	scalar("labrecorder_open_inlets", "gauge", "Stream inlets shared by all recordings.",
+		static_cast<double>(sessions_.inlets()->size()));
+	per_file("labrecorder_file_bytes_written_total", "counter", "Bytes written to the file.",
+		[](const sink_stats &s) { return s.bytes_written; });
+	per_file("labrecorder_file_bytes_dropped_total", "counter",
+		"Bytes dropped because the spill budget was exhausted.",
+		[](const sink_stats &s) { return s.bytes_dropped; });
+	per_file("labrecorder_file_bytes_queued", "gauge", "Bytes buffered in memory for the file.",
+		[](const sink_stats &s) { return s.bytes_queued; });
+	per_file("labrecorder_file_max_write_latency_seconds", "gauge", "Longest single write.",
+		[](const sink_stats &s) { return s.max_write_latency; });
+	per_file("labrecorder_file_alarm", "gauge", "Whether the file raises the writer alarm.",
+		[](const sink_stats &s) { return s.alarm ? 1 : 0; });
+	per_file("labrecorder_file_failed", "gauge", "Whether writing the file failed.",
+		[](const sink_stats &s) { return s.failed ? 1 : 0; });
+	per_stream("labrecorder_stream_samples_total", "counter", "Samples recorded.",
+		[](const stream_health &h) { return h.samples; });
+	per_stream("labrecorder_stream_gaps_total", "counter", "Gaps in the time stamps.",
+		[](const stream_health &h) { return h.gaps; });
+	per_stream("labrecorder_stream_missing_samples_total", "counter",
+		"Samples estimated to be missing in the gaps.",
+		[](const stream_health &h) { return h.missing_samples; });
+	per_stream("labrecorder_stream_reconnects_total", "counter", "Reconnections to the outlet.",
+		[](const stream_health &h) { return h.reconnects; });
+	per_stream("labrecorder_stream_clock_resets_total", "counter", "Clock resets of the source.",
+		[](const stream_health &h) { return h.clock_resets; });
+	per_stream("labrecorder_stream_effective_srate", "gauge",
+		"Sampling rate measured from the time stamps.",
+		[](const stream_health &h) { return h.effective_srate; });
+	return out.str();
+}
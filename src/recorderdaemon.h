@@ -0,0 +1,71 @@
+#ifndef RECORDERDAEMON_H
+#define RECORDERDAEMON_H
+
+#include "recorderconfig.h"
+#include "sessionhost.h"
+#include "streamdirectory.h"
+#include <future>
+#include <list>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * LabRecorder without the GUI (and without Qt), e.g. for acquisition nodes without a display.
+ *
+ * The settings come from LabRecorder.cfg and the recording is controlled with the same remote
+ * control commands as the GUI (see README.md). Recording sessions (session_start) are supported
+ * as well. SIGINT and SIGTERM stop all recordings, so the footers are written before the process
+ * exits. The streams are discovered in the background and files are closed in the background,
+ * so the remote control socket stays responsive.
+ */
+class recorder_daemon {
+public:
+	/**
+	 * @param queries Record only the streams that match one of these queries (default: all)
+	 */
+	explicit recorder_daemon(recorder_config config, std::vector<std::string> queries = {});
+	~recorder_daemon();
+
+	/// handle a remote control command, returns the reply for the client
+	std::string handle_command(const std::string &line);
+
+	/**
+	 * @brief run Serve the remote control socket (and the metrics) until SIGINT or SIGTERM
+	 * @return the process exit code
+	 */
+	int run();
+
+	/// whether the main recording is running
+	bool recording_active() const { return current_ != nullptr; }
+	/// the file of the main recording (empty if none is running)
+	const std::string &current_file() const { return current_file_; }
+
+	/// counters of all recordings in the Prometheus text format
+	std::string metrics() const;
+
+private:
+	recorder_config config_;
+	const std::vector<std::string> queries_;
+	session_host sessions_;
+	std::unique_ptr<recording> current_;
+	std::string current_file_;
+	stream_directory directory_;		   // the streams on the network
+	std::list<std::future<void>> closing_; // stopped recordings whose files are being closed
+	const double started_; // local_clock() at startup
+	uint64_t recordings_ = 0; // number of recordings started so far
+
+	/// start the main recording (false if it's running or can't be started)
+	/// @param start_at the scheduled start, see recording_options::start_at
+	bool start(double start_at = 0);
+	/// stop the main recording, its file is closed in the background
+	void stop();
+	/// apply the options of a "filename {option:value}..." command
+	void update_filename(const std::string &command);
+	/// the streams that are online and selected by the queries (doesn't wait for the network)
+	std::vector<lsl::stream_info> selected_streams();
+	/// the writer alarm of the main recording's file, as in the GUI (empty if there is none)
+	std::string alarm() const;
+};
+
+#endif
@@ -1,6 +1,10 @@
 #include "recording.h"
+#include "xdfreader.h"
 //#include "conversions.h"
 
+#include <cctype>
+#include <filesystem>
+#include <functional>
 #include <set>
 #include <sstream>
 #ifdef XDFZ_SUPPORT
@@ -10,107 +14,230 @@
 #endif
 
 // Thread utilities
-using Clock = std::chrono::high_resolution_clock;
+using Clock = std::chrono::steady_clock;
 
 /**
- * @brief try_join_once		joins and deconstructs the thread if possible
- * @param thread			unique_ptr to a std::tread. Will be reset on success
- * @return					true if the thread was successfully joined, false otherwise
+ * @brief spawn_thread	Start a thread that runs f(args...) and can be joined with a timeout
  */
-inline bool try_join_once(std::unique_ptr<std::thread> &thread) {
-	if (thread && thread->joinable()) {
-		thread->join();
-		thread.reset();
-		return true;
-	}
-	return false;
+template <class F, class... Args> thread_p spawn_thread(F &&f, Args &&...args) {
+	auto thread = std::make_unique<recording_thread>();
+	std::promise<void> finished;
+	thread->finished = finished.get_future();
+	thread->thread = std::thread(
+		[finished = std::move(finished),
+			run = std::bind(std::forward<F>(f), std::forward<Args>(args)...)]() mutable {
+			run();
+			finished.set_value();
+		});
+	return thread;
 }
 
 /**
- * @brief timed_join	Tries to join the passed thread until it succeeds or duration passes
- * @param thread		unique_ptr to a std::tread. Will be reset on success
- * @param duration		max duration to try joining
+ * @brief timed_join	Waits until the passed thread has finished or duration passes and joins it
+ * @param thread		the thread. Will be reset on success
+ * @param duration		max duration to wait
  * @return true on success, false otherwise
  */
 inline bool timed_join(thread_p &thread, std::chrono::milliseconds duration = max_join_wait) {
-	const auto start = Clock::now();
-	while (Clock::now() - start < duration) {
-		if (try_join_once(thread)) return true;
-		std::this_thread::sleep_for(std::chrono::milliseconds(500));
-	}
-	return false;
+	if (!thread) return true;
+	if (thread->finished.wait_for(duration) != std::future_status::ready) return false;
+	thread->thread.join();
+	thread.reset();
+	return true;
 }
 
 /**
  * @brief timed_join_or_detach	Join the thread or detach it if not possible within specified
  * duration
- * @param thread				unique_ptr to a std::tread. Will be reset on success
+ * @param thread				the thread. Will be reset on success
  * @param duration max			duration to try joining
  */
 inline void timed_join_or_detach(
 	thread_p &thread, std::chrono::milliseconds duration = max_join_wait) {
 	if (!timed_join(thread, duration)) {
-		thread->detach();
+		thread->thread.detach();
+		thread.reset();
 		std::cerr << "Thread didn't join in time!" << std::endl;
 	}
 }
 
 /**
- * @brief timed_join_or_detach	Join the thread or detach it if not possible within specified
- * duration
- * @param threads				list of unique_ptrs to std::threads. Guaranteed to be empty
- * afterwards.
+ * @brief timed_join_or_detach	Join the threads or detach those that don't finish within the
+ * specified duration
+ * @param threads				list of threads. Guaranteed to be empty afterwards.
  * @param duration				duration to try joining
  */
 inline void timed_join_or_detach(
 	std::list<thread_p> &threads, std::chrono::milliseconds duration = max_join_wait) {
-	const auto start = Clock::now();
-	while (Clock::now() - start < duration && !threads.empty()) {
-		for (auto it = threads.begin(); it != threads.end();) {
-			if (try_join_once(*it))
-				it = threads.erase(it);
-			else
-				++it;
+	const auto deadline = std::chrono::steady_clock::now() + duration;
+	std::size_t detached = 0;
+	for (auto &thread : threads) {
+		if (thread->finished.wait_until(deadline) == std::future_status::ready)
+			thread->thread.join();
+		else {
+			thread->thread.detach();
+			detached++;
 		}
-		std::this_thread::sleep_for(std::chrono::milliseconds(500));
 	}
-	if (!threads.empty()) {
-		std::cout << threads.size() << " stream threads still running!" << std::endl;
-		for (auto &t : threads) t->detach();
-		threads.clear();
+	threads.clear();
+	if (detached) std::cout << detached << " stream threads still running!" << std::endl;
+}
+
+/// the manifest at the start of a striped recording (empty if the recording isn't striped)
+static session_manifest initial_manifest(
+	const std::string &filename, const recording_options &options) {
+	session_manifest manifest;
+	if (options.shards.empty()) return manifest;
+	std::error_code ec;
+	if (options.resume && std::filesystem::exists(manifest_filename(filename), ec))
+		// continue the session, including the streams recorded so far
+		manifest = read_manifest(manifest_filename(filename));
+	else {
+		manifest.session_id = new_session_id();
+		manifest.session_start = lsl::local_clock();
+	}
+	// shards in the manifest's directory (or below) are listed with relative paths
+	const auto dir = std::filesystem::absolute(filename).parent_path();
+	manifest.shards.resize(options.shards.size() + 1);
+	for (std::size_t i = 0; i < manifest.shards.size(); ++i) {
+		const auto file = std::filesystem::absolute(i ? options.shards[i - 1].filename : filename);
+		const auto relative = file.lexically_relative(dir);
+		manifest.shards[i].filename =
+			relative.empty() || *relative.begin() == ".." ? file.string() : relative.string();
 	}
+	return manifest;
+}
+
+/// the header of the decimated companion of a stream (with float samples at the lower rate)
+static std::string decimated_header(
+	const std::string &header_xml, const decimator &filter, streamid_t source) {
+	std::string xml = header_xml;
+	const auto set_value = [&xml](const std::string &tag, const std::string &value) {
+		const auto begin = xml.find('<' + tag + '>'), end = xml.find("</" + tag + '>');
+		if (begin != std::string::npos && end != std::string::npos)
+			xml.replace(begin + tag.size() + 2, end - begin - tag.size() - 2, value);
+	};
+	const std::string nominal_srate = xml_value(header_xml, "nominal_srate");
+	std::ostringstream srate;
+	srate.precision(17);
+	srate << std::stod(nominal_srate.empty() ? "0" : nominal_srate) / filter.factor();
+	set_value("name", xml_value(header_xml, "name") + "_decimated");
+	set_value("source_id", xml_value(header_xml, "source_id") + "_decimated");
+	set_value("nominal_srate", srate.str());
+	set_value("channel_format", "float32");
+	const std::string decimation =
+		"<decimation><factor>" + std::to_string(filter.factor()) + "</factor><taps>" +
+		std::to_string(filter.taps().size()) + "</taps><source_stream_id>" +
+		std::to_string(source) + "</source_stream_id></decimation>";
+	insert_into_desc(xml, decimation);
+	return xml;
+}
+
+/// the file header fields of a shard (none if the recording isn't striped)
+static std::string header_fields(const session_manifest &manifest, std::size_t shard) {
+	if (manifest.shards.empty()) return std::string();
+	return shard_header_fields(
+		manifest.session_id, manifest.session_start, shard, manifest.shards.size());
+}
+
+/// the exports' file names without the stream name: the recording's without the extension
+static std::string export_base(const std::string &filename) {
+	const std::filesystem::path path(filename);
+	return (path.parent_path() / path.stem()).string();
+}
+
+/// a stream name as part of a file name
+static std::string file_name_part(const std::string &name) {
+	std::string part;
+	for (char c : name)
+		part += std::isalnum(static_cast<unsigned char>(c)) || c == '-' || c == '_' ? c : '_';
+	return part;
 }
 
 recording::recording(const std::string &filename, const std::vector<lsl::stream_info> &streams,
 	const std::vector<std::string> &watchfor, std::map<std::string, int> syncOptions,
-	bool collect_offsets)
-	: file_(filename), offsets_enabled_(collect_offsets), unsorted_(false), streamid_(0),
+	bool collect_offsets, const recording_options &options)
+	: manifest_file_(options.shards.empty() ? std::string() : manifest_filename(filename)),
+	  manifest_(initial_manifest(filename, options)),
+	  file_(filename, options.mirror_files,
+		  options.resume ? open_mode::resume : open_mode::truncate, header_fields(manifest_, 0),
+		  options.durability),
+	  offsets_enabled_(collect_offsets), unsorted_(options.resume), streamid_(file_.max_streamid()),
 	  shutdown_(false), headers_to_finish_(0), streaming_to_finish_(0),
-	  sync_options_by_stream_(std::move(syncOptions)) {
+	  summaries_enabled_(options.signal_summaries), saturation_level_(options.saturation_level),
+	  start_at_(options.start_at), stop_at_(options.stop_at),
+	  sync_options_by_stream_(std::move(syncOptions)),
+	  channel_selections_(options.channel_selections), decimations_(options.decimations),
+	  sidecars_(options.bids_sidecars ? std::make_unique<bids_sidecars>(filename) : nullptr),
+	  export_specs_(options.exports), export_base_(export_base(filename)),
+	  inlets_(options.inlets ? options.inlets : std::make_shared<inlet_pool>()) {
+	// the shards are independent files, each with its own writer thread (and disk)
+	for (std::size_t i = 0; i < options.shards.size(); ++i) {
+		shards_.emplace_back(new XDFWriter(options.shards[i].filename, {},
+			options.resume ? open_mode::resume : open_mode::truncate,
+			header_fields(manifest_, i + 1), options.durability));
+		shard_queries_.push_back(options.shards[i].query);
+		// stream ids are unique across all shards
+		if (shards_.back()->max_streamid() > streamid_) streamid_ = shards_.back()->max_streamid();
+	}
+	for (std::size_t i = 0; i <= shards_.size(); ++i) {
+		XDFWriter &file = shard_file(i);
+		file.set_spill_budget(
+			options.spill_budget, options.spill_alarm, options.write_latency_alarm);
+		file.set_interleaving(options.interleave_window, options.interleave_buffer);
+		if (options.watermark) file.set_watermark();
+		if (options.integrity) file.set_integrity();
+	}
+	if (!manifest_file_.empty()) write_manifest(manifest_file_, manifest_);
+	if (!options.tap_name.empty()) {
+		try {
+			file_.enable_tap(options.tap_name, options.tap_size);
+		} catch (std::exception &e) {
+			std::cerr << "Warning: the shared memory tap is disabled: " << e.what() << std::endl;
+		}
+	}
+	if (start_at_ > 0 && start_at_ < lsl::local_clock())
+		std::cerr << "Warning: the scheduled start has passed, the recording starts with the "
+					 "first sample that is received."
+				  << std::endl;
 	// create a recording thread for each stream
 	for (const auto &stream : streams)
-		stream_threads_.emplace_back(
-			new std::thread(&recording::record_from_streaminfo, this, stream, true));
+		if (auto thread = start_stream(stream, true))
+			stream_threads_.push_back(std::move(thread));
 	// create a resolve-and-record thread for each item in the watchlist
 	for (const auto &query : watchfor)
 		stream_threads_.emplace_back(
-			new std::thread(&recording::record_from_query_results, this, query));
+			spawn_thread(&recording::record_from_query_results, this, query));
 	// create a boundary chunk writer thread
-	boundary_thread_ = std::make_unique<std::thread>(&recording::record_boundaries, this);
+	boundary_thread_ = spawn_thread(&recording::record_boundaries, this);
 }
 
 recording::~recording() {
 	try {
 		// set the shutdown flag (from now on no more new streams)
-		shutdown_ = true;
+		{
+			std::lock_guard<std::mutex> lock(threads_mut_);
+			signal_shutdown();
+		}
 
 		// stop the threads
 		timed_join_or_detach(stream_threads_, max_join_wait);
-		if (!timed_join(boundary_thread_, max_join_wait + boundary_interval)) {
+		if (!timed_join(boundary_thread_, max_join_wait)) {
 			std::cout << "boundary_thread didn't finish in time!" << std::endl;
-			boundary_thread_->detach();
+			boundary_thread_->thread.detach();
+		}
+		if (sidecars_) {
+			try {
+				for (const auto &sidecar : sidecars_->write())
+					std::cout << "Wrote " << sidecar << std::endl;
+			} catch (std::exception &e) {
+				std::cerr << "Warning: the BIDS sidecars are incomplete: " << e.what()
+						  << std::endl;
+			}
 		}
 		std::cout << "Closing the file." << std::endl;
+		for (auto &shard : shards_) shard->close();
+		file_.close();
 	} catch (std::exception &e) {
 		std::cout << "Error while closing the recording: " << e.what() << std::endl;
 	}
@@ -118,7 +245,115 @@ recording::~recording() {
 
 void recording::requestStop() noexcept
 {
-	shutdown_ = true;
+	signal_shutdown();
+}
+
+void recording::signal_shutdown() noexcept {
+	{
+		std::lock_guard<std::mutex> lock(shutdown_mut_);
+		shutdown_ = true;
+	}
+	shutdown_cv_.notify_all();
+}
+
+bool recording::wait_for_shutdown(
+	std::chrono::steady_clock::duration timeout, const std::atomic<bool> *stop) {
+	std::unique_lock<std::mutex> lock(shutdown_mut_);
+	return shutdown_cv_.wait_for(lock, timeout, [&]() { return shutdown_ || (stop && *stop); });
+}
+
+std::vector<stream_summary> recording::signal_summaries() const {
+	std::vector<stream_summary> result;
+	std::lock_guard<std::mutex> lock(summary_mut_);
+	for (const auto &summary : summaries_)
+		if (summary.second.window_end > 0) result.push_back(summary.second);
+	return result;
+}
+
+bool recording::add_stream(const lsl::stream_info &src) {
+	std::lock_guard<std::mutex> lock(threads_mut_);
+	if (shutdown_) return false;
+	auto thread = start_stream(src, false);
+	if (!thread) return false;
+	std::cout << "Adding the stream " << src.name() << " to the recording." << std::endl;
+	stream_threads_.push_back(std::move(thread));
+	return true;
+}
+
+std::size_t recording::remove_streams(const std::string &query) {
+	std::size_t removed = 0;
+	std::lock_guard<std::mutex> lock(active_mut_);
+	for (auto &stream : active_streams_) {
+		if (*stream.second.stop || !stream.second.info.matches_query(query.c_str())) continue;
+		std::cout << "Removing the stream " << stream.second.info.name() << " from the recording."
+				  << std::endl;
+		{
+			std::lock_guard<std::mutex> shutdown_lock(shutdown_mut_);
+			*stream.second.stop = true;
+		}
+		removed++;
+	}
+	if (removed) shutdown_cv_.notify_all();
+	return removed;
+}
+
+std::vector<lsl::stream_info> recording::recorded_streams() const {
+	std::vector<lsl::stream_info> result;
+	std::lock_guard<std::mutex> lock(active_mut_);
+	for (const auto &stream : active_streams_)
+		if (!*stream.second.stop) result.push_back(stream.second.info);
+	return result;
+}
+
+thread_p recording::start_stream(const lsl::stream_info &src, bool phase_locked) {
+	auto stop = std::make_shared<std::atomic<bool>>(false);
+	{
+		std::lock_guard<std::mutex> lock(active_mut_);
+		if (!active_streams_.emplace(src.uid(), active_stream{src, stop}).second) return nullptr;
+	}
+	// streams that start late (or end early) are out of order in the file
+	if (!phase_locked) unsorted_ = true;
+	return spawn_thread(&recording::record_from_streaminfo, this, src, phase_locked, stop);
+}
+
+bool recording::cut_finished() const {
+	const double stop_at = stop_at_;
+	if (stop_at <= 0 || lsl::local_clock() < stop_at) return false;
+	std::lock_guard<std::mutex> lock(active_mut_);
+	return active_streams_.empty();
+}
+
+std::vector<stream_health> recording::stream_health_statistics() const {
+	std::vector<stream_health> result;
+	std::lock_guard<std::mutex> lock(health_mut_);
+	for (const auto &health : health_) result.push_back(health.second);
+	return result;
+}
+
+std::vector<sink_stats> recording::sink_statistics() const {
+	auto stats = file_.sink_statistics();
+	for (const auto &shard : shards_) {
+		const auto shard_stats = shard->sink_statistics();
+		stats.insert(stats.end(), shard_stats.begin(), shard_stats.end());
+	}
+	return stats;
+}
+
+std::size_t recording::shard_for(const lsl::stream_info &src) {
+	for (std::size_t i = 0; i < shard_queries_.size(); ++i)
+		if (src.matches_query(shard_queries_[i].c_str())) return i + 1;
+	return 0;
+}
+
+void recording::add_to_manifest(std::size_t shard, streamid_t streamid, const std::string &name) {
+	if (manifest_file_.empty()) return;
+	std::lock_guard<std::mutex> lock(manifest_mut_);
+	manifest_.shards[shard].streams.emplace_back(streamid, name);
+	try {
+		write_manifest(manifest_file_, manifest_);
+	} catch (std::exception &e) {
+		std::cerr << "Warning: " << e.what() << std::endl;
+	}
 }
 
 void recording::record_from_query_results(const std::string &query) {
@@ -127,9 +362,10 @@ void recording::record_from_query_results(const std::string &query) {
 		std::set<std::string> known_source_ids; // set of previously seen source id's
 		std::list<thread_p> threads;			// our spawned threads
 		std::cout << "Watching for a stream with properties " << query << std::endl;
-		while (!shutdown_) {
-			// periodically re-resolve the query
-			const std::vector<lsl::stream_info> results = lsl::resolve_stream(query, 0, resolve_interval);
+		// resolves in the background, so checking for new streams doesn't block
+		lsl::continuous_resolver resolver(query, resolve_interval);
+		while (!wait_for_shutdown(watchlist_interval)) {
+			const std::vector<lsl::stream_info> results = resolver.results();
 			// for each result...
 			for (const auto &result : results) {
 				// if it is a new stream...
@@ -141,9 +377,9 @@ void recording::record_from_query_results(const std::string &query) {
 							(!known_source_ids.count(result.source_id()))) {
 						std::cout << "Found a new stream named " << result.name()
 								  << ", adding it to the recording." << std::endl;
-						// start a new recording thread
-						threads.emplace_back(new std::thread(
-							&recording::record_from_streaminfo, this, result, false));
+						// start a new recording thread (unless it was added by hand)
+						if (auto thread = start_stream(result, false))
+							threads.push_back(std::move(thread));
 						// ... and add it to the lists of known id's
 						known_uids.insert(result.uid());
 						if (!result.source_id().empty())
@@ -158,26 +394,34 @@ void recording::record_from_query_results(const std::string &query) {
 	}
 }
 
-void recording::record_from_streaminfo(const lsl::stream_info &src, bool phase_locked) {
+void recording::record_from_streaminfo(const lsl::stream_info &src, bool phase_locked,
+	std::shared_ptr<std::atomic<bool>> stop) {
 	try {
 		double first_timestamp, last_timestamp;
 		uint64_t sample_count = 0;
 		// obtain a fresh streamid
 		streamid_t streamid = fresh_streamid();
+		// and the file to record into
+		const std::size_t shard = shard_for(src);
+		XDFWriter &file = shard_file(shard);
 
-		inlet_p in;
+		std::unique_ptr<inlet_subscription> in;
+		std::unique_ptr<channel_selection> channels;
+		std::unique_ptr<companion_stream> companion;
+		std::shared_ptr<eeg_export> exporter;
 
 		// --- headers phase
 		try {
 			enter_headers_phase(phase_locked);
 
-			// open an inlet to read from (and subscribe to data immediately)
-			in.reset(new lsl::stream_inlet(src));
+			// open an inlet to read from (or join the one of another recording of the stream)
+			// and subscribe to data immediately
 			auto it = sync_options_by_stream_.find(src.name() + " (" + src.hostname() + ")");
-			if (it != sync_options_by_stream_.end()) in->set_postprocessing(it->second);
+			in = std::make_unique<inlet_subscription>(
+				inlets_->acquire(src, it != sync_options_by_stream_.end() ? it->second : -1));
 
 			try {
-				in->open_stream(max_open_wait);
+				in->inlet().open_stream(max_open_wait);
 				std::cout << "Opened the stream " << src.name() << "." << std::endl;
 			} catch (lsl::timeout_error &) {
 				std::cout
@@ -187,7 +431,57 @@ void recording::record_from_streaminfo(const lsl::stream_info &src, bool phase_l
 			}
 
 			// retrieve the stream header & get its XML version
-			file_.write_stream_header(streamid, in->info().as_xml());
+			const std::string header = in->inlet().info().as_xml();
+			// with only the selected channels of a wide stream
+			auto selection = channel_selections_.find(src.name() + " (" + src.hostname() + ")");
+			if (selection != channel_selections_.end()) {
+				try {
+					channels = std::make_unique<channel_selection>(selection->second, header);
+				} catch (std::invalid_argument &e) {
+					std::cerr << "Recording all channels of " << src.name() << ": " << e.what()
+							  << std::endl;
+				}
+			}
+			if (!channels)
+				channels =
+					std::make_unique<channel_selection>(std::vector<std::string>(), header);
+			const std::string recorded_header = channels->rewrite_header(header);
+			file.write_stream_header(streamid, recorded_header);
+			add_to_manifest(shard, streamid, src.name());
+			if (sidecars_) sidecars_->add_stream(streamid, recorded_header);
+
+			// and the header of its decimated companion
+			auto decimation = decimations_.find(src.name() + " (" + src.hostname() + ")");
+			if (decimation != decimations_.end() &&
+				(src.channel_format() == lsl::cf_string || src.nominal_srate() <= 0 ||
+					decimation->second < 2))
+				std::cerr << "Not decimating " << src.name()
+						  << ": only regular numeric streams can be decimated, by at least 2"
+						  << std::endl;
+			else if (decimation != decimations_.end()) {
+				companion.reset(new companion_stream{fresh_streamid(),
+					decimator(decimation->second,
+						static_cast<uint32_t>(channels->channels().size()))});
+				file.write_stream_header(companion->streamid,
+					decimated_header(recorded_header, companion->filter, streamid));
+				add_to_manifest(shard, companion->streamid, src.name() + "_decimated");
+			}
+
+			// and start its live export
+			auto exported = export_specs_.find(src.name() + " (" + src.hostname() + ")");
+			if (exported != export_specs_.end()) {
+				try {
+					exporter = std::make_shared<eeg_export>(
+						export_base_ + '_' + file_name_part(src.name()), exported->second,
+						recorded_header);
+					std::lock_guard<std::mutex> lock(exports_mut_);
+					exports_[streamid] = exporter;
+					std::cout << "Exporting " << src.name() << " to "
+							  << exporter->filenames().front() << std::endl;
+				} catch (std::exception &e) {
+					std::cerr << "Not exporting " << src.name() << ": " << e.what() << std::endl;
+				}
+			}
 			std::cout << "Received header for stream " << src.name() << "." << std::endl;
 
 			leave_headers_phase(phase_locked);
@@ -207,33 +501,63 @@ void recording::record_from_streaminfo(const lsl::stream_info &src, bool phase_l
 			enter_streaming_phase(phase_locked);
 			std::cout << "Started data collection for stream " << src.name() << "." << std::endl;
 
-			const double nominal_srate = in->info().nominal_srate();
+			const double nominal_srate = in->inlet().info().nominal_srate();
+			{
+				// room for an hour of offsets, the buffer grows for longer recordings
+				const std::size_t expected = offsets_enabled_ ? 3600 / offset_interval.count() : 0;
+				std::lock_guard<std::mutex> lock(footer_mut_);
+				footers_.emplace(streamid, footer_builder(expected));
+				if (companion) footers_.emplace(companion->streamid, footer_builder(expected));
+			}
+			{
+				std::lock_guard<std::mutex> lock(health_mut_);
+				auto &health = health_[streamid];
+				health.streamid = streamid;
+				health.name = src.name();
+				health.hostname = src.hostname();
+				health.nominal_srate = nominal_srate;
+			}
+			if (summaries_enabled_ && src.channel_format() != lsl::cf_string) {
+				std::lock_guard<std::mutex> lock(summary_mut_);
+				auto &summary = summaries_[streamid];
+				summary.streamid = streamid;
+				summary.name = src.name();
+				summary.type = src.type();
+				summary.source_id = src.source_id();
+				summary.hostname = src.hostname();
+			}
 
 			// now write the actual sample chunks...
 			switch (src.channel_format()) {
 			case lsl::cf_int8:
-				typed_transfer_loop<char>(streamid, nominal_srate, in, first_timestamp,
-					last_timestamp, sample_count);
+				typed_transfer_loop<char>(file, streamid, nominal_srate, *in, *channels,
+					companion.get(), exporter.get(), *stop, first_timestamp, last_timestamp,
+					sample_count);
 				break;
 			case lsl::cf_int16:
-				typed_transfer_loop<int16_t>(streamid, nominal_srate, in, first_timestamp,
-					last_timestamp, sample_count);
+				typed_transfer_loop<int16_t>(file, streamid, nominal_srate, *in, *channels,
+					companion.get(), exporter.get(), *stop, first_timestamp, last_timestamp,
+					sample_count);
 				break;
 			case lsl::cf_int32:
-				typed_transfer_loop<int32_t>(streamid, nominal_srate, in, first_timestamp,
-					last_timestamp, sample_count);
+				typed_transfer_loop<int32_t>(file, streamid, nominal_srate, *in, *channels,
+					companion.get(), exporter.get(), *stop, first_timestamp, last_timestamp,
+					sample_count);
 				break;
 			case lsl::cf_float32:
-				typed_transfer_loop<float>(streamid, nominal_srate, in, first_timestamp,
-					last_timestamp, sample_count);
+				typed_transfer_loop<float>(file, streamid, nominal_srate, *in, *channels,
+					companion.get(), exporter.get(), *stop, first_timestamp, last_timestamp,
+					sample_count);
 				break;
 			case lsl::cf_double64:
-				typed_transfer_loop<double>(streamid, nominal_srate, in, first_timestamp,
-					last_timestamp, sample_count);
+				typed_transfer_loop<double>(file, streamid, nominal_srate, *in, *channels,
+					companion.get(), exporter.get(), *stop, first_timestamp, last_timestamp,
+					sample_count);
 				break;
 			case lsl::cf_string:
-				typed_transfer_loop<std::string>(streamid, nominal_srate, in,
-					first_timestamp, last_timestamp, sample_count);
+				typed_transfer_loop<std::string>(file, streamid, nominal_srate, *in, *channels,
+					companion.get(), exporter.get(), *stop, first_timestamp, last_timestamp,
+					sample_count);
 				break;
 			default:
 				// unsupported channel format
@@ -244,31 +568,67 @@ void recording::record_from_streaminfo(const lsl::stream_info &src, bool phase_l
 			leave_streaming_phase(phase_locked);
 		} catch (std::exception &) {
 			leave_streaming_phase(phase_locked);
+			std::lock_guard<std::mutex> lock(summary_mut_);
+			summaries_.erase(streamid);
 			throw;
 		}
+		{
+			std::lock_guard<std::mutex> lock(summary_mut_);
+			summaries_.erase(streamid);
+		}
 
 		// --- footers phase
+		// a stream that was removed writes its footer right away instead of waiting for the others
+		if (*stop && !shutdown_) {
+			phase_locked = false;
+			unsorted_ = true;
+		}
 		try {
 			enter_footers_phase(phase_locked);
 
-			// now generate the [StreamFooter] contents
-			std::ostringstream footer;
-			footer.precision(16);
-			// [Content]
-			footer << "<?xml version=\"1.0\"?><info><first_timestamp>" << first_timestamp
-				   << "</first_timestamp><last_timestamp>" << last_timestamp
-				   << "</last_timestamp><sample_count>" << sample_count << "</sample_count>";
-			footer << "<clock_offsets>";
+			// now complete the [StreamFooter] that collected the clock offsets while recording
+			std::string health;
 			{
-				// including the clock_offset list
-				std::lock_guard<std::mutex> lock(offset_mut_);
-				for (const auto pair : offset_lists_[streamid]) {
-					footer << "<offset><time>" << pair.first << "</time><value>" << pair.second
-						   << "</value></offset>";
+				// with a summary of the timing problems
+				std::lock_guard<std::mutex> lock(health_mut_);
+				health = health_to_xml(health_[streamid]);
+			}
+			const auto take_footer = [this](streamid_t id) {
+				footer_builder footer(0);
+				std::lock_guard<std::mutex> lock(footer_mut_);
+				auto it = footers_.find(id);
+				if (it != footers_.end()) {
+					footer = std::move(it->second);
+					footers_.erase(it);
 				}
-				footer << "</clock_offsets></info>";
+				return footer;
+			};
+			footer_builder footer = take_footer(streamid);
+			file.write_stream_footer(
+				streamid, footer, first_timestamp, last_timestamp, sample_count, health);
+			if (sidecars_)
+				sidecars_->finish_stream(streamid, first_timestamp, last_timestamp, sample_count);
+			if (companion) {
+				footer_builder companion_footer = take_footer(companion->streamid);
+				file.write_stream_footer(companion->streamid, companion_footer,
+					companion->first_timestamp, companion->last_timestamp,
+					companion->sample_count);
+			}
+			// the export writes what's still queued and completes its files
+			if (exporter) {
+				{
+					std::lock_guard<std::mutex> lock(exports_mut_);
+					exports_.erase(streamid);
+				}
+				const std::string export_name = exporter->filenames().front();
+				const uint64_t dropped = exporter->dropped_samples();
+				exporter.reset();
+				std::cout << "Completed the export " << export_name << std::endl;
+				if (dropped)
+					std::cerr << "Warning: " << dropped << " samples of " << src.name()
+							  << " were replaced by zeros in the export (the disk was too slow)"
+							  << std::endl;
 			}
-			file_.write_stream_footer(streamid, footer.str());
 
 			std::cout << "Wrote footer for stream " << src.name() << "." << std::endl;
 			leave_footers_phase(phase_locked);
@@ -279,42 +639,67 @@ void recording::record_from_streaminfo(const lsl::stream_info &src, bool phase_l
 	} catch (std::exception &e) {
 		std::cout << "Error in the record_from_streaminfo thread: " << e.what() << std::endl;
 	}
+	// the stream can be added again
+	std::lock_guard<std::mutex> lock(active_mut_);
+	auto it = active_streams_.find(src.uid());
+	if (it != active_streams_.end() && it->second.stop == stop) active_streams_.erase(it);
+}
+
+void recording::export_markers(streamid_t streamid, const double *timestamps,
+	const std::string *samples, std::size_t n_samples, uint32_t n_channels) {
+	std::vector<std::pair<std::shared_ptr<eeg_export>, double>> exports;
+	{
+		// the offsets map each time stamp into this computer's clock, then into the export's
+		std::lock_guard<std::mutex> lock(exports_mut_);
+		if (exports_.empty()) return;
+		const auto offset = [this](streamid_t id) {
+			auto it = clock_offsets_.find(id);
+			return it != clock_offsets_.end() ? it->second : 0.0;
+		};
+		for (const auto &entry : exports_)
+			exports.emplace_back(entry.second, offset(streamid) - offset(entry.first));
+	}
+	for (const auto &entry : exports)
+		for (std::size_t s = 0; s < n_samples; ++s)
+			entry.first->push_marker(timestamps[s] + entry.second, samples[s * n_channels]);
 }
 
 void recording::record_boundaries() {
 	try {
-		auto next_boundary = Clock::now() + boundary_interval;
-		while (!shutdown_) {
-			std::this_thread::sleep_for(std::chrono::milliseconds(500));
-			if (Clock::now() > next_boundary) {
-				file_.write_boundary_chunk();
-				next_boundary = Clock::now() + boundary_interval;
-			}
-		}
+		while (!wait_for_shutdown(boundary_interval))
+			for (std::size_t i = 0; i <= shards_.size(); ++i) shard_file(i).write_boundary_chunk();
 	} catch (std::exception &e) {
 		std::cout << "Error in the record_boundaries thread: " << e.what() << std::endl;
 	}
 }
 
-void recording::record_offsets(
-	streamid_t streamid, const inlet_p &in, std::atomic<bool> &offset_shutdown) noexcept {
+void recording::record_offsets(XDFWriter &file, streamid_t streamid, streamid_t companion,
+	const inlet_p &in, std::atomic<bool> &offset_shutdown) noexcept {
 	try {
-		while (!shutdown_ && !offset_shutdown) {
-			// sleep for the interval
-			std::this_thread::sleep_for(offset_interval);
+		// wait for the interval (or the end of the recording)
+		while (!wait_for_shutdown(offset_interval, &offset_shutdown)) {
 			// query the time offset
 			double offset, now;
 			try {
-				offset = in->time_correction(2);
+				offset = in->inlet().time_correction(2);
 				now = lsl::local_clock();
 			} catch (lsl::timeout_error &) {
 				std::cerr << "Timeout in time correction query for stream " << streamid
 						  << std::endl;
+				continue;
 			}
-			file_.write_stream_offset(streamid, now, offset);
-			// also append to the offset lists
-			std::lock_guard<std::mutex> lock(offset_mut_);
-			offset_lists_[streamid].emplace_back(now - offset, offset);
+			// the companion has the same clock as its stream
+			for (const streamid_t id : {streamid, companion}) {
+				if (!id) continue;
+				file.write_stream_offset(id, now, offset);
+				// also append to the stream's footer
+				std::lock_guard<std::mutex> lock(footer_mut_);
+				auto it = footers_.find(id);
+				if (it != footers_.end()) it->second.add_offset(now - offset, offset);
+			}
+			if (sidecars_) sidecars_->set_clock_offset(streamid, offset);
+			std::lock_guard<std::mutex> lock(exports_mut_);
+			clock_offsets_[streamid] = offset;
 		}
 	} catch (std::exception &e) {
 		std::cout << "Error in the record_offsets thread: " << e.what() << std::endl;
@@ -365,34 +750,102 @@ void recording::enter_footers_phase(bool phase_locked) {
 }
 
 template <class T>
-void recording::typed_transfer_loop(streamid_t streamid, double srate, const inlet_p &in,
-	double &first_timestamp, double &last_timestamp, uint64_t &sample_count) {
+void recording::typed_transfer_loop(XDFWriter &file, streamid_t streamid, double srate,
+	inlet_subscription &in, const channel_selection &channels, companion_stream *companion,
+	eeg_export *exporter, const std::atomic<bool> &stop, double &first_timestamp,
+	double &last_timestamp, uint64_t &sample_count) {
 	// optionally start an offset collection thread for this stream
 	std::atomic<bool> offset_shutdown{false};
-	thread_p offset_thread(offsets_enabled_ ? new std::thread(&recording::record_offsets, this,
-												  streamid, in, std::ref(offset_shutdown))
-											: nullptr);
+	thread_p offset_thread(offsets_enabled_
+							   ? spawn_thread(&recording::record_offsets, this, std::ref(file),
+									 streamid, companion ? companion->streamid : 0, in.shared(),
+									 std::ref(offset_shutdown))
+							   : nullptr);
 	try {
 		double sample_interval = srate ? 1.0 / srate : 0;
+		const uint32_t n_channels = in.inlet().get_channel_count();
+		// the recorded channels (all, unless there's a channel selection for the stream)
+		const auto n_recorded = static_cast<uint32_t>(channels.channels().size());
+		std::vector<T> gathered;
+		// the decimated companion's samples of the current chunk
+		std::vector<float> decimated;
+		std::vector<double> decimated_timestamps;
+
+		// signal statistics (numeric streams only), summarized every summary_interval
+		constexpr bool numeric = std::is_arithmetic<T>::value;
+		using stats_t = channel_stats<std::conditional_t<numeric, T, double>>;
+		std::unique_ptr<stats_t> stats;
+		if (numeric && summaries_enabled_)
+			stats = std::make_unique<stats_t>(n_recorded, saturation_level_);
+		auto last_summary = Clock::now();
+
+		// timing problems, checked on every chunk and published right away
+		health_monitor health(srate);
+
+		// the scheduled start and stop are in this computer's clock, the time stamps in the
+		// sender's (unless the inlet synchronizes them); the offset is measured while arming, so
+		// the cut itself is only a comparison
+		double cut_offset = 0;
+		bool offset_known = in.shared()->postprocessing() >= 0 &&
+							(in.shared()->postprocessing() & lsl::post_clocksync);
+		const auto clock_offset = [&]() {
+			if (!offset_known) {
+				try {
+					cut_offset = in.inlet().time_correction(max_cut_wait);
+				} catch (lsl::timeout_error &) {
+					std::cerr << "Timeout in time correction query for stream " << streamid
+							  << ", it's cut without the clock offset" << std::endl;
+				}
+				offset_known = true;
+			}
+			return cut_offset;
+		};
+		if (start_at_ > 0 || stop_at_ > 0) clock_offset();
+		bool cut = false; // whether the stream has reached the scheduled stop
 
-		// temporary data
-		std::vector<T> chunk;
+		// the chunks are shared with the other recordings of the stream, so the samples are
+		// written from the shared chunk and only the time stamps are copied for the deduction
 		std::vector<double> timestamps;
-
-		// Pull the first sample
-		first_timestamp = 0.0;
-		while(!shutdown_ && first_timestamp == 0.0)
-			first_timestamp = last_timestamp = in->pull_sample(chunk, 4.0);
-		if (!shutdown_) {
-			timestamps.push_back(first_timestamp);
-			file_.write_data_chunk(streamid, timestamps, chunk, (uint32_t)in->get_channel_count());
-			sample_count += timestamps.size();
-		}
-
-		auto next_pull = Clock::now();
-		while (!shutdown_) {
-			// get a chunk from the stream
-			in->pull_chunk_multiplexed(chunk, &timestamps, 1e-6);
+		const auto transfer = [&](const typed_chunk<T> &chunk) {
+			if (chunk.clock_reset) health.clock_reset();
+			health.update(chunk.timestamps.data(), chunk.timestamps.size(), chunk.pulled_at);
+			{
+				std::lock_guard<std::mutex> lock(health_mut_);
+				auto it = health_.find(streamid);
+				if (it != health_.end()) health.summarize(it->second);
+			}
+			// the samples to write: from the scheduled start (until the first one is written) up
+			// to the scheduled stop
+			std::size_t begin = 0, end = chunk.timestamps.size();
+			if (start_at_ > 0 && sample_count == 0)
+				while (begin < end && chunk.timestamps[begin] + clock_offset() < start_at_) ++begin;
+			const double stop_at = stop_at_;
+			if (stop_at > 0)
+				for (std::size_t i = begin; i < end; ++i)
+					if (chunk.timestamps[i] + clock_offset() >= stop_at) {
+						end = i;
+						cut = true;
+						break;
+					}
+			if (begin == end) return;
+			const T *data = chunk.data.data() + begin * n_channels;
+			if (!channels.all()) {
+				channels.gather(data, end - begin, gathered);
+				data = gathered.data();
+			}
+			if constexpr (numeric) {
+				if (stats) {
+					stats->update(data, end - begin);
+					const auto now = Clock::now();
+					if (now - last_summary >= summary_interval) {
+						publish_summary(streamid, *stats,
+							std::chrono::duration<double>(now - last_summary).count());
+						last_summary = now;
+					}
+				}
+			}
+			if (sample_count == 0) first_timestamp = chunk.timestamps[begin];
+			timestamps.assign(chunk.timestamps.begin() + begin, chunk.timestamps.begin() + end);
 			// for each sample...
 			for (double &ts : timestamps) {
 				// if the time stamp can be deduced from the previous one...
@@ -403,17 +856,91 @@ void recording::typed_transfer_loop(streamid_t streamid, double srate, const inl
 					last_timestamp = ts;
 			}
 			// write the actual chunk
-			file_.write_data_chunk(streamid, timestamps, chunk, in->get_channel_count());
+			file.write_data_chunk(
+				streamid, timestamps, data, static_cast<uint32_t>(timestamps.size()), n_recorded);
+			if constexpr (numeric) {
+				if (companion) {
+					decimated.clear();
+					decimated_timestamps.clear();
+					companion->filter.process(data, chunk.timestamps.data() + begin, end - begin,
+						decimated, decimated_timestamps);
+					if (!decimated_timestamps.empty()) {
+						if (!companion->sample_count)
+							companion->first_timestamp = decimated_timestamps.front();
+						companion->last_timestamp = decimated_timestamps.back();
+						companion->sample_count += decimated_timestamps.size();
+						file.write_data_chunk(
+							companion->streamid, decimated_timestamps, decimated, n_recorded);
+					}
+				}
+				if (exporter)
+					exporter->push_samples(data, chunk.timestamps.data() + begin, end - begin);
+			} else {
+				if (sidecars_)
+					sidecars_->add_markers(
+						streamid, chunk.timestamps.data() + begin, data, end - begin, n_recorded);
+				export_markers(
+					streamid, chunk.timestamps.data() + begin, data, end - begin, n_recorded);
+			}
 			sample_count += timestamps.size();
+		};
 
+		// wait for the first samples in short intervals, so they are recorded right away
+		std::vector<pulled_chunk_p> chunks;
+		first_timestamp = last_timestamp = 0.0;
+		do
+			in.pull<T>(chunks);
+		while (chunks.empty() && !wait_for_shutdown(first_sample_wait, &stop));
+
+		auto next_pull = Clock::now();
+		for (bool stopping = false;;) {
+			for (const auto &chunk : chunks)
+				transfer(static_cast<const typed_chunk<T> &>(*chunk));
+			chunks.clear();
+			if (stopping || cut) break;
 			next_pull += chunk_interval;
-			std::this_thread::sleep_until(next_pull);
+			// after a stop request, the samples since the last pull are still written
+			stopping = wait_for_shutdown(next_pull - Clock::now(), &stop);
+			// a stream without samples after the scheduled stop ends once it's certainly passed
+			const double stop_at = stop_at_;
+			if (stop_at > 0 && lsl::local_clock() > stop_at + max_cut_wait) stopping = true;
+			in.pull<T>(chunks);
 		}
+		if (const uint64_t dropped = in.chunks_dropped())
+			std::cerr << "Dropped " << dropped << " chunks of stream " << streamid
+					  << " that weren't pulled in time." << std::endl;
 	} catch (std::exception &e) {
 		std::cerr << "Error in transfer thread: " << e.what() << std::endl;
-		offset_shutdown = true;
-		timed_join_or_detach(offset_thread);
+		stop_offsets(offset_shutdown, offset_thread);
 		throw;
 	}
+	stop_offsets(offset_shutdown, offset_thread);
+}
+
+void recording::stop_offsets(std::atomic<bool> &offset_shutdown, thread_p &offset_thread) {
+	// the stream may end before the recording does
+	{
+		std::lock_guard<std::mutex> lock(shutdown_mut_);
+		offset_shutdown = true;
+	}
+	shutdown_cv_.notify_all();
 	timed_join_or_detach(offset_thread);
 }
+
+template <class T>
+void recording::publish_summary(streamid_t streamid, channel_stats<T> &stats, double duration) {
+	// summarize outside of the lock, so readers never wait for the statistics
+	stream_summary summary;
+	stats.summarize(summary);
+	summary.window_end = lsl::local_clock();
+	summary.duration = duration;
+	std::lock_guard<std::mutex> lock(summary_mut_);
+	auto it = summaries_.find(streamid);
+	if (it == summaries_.end()) return;
+	summary.streamid = streamid;
+	summary.name = std::move(it->second.name);
+	summary.type = std::move(it->second.type);
+	summary.source_id = std::move(it->second.source_id);
+	summary.hostname = std::move(it->second.hostname);
+	it->second = std::move(summary);
+}
@@ -1,10 +1,19 @@
 #ifndef RECORDING_H
 #define RECORDING_H
 
+#include "bidssidecar.h"
+#include "channelselection.h"
+#include "decimator.h"
+#include "eegexport.h"
+#include "sharedinlet.h"
+#include "signalstats.h"
+#include "streamhealth.h"
+#include "xdfmanifest.h"
 #include "xdfwriter.h"
 #include <atomic>
 #include <chrono>
 #include <condition_variable>
+#include <future>
 #include <iostream>
 #include <list>
 #include <lsl_cpp.h>
@@ -18,10 +27,14 @@
 const auto boundary_interval = std::chrono::seconds(10);
 // approx. interval between offset measurements
 const auto offset_interval = std::chrono::seconds(5);
-// approx. interval between resolves for outstanding streams on the watchlist, in seconds
+// time after which a stream that went offline is forgotten by the watchlist's resolver, in seconds
 const double resolve_interval = 5;
+// approx. interval between checks for new streams on the watchlist
+const auto watchlist_interval = std::chrono::milliseconds(500);
 // approx. interval between pulling chunks from outlets
 const auto chunk_interval = std::chrono::milliseconds(500);
+// approx. interval between signal summaries of each stream
+const auto summary_interval = std::chrono::seconds(1);
 // maximum waiting time for moving past the headers phase while recording
 const auto max_headers_wait = std::chrono::seconds(10);
 // maximum waiting time for moving into the footers phase while recording
@@ -31,17 +44,93 @@ const auto max_footers_wait = std::chrono::seconds(2);
 const double max_open_wait = 5;
 // maximum time that we wait to join a thread, in seconds
 const std::chrono::seconds max_join_wait(5);
+// interval between pulls while waiting for the first samples of a stream
+const auto first_sample_wait = std::chrono::milliseconds(20);
+// maximum time after a scheduled stop that a stream waits for its samples up to the stop time, in
+// seconds (an irregular stream without newer samples is cut when it has passed)
+const double max_cut_wait = 2;
 
 using streamid_t = uint32_t;
 
+// a thread that can be joined with a timeout (std::thread::join() has none)
+struct recording_thread {
+	std::thread thread;
+	std::future<void> finished; // ready as soon as the thread function has returned
+};
 // pointer to a thread
-using thread_p = std::unique_ptr<std::thread>;
-// pointer to a stream inlet
-using inlet_p = std::shared_ptr<lsl::stream_inlet>;
-// a list of clock offset estimates (time,value)
-using offset_list = std::list<std::pair<double, double>>;
-// a map from streamid to offset_list
-using offset_lists = std::map<streamid_t, offset_list>;
+using thread_p = std::unique_ptr<recording_thread>;
+// pointer to a stream inlet (shared with the other recordings of the stream)
+using inlet_p = std::shared_ptr<shared_inlet>;
+
+/// a decimated copy of a stream, written into the same file with its own stream id
+struct companion_stream {
+	streamid_t streamid;
+	decimator filter;
+	double first_timestamp = 0, last_timestamp = 0;
+	uint64_t sample_count = 0;
+};
+
+/// a separate file for the streams that match a query, e.g. on another disk
+struct shard_spec {
+	std::string query; // see lsl::stream_info::matches_query()
+	std::string filename;
+};
+
+/// settings that apply to the recording as a whole
+struct recording_options {
+	/// additional files (e.g. on another disk) that receive a copy of the recording
+	std::vector<std::string> mirror_files;
+	/// memory for buffering data while the disk stalls; beyond it, samples are dropped
+	std::size_t spill_budget = default_spill_budget;
+	/// buffered data that raises an alarm
+	std::size_t spill_alarm = default_spill_budget / 8;
+	/// duration of a single write (in seconds) that raises an alarm
+	double write_latency_alarm = 1.0;
+	/// when data is synced to the disk
+	durability_policy durability;
+	/// repair an existing, interrupted file and append to it instead of starting a new one
+	bool resume = false;
+	/// publish the committed offset in a sidecar file, so the file can be read while recording
+	bool watermark = false;
+	/// write chunk checksums and the file's SHA-256 in sidecar files (see xdfintegrity.h)
+	bool integrity = false;
+	/// name of a shared memory tap that local programs can read the samples chunks from
+	std::string tap_name;
+	/// size of the tap's ring buffer
+	std::size_t tap_size = 64 * 1024 * 1024;
+	/// hold back samples chunks up to this many seconds to write them in time order (0: off)
+	double interleave_window = 0;
+	/// memory for reordering samples chunks
+	std::size_t interleave_buffer = 64 * 1024 * 1024;
+	/// collect per-channel signal statistics of numeric streams while recording
+	bool signal_summaries = true;
+	/// absolute value at which floating point channels count as saturated (0: only integers)
+	double saturation_level = 0;
+	/// stripe the recording: streams matching a shard's query (the first that matches) go into
+	/// its file, all others into the main file; see xdfmanifest.h
+	std::vector<shard_spec> shards;
+	/// the channels to record of wide streams, by "name (hostname)" (as the sync options), see
+	/// channel_selection; the other streams are recorded with all channels
+	std::map<std::string, std::vector<std::string>> channel_selections;
+	/// write a decimated companion of these regular numeric streams into the same file, by
+	/// "name (hostname)": the decimation factor (see decimator)
+	std::map<std::string, uint32_t> decimations;
+	/// inlets shared with the other recordings in this process (nullptr: the recording has its
+	/// own), see session_host
+	std::shared_ptr<inlet_pool> inlets;
+	/// scheduled start (lsl::local_clock() of this computer, 0: right away): the streams are
+	/// opened immediately, but only the samples from this time on are written, so recordings on
+	/// several computers that were armed with the same time start with the same sample
+	double start_at = 0;
+	/// scheduled stop (0: none), see recording::set_stop_at()
+	double stop_at = 0;
+	/// write the BIDS sidecars (_eeg.json, _channels.tsv, _events.tsv) when the recording stops,
+	/// see bids_sidecars
+	bool bids_sidecars = false;
+	/// export these regular numeric streams live to BrainVision or EDF+ files next to the
+	/// recording, by "name (hostname)", with the markers of all string streams; see eeg_export
+	std::map<std::string, export_spec> exports;
+};
 
 
 /**
@@ -62,10 +151,11 @@ public:
 	 *but is not yet online, or a more generic query (e.g., "record from everything that's out
 	 *there").
 	 * @param collect_offsets Whether to collect time offset measurements periodically.
+	 * @param options Settings for the file output
 	 */
 	recording(const std::string &filename, const std::vector<lsl::stream_info> &streams,
 		const std::vector<std::string> &watchfor, std::map<std::string, int> syncOptions,
-		bool collect_offsets = true);
+		bool collect_offsets = true, const recording_options &options = recording_options());
 
 	/** Destructor.
 	 * Stops the recording and closes the file.
@@ -74,19 +164,74 @@ public:
 
 	void requestStop() noexcept;
 
+	/// throughput counters of the main file, the shards and all mirrors, including the spill alarm
+	std::vector<sink_stats> sink_statistics() const;
+
+	/// published data and reader lag of the shared memory tap
+	tap_stats tap_statistics() { return file_.tap_statistics(); }
+
+	/// reorder buffer size and added latency of the time-ordered interleaving
+	interleave_stats interleave_statistics() { return file_.interleave_statistics(); }
+
+	/// the latest signal summary of each numeric stream (updated every summary_interval)
+	std::vector<stream_summary> signal_summaries() const;
+
+	/**
+	 * @brief add_stream Start recording a stream, e.g. one that was forgotten. Its header is
+	 * written right away, the other streams continue undisturbed.
+	 * @return false if the stream is already being recorded (or the recording is stopping)
+	 */
+	bool add_stream(const lsl::stream_info &src);
+
+	/**
+	 * @brief remove_streams Stop recording the streams that match a query (see
+	 * lsl::stream_info::matches_query()), e.g. a dead one. Their footers are written right away.
+	 * @return the number of streams that are being removed
+	 */
+	std::size_t remove_streams(const std::string &query);
+
+	/// the streams that are currently being recorded
+	std::vector<lsl::stream_info> recorded_streams() const;
+
+	/// the timing problems of each stream so far (updated with every pulled chunk)
+	std::vector<stream_health> stream_health_statistics() const;
+
+	/**
+	 * @brief set_stop_at Schedule the end of the recording at an LSL time (lsl::local_clock() of
+	 * this computer). Each stream writes its samples up to (excluding) that time and then its
+	 * footer, the file is complete once cut_finished() returns true.
+	 */
+	void set_stop_at(double lsl_time) { stop_at_ = lsl_time; }
+
+	/// whether the scheduled stop has passed and all streams have been cut (and their footers
+	/// written), so the recording can be destroyed without losing samples before the stop time
+	bool cut_finished() const;
+
 private:
+	// the session and the streams in each shard of a striped recording (empty otherwise),
+	// rewritten whenever a stream is added
+	const std::string manifest_file_;
+	session_manifest manifest_;
+	std::mutex manifest_mut_; // a mutex to protect the manifest
 	// the file stream
-	XDFWriter file_; // the file output stream
+	XDFWriter file_; // the file output stream (the first shard of a striped recording)
+	// the other shards of a striped recording, each with its own writer threads
+	std::vector<std::unique_ptr<XDFWriter>> shards_;
+	std::vector<std::string> shard_queries_;
 	// static information
 	bool offsets_enabled_; // whether to collect time offset information alongside with the stream
 						   // contents
-	bool unsorted_;		   // whether this file may contain unsorted chunks (e.g., of late streams)
+	// whether this file may contain unsorted chunks (e.g., of late or removed streams)
+	std::atomic<bool> unsorted_;
 
 	// streamid allocation
 	std::atomic<streamid_t> streamid_; // the highest streamid allocated so far
 
 	// phase-of-recording state (headers, streaming data, or footers)
 	std::atomic<bool> shutdown_;   // whether we are trying to shut down
+	// signaled when shutdown_ is set, so all waiting threads react right away
+	std::condition_variable shutdown_cv_;
+	std::mutex shutdown_mut_; // the mutex for shutdown_cv_
 	uint32_t headers_to_finish_;   // the number of streams that still need to write their header
 								   // (i.e., are not yet ready to write streaming content)
 	uint32_t streaming_to_finish_; // the number of streams that still need to finish the streaming
@@ -99,17 +244,62 @@ private:
 							// recording jobs and are now ready to write a footer
 	std::mutex phase_mut_;  // a mutex to protect the phase state
 
-	// data structure to collect the time offsets for every stream
-	offset_lists
-		offset_lists_; // the clock offset lists for each stream (to be written into the footer)
-	std::mutex offset_mut_; // a mutex to protect the offset lists
+	// the footer of every stream, collecting its time offsets while recording
+	std::map<streamid_t, footer_builder> footers_;
+	std::mutex footer_mut_; // a mutex to protect the footers
+
+	// the latest signal summaries of the numeric streams
+	const bool summaries_enabled_;
+	const double saturation_level_;
+	std::map<streamid_t, stream_summary> summaries_;
+	mutable std::mutex summary_mut_; // a mutex to protect the summaries
+
+	// the timing problems of each stream, kept after the stream ends for the final counters
+	std::map<streamid_t, stream_health> health_;
+	mutable std::mutex health_mut_; // a mutex to protect the health counters
+
+	// the streams being recorded by their uid, each with a flag to remove it from the recording
+	struct active_stream {
+		lsl::stream_info info;
+		std::shared_ptr<std::atomic<bool>> stop;
+	};
+	std::map<std::string, active_stream> active_streams_;
+	mutable std::mutex active_mut_; // a mutex to protect the active streams
 
 	// data for shutdown / final joining
 	std::list<thread_p> stream_threads_; // the spawned stream handling threads
+	std::mutex threads_mut_; // a mutex to protect stream_threads_ while streams are added
 	thread_p boundary_thread_;			 // the spawned boundary-recording thread
 
+	// the scheduled start and stop (0: none)
+	const double start_at_;
+	std::atomic<double> stop_at_;
+
 	// for enabling online sync options
 	std::map<std::string, int> sync_options_by_stream_;
+	// the channels to record of some streams
+	const std::map<std::string, std::vector<std::string>> channel_selections_;
+	// the decimation factors of the streams with a decimated companion
+	const std::map<std::string, uint32_t> decimations_;
+	// the BIDS sidecars, gathered while recording (nullptr if they aren't written)
+	std::unique_ptr<bids_sidecars> sidecars_;
+	// the streams to export, and the file names of the exports without the stream name
+	const std::map<std::string, export_spec> export_specs_;
+	const std::string export_base_;
+	// the running exports by stream id and the latest clock offsets of all streams (to place
+	// the markers of the string streams in the exported streams' clocks)
+	std::map<streamid_t, std::shared_ptr<eeg_export>> exports_;
+	std::map<streamid_t, double> clock_offsets_;
+	std::mutex exports_mut_; // a mutex to protect the exports and clock offsets
+	// the inlets, possibly shared with other recordings
+	std::shared_ptr<inlet_pool> inlets_;
+
+	/// set shutdown_ and wake up all waiting threads
+	void signal_shutdown() noexcept;
+
+	/// wait for the timeout or a stop request (or *stop), true if the recording is stopping
+	bool wait_for_shutdown(
+		std::chrono::steady_clock::duration timeout, const std::atomic<bool> *stop = nullptr);
 
 	// === recording thread functions ===
 
@@ -118,26 +308,44 @@ private:
 	/// @param query The query string
 	void record_from_query_results(const std::string &query);
 
+	/// start a recording thread for a stream, nullptr if the stream is already being recorded
+	thread_p start_stream(const lsl::stream_info &src, bool phase_locked);
+
 	/// record from a given stream (identified by its streaminfo)
 	/// @param src the stream_info from which to record
 	/// @param phase_locked whether this is a stream that is locked to the phases (1. Headers, 2.
 	/// Streaming Content, 3. Footers)
 	///                     Late-added streams (e.g. forgotten devices) are not phase-locked.
-	void record_from_streaminfo(const lsl::stream_info &src, bool phase_locked);
+	/// @param stop set to remove the stream from the recording
+	void record_from_streaminfo(const lsl::stream_info &src, bool phase_locked,
+		std::shared_ptr<std::atomic<bool>> stop);
+
 
+	/// pass the markers of a string stream on to the exports
+	void export_markers(streamid_t streamid, const double *timestamps, const std::string *samples,
+		std::size_t n_samples, uint32_t n_channels);
 
 	/// record boundary markers every few seconds
 	void record_boundaries();
 
-	// record ClockOffset chunks from a given stream
-	void record_offsets(
-		streamid_t streamid, const inlet_p &in, std::atomic<bool> &offset_shutdown) noexcept;
+	// record ClockOffset chunks from a given stream (and its decimated companion, if not 0)
+	void record_offsets(XDFWriter &file, streamid_t streamid, streamid_t companion,
+		const inlet_p &in, std::atomic<bool> &offset_shutdown) noexcept;
 
 
 	// sample collection loop for a numeric stream
 	template <class T>
-	void typed_transfer_loop(streamid_t streamid, double srate, const inlet_p &in,
-		double &first_timestamp, double &last_timestamp, uint64_t &sample_count);
+	void typed_transfer_loop(XDFWriter &file, streamid_t streamid, double srate,
+		inlet_subscription &in, const channel_selection &channels, companion_stream *companion,
+		eeg_export *exporter, const std::atomic<bool> &stop, double &first_timestamp,
+		double &last_timestamp, uint64_t &sample_count);
+
+	/// end the offset collection thread of a stream
+	void stop_offsets(std::atomic<bool> &offset_shutdown, thread_p &offset_thread);
+
+	/// publish the statistics since the last summary of a stream
+	template <class T>
+	void publish_summary(streamid_t streamid, channel_stats<T> &stats, double duration);
 
 	// === phase registration & condition checks ===
 	// writing is coordinated across threads in three phases to keep the file chunks sorted
@@ -162,6 +370,12 @@ private:
 
 	/// allocate a fresh stream id
 	streamid_t fresh_streamid() { return ++streamid_; }
+
+	/// the index of the shard that records a stream (0: the main file)
+	std::size_t shard_for(const lsl::stream_info &src);
+	XDFWriter &shard_file(std::size_t shard) { return shard ? *shards_[shard - 1] : file_; }
+	/// add a stream to the manifest of a striped recording
+	void add_to_manifest(std::size_t shard, streamid_t streamid, const std::string &name);
 };
 
 #endif
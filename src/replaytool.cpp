@@ -0,0 +1,62 @@
+#include "xdfreplay.h"
+
+#include <atomic>
+#include <csignal>
+#include <iostream>
+#include <string>
+
+// Publish the streams of a recording again as LSL outlets
+
+namespace {
+std::atomic<bool> stop{false};
+extern "C" void on_stop_signal(int) { stop = true; }
+} // namespace
+
+static int usage(const char *name) {
+	std::cout << "Usage: " << name << " [--speed=N | --max-speed] [--wait=seconds] file.xdf\n\n"
+			  << "Replay the streams of a recording as LSL outlets with the recorded intervals\n"
+			  << "between the samples, N (default 1) times faster, or as fast as possible with\n"
+			  << "--max-speed. With --wait, the replay starts once every outlet has a consumer\n"
+			  << "(or after that many seconds).\n";
+	return 1;
+}
+
+int main(int argc, char **argv) {
+	replay_options options;
+	const char *filename = nullptr;
+	for (int i = 1; i < argc; ++i) {
+		const std::string arg(argv[i]);
+		try {
+			if (arg.rfind("--speed=", 0) == 0)
+				options.speed = std::stod(arg.substr(8));
+			else if (arg == "--max-speed")
+				options.speed = 0;
+			else if (arg.rfind("--wait=", 0) == 0)
+				options.wait_for_consumers = std::stod(arg.substr(7));
+			else if (arg.rfind("--", 0) == 0 || filename)
+				return usage(argv[0]);
+			else
+				filename = argv[i];
+		} catch (std::exception &e) {
+			std::cerr << "Invalid option " << arg << ": " << e.what() << std::endl;
+			return usage(argv[0]);
+		}
+	}
+	if (!filename || options.speed < 0) return usage(argv[0]);
+
+	std::signal(SIGINT, on_stop_signal);
+	std::signal(SIGTERM, on_stop_signal);
+	try {
+		xdf_replay replay(filename);
+		for (const auto &name : replay.stream_names()) std::cout << "Publishing " << name << '\n';
+		const double start = lsl::local_clock();
+		const uint64_t samples = replay.run(options, stop);
+		std::cout << (stop ? "Stopped after " : "Replayed ") << samples << " samples of "
+				  << replay.stream_names().size() << " streams in " << lsl::local_clock() - start
+				  << " s" << std::endl;
+	} catch (std::exception &e) {
+		std::cerr << "Error: " << e.what() << std::endl;
+		return 2;
+	}
+	return 0;
+}
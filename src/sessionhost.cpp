@@ -0,0 +1,79 @@
+#include "sessionhost.h"
+#include "jsonformat.h"
+#include <sstream>
+#include <stdexcept>
+
+void session_host::start(const std::string &name, const std::string &filename,
+	const std::vector<lsl::stream_info> &streams, const std::vector<std::string> &watchfor,
+	std::map<std::string, int> sync_options, bool collect_offsets, recording_options options) {
+	std::lock_guard<std::mutex> lock(mut_);
+	if (sessions_.count(name))
+		throw std::invalid_argument("The session " + name + " is already recording.");
+	options.inlets = inlets_;
+	auto rec = std::make_shared<recording>(
+		filename, streams, watchfor, std::move(sync_options), collect_offsets, options);
+	sessions_[name] = session{filename, std::move(rec)};
+	std::cout << "Started the session " << name << " (" << filename << ")." << std::endl;
+}
+
+bool session_host::stop(const std::string &name) {
+	std::shared_ptr<recording> rec;
+	{
+		std::lock_guard<std::mutex> lock(mut_);
+		auto it = sessions_.find(name);
+		if (it == sessions_.end()) return false;
+		rec = std::move(it->second.rec);
+		sessions_.erase(it);
+	}
+	// the file is closed outside of the lock (or by the last user of find()'s result)
+	rec.reset();
+	std::cout << "Stopped the session " << name << "." << std::endl;
+	return true;
+}
+
+void session_host::stop_all() {
+	std::map<std::string, session> stopping;
+	{
+		std::lock_guard<std::mutex> lock(mut_);
+		stopping.swap(sessions_);
+	}
+	// stop all at once, then wait for the files to be closed
+	for (auto &entry : stopping) entry.second.rec->requestStop();
+	stopping.clear();
+}
+
+std::shared_ptr<recording> session_host::find(const std::string &name) const {
+	std::lock_guard<std::mutex> lock(mut_);
+	auto it = sessions_.find(name);
+	return it == sessions_.end() ? nullptr : it->second.rec;
+}
+
+std::vector<session_info> session_host::sessions() const {
+	std::vector<session_info> result;
+	std::lock_guard<std::mutex> lock(mut_);
+	for (const auto &entry : sessions_) {
+		session_info info;
+		info.name = entry.first;
+		info.filename = entry.second.filename;
+		for (const auto &stream : entry.second.rec->recorded_streams())
+			info.streams.push_back(stream.name());
+		result.push_back(std::move(info));
+	}
+	return result;
+}
+
+std::string sessions_to_json(const std::vector<session_info> &sessions) {
+	std::ostringstream out;
+	out << "{\"sessions\":[";
+	for (std::size_t i = 0; i < sessions.size(); ++i) {
+		const auto &s = sessions[i];
+		if (i) out << ',';
+		out << "{\"name\":" << json_string(s.name) << ",\"file\":" << json_string(s.filename)
+			<< ",\"streams\":[";
+		for (std::size_t j = 0; j < s.streams.size(); ++j)
+			out << (j ? "," : "") << json_string(s.streams[j]);
+		out << "]}";
+	}
+	out << "]}";
+	return out.str();
+}
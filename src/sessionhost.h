@@ -0,0 +1,64 @@
+#ifndef SESSIONHOST_H
+#define SESSIONHOST_H
+
+#include "recording.h"
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// a running session of a session_host
+struct session_info {
+	std::string name, filename;
+	std::vector<std::string> streams; // the names of the recorded streams
+};
+
+/**
+ * Several named recordings in one process, e.g. one file per subject and a joint file of a
+ * hyperscanning session. Each session has its own streams and file and is started and stopped
+ * on its own, but all of them share one inlet per stream (see shared_inlet), so a stream that is
+ * recorded into several files is only received and decoded once.
+ */
+class session_host {
+public:
+	session_host() : inlets_(std::make_shared<inlet_pool>()) {}
+	~session_host() { stop_all(); }
+
+	/// the shared inlets, for recordings that are run outside the host (recording_options::inlets)
+	const std::shared_ptr<inlet_pool> &inlets() const { return inlets_; }
+
+	/**
+	 * @brief start Start recording a session (the arguments are those of recording::recording)
+	 * @throws std::invalid_argument if a session with this name is running
+	 */
+	void start(const std::string &name, const std::string &filename,
+		const std::vector<lsl::stream_info> &streams, const std::vector<std::string> &watchfor,
+		std::map<std::string, int> sync_options, bool collect_offsets = true,
+		recording_options options = recording_options());
+
+	/// stop a session and close its file, false if there is no such session
+	bool stop(const std::string &name);
+
+	/// stop all sessions
+	void stop_all();
+
+	/// the running session with this name (nullptr if there is none)
+	std::shared_ptr<recording> find(const std::string &name) const;
+
+	std::vector<session_info> sessions() const;
+
+private:
+	struct session {
+		std::string filename;
+		std::shared_ptr<recording> rec;
+	};
+	std::shared_ptr<inlet_pool> inlets_;
+	std::map<std::string, session> sessions_;
+	mutable std::mutex mut_; // protects sessions_
+};
+
+/// the sessions as a single line of JSON, e.g. for the remote control
+std::string sessions_to_json(const std::vector<session_info> &sessions);
+
+#endif
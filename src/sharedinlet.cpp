@@ -0,0 +1,64 @@
+#include "sharedinlet.h"
+
+shared_inlet::shared_inlet(const lsl::stream_info &src, int postprocessing)
+	: inlet_(src), postprocessing_(postprocessing) {
+	if (postprocessing >= 0) inlet_.set_postprocessing(postprocessing);
+}
+
+uint64_t shared_inlet::subscribe() {
+	std::lock_guard<std::mutex> lock(mut_);
+	queues_[next_reader_];
+	return next_reader_++;
+}
+
+void shared_inlet::unsubscribe(uint64_t reader) {
+	std::lock_guard<std::mutex> lock(mut_);
+	queues_.erase(reader);
+}
+
+void shared_inlet::set_reader_budget(std::size_t max_bytes) {
+	std::lock_guard<std::mutex> lock(mut_);
+	reader_budget_ = max_bytes;
+}
+
+uint64_t shared_inlet::chunks_dropped(uint64_t reader) const {
+	std::lock_guard<std::mutex> lock(mut_);
+	auto it = queues_.find(reader);
+	return it != queues_.end() ? it->second.chunks_dropped : 0;
+}
+
+void shared_inlet::enqueue(reader_queue &queue, const pulled_chunk_p &chunk) {
+	queue.chunks.push_back(chunk);
+	queue.bytes += chunk->bytes;
+	// the newest chunk is always kept, so a reader gets the latest samples when it pulls again
+	while (queue.bytes > reader_budget_ && queue.chunks.size() > 1) {
+		queue.bytes -= queue.chunks.front()->bytes;
+		queue.chunks.pop_front();
+		queue.chunks_dropped++;
+	}
+}
+
+std::size_t shared_inlet::readers() const {
+	std::lock_guard<std::mutex> lock(mut_);
+	return queues_.size();
+}
+
+std::shared_ptr<shared_inlet> inlet_pool::acquire(const lsl::stream_info &src, int postprocessing) {
+	const std::string key = src.uid() + '/' + std::to_string(postprocessing);
+	std::lock_guard<std::mutex> lock(mut_);
+	// forget the inlets that were closed in the meantime
+	for (auto it = inlets_.begin(); it != inlets_.end();)
+		it = it->second.expired() ? inlets_.erase(it) : std::next(it);
+	auto &entry = inlets_[key];
+	auto inlet = entry.lock();
+	if (!inlet) entry = inlet = std::make_shared<shared_inlet>(src, postprocessing);
+	return inlet;
+}
+
+std::size_t inlet_pool::size() const {
+	std::lock_guard<std::mutex> lock(mut_);
+	std::size_t open = 0;
+	for (const auto &entry : inlets_)
+		if (!entry.second.expired()) open++;
+	return open;
+}
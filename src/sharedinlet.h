@@ -0,0 +1,138 @@
+#ifndef SHAREDINLET_H
+#define SHAREDINLET_H
+
+#include <cstdint>
+#include <deque>
+#include <lsl_cpp.h>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// samples pulled from an inlet, shared (read-only) by all recordings of the stream
+struct pulled_chunk {
+	std::vector<double> timestamps; // as returned by liblsl
+	bool clock_reset = false;		// the inlet reported a clock reset before this chunk
+	double pulled_at = 0;			// local_clock() when the chunk was pulled
+	std::size_t bytes = 0;			// size of the samples and timestamps
+	virtual ~pulled_chunk() = default;
+};
+template <class T> struct typed_chunk : pulled_chunk {
+	std::vector<T> data; // multiplexed samples
+};
+using pulled_chunk_p = std::shared_ptr<const pulled_chunk>;
+
+// default limit for the chunks queued for a single reader of a shared inlet
+const std::size_t default_reader_budget = 64 * 1024 * 1024;
+
+/**
+ * An inlet that several recordings read from, e.g. the per-subject and joint files of a
+ * hyperscanning session.
+ *
+ * The stream is received and decoded once: whichever reader pulls first pulls from liblsl, and
+ * the resulting chunk is queued for every subscribed reader. Readers that pull in between get the
+ * queued chunks without touching the inlet. A reader only gets the samples pulled after it
+ * subscribed. A reader that stops pulling doesn't hold on to the samples forever: once its queue
+ * exceeds the reader budget, its oldest chunks are dropped (and counted).
+ */
+class shared_inlet {
+public:
+	/// create the inlet (see inlet_pool::acquire())
+	shared_inlet(const lsl::stream_info &src, int postprocessing);
+
+	/// the inlet for everything but pulling samples (info, time corrections, open_stream())
+	lsl::stream_inlet &inlet() { return inlet_; }
+	/// the lsl::post_* flags (post_clocksync, post_dejitter, ...) the inlet was created with
+	/// (-1: liblsl's default)
+	int postprocessing() const { return postprocessing_; }
+
+	/// register a reader, the returned id is passed to pull() and unsubscribe()
+	uint64_t subscribe();
+	void unsubscribe(uint64_t reader);
+
+	/// append the chunks pulled since the reader's last call to out (after pulling from the inlet)
+	template <class T> void pull(uint64_t reader, std::vector<pulled_chunk_p> &out) {
+		std::lock_guard<std::mutex> lock(mut_);
+		auto chunk = std::make_shared<typed_chunk<T>>();
+		inlet_.pull_chunk_multiplexed(chunk->data, &chunk->timestamps, 1e-6);
+		chunk->clock_reset = inlet_.was_clock_reset();
+		chunk->pulled_at = lsl::local_clock();
+		chunk->bytes = chunk->data.size() * sizeof(T) + chunk->timestamps.size() * sizeof(double);
+		if (!chunk->timestamps.empty() || chunk->clock_reset)
+			for (auto &queue : queues_) enqueue(queue.second, chunk);
+		auto &queue = queues_[reader];
+		out.insert(out.end(), queue.chunks.begin(), queue.chunks.end());
+		queue.chunks.clear();
+		queue.bytes = 0;
+	}
+
+	/// limit the size of the chunks queued for each reader (default: default_reader_budget)
+	void set_reader_budget(std::size_t max_bytes);
+	/// the number of chunks that were dropped because the reader didn't pull in time
+	uint64_t chunks_dropped(uint64_t reader) const;
+
+	/// the number of subscribed readers
+	std::size_t readers() const;
+
+private:
+	struct reader_queue {
+		std::deque<pulled_chunk_p> chunks;
+		std::size_t bytes = 0;
+		uint64_t chunks_dropped = 0;
+	};
+	/// append a chunk, dropping the oldest ones beyond the reader budget
+	void enqueue(reader_queue &queue, const pulled_chunk_p &chunk);
+
+	lsl::stream_inlet inlet_;
+	const int postprocessing_;
+	mutable std::mutex mut_; // protects the inlet's buffer and the queues
+	std::map<uint64_t, reader_queue> queues_;
+	std::size_t reader_budget_ = default_reader_budget;
+	uint64_t next_reader_ = 0;
+};
+
+/// a reader of a shared inlet, unsubscribed on destruction
+class inlet_subscription {
+public:
+	explicit inlet_subscription(std::shared_ptr<shared_inlet> inlet)
+		: inlet_(std::move(inlet)), reader_(inlet_->subscribe()) {}
+	~inlet_subscription() { inlet_->unsubscribe(reader_); }
+	inlet_subscription(const inlet_subscription &) = delete;
+	inlet_subscription &operator=(const inlet_subscription &) = delete;
+
+	template <class T> void pull(std::vector<pulled_chunk_p> &out) {
+		inlet_->template pull<T>(reader_, out);
+	}
+	uint64_t chunks_dropped() const { return inlet_->chunks_dropped(reader_); }
+	lsl::stream_inlet &inlet() { return inlet_->inlet(); }
+	const std::shared_ptr<shared_inlet> &shared() const { return inlet_; }
+
+private:
+	std::shared_ptr<shared_inlet> inlet_;
+	const uint64_t reader_;
+};
+
+/**
+ * The shared inlets of the recordings in one process. An inlet lives as long as a recording
+ * reads from it; recordings that use the same pool share the inlet of a stream (if they use the
+ * same postprocessing flags).
+ */
+class inlet_pool {
+public:
+	/**
+	 * @brief acquire Get the stream's inlet, it is created if no recording reads from it yet
+	 * @param postprocessing lsl::post_* flags (post_clocksync, post_dejitter, ...) for
+	 * lsl::stream_inlet::set_postprocessing() (or -1)
+	 */
+	std::shared_ptr<shared_inlet> acquire(const lsl::stream_info &src, int postprocessing = -1);
+
+	/// the number of open inlets
+	std::size_t size() const;
+
+private:
+	std::map<std::string, std::weak_ptr<shared_inlet>> inlets_; // by uid and postprocessing
+	mutable std::mutex mut_;
+};
+
+#endif
@@ -0,0 +1,142 @@
+#ifndef SIGNALSTATS_H
+#define SIGNALSTATS_H
+
+#include "jsonformat.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// signal quality of one channel over the last summary window
+struct channel_summary {
+	double min, max, mean, rms;
+	bool flat;			// the value didn't change at all during the window
+	uint64_t saturated; // number of samples at the limits of the value range
+};
+
+// signal quality of all channels of a stream over the last summary window
+struct stream_summary {
+	uint32_t streamid = 0;
+	std::string name, type, source_id, hostname; // the stream's identity (see stream_key)
+	double window_end = 0; // local_clock() at the end of the window
+	double duration = 0;   // window length in seconds
+	uint64_t samples = 0;
+	std::vector<channel_summary> channels;
+};
+
+/**
+ * Running per-channel statistics (min, max, mean, RMS, flat lines, saturation) for multiplexed
+ * numeric chunks as returned by pull_chunk_multiplexed.
+ *
+ * The statistics are kept in one contiguous array of doubles per quantity (even the saturation
+ * counts), so the inner loop over the channels of a sample is branch-free and gets vectorized.
+ */
+template <typename T> class channel_stats {
+	static_assert(std::is_arithmetic<T>::value, "only numeric streams have signal statistics");
+
+public:
+	/**
+	 * @param n_channels Number of channels in the stream
+	 * @param saturation_level For floating point streams, values with an absolute value of at
+	 * least this count as saturated (0: disabled). Integer streams saturate at their type limits.
+	 */
+	explicit channel_stats(uint32_t n_channels, double saturation_level = 0)
+		: n_channels_(n_channels), min_(n_channels), max_(n_channels), sum_(n_channels),
+		  sumsq_(n_channels), saturated_(n_channels) {
+		if (std::is_integral<T>::value) {
+			upper_ = static_cast<double>(std::numeric_limits<T>::max());
+			lower_ = static_cast<double>(std::numeric_limits<T>::lowest());
+		} else if (saturation_level > 0) {
+			upper_ = saturation_level;
+			lower_ = -saturation_level;
+		}
+		reset();
+	}
+
+	/// add n_samples multiplexed samples
+	void update(const T *chunk, std::size_t n_samples) {
+		double *const min = min_.data(), *const max = max_.data(), *const sum = sum_.data(),
+					  *const sumsq = sumsq_.data();
+		double *const saturated = saturated_.data();
+		const double upper = upper_, lower = lower_;
+		for (std::size_t s = 0; s < n_samples; ++s, chunk += n_channels_) {
+			for (uint32_t c = 0; c < n_channels_; ++c) {
+				const double v = static_cast<double>(chunk[c]);
+				min[c] = v < min[c] ? v : min[c];
+				max[c] = v > max[c] ? v : max[c];
+				sum[c] += v;
+				sumsq[c] += v * v;
+				saturated[c] += (v >= upper || v <= lower) ? 1.0 : 0.0;
+			}
+		}
+		samples_ += n_samples;
+	}
+
+	/// write the statistics since the last call to out and start a new window
+	void summarize(stream_summary &out) {
+		out.samples = samples_;
+		out.channels.resize(n_channels_);
+		for (uint32_t c = 0; c < n_channels_; ++c) {
+			auto &ch = out.channels[c];
+			if (samples_) {
+				ch.min = min_[c];
+				ch.max = max_[c];
+				ch.mean = sum_[c] / samples_;
+				ch.rms = std::sqrt(sumsq_[c] / samples_);
+			} else
+				ch.min = ch.max = ch.mean = ch.rms = 0;
+			ch.flat = samples_ > 1 && min_[c] == max_[c];
+			ch.saturated = static_cast<uint64_t>(saturated_[c]);
+		}
+		reset();
+	}
+
+private:
+	void reset() {
+		std::fill(min_.begin(), min_.end(), std::numeric_limits<double>::infinity());
+		std::fill(max_.begin(), max_.end(), -std::numeric_limits<double>::infinity());
+		std::fill(sum_.begin(), sum_.end(), 0.0);
+		std::fill(sumsq_.begin(), sumsq_.end(), 0.0);
+		std::fill(saturated_.begin(), saturated_.end(), 0.0);
+		samples_ = 0;
+	}
+
+	const uint32_t n_channels_;
+	std::vector<double> min_, max_, sum_, sumsq_;
+	std::vector<double> saturated_;
+	uint64_t samples_ = 0;
+	double upper_ = std::numeric_limits<double>::infinity();
+	double lower_ = -std::numeric_limits<double>::infinity();
+};
+
+/// serialize summaries as a single line of JSON, e.g. for the remote control socket
+inline std::string summaries_to_json(const std::vector<stream_summary> &summaries) {
+	std::ostringstream out;
+	out << "{\"streams\":[";
+	for (std::size_t i = 0; i < summaries.size(); ++i) {
+		const auto &s = summaries[i];
+		if (i) out << ',';
+		out << "{\"id\":" << s.streamid << ",\"name\":" << json_string(s.name)
+			<< ",\"host\":" << json_string(s.hostname) << ",\"time\":" << json_number(s.window_end)
+			<< ",\"duration\":" << json_number(s.duration) << ",\"samples\":" << s.samples
+			<< ",\"channels\":[";
+		for (std::size_t c = 0; c < s.channels.size(); ++c) {
+			const auto &ch = s.channels[c];
+			if (c) out << ',';
+			out << "{\"min\":" << json_number(ch.min) << ",\"max\":" << json_number(ch.max)
+				<< ",\"mean\":" << json_number(ch.mean) << ",\"rms\":" << json_number(ch.rms)
+				<< ",\"flat\":" << (ch.flat ? "true" : "false")
+				<< ",\"saturated\":" << ch.saturated << '}';
+		}
+		out << "]}";
+	}
+	out << "]}";
+	return out.str();
+}
+
+#endif
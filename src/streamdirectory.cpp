@@ -0,0 +1,58 @@
+#include "streamdirectory.h"
+#include <functional>
+#include <unordered_set>
+
+std::size_t stream_key_hash::operator()(const stream_key &key) const {
+	const std::hash<std::string> hash;
+	std::size_t seed = 0;
+	for (const auto *field : {&key.name, &key.type, &key.source_id, &key.hostname})
+		seed ^= hash(*field) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+	return seed;
+}
+
+stream_key key_of(const lsl::stream_info &info) {
+	return {info.name(), info.type(), info.source_id(), info.hostname()};
+}
+
+stream_changes stream_directory::update() {
+	stream_changes changes;
+	std::unordered_set<stream_key, stream_key_hash> online;
+	for (auto &info : resolver_.results()) {
+		stream_key key = key_of(info);
+		auto it = streams_.find(key);
+		if (it == streams_.end()) {
+			changes.added.push_back(info);
+			streams_.emplace(key, std::move(info));
+		} else if (it->second.uid() != info.uid())
+			// the outlet was restarted, new recordings connect to the new one
+			it->second = std::move(info);
+		online.insert(std::move(key));
+	}
+	for (auto it = streams_.begin(); it != streams_.end();)
+		if (online.count(it->first))
+			++it;
+		else {
+			changes.removed.push_back(it->first);
+			it = streams_.erase(it);
+		}
+	return changes;
+}
+
+const lsl::stream_info *stream_directory::find(const stream_key &key) const {
+	auto it = streams_.find(key);
+	return it == streams_.end() ? nullptr : &it->second;
+}
+
+std::vector<lsl::stream_info> stream_directory::streams() const {
+	std::vector<lsl::stream_info> result;
+	result.reserve(streams_.size());
+	for (const auto &stream : streams_) result.push_back(stream.second);
+	return result;
+}
+
+std::vector<lsl::stream_info> stream_directory::matching(const std::string &query) const {
+	std::vector<lsl::stream_info> result;
+	for (const auto &stream : streams_)
+		if (stream.second.matches_query(query.c_str())) result.push_back(stream.second);
+	return result;
+}
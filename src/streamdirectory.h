@@ -0,0 +1,67 @@
+#ifndef STREAMDIRECTORY_H
+#define STREAMDIRECTORY_H
+
+#include <lsl_cpp.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/// identifies a stream across discoveries (a restarted outlet keeps its key, but not its uid)
+struct stream_key {
+	std::string name, type, source_id, hostname;
+
+	bool operator==(const stream_key &other) const {
+		return name == other.name && type == other.type && source_id == other.source_id &&
+			   hostname == other.hostname;
+	}
+};
+
+struct stream_key_hash {
+	std::size_t operator()(const stream_key &key) const;
+};
+
+/// the key of a resolved stream
+stream_key key_of(const lsl::stream_info &info);
+
+/// the streams that came online or went offline since the previous stream_directory::update()
+struct stream_changes {
+	std::vector<lsl::stream_info> added;
+	std::vector<stream_key> removed;
+
+	bool empty() const { return added.empty() && removed.empty(); }
+};
+
+/**
+ * The streams on the network, discovered in the background by an lsl::continuous_resolver and
+ * indexed by their stream_key.
+ *
+ * Unlike lsl::resolve_streams(), reading the directory never waits for the network: update()
+ * takes the resolver's current results and reports what changed, so a stream list can be updated
+ * item by item instead of being rebuilt. A stream is dropped when the resolver hasn't seen it for
+ * forget_after seconds. The directory isn't thread-safe, it's meant to be updated and read by
+ * the GUI thread.
+ */
+class stream_directory {
+public:
+	explicit stream_directory(double forget_after = 5.0) : resolver_(forget_after) {}
+
+	/// take the resolver's current results into the index, doesn't block
+	stream_changes update();
+
+	/// the stream with this key, nullptr if it's not online
+	const lsl::stream_info *find(const stream_key &key) const;
+
+	/// all streams that are online
+	std::vector<lsl::stream_info> streams() const;
+
+	/// the streams that match an LSL query (see lsl::stream_info::matches_query())
+	std::vector<lsl::stream_info> matching(const std::string &query) const;
+
+	std::size_t size() const { return streams_.size(); }
+
+private:
+	lsl::continuous_resolver resolver_;
+	std::unordered_map<stream_key, lsl::stream_info, stream_key_hash> streams_;
+};
+
+#endif
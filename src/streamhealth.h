@@ -0,0 +1,168 @@
+#ifndef STREAMHEALTH_H
+#define STREAMHEALTH_H
+
+#include "jsonformat.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// timing problems of a stream, detected while recording
+struct stream_health {
+	uint32_t streamid = 0;
+	std::string name, hostname;
+	double nominal_srate = 0;
+	uint64_t samples = 0;
+	double first_timestamp = 0, last_timestamp = 0;
+	// intervals longer than the gap threshold (regular streams only)
+	uint64_t gaps = 0;
+	uint64_t missing_samples = 0; // estimated from the lengths of the gaps
+	double max_gap = 0;			  // the longest interval between two samples, in seconds
+	uint64_t backwards = 0;		  // time stamps that are earlier than the previous one
+	// sampling rate from the time stamps of the whole recording and of the last rate window
+	double effective_srate = 0, window_srate = 0;
+	double max_rate_deviation = 0; // largest relative deviation of a window from the nominal rate
+	uint64_t clock_resets = 0;	   // the inlet reported that the source clock was reset
+	// the inlet went silent for longer than the reconnect threshold or reported a clock reset,
+	// i.e. liblsl (most likely) recovered the connection to the outlet
+	uint64_t reconnects = 0;
+
+	/// any gaps, time stamps going backwards, clock resets or reconnections
+	bool problems() const { return gaps || backwards || clock_resets || reconnects; }
+};
+
+/**
+ * Online detection of timing problems from the time stamps of the pulled chunks.
+ *
+ * Each chunk is checked with a single pass over its time stamps, so this costs about as much as
+ * the time stamp deduction in the transfer loop. The rate deviation is measured over windows of
+ * rate_window seconds (of stream time) to tell a drifting or overloaded source from jitter.
+ */
+class health_monitor {
+public:
+	/**
+	 * @param nominal_srate The stream's nominal rate (0: irregular, no gap or rate checks)
+	 * @param gap_factor An interval longer than gap_factor / nominal_srate counts as a gap
+	 * @param reconnect_silence A regular stream that delivers nothing for this many seconds (or
+	 * gap_factor sample intervals, if that's longer) and then resumes counts as reconnected
+	 * @param rate_window Length of the windows for the rate deviation, in seconds
+	 */
+	explicit health_monitor(double nominal_srate, double gap_factor = 2.0,
+		double reconnect_silence = 2.0, double rate_window = 10.0)
+		: srate_(nominal_srate), gap_threshold_(nominal_srate > 0 ? gap_factor / nominal_srate : 0),
+		  silence_threshold_(std::max(reconnect_silence, gap_threshold_)),
+		  rate_window_(rate_window) {}
+
+	/**
+	 * @brief update Check the time stamps of a pulled chunk
+	 * @param timestamps The time stamps as returned by liblsl (i.e. before they are deduced)
+	 * @param now local_clock() when the chunk was pulled
+	 */
+	void update(const double *timestamps, std::size_t n, double now) {
+		if (n == 0) return;
+		if (srate_ > 0 && last_arrival_ > 0 && now - last_arrival_ > silence_threshold_)
+			reset_pending_ = true;
+		last_arrival_ = now;
+		if (reset_pending_) h_.reconnects++;
+		reset_pending_ = false;
+
+		std::size_t i = 0;
+		if (h_.samples == 0) {
+			h_.first_timestamp = h_.last_timestamp = window_start_ = timestamps[0];
+			i = 1;
+		}
+		double last = h_.last_timestamp;
+		for (; i < n; ++i) {
+			const double interval = timestamps[i] - last;
+			if (interval < 0) h_.backwards++;
+			if (gap_threshold_ > 0 && interval > gap_threshold_) {
+				h_.gaps++;
+				h_.missing_samples +=
+					static_cast<uint64_t>(std::max(1LL, std::llround(interval * srate_)) - 1);
+			}
+			h_.max_gap = std::max(h_.max_gap, interval);
+			last = timestamps[i];
+		}
+		h_.last_timestamp = last;
+		h_.samples += n;
+
+		// rate windows end at chunk borders, so a window is at least rate_window seconds long
+		window_samples_ += n;
+		const double span = last - window_start_;
+		if (srate_ > 0 && span >= rate_window_) {
+			// the first sample of the window is its start, so it isn't counted
+			h_.window_srate = (window_samples_ - 1) / span;
+			h_.max_rate_deviation =
+				std::max(h_.max_rate_deviation, std::abs(h_.window_srate / srate_ - 1));
+			window_start_ = last;
+			window_samples_ = 1;
+		}
+	}
+
+	/// the inlet reported a clock reset (lsl::stream_inlet::was_clock_reset())
+	void clock_reset() {
+		h_.clock_resets++;
+		reset_pending_ = true;
+	}
+
+	/// copy the counters to out (the stream's identity in out is kept)
+	void summarize(stream_health &out) const {
+		const uint32_t streamid = out.streamid;
+		std::string name = std::move(out.name), hostname = std::move(out.hostname);
+		out = h_;
+		out.streamid = streamid;
+		out.name = std::move(name);
+		out.hostname = std::move(hostname);
+		out.nominal_srate = srate_;
+		if (h_.samples > 1 && h_.last_timestamp > h_.first_timestamp)
+			out.effective_srate = (h_.samples - 1) / (h_.last_timestamp - h_.first_timestamp);
+	}
+
+private:
+	const double srate_, gap_threshold_, silence_threshold_, rate_window_;
+	stream_health h_;
+	double last_arrival_ = 0;	   // local_clock() of the last chunk with samples
+	bool reset_pending_ = false;   // a clock reset that wasn't followed by samples yet
+	double window_start_ = 0;	   // time stamp of the first sample of the rate window
+	uint64_t window_samples_ = 0; // samples in the rate window, including the first
+};
+
+/// the counters as an element of the stream footer XML (appended to <info>)
+inline std::string health_to_xml(const stream_health &h) {
+	std::ostringstream out;
+	out.precision(10);
+	out << "<stream_health><gaps>" << h.gaps << "</gaps><missing_samples>" << h.missing_samples
+		<< "</missing_samples><max_gap>" << h.max_gap << "</max_gap><backwards>" << h.backwards
+		<< "</backwards><effective_srate>" << h.effective_srate
+		<< "</effective_srate><max_rate_deviation>" << h.max_rate_deviation
+		<< "</max_rate_deviation><clock_resets>" << h.clock_resets
+		<< "</clock_resets><reconnects>" << h.reconnects << "</reconnects></stream_health>";
+	return out.str();
+}
+
+/// serialize the counters of all streams as a single line of JSON, e.g. for the remote control
+inline std::string health_to_json(const std::vector<stream_health> &streams) {
+	std::ostringstream out;
+	out << "{\"streams\":[";
+	for (std::size_t i = 0; i < streams.size(); ++i) {
+		const auto &h = streams[i];
+		if (i) out << ',';
+		out << "{\"id\":" << h.streamid << ",\"name\":" << json_string(h.name)
+			<< ",\"host\":" << json_string(h.hostname) << ",\"samples\":" << h.samples
+			<< ",\"nominal_srate\":" << json_number(h.nominal_srate)
+			<< ",\"effective_srate\":" << json_number(h.effective_srate)
+			<< ",\"window_srate\":" << json_number(h.window_srate)
+			<< ",\"max_rate_deviation\":" << json_number(h.max_rate_deviation)
+			<< ",\"gaps\":" << h.gaps << ",\"missing_samples\":" << h.missing_samples
+			<< ",\"max_gap\":" << json_number(h.max_gap)
+			<< ",\"backwards\":" << h.backwards << ",\"clock_resets\":" << h.clock_resets
+			<< ",\"reconnects\":" << h.reconnects << '}';
+	}
+	out << "]}";
+	return out.str();
+}
+
+#endif
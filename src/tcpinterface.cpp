@@ -13,16 +13,55 @@ void RemoteControlSocket::addClient() {
 		while(client->canReadLine())
 			this->handleLine(client->readLine().trimmed(), client);
 	});
+	connect(client, &QTcpSocket::disconnected, this, [this, client]() {
+		clients.removeAll(client);
+		client->deleteLater();
+	});
+}
+
+void RemoteControlSocket::broadcast(const QString &line) {
+	for (auto *client : std::as_const(clients)) client->write((line + '\n').toUtf8());
+}
+
+void RemoteControlSocket::addQuery(const QString &command, std::function<QString()> handler) {
+	queries.insert(command, std::move(handler));
 }
 
 void RemoteControlSocket::handleLine(QString s, QTcpSocket *sock) {
 	qInfo() << s;
+	auto query = queries.constFind(s);
+	if (query != queries.constEnd()) {
+		sock->write(((*query)() + '\n').toUtf8());
+		return;
+	}
 	if (s == "start")
 		emit start();
 	else if (s == "stop")
 		emit stop();
 	else if (s == "update")
 			emit refresh_streams();
+	else if (s.startsWith("start_at ") || s.startsWith("stop_at ")) {
+		// start_at|stop_at <lsl_time>
+		bool ok = false;
+		const double time = s.section(' ', 1).trimmed().toDouble(&ok);
+		if (!ok || time <= 0)
+			qWarning() << "Invalid LSL time: " << s.section(' ', 1);
+		else if (s.startsWith("start_at "))
+			emit start_at(time);
+		else
+			emit stop_at(time);
+	}
+	else if (s.startsWith("add_stream "))
+		emit add_stream(s.mid(11).trimmed());
+	else if (s.startsWith("remove_stream "))
+		emit remove_stream(s.mid(14).trimmed());
+	else if (s.startsWith("session_start ")) {
+		// session_start <name> <file> [<query>]
+		const QString args = s.mid(14).trimmed();
+		emit start_session(args.section(' ', 0, 0), args.section(' ', 1, 1),
+			args.section(' ', 2).trimmed());
+	} else if (s.startsWith("session_stop "))
+		emit stop_session(s.mid(13).trimmed());
 	else if (s.contains("filename")) {
 		emit filename(s);
 	} else if (s.contains("select")) {
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <cstdint>
+#include <functional>
 
 #include <QtNetwork/QTcpServer>
 #include <QtNetwork/QTcpSocket>
@@ -11,16 +12,28 @@ class RemoteControlSocket : public QObject {
 	Q_OBJECT
 	QTcpServer server;
 	QList<QTcpSocket*> clients;
+	QMap<QString, std::function<QString()>> queries;
 public:
 	RemoteControlSocket(uint16_t port);
 
+	/// send a line (e.g. an alarm) to all connected clients
+	void broadcast(const QString &line);
+	/// answer the command with a line returned by handler instead of "OK"
+	void addQuery(const QString &command, std::function<QString()> handler);
+
 signals:
 	void refresh_streams();
 	void start();
 	void stop();
+	void start_at(double lsl_time);
+	void stop_at(double lsl_time);
 	void filename(QString s);
 	void select_all();
 	void select_none();
+	void add_stream(QString query);
+	void remove_stream(QString query);
+	void start_session(QString name, QString file, QString query);
+	void stop_session(QString name);
 
 public slots:
 	void addClient();
@@ -0,0 +1,771 @@
+// start and stop latency of a recording, adding/removing streams while recording, sessions
+// that share inlets, the remote controlled daemon, the GUI's stream directory, channel
+// selections, decimated companions, BIDS sidecars, live exports and replayed recordings, with
+// local outlets (needs liblsl and a network interface)
+#include "bidssidecar.h"
+#include "channelselection.h"
+#include "decimator.h"
+#include "eegexport.h"
+#include "rcsserver.h"
+#include "recorderdaemon.h"
+#include "recording.h"
+#include "sessionhost.h"
+#include "streamdirectory.h"
+#include "test_check.h"
+#include "xdfreplay.h"
+#include "xdfvalidate.h"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#ifndef _WIN32
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+using Clock = std::chrono::steady_clock;
+using stream_list = std::vector<lsl::stream_info>;
+
+// the longest acceptable time from the stop request until all threads are joined
+const auto max_stop_latency = std::chrono::milliseconds(100);
+
+static double ms(Clock::duration d) {
+	return std::chrono::duration<double, std::milli>(d).count();
+}
+
+/// record a stream for `duration` and return the stop latency; the outlet may never push data
+static Clock::duration record(const lsl::stream_info &info, const char *filename,
+	std::chrono::milliseconds duration, bool wait_for_samples) {
+	const auto start = Clock::now();
+	auto r = std::make_unique<recording>(
+		filename, std::vector<lsl::stream_info>{info}, std::vector<std::string>{},
+		std::map<std::string, int>{}, true);
+	if (wait_for_samples) {
+		// the first samples chunk is counted in the health statistics
+		const auto deadline = start + std::chrono::seconds(10);
+		for (;;) {
+			const auto health = r->stream_health_statistics();
+			if ((!health.empty() && health.front().samples) || Clock::now() > deadline) break;
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		std::cout << "First samples recorded after " << ms(Clock::now() - start) << " ms"
+				  << std::endl;
+	}
+	std::this_thread::sleep_for(duration);
+	const auto stop = Clock::now();
+	r.reset();
+	const auto latency = Clock::now() - stop;
+	std::cout << "Stopped after " << ms(latency) << " ms" << std::endl;
+	return latency;
+}
+
+/// update the directory until something changed or the timeout passed, as the GUI's timer does
+static stream_changes wait_for_changes(stream_directory &directory, Clock::duration timeout) {
+	const auto deadline = Clock::now() + timeout;
+	auto changes = directory.update();
+	while (changes.empty() && Clock::now() < deadline) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		changes = directory.update();
+	}
+	return changes;
+}
+
+// pushes samples at 100 Hz until destroyed
+class test_outlet {
+public:
+	explicit test_outlet(const lsl::stream_info &info) : outlet_(info) {
+		thread_ = std::thread([this]() {
+			std::vector<float> sample(outlet_.info().channel_count(), 1.f);
+			while (!done_) {
+				outlet_.push_sample(sample);
+				std::this_thread::sleep_for(std::chrono::milliseconds(10));
+			}
+		});
+	}
+	~test_outlet() {
+		done_ = true;
+		thread_.join();
+	}
+
+private:
+	lsl::stream_outlet outlet_;
+	std::atomic<bool> done_{false};
+	std::thread thread_;
+};
+
+/// the stop latency of a recording, with and without data
+static int test_stop_latency(const stream_list &found, const stream_list &found_silent) {
+	// a stream that delivers data, including the offset and boundary threads
+	const char *filename = "test_recording.xdf";
+	CHECK(record(found.front(), filename, std::chrono::milliseconds(1500), true) <=
+		  max_stop_latency);
+	const auto validation = validate_xdf(filename);
+	CHECK(validation.streams.size() == 1);
+	CHECK(validation.streams.front().has_footer);
+	CHECK(validation.streams.front().sample_count > 0);
+
+	// a stream that never sends its first sample
+	CHECK(record(found_silent.front(), "test_recording_silent.xdf", std::chrono::milliseconds(300),
+			  false) <= max_stop_latency);
+	return 0;
+}
+
+/// add a stream to a running recording and remove it again
+static int test_hot_add(const stream_list &found, const stream_list &found_added) {
+	const char *hot_filename = "test_recording_hot.xdf";
+	{
+		recording r(hot_filename, found, {}, {}, true);
+		std::this_thread::sleep_for(std::chrono::milliseconds(700));
+		CHECK(r.add_stream(found_added.front()));
+		CHECK(!r.add_stream(found_added.front()));
+		std::this_thread::sleep_for(std::chrono::milliseconds(1200));
+		CHECK(r.recorded_streams().size() == 2);
+		CHECK(r.remove_streams("source_id='latency-test-added'") == 1);
+		CHECK(r.recorded_streams().size() == 1);
+		std::this_thread::sleep_for(std::chrono::milliseconds(700));
+	}
+	const auto hot = validate_xdf(hot_filename);
+	CHECK(hot.streams.size() == 2);
+	for (const auto &stream : hot.streams) {
+		CHECK(stream.has_header && stream.has_footer);
+		CHECK(stream.footer_sample_count == stream.sample_count);
+	}
+	// the removed stream covers only the middle of the recording
+	CHECK(hot.streams[1].sample_count > 50);
+	CHECK(hot.streams[1].sample_count < hot.streams[0].sample_count);
+	return 0;
+}
+
+/// two sessions that record the same stream share its inlet
+static int test_shared_sessions(const stream_list &found, const stream_list &found_added) {
+	{
+		session_host host;
+		host.start("a", "test_recording_a.xdf", found, {}, {});
+		host.start("joint", "test_recording_joint.xdf", {found.front(), found_added.front()}, {},
+			{});
+		std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+		CHECK(host.inlets()->size() == 2);
+		CHECK(host.sessions().size() == 2);
+		CHECK(host.find("joint")->recorded_streams().size() == 2);
+		CHECK(host.stop("a") && !host.stop("a"));
+		CHECK(host.sessions().size() == 1);
+		std::this_thread::sleep_for(std::chrono::milliseconds(700));
+		// the joint session still receives the stream
+		CHECK(host.inlets()->size() == 2);
+	}
+	const auto a = validate_xdf("test_recording_a.xdf"),
+			   joint = validate_xdf("test_recording_joint.xdf");
+	CHECK(a.ok() && joint.ok());
+	CHECK(a.streams.size() == 1 && joint.streams.size() == 2);
+	// the joint file goes on after the other one stopped
+	const auto &shared = joint.streams[joint.streams[0].name == "LatencyTest" ? 0 : 1];
+	CHECK(a.streams[0].sample_count > 50);
+	CHECK(shared.name == "LatencyTest");
+	CHECK(shared.last_timestamp > a.streams[0].last_timestamp);
+	return 0;
+}
+
+/// a reader that doesn't pull only keeps the newest chunks within the reader budget
+static int test_reader_budget(const stream_list &found) {
+	shared_inlet shared(found.front(), -1);
+	shared.inlet().open_stream(5.0);
+	// 4 float channels and a timestamp: 24 bytes per sample
+	const std::size_t budget = 24 * 10;
+	shared.set_reader_budget(budget);
+	const uint64_t active = shared.subscribe(), lagging = shared.subscribe();
+	std::vector<pulled_chunk_p> chunks;
+	for (int i = 0; i < 50; ++i) {
+		shared.pull<float>(active, chunks);
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	}
+	CHECK(shared.chunks_dropped(active) == 0 && shared.chunks_dropped(lagging) > 0);
+	CHECK(!chunks.empty());
+	const double first_received = chunks.front()->timestamps.front();
+	std::size_t received = 0, queued = 0;
+	for (const auto &chunk : chunks) received += chunk->bytes;
+	chunks.clear();
+	shared.pull<float>(lagging, chunks);
+	CHECK(!chunks.empty());
+	for (const auto &chunk : chunks) queued += chunk->bytes;
+	CHECK(received > 3 * budget && queued <= budget);
+	// the oldest chunks were dropped
+	CHECK(chunks.front()->timestamps.front() > first_received);
+	shared.unsubscribe(active);
+	shared.unsubscribe(lagging);
+	CHECK(shared.readers() == 0);
+	return 0;
+}
+
+/// the stream directory reports the streams that came online or went offline
+static int test_stream_directory(const stream_list &found) {
+	stream_directory directory(1.0);
+	const auto deadline = Clock::now() + std::chrono::seconds(3);
+	while (!directory.find(key_of(found.front())) && Clock::now() < deadline) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		directory.update();
+	}
+	CHECK(directory.find(key_of(found.front())) != nullptr);
+	CHECK(directory.find(key_of(found.front()))->uid() == found.front().uid());
+	{
+		lsl::stream_outlet extra(lsl::stream_info(
+			"DirectoryTest", "Markers", 1, lsl::IRREGULAR_RATE, lsl::cf_string, "dir-test"));
+		const auto added = wait_for_changes(directory, std::chrono::seconds(3));
+		CHECK(added.added.size() == 1 && added.added.front().name() == "DirectoryTest");
+		CHECK(directory.matching("source_id='dir-test'").size() == 1);
+	}
+	const auto removed = wait_for_changes(directory, std::chrono::seconds(5));
+	CHECK(removed.removed.size() == 1 && removed.removed.front().name == "DirectoryTest");
+	CHECK(directory.matching("source_id='dir-test'").empty());
+	return 0;
+}
+
+/// a scheduled start and stop cut the stream at the sample
+static int test_scheduled_cut(const stream_list &found) {
+	recording_options options;
+	options.start_at = lsl::local_clock() + 0.5;
+	options.stop_at = options.start_at + 0.5;
+	double offset;
+	{
+		recording r("test_recording_cut.xdf", found, {}, {}, true, options);
+		// the same offset the recording measured while it was armed
+		offset = lsl::stream_inlet(found.front()).time_correction(1);
+		const auto deadline = Clock::now() + std::chrono::seconds(5);
+		while (!r.cut_finished() && Clock::now() < deadline)
+			std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		CHECK(r.cut_finished());
+	}
+	const auto cut = validate_xdf("test_recording_cut.xdf");
+	CHECK(cut.ok() && cut.streams.size() == 1);
+	const auto &stream = cut.streams.front();
+	CHECK(stream.first_timestamp + offset >= options.start_at);
+	CHECK(stream.first_timestamp + offset < options.start_at + 0.05);
+	CHECK(stream.last_timestamp + offset < options.stop_at);
+	CHECK(stream.last_timestamp + offset > options.stop_at - 0.05);
+	CHECK(stream.sample_count > 30 && stream.sample_count <= 50);
+	return 0;
+}
+
+/// per-channel signal statistics and their JSON form
+static int test_signal_stats() {
+	// integer streams saturate at the limits of their type
+	channel_stats<int16_t> ints(2);
+	const std::vector<int16_t> chunk{5, -3, 5, 4, 5, 32767, 5, 0};
+	ints.update(chunk.data(), 3);
+	ints.update(chunk.data() + 6, 1);
+	stream_summary summary;
+	ints.summarize(summary);
+	CHECK(summary.samples == 4 && summary.channels.size() == 2);
+	const auto &flat = summary.channels[0], &varying = summary.channels[1];
+	CHECK(flat.flat && flat.min == 5 && flat.max == 5 && flat.mean == 5 && flat.rms == 5);
+	CHECK(flat.saturated == 0);
+	CHECK(!varying.flat && varying.min == -3 && varying.max == 32767);
+	CHECK(std::abs(varying.mean - (32767 + 4 - 3) / 4.0) < 1e-9);
+	CHECK(std::abs(varying.rms - std::sqrt((32767.0 * 32767 + 16 + 9) / 4)) < 1e-6);
+	CHECK(varying.saturated == 1);
+	// summarize() starts a new window
+	ints.summarize(summary);
+	CHECK(summary.samples == 0 && !summary.channels[0].flat && summary.channels[1].saturated == 0);
+
+	// floating point streams only saturate at the configured level
+	const std::vector<float> values{-150.f, 99.f, 100.f, 0.f};
+	channel_stats<float> unlimited(1), limited(1, 100);
+	unlimited.update(values.data(), values.size());
+	limited.update(values.data(), values.size());
+	unlimited.summarize(summary);
+	CHECK(summary.channels[0].saturated == 0);
+	limited.summarize(summary);
+	CHECK(summary.channels[0].saturated == 2);
+
+	summary.streamid = 3;
+	summary.name = "Amp \"1\"";
+	summary.hostname = "host";
+	summary.channels[0].min = -std::numeric_limits<double>::infinity();
+	const std::string json = summaries_to_json({summary});
+	// quotes in names are escaped, infinite values are null
+	CHECK(json.rfind("{\"streams\":[{\"id\":3,\"name\":\"Amp \\\"1\\\"\",\"host\":\"host\",", 0) ==
+		  0);
+	CHECK(json.find("\"min\":null,\"max\":100,") != std::string::npos);
+	CHECK(json.find("\"saturated\":2}]}]}") != std::string::npos);
+	return 0;
+}
+
+/// the health counters of synthetic time stamps: a regular run, a rate drop, a gap, a
+/// reconnection and a clock reset
+static int test_stream_health() {
+	// a 100 Hz stream with 1 s rate windows
+	health_monitor monitor(100, 2.0, 2.0, 1.0);
+	double now = 1000;
+	// n samples dt apart, starting at first, pulled at `now`
+	const auto feed = [&](double first, double dt, std::size_t n) {
+		std::vector<double> timestamps(n);
+		for (std::size_t i = 0; i < n; ++i) timestamps[i] = first + i * dt;
+		monitor.update(timestamps.data(), n, now);
+		now += 0.1;
+		return first + (n - 1) * dt;
+	};
+	stream_health h;
+	h.streamid = 4;
+	h.name = "Amp";
+
+	// 1.1 s of regular samples complete the first rate window
+	double last = 10;
+	for (int i = 0; i < 11; ++i) last = feed(i ? last + 0.01 : last, 0.01, 10);
+	monitor.summarize(h);
+	CHECK(h.streamid == 4 && h.name == "Amp" && h.nominal_srate == 100 && h.samples == 110);
+	CHECK(!h.problems() && h.missing_samples == 0 && std::abs(h.max_gap - 0.01) < 1e-9);
+	CHECK(std::abs(h.window_srate - 100) < 1e-6 && h.max_rate_deviation < 1e-6);
+	CHECK(std::abs(h.effective_srate - 100) < 1e-6);
+
+	// the source slows down to 80 Hz for a whole window, without gaps
+	last = feed(last + 0.0125, 0.0125, 88);
+	monitor.summarize(h);
+	CHECK(h.gaps == 0 && std::abs(h.window_srate - 80) < 1e-6);
+	CHECK(std::abs(h.max_rate_deviation - 0.2) < 1e-6);
+
+	// 5 samples are missing
+	last = feed(last + 0.06, 0.01, 10);
+	monitor.summarize(h);
+	CHECK(h.gaps == 1 && h.missing_samples == 5 && std::abs(h.max_gap - 0.06) < 1e-9);
+	CHECK(h.reconnects == 0 && h.backwards == 0);
+
+	// nothing arrives for 5 s, then the stream continues where it was
+	now += 5;
+	last = feed(last + 0.01, 0.01, 10);
+	monitor.summarize(h);
+	CHECK(h.reconnects == 1 && h.gaps == 1 && h.clock_resets == 0);
+
+	// the source clock is reset: the next chunk counts as a reconnection, its time stamps go back
+	monitor.clock_reset();
+	feed(0, 0.01, 10);
+	monitor.summarize(h);
+	CHECK(h.clock_resets == 1 && h.reconnects == 2 && h.backwards == 1 && h.gaps == 1);
+	CHECK(h.samples == 110 + 88 + 10 + 10 + 10 && h.problems());
+
+	// irregular streams have no gaps, rate windows or silence
+	health_monitor irregular(0);
+	const std::vector<double> events{1, 5, 100};
+	irregular.update(events.data(), 2, 1000);
+	irregular.update(events.data() + 2, 1, 1100);
+	stream_health e;
+	irregular.summarize(e);
+	CHECK(e.samples == 3 && !e.problems() && e.max_gap == 95 && e.window_srate == 0);
+
+	// backslashes in names are escaped, non-finite values are null
+	h.hostname = "lab\\pc";
+	h.max_gap = std::numeric_limits<double>::quiet_NaN();
+	CHECK(health_to_json({h, e}).rfind("{\"streams\":[{\"id\":4,\"name\":\"Amp\","
+									   "\"host\":\"lab\\\\pc\",\"samples\":228,", 0) == 0);
+	CHECK(health_to_json({h}).find(",\"max_gap\":null,\"backwards\":1,\"clock_resets\":1,"
+								   "\"reconnects\":2}]}") != std::string::npos);
+	CHECK(health_to_json({}) == "{\"streams\":[]}");
+	// the footer element
+	stream_health footer;
+	footer.gaps = 2;
+	footer.missing_samples = 7;
+	footer.max_gap = 0.25;
+	footer.effective_srate = 99.5;
+	footer.max_rate_deviation = 0.125;
+	footer.reconnects = 1;
+	CHECK(health_to_xml(footer) ==
+		  "<stream_health><gaps>2</gaps><missing_samples>7</missing_samples><max_gap>0.25"
+		  "</max_gap><backwards>0</backwards><effective_srate>99.5</effective_srate>"
+		  "<max_rate_deviation>0.125</max_rate_deviation><clock_resets>0</clock_resets>"
+		  "<reconnects>1</reconnects></stream_health>");
+	return 0;
+}
+
+/// a channel selection is resolved against the header and gathered from every chunk
+static int test_channel_selection(const stream_list &found) {
+	const std::string header =
+		"<info><name>Amp</name><channel_count>4</channel_count><desc><channels>"
+		"<channel><label>Fp1</label></channel> <channel><label>Fp2</label></channel> "
+		"<channel><label>Cz</label></channel> <channel><label>Pz</label></channel>"
+		"</channels></desc></info>";
+	const channel_selection selection({"Pz", "0-1"}, header);
+	CHECK(selection.channels() == std::vector<uint32_t>({3, 0, 1}) && !selection.all());
+	CHECK(selection.rewrite_header(header) ==
+		  "<info><name>Amp</name><channel_count>3</channel_count><desc><channels>"
+		  "<channel><label>Pz</label></channel> <channel><label>Fp1</label></channel> "
+		  "<channel><label>Fp2</label></channel></channels>"
+		  "<selected_channels>3 0 1</selected_channels></desc></info>");
+	// the indices go into an empty desc, or a new one
+	CHECK(channel_selection({"1"}, "<info><channel_count>2</channel_count><desc/></info>")
+			  .rewrite_header("<info><channel_count>2</channel_count><desc/></info>") ==
+		  "<info><channel_count>1</channel_count><desc><selected_channels>1</selected_channels>"
+		  "</desc></info>");
+	CHECK(channel_selection({"1"}, "<info><channel_count>2</channel_count></info>")
+			  .rewrite_header("<info><channel_count>2</channel_count></info>") ==
+		  "<info><channel_count>1</channel_count><desc><selected_channels>1</selected_channels>"
+		  "</desc></info>");
+	const std::vector<int16_t> chunk{0, 1, 2, 3, 10, 11, 12, 13};
+	std::vector<int16_t> gathered;
+	selection.gather(chunk.data(), 2, gathered);
+	CHECK(gathered == std::vector<int16_t>({3, 0, 1, 13, 10, 11}));
+	CHECK(channel_selection({}, header).all());
+	// indices past the channel count and descending ranges are rejected
+	for (const char *spec : {"4", "3-1"}) {
+		bool rejected = false;
+		try {
+			channel_selection({std::string(spec)}, header);
+		} catch (std::invalid_argument &) { rejected = true; }
+		CHECK(rejected);
+	}
+
+	recording_options options;
+	options.channel_selections["LatencyTest (" + found.front().hostname() + ")"] = {"1-2"};
+	{
+		recording r("test_recording_channels.xdf", found, {}, {}, true, options);
+		std::this_thread::sleep_for(std::chrono::milliseconds(700));
+	}
+	const auto subset = validate_xdf("test_recording_channels.xdf");
+	CHECK(subset.ok() && subset.streams.size() == 1);
+	CHECK(subset.streams.front().channel_count == 2);
+	CHECK(subset.streams.front().sample_count > 30);
+	return 0;
+}
+
+/// decimated companion streams
+static int test_decimation(const stream_list &found) {
+	// unity gain for constant signals, and the same output however the input is chunked
+	const std::size_t n = 300;
+	std::vector<int16_t> in(2 * n);
+	std::vector<double> timestamps(n);
+	for (std::size_t s = 0; s < n; ++s) {
+		in[2 * s] = 100;
+		in[2 * s + 1] = static_cast<int16_t>(s % 7);
+		timestamps[s] = s / 1000.0;
+	}
+	decimator whole(4, 2), pieces(4, 2);
+	std::vector<float> out_whole, out_pieces;
+	std::vector<double> ts_whole, ts_pieces;
+	whole.process(in.data(), timestamps.data(), n, out_whole, ts_whole);
+	for (std::size_t s = 0; s < n; s += 13)
+		pieces.process(in.data() + 2 * s, timestamps.data() + s,
+			std::min<std::size_t>(13, n - s), out_pieces, ts_pieces);
+	CHECK(out_whole == out_pieces && ts_whole == ts_pieces);
+	CHECK(ts_whole.size() == (n - whole.taps().size()) / 4 + 1);
+	CHECK(ts_whole.front() == timestamps[whole.delay()] && ts_whole[1] - ts_whole[0] > 0.0039);
+	for (std::size_t s = 0; s < ts_whole.size(); ++s)
+		CHECK(std::abs(out_whole[2 * s] - 100) < 1e-3);
+
+	recording_options options;
+	options.decimations["LatencyTest (" + found.front().hostname() + ")"] = 2;
+	{
+		recording r("test_recording_decimated.xdf", found, {}, {}, true, options);
+		std::this_thread::sleep_for(std::chrono::milliseconds(700));
+	}
+	const auto decimated = validate_xdf("test_recording_decimated.xdf");
+	CHECK(decimated.ok() && decimated.streams.size() == 2);
+	const auto &full = decimated.streams[decimated.streams[0].name == "LatencyTest" ? 0 : 1];
+	const auto &half = decimated.streams[decimated.streams[0].name == "LatencyTest" ? 1 : 0];
+	CHECK(half.name == "LatencyTest_decimated" && half.nominal_srate == 50);
+	CHECK(half.channel_format == "float32" && half.channel_count == 4);
+	CHECK(half.sample_count > 10 && half.sample_count * 2 <= full.sample_count);
+	return 0;
+}
+
+/// BIDS sidecars from the headers, footers and markers gathered while recording
+static int test_bids_sidecars(const stream_list &found) {
+	const bids_sidecars names("study/sub-01/eeg/sub-01_task-rest_run-001_eeg.xdf");
+	CHECK(names.modality() == "eeg" &&
+		  std::filesystem::path(names.base()) ==
+			  std::filesystem::path("study/sub-01/eeg/sub-01_task-rest_run-001"));
+	CHECK(bids_sidecars("exp001/block_T1.xdf").modality() == "eeg");
+	CHECK(std::filesystem::path(bids_sidecars("exp001/block_T1.xdf").base()) ==
+		  std::filesystem::path("exp001/block_T1"));
+
+	lsl::stream_outlet markers(lsl::stream_info(
+		"SidecarMarkers", "Markers", 1, lsl::IRREGULAR_RATE, lsl::cf_string, "sidecar-test"));
+	auto streams = found;
+	const auto found_markers = lsl::resolve_stream("source_id='sidecar-test'", 1, 10.0);
+	CHECK(!found_markers.empty());
+	streams.push_back(found_markers.front());
+	recording_options options;
+	options.bids_sidecars = true;
+	{
+		recording r("sub-01_task-rest_run-001_eeg.xdf", streams, {}, {}, true, options);
+		std::this_thread::sleep_for(std::chrono::milliseconds(300));
+		markers.push_sample(std::vector<std::string>{"stimulus\tleft"});
+		std::this_thread::sleep_for(std::chrono::milliseconds(700));
+	}
+	const auto read = [](const char *filename) {
+		std::ifstream in(filename);
+		return std::string(std::istreambuf_iterator<char>(in), {});
+	};
+	const std::string json = read("sub-01_task-rest_run-001_eeg.json");
+	CHECK(json.find("\"TaskName\": \"rest\"") != std::string::npos);
+	CHECK(json.find("\"SamplingFrequency\": 100,") != std::string::npos);
+	CHECK(json.find("\"MiscChannelCount\": 4,") != std::string::npos);
+	CHECK(json.find("\"Name\": \"SidecarMarkers\"") != std::string::npos);
+	const std::string channels = read("sub-01_task-rest_run-001_channels.tsv");
+	CHECK(channels.rfind("name\ttype\tunits\tsampling_frequency\tstream\n"
+						 "LatencyTest_1\tMISC\tn/a\t100\tLatencyTest\n",
+			  0) == 0);
+	CHECK(std::count(channels.begin(), channels.end(), '\n') == 5);
+	const std::string events = read("sub-01_task-rest_run-001_events.tsv");
+	const auto marker = events.find("\tn/a\tstimulus left\tSidecarMarkers\n");
+	CHECK(marker != std::string::npos);
+	// the marker was sent at least 300 ms after the first sample
+	CHECK(std::stod(events.substr(events.find('\n') + 1)) > 0.25);
+	return 0;
+}
+
+/// live exports: BrainVision and EDF+ with the markers of the string streams
+static int test_exports(const stream_list &found) {
+	const auto read = [](const std::string &filename) {
+		std::ifstream in(filename, std::ios::binary);
+		return std::string(std::istreambuf_iterator<char>(in), {});
+	};
+	const std::string header =
+		"<info><name>Amp</name><channel_count>2</channel_count><nominal_srate>250"
+		"</nominal_srate><channel_format>float32</channel_format><desc><channels><channel>"
+		"<label>Cz</label><unit>microvolts</unit></channel><channel><label>Pz</label>"
+		"</channel></channels></desc></info>";
+	std::vector<float> samples(2 * 300, 1.5f);
+	std::vector<double> timestamps(300);
+	for (std::size_t s = 0; s < timestamps.size(); ++s) timestamps[s] = 10 + s / 250.0;
+	{
+		eeg_export bv("test_export", export_spec(), header);
+		bv.push_marker(10.5, "go, left");
+		bv.push_samples(samples.data(), timestamps.data(), timestamps.size());
+	}
+	const std::string vhdr = read("test_export.vhdr");
+	CHECK(vhdr.find("NumberOfChannels=2\n") != std::string::npos);
+	CHECK(vhdr.find("SamplingInterval=4000\n") != std::string::npos);
+	CHECK(vhdr.find("Ch1=Cz,,1,µV\nCh2=Pz,,1,µV\n") != std::string::npos);
+	CHECK(read("test_export.eeg").size() == samples.size() * sizeof(float));
+	// the marker before the first sample is placed at its start
+	CHECK(read("test_export.vmrk").find("Mk2=Stimulus,go\\1 left,1,1,0\n") !=
+		  std::string::npos);
+
+	export_spec edf_spec;
+	edf_spec.format = export_format::edf;
+	{
+		eeg_export edf("test_export", edf_spec, header);
+		edf.push_samples(samples.data(), timestamps.data(), timestamps.size());
+		edf.push_marker(10.5, "go");
+	}
+	// a header of 256 bytes per signal and the annotations, and two records of one second
+	const std::string edf = read("test_export.edf");
+	CHECK(edf.size() == 256 * 4 + 2 * (2 * 250 * 2 + 512));
+	CHECK(edf.compare(236, 8, "2       ") == 0 && edf.compare(192, 5, "EDF+C") == 0);
+	CHECK(edf.find("+0.5\x14go\x14") != std::string::npos);
+	// "Startdate dd-MMM-yyyy" with an English month abbreviation, whatever the locale
+	const std::string months = "JANFEBMARAPRMAYJUNJULAUGSEPOCTNOVDEC";
+	const auto month = months.find(edf.substr(101, 3));
+	CHECK(edf.compare(88, 10, "Startdate ") == 0 && edf[100] == '-' && edf[104] == '-');
+	CHECK(month != std::string::npos && month % 3 == 0);
+
+	lsl::stream_outlet markers(lsl::stream_info(
+		"ExportMarkers", "Markers", 1, lsl::IRREGULAR_RATE, lsl::cf_string, "export-test"));
+	auto streams = found;
+	const auto found_markers = lsl::resolve_stream("source_id='export-test'", 1, 10.0);
+	CHECK(!found_markers.empty());
+	streams.push_back(found_markers.front());
+	recording_options options;
+	options.exports["LatencyTest (" + found.front().hostname() + ")"] = edf_spec;
+	{
+		recording r("test_recording_export.xdf", streams, {}, {}, true, options);
+		std::this_thread::sleep_for(std::chrono::milliseconds(300));
+		markers.push_sample(std::vector<std::string>{"stimulus"});
+		std::this_thread::sleep_for(std::chrono::milliseconds(700));
+	}
+	const std::string recorded = read("test_recording_export_LatencyTest.edf");
+	// 4 channels at 100 Hz and the annotations per record
+	const std::size_t record_size = 4 * 100 * 2 + 512;
+	CHECK(recorded.size() > 256 * 6 && (recorded.size() - 256 * 6) % record_size == 0);
+	CHECK(std::stoul(recorded.substr(236, 8)) == (recorded.size() - 256 * 6) / record_size);
+	CHECK(recorded.find("\x14stimulus\x14") != std::string::npos);
+	return 0;
+}
+
+/// a recording replayed as outlets and recorded again
+static int test_replay() {
+	const auto header = [](const char *name, const char *format, double srate,
+							const char *source_id) {
+		return std::string("<?xml version=\"1.0\"?><info><name>") + name +
+			   "</name><type>Test</type><channel_count>2</channel_count><nominal_srate>" +
+			   std::to_string(srate) + "</nominal_srate><channel_format>" + format +
+			   "</channel_format><source_id>" + source_id + "</source_id></info>";
+	};
+	{
+		XDFWriter w("test_replay_source.xdf");
+		w.write_stream_header(1, header("ReplayEEG", "float32", 100, "replay-eeg"));
+		w.write_stream_header(2, header("ReplayMarkers", "string", 0, "replay-markers"));
+		for (int i = 0; i < 3; ++i) {
+			// the timestamps after the first one are deduced
+			std::vector<double> ts(10, 0.0);
+			if (i == 0) ts[0] = 50;
+			w.write_data_chunk(1, ts, std::vector<float>(20, static_cast<float>(i)), 2);
+		}
+		w.write_data_chunk(2, std::vector<double>{50.05, 50.25},
+			std::vector<std::string>{"a", "b", "c", "d"}, 2);
+	}
+	xdf_replay replay("test_replay_source.xdf");
+	CHECK(replay.stream_names() == std::vector<std::string>({"ReplayEEG", "ReplayMarkers"}));
+	auto streams = lsl::resolve_stream("source_id='replay-eeg'", 1, 10.0);
+	const auto found_markers = lsl::resolve_stream("source_id='replay-markers'", 1, 10.0);
+	CHECK(streams.size() == 1 && found_markers.size() == 1);
+	streams.push_back(found_markers.front());
+	{
+		recording r("test_recording_replayed.xdf", streams, {}, {}, true);
+		replay_options options;
+		options.speed = 0;
+		options.wait_for_consumers = 5;
+		std::atomic<bool> stop{false};
+		CHECK(replay.run(options, stop) == 32);
+		std::this_thread::sleep_for(std::chrono::milliseconds(500));
+	}
+	const auto replayed = validate_xdf("test_recording_replayed.xdf");
+	CHECK(replayed.ok() && replayed.streams.size() == 2);
+	const auto &eeg = replayed.streams[replayed.streams[0].name == "ReplayEEG" ? 0 : 1];
+	const auto &markers = replayed.streams[replayed.streams[0].name == "ReplayEEG" ? 1 : 0];
+	CHECK(eeg.sample_count == 30 && markers.sample_count == 2);
+	// the recorded intervals are kept
+	CHECK(std::abs(eeg.last_timestamp - eeg.first_timestamp - 0.29) < 1e-6);
+	CHECK(std::abs(markers.first_timestamp - eeg.first_timestamp - 0.05) < 1e-6);
+	return 0;
+}
+
+/// the daemon reads the GUI's config file and is controlled by the same commands
+#ifndef _WIN32
+/// a remote control client that doesn't read its replies is dropped without blocking the server
+static int test_rcs_server() {
+	rcs_server server;
+	// replies much larger than the socket buffers
+	server.listen_lines(
+		22398, [](const std::string &) { return std::string(512 * 1024, 'x') + '\n'; });
+	sockaddr_in addr{};
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(22398);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	const timeval recv_timeout{2, 0};
+	int clients[2];
+	for (int &s : clients) {
+		s = socket(AF_INET, SOCK_STREAM, 0);
+		setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &recv_timeout, sizeof(recv_timeout));
+		CHECK(connect(s, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == 0);
+	}
+	const int slow = clients[0], idle = clients[1];
+	// 32 MiB of replies
+	const std::string commands(64, '\n');
+	CHECK(send(slow, commands.data(), commands.size(), 0) == static_cast<ssize_t>(commands.size()));
+	for (int i = 0; i < 20; ++i) {
+		const auto start = Clock::now();
+		server.poll(std::chrono::milliseconds(10));
+		CHECK(Clock::now() - start < std::chrono::milliseconds(500));
+	}
+	server.broadcast("ALARM test");
+	for (int i = 0; i < 5; ++i) server.poll(std::chrono::milliseconds(10));
+
+	// the slow client got what fit into the socket buffers and was disconnected
+	std::vector<char> buffer(65536);
+	std::size_t received = 0;
+	ssize_t n;
+	while ((n = recv(slow, buffer.data(), buffer.size(), 0)) > 0) received += n;
+	CHECK(n == 0 && received < commands.size() * 512 * 1024);
+	// the other client is still served
+	n = recv(idle, buffer.data(), buffer.size(), 0);
+	CHECK(n > 0 && std::string(buffer.data(), n) == "ALARM test\n");
+	for (int s : clients) close(s);
+	return 0;
+}
+#endif
+
+static int test_daemon() {
+	{
+		std::ofstream cfg("test_recording.cfg");
+		cfg << "\xEF\xBB\xBF; comment\nStudyRoot=test_daemon\nPathTemplate=exp%n/block_%b.xdf\n"
+			<< "RequiredStreams=\"LatencyTest (somehost)\", \"Other (host)\"\n"
+			<< "OnlineSync=\"LatencyTest (somehost) post_clocksync post_dejitter\"\n"
+			<< "ChannelSelection=\"Amp (host) 0-31 Cz\"\n"
+			<< "Decimation=\"Amp (host) 20\", \"Amp2 (host) 1\", \"NoHost\"\n"
+			<< "Export=\"Amp (host) edf 500\", \"Other (host) gdf\"\n"
+			<< "MirrorLocations=test_daemon_mirror\n"
+			<< "SpillBudgetMB=16\nCommitWatermark=true\nRCSPort=22399\n";
+	}
+	const auto config = read_config("test_recording.cfg");
+	CHECK(config.study_root == "test_daemon" && config.rcs_port == 22399);
+	CHECK(config.required_streams.size() == 2 && config.required_streams[1] == "Other (host)");
+	CHECK(config.sync_options.at("LatencyTest (somehost)") ==
+		  (lsl::post_clocksync | lsl::post_dejitter));
+	CHECK(config.options.spill_budget == 16 * 1024 * 1024 && config.options.watermark);
+	CHECK(config.options.channel_selections.at("Amp (host)") ==
+		  std::vector<std::string>({"0-31", "Cz"}));
+	CHECK(config.options.decimations.size() == 1 &&
+		  config.options.decimations.at("Amp (host)") == 20);
+	CHECK(config.options.exports.size() == 1 &&
+		  config.options.exports.at("Amp (host)").format == export_format::edf &&
+		  config.options.exports.at("Amp (host)").edf_range == 500);
+	// not in the BIDS layout
+	CHECK(!config.options.bids_sidecars);
+	CHECK(listname_to_query("Other (host)") == "name='Other' and hostname='host'");
+	std::filesystem::remove_all("test_daemon");
+	std::filesystem::remove_all("test_daemon_mirror");
+	std::string daemon_file;
+	{
+		recorder_daemon daemon(config, {"source_id='latency-test-100hz'"});
+		// the streams are discovered in the background
+		std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+		CHECK(daemon.handle_command("filename {task:T1}{run:2}") == "OK");
+		CHECK(daemon.handle_command("start") == "OK");
+		CHECK(daemon.recording_active());
+		daemon_file = daemon.current_file();
+		CHECK(daemon_file ==
+			  (std::filesystem::path("test_daemon") / "exp002/block_T1.xdf").string());
+		std::this_thread::sleep_for(std::chrono::milliseconds(700));
+		CHECK(daemon.handle_command("health").find("LatencyTest") != std::string::npos);
+		const std::string samples_metric =
+			"labrecorder_stream_samples_total{session=\"\",stream=\"LatencyTest\"";
+		CHECK(daemon.metrics().find(samples_metric) != std::string::npos);
+		CHECK(daemon.handle_command("stop") == "OK");
+		CHECK(!daemon.recording_active());
+	}
+	const auto daemon_validation = validate_xdf(daemon_file);
+	CHECK(daemon_validation.ok() && daemon_validation.streams.size() == 1);
+	// the mirror has the same path below its root
+	const auto mirror = std::filesystem::path("test_daemon_mirror") / "exp002/block_T1.xdf";
+	CHECK(std::filesystem::file_size(mirror) == std::filesystem::file_size(daemon_file));
+	// an existing file is moved away instead of being overwritten
+	move_existing(mirror.string());
+	CHECK(!std::filesystem::exists(mirror));
+	CHECK(std::filesystem::exists(mirror.parent_path() / "block_T1_old1.xdf"));
+	return 0;
+}
+
+int main() {
+	test_outlet outlet(
+		lsl::stream_info("LatencyTest", "Test", 4, 100, lsl::cf_float32, "latency-test-100hz"));
+	lsl::stream_outlet silent(lsl::stream_info(
+		"LatencyTestSilent", "Test", 1, 100, lsl::cf_float32, "latency-test-silent"));
+	test_outlet added(
+		lsl::stream_info("HotAddTest", "Test", 2, 100, lsl::cf_float32, "latency-test-added"));
+	const auto found = lsl::resolve_stream("source_id='latency-test-100hz'", 1, 10.0);
+	const auto found_silent = lsl::resolve_stream("source_id='latency-test-silent'", 1, 10.0);
+	const auto found_added = lsl::resolve_stream("source_id='latency-test-added'", 1, 10.0);
+	CHECK(!found.empty() && !found_silent.empty() && !found_added.empty());
+
+	for (const int failed : {
+		test_stop_latency(found, found_silent),
+		test_hot_add(found, found_added),
+		test_shared_sessions(found, found_added),
+		test_reader_budget(found),
+		test_stream_directory(found),
+		test_scheduled_cut(found),
+		test_signal_stats(),
+		test_stream_health(),
+		test_channel_selection(found),
+		test_decimation(found),
+		test_bids_sidecars(found),
+		test_exports(found),
+		test_replay(),
+#ifndef _WIN32
+		test_rcs_server(),
+#endif
+		test_daemon()})
+		if (failed) return failed;
+	return 0;
+}
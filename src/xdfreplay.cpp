@@ -0,0 +1,218 @@
+#include "xdfreplay.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <set>
+#include <stdexcept>
+#include <thread>
+
+namespace {
+const double infinity = std::numeric_limits<double>::infinity();
+// the longest sleep between checks of the stop flag, in seconds
+const double max_sleep = 0.05;
+
+/// sleep in short steps until the local clock reaches due, returns false if stopped before
+bool sleep_until(double due, const std::atomic<bool> &stop) {
+	for (double wait = due - lsl::local_clock(); wait > 0; wait = due - lsl::local_clock()) {
+		if (stop) return false;
+		std::this_thread::sleep_for(std::chrono::duration<double>(std::min(wait, max_sleep)));
+	}
+	return !stop;
+}
+
+/// push n samples from their place in a samples chunk
+template <class T>
+void push_values(lsl::stream_outlet &outlet, const char *content, const sample_ref *samples,
+	std::size_t n, uint32_t n_channels, const std::vector<double> &timestamps) {
+	std::vector<T> values(n * n_channels);
+	for (std::size_t i = 0; i < n; ++i)
+		std::memcpy(values.data() + i * n_channels, content + samples[i].value_offset,
+			n_channels * sizeof(T));
+	outlet.push_chunk_multiplexed(values.data(), timestamps.data(), values.size());
+}
+
+template <>
+void push_values<std::string>(lsl::stream_outlet &outlet, const char *content,
+	const sample_ref *samples, std::size_t n, uint32_t n_channels,
+	const std::vector<double> &timestamps) {
+	std::vector<std::string> values;
+	values.reserve(n * n_channels);
+	for (std::size_t i = 0; i < n; ++i) {
+		// [Length][Value] per channel; decode_samples() has checked the lengths
+		uint64_t pos = samples[i].value_offset, len;
+		for (uint32_t c = 0; c < n_channels; ++c) {
+			read_varlen_int(content, samples[i].end, pos, len);
+			values.emplace_back(content + pos, len);
+			pos += len;
+		}
+	}
+	outlet.push_chunk_multiplexed(values.data(), timestamps.data(), values.size());
+}
+} // namespace
+
+struct xdf_replay::replayed_stream {
+	stream_header_info header;
+	std::unique_ptr<lsl::stream_outlet> outlet;
+	std::vector<uint64_t> chunks;						  // the offsets of its samples chunks
+	std::vector<std::pair<double, double>> clock_offsets; // (collection time, offset value)
+
+	// the replay position: the decoded samples of the current chunk
+	std::size_t next_chunk = 0, next_sample = 0;
+	const char *content = nullptr;
+	std::vector<sample_ref> samples;
+	double last_timestamp = 0;
+
+	/// the time of a sample of the current chunk in the recording computer's clock
+	double time(std::size_t i) const {
+		return samples[i].timestamp + clock_offset_at(clock_offsets, samples[i].timestamp);
+	}
+	/// the time of the next sample (infinity after the last one)
+	double next_time() const { return next_sample < samples.size() ? time(next_sample) : infinity; }
+
+	/// decode the next chunk once the current one is pushed
+	void load(const mapped_file &file) {
+		while (next_sample >= samples.size() && next_chunk < chunks.size()) {
+			chunk_info chunk;
+			if (!parse_chunk_header(file.data(), file.size(), chunks[next_chunk++], chunk) ||
+				!decode_samples(file.data() + chunk.content_offset, chunk.content_size(), header,
+					last_timestamp, samples))
+				throw std::runtime_error("Malformed samples chunk of the stream " + header.name);
+			content = file.data() + chunk.content_offset;
+			next_sample = 0;
+		}
+	}
+
+	void rewind() {
+		next_chunk = next_sample = 0;
+		samples.clear();
+		last_timestamp = 0;
+	}
+
+	/// push the samples up to end with the given timestamps
+	void push(std::size_t end, const std::vector<double> &timestamps) {
+		const sample_ref *first = samples.data() + next_sample;
+		const std::size_t n = end - next_sample;
+		const uint32_t n_channels = header.channel_count;
+		const std::string &format = header.channel_format;
+		if (format == "float32")
+			push_values<float>(*outlet, content, first, n, n_channels, timestamps);
+		else if (format == "double64")
+			push_values<double>(*outlet, content, first, n, n_channels, timestamps);
+		else if (format == "int32")
+			push_values<int32_t>(*outlet, content, first, n, n_channels, timestamps);
+		else if (format == "int16")
+			push_values<int16_t>(*outlet, content, first, n, n_channels, timestamps);
+		else if (format == "int8")
+			push_values<char>(*outlet, content, first, n, n_channels, timestamps);
+		else
+			push_values<std::string>(*outlet, content, first, n, n_channels, timestamps);
+		next_sample = end;
+	}
+};
+
+xdf_replay::xdf_replay(const std::string &filename) : filename_(filename), file_(filename) {
+	const char *data = file_.data();
+	const uint64_t size = file_.size();
+	if (size < 4 || std::memcmp(data, "XDF:", 4) != 0)
+		throw std::runtime_error(filename + " is not an XDF file");
+
+	// walk the chunk headers for the stream headers, samples chunks and clock offsets
+	static const std::set<std::string> formats{
+		"float32", "double64", "int32", "int16", "int8", "string"};
+	std::map<streamid_t, replayed_stream *> by_id;
+	chunk_info chunk;
+	uint64_t pos = 4;
+	for (; parse_chunk_header(data, size, pos, chunk); pos = chunk.end) {
+		const char *content = data + chunk.content_offset;
+		if (chunk.tag == chunk_tag_t::streamheader) {
+			const std::string xml(content, chunk.content_size());
+			auto stream = std::make_unique<replayed_stream>();
+			stream->header = parse_stream_header(xml);
+			if (!formats.count(stream->header.channel_format)) {
+				std::cerr << "Not replaying the stream " << stream->header.name
+						  << ": unsupported channel format " << stream->header.channel_format
+						  << std::endl;
+				continue;
+			}
+			stream->outlet =
+				std::make_unique<lsl::stream_outlet>(lsl::stream_info::from_xml(xml));
+			by_id[chunk.streamid] = stream.get();
+			streams_.push_back(std::move(stream));
+			continue;
+		}
+		auto it = by_id.find(chunk.streamid);
+		if (!chunk.has_streamid() || it == by_id.end()) continue;
+		if (chunk.tag == chunk_tag_t::samples)
+			it->second->chunks.push_back(chunk.offset);
+		else if (chunk.tag == chunk_tag_t::clockoffset && chunk.content_size() >= 16) {
+			double collection_time, offset;
+			std::memcpy(&collection_time, content, 8);
+			std::memcpy(&offset, content + 8, 8);
+			it->second->clock_offsets.emplace_back(collection_time, offset);
+		}
+	}
+	if (pos < size)
+		std::cerr << "Warning: " << filename << " ends in a partial chunk at " << pos
+				  << ", replaying up to there" << std::endl;
+}
+
+xdf_replay::~xdf_replay() = default;
+
+std::vector<std::string> xdf_replay::stream_names() const {
+	std::vector<std::string> names;
+	for (const auto &stream : streams_) names.push_back(stream->header.name);
+	return names;
+}
+
+uint64_t xdf_replay::run(const replay_options &options, const std::atomic<bool> &stop) {
+	if (options.wait_for_consumers > 0) {
+		const double deadline = lsl::local_clock() + options.wait_for_consumers;
+		for (const auto &stream : streams_)
+			if (!stream->outlet->wait_for_consumers(std::max(0.0, deadline - lsl::local_clock())))
+				std::cerr << "Nobody consumes the stream " << stream->header.name << std::endl;
+	}
+	double first = infinity;
+	for (const auto &stream : streams_) {
+		stream->rewind();
+		stream->load(file_);
+		first = std::min(first, stream->next_time());
+	}
+	if (!std::isfinite(first)) return 0;
+
+	// each sample is due at a fixed time after the start, so the pacing doesn't drift
+	const double start = lsl::local_clock();
+	const double shift = start - first;
+	uint64_t pushed = 0;
+	std::vector<double> timestamps;
+	while (!stop) {
+		replayed_stream *next = nullptr;
+		double next_time = infinity;
+		for (const auto &stream : streams_)
+			if (stream->next_time() < next_time) {
+				next = stream.get();
+				next_time = next->next_time();
+			}
+		if (!next) break;
+		// how far the replay is, in the recording's clock
+		double now = infinity;
+		if (options.speed > 0) {
+			const double due = start + (next_time - first) / options.speed;
+			if (!sleep_until(due, stop)) break;
+			now = first + (lsl::local_clock() - start) * options.speed;
+		}
+		// the samples of the stream that are due, up to the end of its current chunk
+		std::size_t end = next->next_sample + 1;
+		while (end < next->samples.size() && next->time(end) <= now) ++end;
+		timestamps.clear();
+		for (std::size_t i = next->next_sample; i < end; ++i)
+			timestamps.push_back(next->time(i) + shift);
+		pushed += end - next->next_sample;
+		next->push(end, timestamps);
+		next->load(file_);
+	}
+	return pushed;
+}
@@ -0,0 +1,54 @@
+#ifndef XDFREPLAY_H
+#define XDFREPLAY_H
+
+#include "xdfreader.h"
+#include <atomic>
+#include <cstdint>
+#include <lsl_cpp.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+/// how xdf_replay::run() paces the samples
+struct replay_options {
+	/// 1: as recorded, N: N times faster, 0: as fast as possible
+	double speed = 1;
+	/// wait up to this many seconds for every outlet to have a consumer before the first sample
+	double wait_for_consumers = 0;
+};
+
+/**
+ * The streams of an XDF file, published again as local LSL outlets, e.g. to test the recorder
+ * or online processing with the rates, channel counts and marker patterns of a real session.
+ *
+ * Each outlet is created from the stream header in the file, so it has the same name, type,
+ * source id, channels and description. The samples are pushed in the order of their timestamps
+ * across all streams (clock offsets applied), with timestamps that keep the recorded intervals,
+ * shifted to the time of the replay; only when they are pushed depends on the speed. The file
+ * is memory mapped and decoded one chunk per stream at a time.
+ */
+class xdf_replay {
+public:
+	/// map the file and create the outlets, throws std::runtime_error if it can't be read
+	explicit xdf_replay(const std::string &filename);
+	~xdf_replay();
+
+	/// the names of the replayed streams
+	std::vector<std::string> stream_names() const;
+
+	/**
+	 * push the samples of all streams (again from the beginning on every call)
+	 * @param stop set to end the replay early
+	 * @return the number of samples that were pushed
+	 */
+	uint64_t run(const replay_options &options, const std::atomic<bool> &stop);
+
+private:
+	struct replayed_stream;
+
+	const std::string filename_;
+	mapped_file file_;
+	std::vector<std::unique_ptr<replayed_stream>> streams_;
+};
+
+#endif
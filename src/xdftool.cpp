@@ -0,0 +1,260 @@
+#include "xdfextract.h"
+#include "xdfintegrity.h"
+#include "xdfmanifest.h"
+#include "xdfrecover.h"
+#include "xdftail.h"
+#include "xdftap.h"
+#include "xdfvalidate.h"
+
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+// Utilities for XDF files written by LabRecorder
+
+static int usage(const char *name) {
+	std::cout << "Usage: " << name << " <command> [options] file.xdf\n\n"
+			  << "Commands:\n"
+			  << "\trecover [--check] file.xdf\n"
+			  << "\t\tRepair an interrupted recording: cut off the partial last chunk and\n"
+			  << "\t\twrite the missing stream footers. --check only reports what would be done.\n"
+			  << "\ttail [--idle=seconds] file.xdf\n"
+			  << "\t\tList the chunks of a file while it's being recorded, until the recording\n"
+			  << "\t\tis finished or no chunk arrived for --idle seconds (default 60).\n"
+			  << "\ttap name\n"
+			  << "\t\tList the chunks published in the shared memory tap of a running recording.\n"
+			  << "\tmerge file.xdf.manifest merged.xdf\n"
+			  << "\t\tCombine the files of a striped recording into a single file.\n"
+			  << "\tverify [--threads=N] file.xdf\n"
+			  << "\t\tCheck the chunk checksums and the digest written with --checksums.\n"
+			  << "\tvalidate [--json] [--threads=N] [--gap-factor=F] file.xdf\n"
+			  << "\t\tCheck that a recording is complete and summarize its streams. Intervals\n"
+			  << "\t\tlonger than F (default 2) sample periods count as gaps.\n"
+			  << "\textract --from=S --to=S [--absolute] file.xdf excerpt.xdf\n"
+			  << "\t\tCopy the samples from --from seconds after the first sample up to --to\n"
+			  << "\t\t(exclusive) into a new file. With --absolute, the times are LSL\n"
+			  << "\t\ttimestamps of the recording computer.\n";
+	return 1;
+}
+
+static int recover(int argc, char **argv) {
+	bool dry_run = false;
+	const char *filename = nullptr;
+	for (int i = 0; i < argc; ++i) {
+		if (std::strcmp(argv[i], "--check") == 0)
+			dry_run = true;
+		else
+			filename = argv[i];
+	}
+	if (!filename) return -1;
+
+	const recovery_report report = recover_xdf(filename, dry_run);
+	std::cout << filename << ": " << report.chunks << " intact chunks, "
+			  << report.original_size - report.intact_size << " bytes of partial data at the end";
+	if (report.skipped_bytes) std::cout << ", " << report.skipped_bytes << " damaged bytes skipped";
+	std::cout << '\n';
+	for (const auto &stream : report.streams) {
+		std::cout << "Stream " << stream.streamid << " (" << stream.name
+				  << "): " << stream.sample_count << " samples, " << stream.first_timestamp
+				  << " - " << stream.last_timestamp << ", " << stream.clock_offsets.size()
+				  << " clock offsets" << (stream.had_footer ? "" : ", footer missing") << '\n';
+	}
+	if (dry_run)
+		std::cout << "Nothing changed (--check)" << std::endl;
+	else
+		std::cout << "Wrote " << report.footers_written << " footers" << std::endl;
+	return 0;
+}
+
+static const char *tag_name(chunk_tag_t tag) {
+	switch (tag) {
+	case chunk_tag_t::fileheader: return "FileHeader";
+	case chunk_tag_t::streamheader: return "StreamHeader";
+	case chunk_tag_t::samples: return "Samples";
+	case chunk_tag_t::clockoffset: return "ClockOffset";
+	case chunk_tag_t::boundary: return "Boundary";
+	case chunk_tag_t::streamfooter: return "StreamFooter";
+	default: return "Undefined";
+	}
+}
+
+static int tail(int argc, char **argv) {
+	double idle = 60;
+	const char *filename = nullptr;
+	for (int i = 0; i < argc; ++i) {
+		if (std::strncmp(argv[i], "--idle=", 7) == 0)
+			idle = std::stod(argv[i] + 7);
+		else
+			filename = argv[i];
+	}
+	if (!filename) return -1;
+
+	xdf_tail_reader reader(filename);
+	tail_chunk chunk;
+	while (reader.next(chunk, idle)) {
+		std::cout << chunk.info.offset << '\t' << tag_name(chunk.info.tag);
+		if (chunk.info.has_streamid()) std::cout << "\tstream " << chunk.info.streamid;
+		uint64_t n_samples;
+		if (chunk.info.tag == chunk_tag_t::samples &&
+			read_sample_count(chunk.content.data(), chunk.content.size(), n_samples))
+			std::cout << '\t' << n_samples << " samples";
+		std::cout << '\t' << chunk.info.end - chunk.info.offset << " bytes" << std::endl;
+	}
+	if (reader.finished())
+		std::cout << "Recording finished at " << reader.offset() << " bytes" << std::endl;
+	else
+		std::cout << "No new data for " << idle << " seconds" << std::endl;
+	return 0;
+}
+
+static int tap(int argc, char **argv) {
+	if (argc != 1) return -1;
+	shm_tap_reader reader(argv[0]);
+	for (const auto &stream : reader.streams())
+		std::cout << "Stream " << stream.first << ": " << xml_value(stream.second, "name") << '\n';
+	const char *data;
+	uint64_t size;
+	while (true) {
+		try {
+			if (!reader.next(data, size, 3600)) break;
+		} catch (std::runtime_error &e) {
+			std::cout << e.what() << ", skipping to the newest data" << std::endl;
+			reader.resync();
+			continue;
+		}
+		chunk_info chunk;
+		uint64_t n_samples = 0;
+		if (parse_chunk_header(data, size, 0, chunk))
+			read_sample_count(data + chunk.content_offset, chunk.content_size(), n_samples);
+		if (!reader.valid()) continue;
+		std::cout << "stream " << chunk.streamid << '\t' << n_samples << " samples\t" << size
+				  << " bytes\t" << reader.lag() << " bytes behind" << std::endl;
+	}
+	std::cout << "The recording is finished" << std::endl;
+	return 0;
+}
+
+static int merge(int argc, char **argv) {
+	if (argc != 2) return -1;
+	const session_manifest manifest = read_manifest(argv[0]);
+	for (const auto &shard : manifest.shards)
+		std::cout << shard.filename << ": " << shard.streams.size() << " streams\n";
+	const merge_report report = merge_shards(manifest, argv[1]);
+	std::cout << "Merged " << report.streams << " streams (" << report.chunks << " chunks, "
+			  << report.bytes << " bytes) into " << argv[1] << std::endl;
+	return 0;
+}
+
+static int verify(int argc, char **argv) {
+	unsigned threads = 0;
+	const char *filename = nullptr;
+	for (int i = 0; i < argc; ++i) {
+		if (std::strncmp(argv[i], "--threads=", 10) == 0)
+			threads = static_cast<unsigned>(std::stoul(argv[i] + 10));
+		else
+			filename = argv[i];
+	}
+	if (!filename) return -1;
+
+	const verify_report report = verify_xdf(filename, threads);
+	std::cout << filename << ": " << report.chunks_checked << " chunks checked ("
+			  << report.bytes_checked << " of " << report.file_size << " bytes), "
+			  << report.bad_chunks.size() << " damaged\n";
+	for (uint64_t offset : report.bad_chunks)
+		std::cout << "Damaged chunk at " << offset << '\n';
+	if (report.bytes_checked < report.file_size)
+		std::cout << report.file_size - report.bytes_checked << " bytes without checksums\n";
+	if (report.has_digest)
+		std::cout << "SHA-256 " << (report.digest_ok ? "OK" : "MISMATCH") << std::endl;
+	else
+		std::cout << "No digest, the recording wasn't closed properly" << std::endl;
+	return report.bad_chunks.empty() && report.digest_ok ? 0 : 3;
+}
+
+static int validate(int argc, char **argv) {
+	bool json = false;
+	unsigned threads = 0;
+	double gap_factor = 2;
+	const char *filename = nullptr;
+	for (int i = 0; i < argc; ++i) {
+		if (std::strcmp(argv[i], "--json") == 0)
+			json = true;
+		else if (std::strncmp(argv[i], "--threads=", 10) == 0)
+			threads = static_cast<unsigned>(std::stoul(argv[i] + 10));
+		else if (std::strncmp(argv[i], "--gap-factor=", 13) == 0)
+			gap_factor = std::stod(argv[i] + 13);
+		else
+			filename = argv[i];
+	}
+	if (!filename) return -1;
+
+	const xdf_validation v = validate_xdf(filename, threads, gap_factor);
+	if (json) {
+		std::cout << validation_to_json(v) << std::endl;
+		return v.ok() ? 0 : 3;
+	}
+	std::cout << filename << ": " << v.file_size << " bytes, " << v.chunks << " chunks, "
+			  << v.boundaries << " boundaries\n";
+	for (const auto &problem : v.problems) std::cout << "Problem: " << problem << '\n';
+	std::cout.precision(10);
+	for (const auto &s : v.streams) {
+		std::cout << "Stream " << s.streamid << " (" << s.name << ", " << s.type << "): "
+				  << s.channel_count << " x " << s.channel_format << " @ " << s.nominal_srate
+				  << " Hz\n\t" << s.sample_count << " samples in " << s.chunks << " chunks, "
+				  << s.first_timestamp << " - " << s.last_timestamp << " (effective "
+				  << s.effective_srate << " Hz), " << s.clock_offsets << " clock offsets\n";
+		if (s.nominal_srate > 0)
+			std::cout << '\t' << s.gaps << " gaps, longest interval " << s.max_gap << " s, "
+					  << s.backwards << " timestamps going backwards\n";
+		for (const auto &problem : s.problems) std::cout << "\tProblem: " << problem << '\n';
+	}
+	std::cout << (v.ok() ? "The file is complete" : "The file has problems") << std::endl;
+	return v.ok() ? 0 : 3;
+}
+
+static int extract(int argc, char **argv) {
+	double from = 0, to = -1;
+	bool absolute = false;
+	std::vector<const char *> files;
+	for (int i = 0; i < argc; ++i) {
+		if (std::strncmp(argv[i], "--from=", 7) == 0)
+			from = std::stod(argv[i] + 7);
+		else if (std::strncmp(argv[i], "--to=", 5) == 0)
+			to = std::stod(argv[i] + 5);
+		else if (std::strcmp(argv[i], "--absolute") == 0)
+			absolute = true;
+		else
+			files.push_back(argv[i]);
+	}
+	if (files.size() != 2 || to <= from) return -1;
+
+	const extract_report report = extract_xdf(files[0], files[1], from, to, !absolute);
+	std::cout.precision(10);
+	std::cout << "Extracted " << report.begin - report.recording_start << " - "
+			  << report.end - report.recording_start << " s after the first sample ("
+			  << report.begin << " - " << report.end << "): " << report.samples
+			  << " samples of " << report.streams << " streams\n"
+			  << report.chunks_copied << " samples chunks copied unchanged, " << report.chunks_split
+			  << " split at the edges; " << report.bytes_copied << " bytes copied unchanged ("
+			  << report.bytes_copied_in_kernel << " by the kernel)\n"
+			  << "Wrote " << report.bytes << " bytes to " << files[1] << std::endl;
+	return 0;
+}
+
+int main(int argc, char **argv) {
+	if (argc < 3) return usage(argv[0]);
+	const std::map<std::string, int (*)(int, char **)> commands{
+		{"recover", recover}, {"tail", tail}, {"tap", tap}, {"merge", merge},
+		{"verify", verify}, {"validate", validate}, {"extract", extract}};
+	const auto command = commands.find(argv[1]);
+	if (command == commands.end()) return usage(argv[0]);
+	try {
+		const int result = command->second(argc - 2, argv + 2);
+		return result < 0 ? usage(argv[0]) : result;
+	} catch (std::exception &e) {
+		std::cerr << "Error: " << e.what() << std::endl;
+		return 2;
+	}
+}
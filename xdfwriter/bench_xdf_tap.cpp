@@ -0,0 +1,58 @@
+#include "xdftap.h"
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+
+// Throughput of the shared memory tap with one writer and one reader
+// usage: benchxdftap [chunk size in bytes] [number of chunks] [ring size in MiB]
+int main(int argc, char **argv) {
+	const std::size_t chunk_size = argc > 1 ? std::stoul(argv[1]) : 16 * 1024;
+	const uint64_t n_chunks = argc > 2 ? std::stoull(argv[2]) : 200000;
+	const uint64_t ring_size = (argc > 3 ? std::stoull(argv[3]) : 64) * 1024 * 1024;
+	const std::string name = "xdfwriter_bench_tap";
+
+	auto writer = std::make_unique<shm_tap_writer>(name, ring_size);
+	uint64_t received = 0, received_bytes = 0, resyncs = 0;
+	std::thread consumer([&]() {
+		shm_tap_reader reader(name);
+		const char *data;
+		uint64_t size;
+		while (true) {
+			try {
+				if (!reader.next(data, size, 1.0)) break;
+				// touch the data like a real consumer would
+				volatile char sum = 0;
+				for (uint64_t i = 0; i < size; i += 64) sum = sum + data[i];
+				if (reader.valid()) {
+					++received;
+					received_bytes += size;
+				}
+			} catch (std::runtime_error &) {
+				++resyncs;
+				reader.resync();
+			}
+		}
+	});
+	// give the reader time to attach
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+	const std::string chunk(chunk_size, 'x');
+	const auto start = std::chrono::steady_clock::now();
+	for (uint64_t i = 0; i < n_chunks; ++i) writer->publish(chunk);
+	const double seconds =
+		std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	const tap_stats stats = writer->stats();
+	// closing the tap lets the reader finish
+	writer.reset();
+	consumer.join();
+
+	std::cout << "Published " << n_chunks << " chunks of " << chunk_size << " bytes in "
+			  << seconds * 1000 << " ms: " << n_chunks / seconds / 1e6 << " M chunks/s, "
+			  << stats.bytes_published / seconds / 1e9 << " GB/s\n"
+			  << "Reader received " << received << " chunks (" << received_bytes / 1e6
+			  << " MB), was dropped " << resyncs << " times, max lag " << stats.max_lag / 1024
+			  << " KiB" << std::endl;
+	return 0;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+#include <string>
+
+// the JSON formatting shared by all reports (validation, health, signal summaries, sessions, BIDS)
+
+/// a quoted JSON string: quotes and backslashes are escaped, control characters as \uXXXX
+inline std::string json_string(const std::string &str) {
+	std::string quoted = "\"";
+	quoted.reserve(str.size() + 2);
+	for (char c : str) {
+		const auto u = static_cast<unsigned char>(c);
+		if (c == '"' || c == '\\')
+			(quoted += '\\') += c;
+		else if (c == '\n')
+			quoted += "\\n";
+		else if (c == '\t')
+			quoted += "\\t";
+		else if (c == '\r')
+			quoted += "\\r";
+		else if (u < 0x20) {
+			char escaped[8];
+			std::snprintf(escaped, sizeof(escaped), "\\u%04x", u);
+			quoted += escaped;
+		} else
+			quoted += c;
+	}
+	return quoted += '"';
+}
+
+/**
+ * @brief json_number The shortest representation that reads back as the same value,
+ * independent of the locale
+ * @param unknown What to write for infinity and NaN, which JSON can't represent
+ */
+inline std::string json_number(double v, const char *unknown = "null") {
+	if (!std::isfinite(v)) return unknown;
+	char buf[32];
+	return std::string(buf, std::to_chars(buf, buf + sizeof(buf), v).ptr);
+}
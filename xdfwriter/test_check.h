@@ -0,0 +1,10 @@
+#pragma once
+
+#include <iostream>
+
+// the assertion of the tests: report the failed condition and return 1 from the test function
+#define CHECK(cond)                                                                                \
+	if (!(cond)) {                                                                                 \
+		std::cerr << __FILE__ << ':' << __LINE__ << ": check failed: " #cond << std::endl;         \
+		return 1;                                                                                  \
+	}
@@ -0,0 +1,73 @@
+#include "test_check.h"
+#include "xdfextract.h"
+#include "xdfvalidate.h"
+#include <cmath>
+#include <filesystem>
+#include <iostream>
+
+static std::string header(const char *name, const char *format, double srate) {
+	return std::string("<?xml version=\"1.0\"?><info><name>") + name +
+		   "</name><type>Test</type><channel_count>2</channel_count><nominal_srate>" +
+		   std::to_string(srate) + "</nominal_srate><channel_format>" + format +
+		   "</channel_format></info>";
+}
+
+int main() {
+	const char *filename = "test_extract.xdf";
+	const std::vector<std::pair<double, double>> no_offsets;
+	{
+		XDFWriter w(filename);
+		w.write_stream_header(1, header("EEG", "float32", 100));
+		w.write_stream_header(2, header("Markers", "string", 0));
+		for (int i = 0; i < 100; ++i) {
+			// 10 samples per chunk, only the first timestamp of the recording is written
+			std::vector<double> ts(10, 0.0);
+			if (i == 0) ts[0] = 100;
+			w.write_data_chunk(1, ts, std::vector<float>(20, static_cast<float>(i)), 2);
+			if (i % 10 == 0) {
+				w.write_data_chunk(2, std::vector<double>{100.0 + i * 0.1},
+					std::vector<std::string>{"a", "b"}, 2);
+				// the EEG amplifier's clock is 0.5 s behind the recording computer's
+				w.write_stream_offset(1, 100.5 + i * 0.1, 0.5);
+			}
+			if (i % 10 == 5) w.write_boundary_chunk();
+		}
+		w.write_stream_footer(1, stream_footer_xml(100, 109.99, 1000, no_offsets));
+		w.write_stream_footer(2, stream_footer_xml(100, 109, 10, no_offsets));
+	}
+
+	// the recording starts with the first marker at 100; the EEG samples from 101.555 (156) up
+	// to 103.555 (355) are in the excerpt, i.e. the chunks 16-34 and parts of 15 and 35
+	const char *excerpt = "test_extract_excerpt.xdf";
+	const extract_report report = extract_xdf(filename, excerpt, 2.055, 4.055);
+	CHECK(report.recording_start == 100 && std::abs(report.begin - 102.055) < 1e-9);
+	CHECK(report.streams == 2 && report.samples == 202);
+	CHECK(report.chunks_split == 2 && report.chunks_copied == 19 + 2);
+	CHECK(report.bytes == std::filesystem::file_size(excerpt));
+	CHECK(report.bytes_copied > 0 && report.bytes_copied_in_kernel <= report.bytes_copied);
+
+	const xdf_validation v = validate_xdf(excerpt);
+	CHECK(v.ok() && v.has_file_header && v.boundaries >= 3);
+	CHECK(v.streams.size() == 2);
+	const auto &eeg = v.streams[0];
+	CHECK(eeg.name == "EEG" && eeg.sample_count == 200 && eeg.has_footer);
+	// the first sample got its timestamp, the split chunk's samples were deduced in the original
+	CHECK(std::abs(eeg.first_timestamp - 101.56) < 1e-6);
+	CHECK(std::abs(eeg.last_timestamp - 103.55) < 1e-6);
+	CHECK(eeg.gaps == 0);
+	// the offsets at 102.5 and 103.5, and the last one before and the first one after
+	CHECK(eeg.clock_offsets == 4);
+	const auto &markers = v.streams[1];
+	CHECK(markers.sample_count == 2 && markers.first_timestamp == 103 &&
+		  markers.last_timestamp == 104);
+
+	// the same time range in the recording computer's clock
+	CHECK(extract_xdf(filename, excerpt, 102.055, 104.055, false).bytes == report.bytes);
+
+	// a time range after the recording: the headers and empty footers only
+	const extract_report empty = extract_xdf(filename, excerpt, 100, 200);
+	CHECK(empty.samples == 0 && empty.chunks_copied == 0);
+	CHECK(validate_xdf(excerpt).streams.size() == 2);
+	std::cout << "Extraction tests passed" << std::endl;
+	return 0;
+}
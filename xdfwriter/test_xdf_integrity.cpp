@@ -0,0 +1,102 @@
+#include "test_check.h"
+#include "xdfintegrity.h"
+#include "xdfwriter.h"
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+const char *header = "<?xml version=\"1.0\"?><info><name>Archived</name><type>EEG</type>"
+					 "<channel_count>8</channel_count><nominal_srate>100</nominal_srate>"
+					 "<channel_format>float32</channel_format></info>";
+
+const int n_chunks = 50;
+
+static void record(const char *filename, open_mode mode, streamid_t streamid) {
+	XDFWriter w(filename, {}, mode);
+	w.set_integrity();
+	w.write_stream_header(streamid, header);
+	for (int i = 0; i < n_chunks; ++i)
+		w.write_data_chunk(streamid, std::vector<double>(10, 100.0 + i),
+			std::vector<float>(80, static_cast<float>(i)), 8);
+	const std::vector<std::pair<double, double>> no_offsets;
+	w.write_stream_footer(
+		streamid, stream_footer_xml(100, 100 + n_chunks, 10 * n_chunks, no_offsets));
+}
+
+static std::string file_digest(const char *filename) {
+	std::ifstream in(filename, std::ios::binary);
+	std::stringstream content;
+	content << in.rdbuf();
+	sha256 digest;
+	digest.update(content.str().data(), content.str().size());
+	return digest.hex_digest();
+}
+
+int main() {
+	// reference values
+	CHECK(crc32c("123456789", 9) == 0xE3069283);
+	CHECK(crc32c("", 0) == 0);
+	const std::string text = "The quick brown fox jumps over the lazy dog, several times over.";
+	for (std::size_t split = 0; split <= text.size(); ++split)
+		CHECK(crc32c(text.data() + split, text.size() - split, crc32c(text.data(), split)) ==
+			  crc32c(text.data(), text.size()));
+	{
+		sha256 empty;
+		CHECK(empty.hex_digest() ==
+			  "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+		sha256 abc;
+		abc.update("abc", 3);
+		CHECK(abc.hex_digest() ==
+			  "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+		// a million 'a's, in pieces that don't line up with the blocks
+		sha256 million;
+		const std::string piece(1000, 'a');
+		for (int i = 0; i < 1001; ++i) million.update(piece.data(), i < 1000 ? 999 : 1000);
+		CHECK(million.hex_digest() ==
+			  "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+	}
+
+	const char *filename = "test_integrity.xdf";
+	record(filename, open_mode::truncate, 1);
+	const auto size = std::filesystem::file_size(filename);
+	verify_report report = verify_xdf(filename, 4);
+	// file header, stream header, samples, footer
+	CHECK(report.chunks_checked == n_chunks + 3);
+	CHECK(report.bytes_checked == size);
+	CHECK(report.bad_chunks.empty());
+	CHECK(report.has_digest && report.digest_ok);
+	{
+		std::ifstream in(digest_filename(filename));
+		std::string digest, name;
+		in >> digest >> name;
+		CHECK(digest == file_digest(filename));
+		CHECK(name == filename);
+	}
+
+	// appending continues the checksums and covers the whole file
+	record(filename, open_mode::append, 2);
+	report = verify_xdf(filename, 3);
+	// one file header, two streams and the boundary chunk that marks the appended part
+	CHECK(report.chunks_checked == 1 + 2 * (n_chunks + 2) + 1);
+	CHECK(report.bytes_checked == std::filesystem::file_size(filename));
+	CHECK(report.bad_chunks.empty() && report.digest_ok);
+
+	// a damaged byte is pinned down to its chunk
+	const uint64_t damaged = size / 2;
+	{
+		std::fstream f(filename, std::ios::binary | std::ios::in | std::ios::out);
+		f.seekg(damaged);
+		char c = 0;
+		f.get(c);
+		f.seekp(damaged);
+		f.put(static_cast<char>(c ^ 0x10));
+	}
+	report = verify_xdf(filename);
+	CHECK(report.bad_chunks.size() == 1);
+	CHECK(report.bad_chunks[0] <= damaged && damaged - report.bad_chunks[0] < 400);
+	CHECK(report.has_digest && !report.digest_ok);
+	std::cout << "Integrity test passed (CRC32C " << (crc32c_hardware() ? "hardware" : "software")
+			  << ")" << std::endl;
+	return 0;
+}
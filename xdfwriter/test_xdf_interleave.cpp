@@ -0,0 +1,61 @@
+#include "test_check.h"
+#include "xdfreader.h"
+#include <iostream>
+#include <utility>
+
+const char *header = "<?xml version=\"1.0\"?><info><name>Interleaved</name><type>EEG</type>"
+					 "<channel_count>1</channel_count><nominal_srate>10</nominal_srate>"
+					 "<channel_format>float32</channel_format></info>";
+
+// one second of samples starting at t, all but the first timestamp deduced
+static void write_second(XDFWriter &w, streamid_t streamid, double t) {
+	std::vector<double> ts(10, 0.0);
+	ts[0] = t;
+	w.write_data_chunk(streamid, ts, std::vector<float>(10, static_cast<float>(streamid)), 1);
+}
+
+int main() {
+	const char *filename = "test_interleave.xdf";
+	interleave_stats stats;
+	{
+		XDFWriter w(filename);
+		w.set_interleaving(60, 1024 * 1024);
+		w.write_stream_header(1, header);
+		w.write_stream_header(2, header);
+		// stream 1 is three seconds ahead of stream 2
+		for (int t = 0; t < 3; ++t) write_second(w, 1, 100 + t);
+		CHECK(w.interleave_statistics().chunks_buffered == 3);
+		for (int t = 0; t < 3; ++t) write_second(w, 2, 100 + t);
+		CHECK(w.interleave_statistics().chunks_buffered == 0);
+		// stream 1 could still send data before this chunk
+		write_second(w, 2, 103);
+		CHECK(w.interleave_statistics().chunks_buffered == 1);
+		// but the footer needs all samples of its stream to be written first
+		const std::vector<std::pair<double, double>> no_offsets;
+		w.write_stream_footer(2, stream_footer_xml(100, 103.9, 40, no_offsets));
+		CHECK(w.interleave_statistics().chunks_buffered == 0);
+		stats = w.interleave_statistics();
+	}
+	CHECK(stats.chunks_written == 7 && stats.chunks_late == 0);
+	CHECK(stats.max_bytes_buffered > 0 && stats.bytes_buffered == 0);
+
+	// read back the order of the samples chunks
+	mapped_file file(filename);
+	const auto info = parse_stream_header(header);
+	double last_timestamp[3] = {0, 0, 0};
+	std::vector<std::pair<streamid_t, double>> order;
+	chunk_info chunk;
+	for (uint64_t pos = 4; parse_chunk_header(file.data(), file.size(), pos, chunk);
+		 pos = chunk.end) {
+		if (chunk.tag != chunk_tag_t::samples) continue;
+		std::vector<sample_ref> samples;
+		CHECK(decode_samples(file.data() + chunk.content_offset, chunk.content_size(), info,
+			last_timestamp[chunk.streamid], samples));
+		order.emplace_back(chunk.streamid, samples.front().timestamp);
+	}
+	const std::vector<std::pair<streamid_t, double>> expected = {
+		{1, 100}, {2, 100}, {1, 101}, {2, 101}, {1, 102}, {2, 102}, {2, 103}};
+	CHECK(order == expected);
+	std::cout << "Interleaving test passed" << std::endl;
+	return 0;
+}
@@ -0,0 +1,88 @@
+#include "test_check.h"
+#include "xdfrecover.h"
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+const char *header = "<?xml version=\"1.0\"?><info><name>Crashed</name><type>EEG</type>"
+					 "<channel_count>2</channel_count><nominal_srate>100</nominal_srate>"
+					 "<channel_format>float32</channel_format></info>";
+
+int main() {
+	const char *filename = "test_recover.xdf";
+	{
+		XDFWriter w(filename);
+		w.write_stream_header(1, header);
+		w.write_stream_header(2, header);
+		const std::vector<std::pair<double, double>> no_offsets;
+		w.write_stream_footer(2, stream_footer_xml(0, 0, 0, no_offsets));
+		w.write_boundary_chunk();
+		// 10 samples, all but the first timestamp deduced
+		std::vector<double> ts(10, 0.0);
+		ts[0] = 100;
+		w.write_data_chunk(1, ts, std::vector<float>(20, 1.f), 2);
+		w.write_stream_offset(1, 105, .5);
+		w.write_boundary_chunk();
+		// 5 more samples, continuing the deduced timestamps from the previous chunk
+		w.write_data_chunk(1, std::vector<double>(5, 0.0), std::vector<float>(10, 2.f), 2);
+	}
+	const auto intact_size = std::filesystem::file_size(filename);
+	{
+		// simulate a crash in the middle of a samples chunk
+		std::ofstream out(filename, std::ios::binary | std::ios::app);
+		const char partial[] = {4, 0x10, 0x27, 0, 0, 3, 0, 1, 0, 0, 0, 4, 42};
+		out.write(partial, sizeof(partial));
+	}
+
+	auto report = recover_xdf(filename);
+	CHECK(report.original_size == intact_size + 13);
+	CHECK(report.intact_size == intact_size);
+	CHECK(std::filesystem::file_size(filename) > intact_size); // footers were appended
+	CHECK(report.max_streamid == 2);
+	CHECK(report.footers_written == 1);
+	CHECK(report.streams.size() == 2);
+	const auto &stream = report.streams[0];
+	CHECK(stream.sample_count == 15);
+	CHECK(stream.first_timestamp == 100);
+	CHECK(std::abs(stream.last_timestamp - 100.14) < 1e-9);
+	CHECK(stream.clock_offsets.size() == 1 && stream.clock_offsets[0].second == .5);
+
+	// the recovered file is intact, recovering it again doesn't change it
+	const auto recovered_size = std::filesystem::file_size(filename);
+	report = recover_xdf(filename);
+	CHECK(report.intact_size == recovered_size && report.footers_written == 0);
+
+	// resume recording into the same file
+	{
+		XDFWriter w(filename, {}, open_mode::resume);
+		CHECK(w.max_streamid() == 2);
+		w.write_stream_header(3, header);
+		w.write_data_chunk(3, {200}, std::vector<float>{3.f, 3.f}, 2);
+	}
+	report = recover_xdf(filename, true);
+	CHECK(report.skipped_bytes == 0 && report.streams.size() == 3);
+	CHECK(report.streams[2].sample_count == 1 && !report.streams[2].had_footer);
+
+	// a damaged chunk before the last boundary is skipped up to the next boundary
+	uint64_t damaged = 0;
+	{
+		mapped_file file(filename);
+		chunk_info chunk;
+		for (uint64_t pos = 4; !damaged && parse_chunk_header(file.data(), file.size(), pos, chunk);
+			 pos = chunk.end)
+			if (chunk.tag == chunk_tag_t::samples) damaged = pos;
+	}
+	{
+		std::fstream out(filename, std::ios::binary | std::ios::in | std::ios::out);
+		out.seekp(damaged);
+		out.put(3); // an invalid number of length bytes
+	}
+	const auto damaged_size = std::filesystem::file_size(filename);
+	report = recover_xdf(filename, true);
+	CHECK(report.skipped_bytes > 0 && report.intact_size == damaged_size);
+	// the samples of the first chunk are lost, the ones after the boundary are counted
+	CHECK(report.streams[0].sample_count == 5 && report.streams[2].sample_count == 1);
+	std::cout << "Recovery tests passed" << std::endl;
+	return 0;
+}
@@ -0,0 +1,103 @@
+#include "test_check.h"
+#include "xdfmanifest.h"
+#include "xdfreader.h"
+#include <filesystem>
+#include <iostream>
+#include <map>
+
+static std::string header(const char *name) {
+	return std::string("<?xml version=\"1.0\"?><info><name>") + name +
+		   "</name><type>EEG</type><channel_count>2</channel_count><nominal_srate>10"
+		   "</nominal_srate><channel_format>float32</channel_format></info>";
+}
+
+const int n_chunks = 30;
+
+// one stream per shard, with chunks of 10 samples (1 second) that alternate between the shards
+static void write_shard(const std::string &filename, const session_manifest &manifest,
+	std::size_t shard, streamid_t streamid) {
+	XDFWriter w(filename, {}, open_mode::truncate,
+		shard_header_fields(manifest.session_id, manifest.session_start, shard, 2));
+	w.write_stream_header(streamid, header(shard ? "Second" : "First"));
+	const std::vector<std::pair<double, double>> no_offsets;
+	for (int i = 0; i < n_chunks; ++i) {
+		const double t0 = 100 + i + 0.5 * shard;
+		std::vector<double> timestamps(10, 0.0);
+		timestamps[0] = t0;
+		w.write_data_chunk(streamid, timestamps, std::vector<float>(20, 1.f * i), 2);
+		if (i % 5 == 0) w.write_stream_offset(streamid, t0 + 0.2, 0.001);
+		if (i % 10 == 9) w.write_boundary_chunk();
+	}
+	w.write_stream_footer(
+		streamid, stream_footer_xml(100, 100 + n_chunks, 10 * n_chunks, no_offsets));
+}
+
+int main() {
+	std::filesystem::create_directories("shards");
+	session_manifest manifest;
+	manifest.session_id = new_session_id();
+	manifest.session_start = 99.5;
+	manifest.shards = {
+		{"test_shard0.xdf", {{1, "First"}}}, {"shards/test_shard1.xdf", {{2, "Second"}}}};
+	write_shard("test_shard0.xdf", manifest, 0, 1);
+	write_shard("shards/test_shard1.xdf", manifest, 1, 2);
+
+	const std::string manifest_file = manifest_filename("test_shard0.xdf");
+	write_manifest(manifest_file, manifest);
+	const session_manifest read = read_manifest(manifest_file);
+	CHECK(read.session_id == manifest.session_id);
+	CHECK(read.session_start == 99.5);
+	CHECK(read.shards.size() == 2);
+	CHECK(std::filesystem::equivalent(read.shards[1].filename, "shards/test_shard1.xdf"));
+	CHECK(read.shards[1].streams.size() == 1 && read.shards[1].streams[0].first == 2);
+	CHECK(read.shards[1].streams[0].second == "Second");
+
+	const merge_report report = merge_shards(read, "test_merged.xdf");
+	CHECK(report.streams == 2);
+	// 2 headers, 2 * 30 samples chunks, 2 * 6 clock offsets, 2 footers
+	CHECK(report.chunks == 2 + 2 * n_chunks + 2 * 6 + 2);
+	CHECK(report.boundaries == 2);
+	CHECK(report.bytes == std::filesystem::file_size("test_merged.xdf"));
+
+	// headers first, then everything in time order, then the footers
+	mapped_file merged("test_merged.xdf");
+	const char *data = merged.data();
+	std::map<streamid_t, stream_header_info> headers;
+	std::map<streamid_t, double> last_timestamps;
+	std::map<chunk_tag_t, int> counts;
+	std::vector<sample_ref> samples;
+	chunk_info chunk;
+	double last_key = 0;
+	for (uint64_t pos = 4; pos < merged.size(); pos = chunk.end) {
+		CHECK(parse_chunk_header(data, merged.size(), pos, chunk));
+		const std::string content(data + chunk.content_offset, chunk.content_size());
+		counts[chunk.tag]++;
+		switch (chunk.tag) {
+		case chunk_tag_t::fileheader:
+			CHECK(xml_value(content, "session_id") == manifest.session_id);
+			break;
+		case chunk_tag_t::streamheader:
+			CHECK(counts[chunk_tag_t::samples] == 0);
+			headers[chunk.streamid] = parse_stream_header(content);
+			break;
+		case chunk_tag_t::samples:
+			CHECK(decode_samples(content.data(), content.size(), headers[chunk.streamid],
+				last_timestamps[chunk.streamid], samples));
+			CHECK(samples.size() == 10);
+			CHECK(samples.front().timestamp >= last_key);
+			last_key = samples.front().timestamp;
+			break;
+		case chunk_tag_t::streamfooter:
+			CHECK(counts[chunk_tag_t::samples] == 2 * n_chunks);
+			break;
+		default: break;
+		}
+	}
+	CHECK(counts[chunk_tag_t::fileheader] == 1);
+	CHECK(counts[chunk_tag_t::boundary] == 2);
+	CHECK(counts[chunk_tag_t::clockoffset] == 12);
+	CHECK(counts[chunk_tag_t::streamfooter] == 2);
+	CHECK(last_timestamps[2] > last_timestamps[1]);
+	std::cout << "Shard merge test passed" << std::endl;
+	return 0;
+}
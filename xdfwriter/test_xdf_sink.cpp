@@ -0,0 +1,175 @@
+#include "test_check.h"
+#include "xdfreader.h"
+#include "xdfwriter.h"
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Spill budget, dropping and alarm of a stalled main file, write errors and syncs
+
+const char *header = "<?xml version=\"1.0\"?><info><name>Wide</name><type>EEG</type>"
+					 "<channel_count>1024</channel_count><nominal_srate>1000</nominal_srate>"
+					 "<channel_format>float32</channel_format></info>";
+
+#ifndef _WIN32
+/// a stalled disk: a FIFO that isn't read until the test drains it
+static int test_spill_budget() {
+	const char *fifo = "test_sink.fifo";
+	std::filesystem::remove(fifo);
+	CHECK(mkfifo(fifo, 0600) == 0);
+	// opening the reading end first lets the writer open the FIFO without blocking
+	const int reader = open(fifo, O_RDONLY | O_NONBLOCK);
+	CHECK(reader >= 0);
+
+	const std::size_t budget = 400 * 1024;
+	const int n_chunks = 40, boundary_interval = 10;
+	// about 40 KiB per samples chunk
+	const std::vector<float> samples(10 * 1024, 1.f);
+	XDFWriter w(fifo);
+	w.set_spill_budget(budget, budget / 4, 0.1);
+	w.write_stream_header(1, header);
+	for (int i = 0; i < n_chunks; ++i) {
+		w.write_data_chunk(1, std::vector<double>(10, 100.0 + i), samples, 1024);
+		if (i % boundary_interval == boundary_interval - 1) {
+			w.write_stream_offset(1, 100.0 + i, 0.001);
+			w.write_boundary_chunk();
+		}
+	}
+	std::this_thread::sleep_for(std::chrono::milliseconds(300));
+
+	// the writer is stuck in a write call, the queue is full and samples are dropped
+	const sink_stats stalled = w.sink_statistics().front();
+	CHECK(stalled.alarm && !stalled.failed);
+	CHECK(stalled.stalled_seconds > 0.1);
+	CHECK(stalled.chunks_dropped > 0 && stalled.chunks_dropped < n_chunks);
+	CHECK(stalled.bytes_dropped >= stalled.chunks_dropped * samples.size() * sizeof(float));
+	// only the headers, offsets and boundaries may exceed the budget
+	CHECK(stalled.max_bytes_queued <= budget + 4 * 1024);
+	w.write_stream_footer(1, stream_footer_xml(100, 100 + n_chunks, 10 * n_chunks,
+								 std::vector<std::pair<double, double>>()));
+
+	// the disk recovers: everything that was queued is written
+	std::string data;
+	std::thread drain([&]() {
+		fcntl(reader, F_SETFL, fcntl(reader, F_GETFL) & ~O_NONBLOCK);
+		char buf[65536];
+		for (ssize_t n; (n = read(reader, buf, sizeof(buf))) > 0;) data.append(buf, n);
+	});
+	w.close();
+	drain.join();
+	::close(reader);
+	std::filesystem::remove(fifo);
+
+	const sink_stats done = w.sink_statistics().front();
+	CHECK(!done.failed && done.bytes_queued == 0);
+	CHECK(done.chunks_dropped == stalled.chunks_dropped);
+	CHECK(data.size() == done.bytes_written && data.compare(0, 4, "XDF:") == 0);
+	std::map<chunk_tag_t, int> tags;
+	chunk_info chunk;
+	uint64_t pos = 4;
+	for (; parse_chunk_header(data.data(), data.size(), pos, chunk); pos = chunk.end)
+		tags[chunk.tag]++;
+	CHECK(pos == data.size());
+	// samples chunks are dropped, everything else is needed to read the file
+	CHECK(tags[chunk_tag_t::fileheader] == 1 && tags[chunk_tag_t::streamheader] == 1);
+	CHECK(tags[chunk_tag_t::boundary] == n_chunks / boundary_interval);
+	CHECK(tags[chunk_tag_t::clockoffset] == n_chunks / boundary_interval);
+	CHECK(tags[chunk_tag_t::streamfooter] == 1);
+	CHECK(tags[chunk_tag_t::samples] == n_chunks - static_cast<int>(done.chunks_dropped));
+	return 0;
+}
+#endif
+
+/// write chunks of about 40 KiB with a boundary after every `boundary_interval` chunks
+static std::vector<sink_stats> write_synced(
+	const durability_policy &durability, int n_chunks, int boundary_interval) {
+	const std::vector<float> samples(10 * 1024, 1.f);
+	XDFWriter w("test_sync.xdf", {"test_sync_mirror.xdf"}, open_mode::truncate, std::string(),
+		durability);
+	w.write_stream_header(1, header);
+	for (int i = 0; i < n_chunks; ++i) {
+		w.write_data_chunk(1, std::vector<double>(10, 100.0 + i), samples, 1024);
+		if (boundary_interval && i % boundary_interval == boundary_interval - 1)
+			w.write_boundary_chunk();
+	}
+	w.write_stream_footer(1, stream_footer_xml(100, 100 + n_chunks, 10 * n_chunks,
+								 std::vector<std::pair<double, double>>()));
+	w.close();
+	std::filesystem::remove("test_sync.xdf");
+	std::filesystem::remove("test_sync_mirror.xdf");
+	return w.sink_statistics();
+}
+
+/// syncs happen at boundaries (periodic) and after max_unsynced_bytes (group_commit)
+static int test_durability() {
+	// a long interval, so only boundaries, the size limit and closing the file trigger syncs
+	durability_policy policy;
+	policy.interval = 60;
+	CHECK(write_synced(policy, 10, 2).front().syncs == 0);
+
+	policy.mode = durability_mode::periodic;
+	for (const sink_stats &stats : write_synced(policy, 10, 2)) {
+		// after each of the five boundaries; the footer is synced when closing
+		CHECK(stats.syncs == 6 && stats.unsynced_bytes == 0 && !stats.failed);
+		CHECK(stats.sync_seconds > 0 && stats.max_sync_latency > 0);
+		CHECK(stats.mean_sync_latency() <= stats.max_sync_latency);
+	}
+	// the size limit is ignored in periodic mode
+	policy.max_unsynced_bytes = 64 * 1024;
+	CHECK(write_synced(policy, 10, 0).front().syncs == 1);
+
+	policy.mode = durability_mode::group_commit;
+	for (const sink_stats &stats : write_synced(policy, 10, 0)) {
+		// after every second chunk (80 KiB), and the footer when closing
+		CHECK(stats.syncs == 6 && stats.unsynced_bytes == 0 && !stats.failed);
+		CHECK(stats.max_sync_latency > 0);
+		CHECK(stats.mean_sync_latency() <= stats.max_sync_latency);
+	}
+	return 0;
+}
+
+#ifdef __linux__
+/// a write error on the main file is thrown by every later write and by close()
+static int test_write_error() {
+	// every write to /dev/full fails with ENOSPC
+	XDFWriter w("/dev/full");
+	const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+	while (!w.sink_statistics().front().failed && std::chrono::steady_clock::now() < deadline)
+		std::this_thread::sleep_for(std::chrono::milliseconds(5));
+	CHECK(w.sink_statistics().front().failed && w.sink_statistics().front().alarm);
+	bool thrown = false;
+	try {
+		w.write_stream_header(1, header);
+	} catch (std::runtime_error &) { thrown = true; }
+	CHECK(thrown);
+	thrown = false;
+	try {
+		w.close();
+	} catch (std::runtime_error &) { thrown = true; }
+	CHECK(thrown);
+	return 0;
+}
+#endif
+
+int main() {
+#ifndef _WIN32
+	if (int failed = test_spill_budget()) return failed;
+#endif
+	if (int failed = test_durability()) return failed;
+#ifdef __linux__
+	if (int failed = test_write_error()) return failed;
+#endif
+	std::cout << "Sink tests passed" << std::endl;
+	return 0;
+}
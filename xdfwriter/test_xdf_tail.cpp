@@ -0,0 +1,54 @@
+#include "test_check.h"
+#include "xdftail.h"
+#include <filesystem>
+#include <iostream>
+#include <thread>
+#include <utility>
+
+const char *header = "<?xml version=\"1.0\"?><info><name>Growing</name><type>EEG</type>"
+					 "<channel_count>4</channel_count><nominal_srate>100</nominal_srate>"
+					 "<channel_format>float32</channel_format></info>";
+
+const int n_chunks = 20;
+
+static void write_slowly(const char *filename) {
+	XDFWriter w(filename);
+	w.set_watermark(0.01);
+	w.write_stream_header(1, header);
+	for (int i = 0; i < n_chunks; ++i) {
+		w.write_data_chunk(1, std::vector<double>(10, 100.0 + i), std::vector<float>(40, 1.f), 4);
+		std::this_thread::sleep_for(std::chrono::milliseconds(5));
+	}
+	const std::vector<std::pair<double, double>> no_offsets;
+	w.write_stream_footer(1, stream_footer_xml(100, 100 + n_chunks, 10 * n_chunks, no_offsets));
+}
+
+int main() {
+	const char *filename = "test_tail.xdf";
+	// a finished recording from an earlier run must not be mistaken for the new one
+	std::filesystem::remove(filename);
+	std::filesystem::remove(watermark_filename(filename));
+
+	// start following before the file exists
+	xdf_tail_reader reader(filename);
+	std::thread writer(write_slowly, filename);
+
+	std::vector<chunk_tag_t> tags;
+	tail_chunk chunk;
+	uint64_t expected_offset = 4;
+	while (reader.next(chunk, 5.0)) {
+		CHECK(chunk.info.offset == expected_offset);
+		expected_offset = chunk.info.end;
+		tags.push_back(chunk.info.tag);
+	}
+	writer.join();
+
+	CHECK(reader.finished());
+	CHECK(expected_offset == std::filesystem::file_size(filename));
+	CHECK(tags.size() == n_chunks + 3);
+	CHECK(tags.front() == chunk_tag_t::fileheader);
+	CHECK(tags[1] == chunk_tag_t::streamheader);
+	CHECK(tags.back() == chunk_tag_t::streamfooter);
+	std::cout << "Tail reader test passed" << std::endl;
+	return 0;
+}
@@ -0,0 +1,56 @@
+#include "test_check.h"
+#include "xdfreader.h"
+#include <cstring>
+#include <iostream>
+#include <string>
+
+const char *header = "<?xml version=\"1.0\"?><info><name>Tapped</name><type>EEG</type>"
+					 "<channel_count>8</channel_count><nominal_srate>100</nominal_srate>"
+					 "<channel_format>float32</channel_format></info>";
+
+int main() {
+	const std::string tap_name = "xdfwriter_test_tap";
+	XDFWriter w("test_tap.xdf");
+	w.enable_tap(tap_name, 64 * 1024);
+	w.write_stream_header(1, header);
+
+	shm_tap_reader reader(tap_name), slow_reader(tap_name);
+	const auto streams = reader.streams();
+	CHECK(streams.size() == 1 && streams[0].first == 1 && streams[0].second == header);
+
+	const char *data;
+	uint64_t size;
+	CHECK(!reader.next(data, size, 0.01)); // nothing published yet
+
+	// each chunk has 10 samples with 8 channels, about 400 bytes
+	const auto write_chunk = [&w](float value) {
+		w.write_data_chunk(1, std::vector<double>(10, 1.0), std::vector<float>(80, value), 8);
+	};
+	for (int i = 0; i < 200; ++i) {
+		write_chunk(static_cast<float>(i));
+		CHECK(reader.next(data, size, 1.0));
+		chunk_info chunk;
+		CHECK(parse_chunk_header(data, size, 0, chunk) && chunk.end == size);
+		CHECK(chunk.tag == chunk_tag_t::samples && chunk.streamid == 1);
+		float value;
+		// the first value follows the sample count (5 bytes) and the timestamp (9 bytes)
+		std::memcpy(&value, data + chunk.content_offset + 14, sizeof(value));
+		CHECK(value == static_cast<float>(i));
+		CHECK(reader.valid() && reader.lag() == 0);
+	}
+	// 200 chunks (86 KB) don't fit in the ring, so the reader that didn't read anything is dropped...
+	CHECK(slow_reader.dropped());
+	CHECK(w.tap_statistics().consumers_dropped == 1 && w.tap_statistics().consumers == 1);
+	bool threw = false;
+	try {
+		slow_reader.next(data, size, 0.01);
+	} catch (std::runtime_error &) { threw = true; }
+	CHECK(threw);
+	// ... and continues with the newest data after a resync
+	slow_reader.resync();
+	write_chunk(200);
+	CHECK(slow_reader.next(data, size, 1.0) && slow_reader.valid());
+	CHECK(w.tap_statistics().chunks_published == 201);
+	std::cout << "Tap test passed" << std::endl;
+	return 0;
+}
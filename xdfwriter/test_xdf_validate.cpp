@@ -0,0 +1,77 @@
+#include "test_check.h"
+#include "xdfvalidate.h"
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+static std::string header(const char *name, const char *format, double srate) {
+	return std::string("<?xml version=\"1.0\"?><info><name>") + name +
+		   "</name><type>Test</type><channel_count>2</channel_count><nominal_srate>" +
+		   std::to_string(srate) + "</nominal_srate><channel_format>" + format +
+		   "</channel_format></info>";
+}
+
+const int n_chunks = 200;
+
+int main() {
+	const char *filename = "test_validate.xdf";
+	const std::vector<std::pair<double, double>> no_offsets;
+	{
+		XDFWriter w(filename);
+		w.write_stream_header(1, header("EEG", "float32", 100));
+		w.write_stream_header(2, header("Markers", "string", 0));
+		for (int i = 0; i < n_chunks; ++i) {
+			// 10 samples with deduced timestamps, and a gap of one second after chunk 150
+			std::vector<double> ts(10, 0.0);
+			if (i == 0 || i == 151) ts[0] = 100 + i * 0.1 + (i > 150 ? 1 : 0);
+			w.write_data_chunk(1, ts, std::vector<float>(20, 1.f), 2);
+			if (i % 20 == 0)
+				w.write_data_chunk(2, std::vector<double>{100.0 + i * 0.1},
+					std::vector<std::string>{"a", "b"}, 2);
+			if (i % 50 == 0) w.write_stream_offset(1, 100 + i * 0.1, 0.01);
+			if (i % 100 == 99) w.write_boundary_chunk();
+		}
+		const double last = 100 + (n_chunks - 1) * 0.1 + 1 + 0.09;
+		w.write_stream_footer(1, stream_footer_xml(100, last, 10 * n_chunks, no_offsets));
+		// a footer that doesn't match the samples
+		w.write_stream_footer(2, stream_footer_xml(100, 119, 5, no_offsets));
+	}
+
+	// decode with several threads, so the ranges of stream 1 have to be stitched together
+	xdf_validation v = validate_xdf(filename, 4);
+	CHECK(v.problems.empty());
+	CHECK(v.has_file_header && v.boundaries == 2 && v.truncated_bytes == 0);
+	CHECK(v.streams.size() == 2);
+	const auto &eeg = v.streams[0];
+	CHECK(eeg.name == "EEG" && eeg.has_header && eeg.has_footer);
+	CHECK(eeg.chunks == n_chunks && eeg.sample_count == 10 * n_chunks);
+	CHECK(eeg.clock_offsets == 4);
+	CHECK(eeg.problems.empty());
+	CHECK(eeg.first_timestamp == 100);
+	CHECK(std::abs(eeg.last_timestamp - (100 + (n_chunks - 1) * 0.1 + 1 + 0.09)) < 1e-9);
+	CHECK(eeg.gaps == 1 && std::abs(eeg.max_gap - 1.01) < 1e-9 && eeg.backwards == 0);
+	const auto &markers = v.streams[1];
+	CHECK(markers.sample_count == 10 && markers.footer_sample_count == 5);
+	CHECK(markers.gaps == 0);
+	CHECK(markers.problems.size() == 1);
+	CHECK(!v.ok());
+	// the same results with a single thread (up to the rounding of deduced timestamps)
+	const xdf_validation single = validate_xdf(filename, 1);
+	CHECK(single.streams[0].sample_count == eeg.sample_count);
+	CHECK(single.streams[0].gaps == eeg.gaps);
+	CHECK(std::abs(single.streams[0].last_timestamp - eeg.last_timestamp) < 1e-9);
+	CHECK(validation_to_json(v).find("{\"ok\":false,") == 0);
+
+	// an interrupted recording
+	{
+		std::ofstream out(filename, std::ios::binary | std::ios::app);
+		const char partial[] = {4, 0x10, 0x27, 0, 0, 3, 0, 1, 0, 0, 0, 4};
+		out.write(partial, sizeof(partial));
+	}
+	v = validate_xdf(filename);
+	CHECK(v.truncated_bytes == 12);
+	CHECK(v.problems.size() == 1);
+	std::cout << "Validation test passed" << std::endl;
+	return 0;
+}
@@ -0,0 +1,354 @@
+#include "xdfextract.h"
+#include "xdfwriter.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+
+#ifdef __linux__
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace {
+using offset_list = std::vector<std::pair<double, double>>; // (collection time, offset value)
+
+// a stream of the recording
+struct extract_stream {
+	stream_header_info header;
+	bool has_header = false;
+	bool has_samples = false;
+	double first_recorded = 0; // the recording's first sample of the stream
+	offset_list offsets;	   // all clock offsets in the recording
+
+	// while copying
+	double last_timestamp = 0; // for the deduced timestamps
+	bool previous_written = false;
+	offset_list written_offsets;
+	bool offset_after_written = false; // the first offset after the excerpt
+	uint64_t sample_count = 0;
+	double first_timestamp = 0, last_written = 0;
+};
+
+/// a chunk with its header (the stream id only for stream specific chunks)
+std::string serialize_chunk(chunk_tag_t tag, const std::string &content,
+	const streamid_t *streamid = nullptr) {
+	std::ostringstream out;
+	write_varlen_int(
+		out, sizeof(chunk_tag_t) + (streamid ? sizeof(streamid_t) : 0) + content.size());
+	write_little_endian(out, static_cast<uint16_t>(tag));
+	if (streamid) write_little_endian(out, *streamid);
+	out << content;
+	return out.str();
+}
+
+std::string offset_chunk(streamid_t streamid, const std::pair<double, double> &offset) {
+	std::ostringstream content;
+	write_little_endian(content, offset.first);
+	write_little_endian(content, offset.second);
+	return serialize_chunk(chunk_tag_t::clockoffset, content.str(), &streamid);
+}
+
+/**
+ * The excerpt: new chunks are collected in a buffer, unchanged chunks are copied from the input
+ * file (by the kernel where possible).
+ */
+class excerpt_file {
+public:
+	excerpt_file(const mapped_file &in, const std::string &input, const std::string &output)
+		: in_(in), output_(output) {
+#ifdef __linux__
+		in_fd_ = ::open(input.c_str(), O_RDONLY);
+		out_fd_ = ::open(output.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (in_fd_ < 0 || out_fd_ < 0) {
+			if (in_fd_ >= 0) ::close(in_fd_);
+			if (out_fd_ >= 0) ::close(out_fd_);
+			throw std::runtime_error("Can't open " + (in_fd_ < 0 ? input : output));
+		}
+#else
+		(void)input;
+		out_ = std::make_unique<output_file>(output);
+#endif
+	}
+	~excerpt_file() {
+#ifdef __linux__
+		::close(in_fd_);
+		if (out_fd_ >= 0) ::close(out_fd_);
+#endif
+	}
+	excerpt_file(const excerpt_file &) = delete;
+	excerpt_file &operator=(const excerpt_file &) = delete;
+
+	void write(const std::string &data) {
+		buffer_ += data;
+		if (buffer_.size() >= 1 << 20) flush();
+	}
+
+	/// copy len bytes of the input from offset
+	void copy(uint64_t offset, uint64_t len) {
+		flush();
+		copied_ += len;
+#ifdef __linux__
+		while (copy_range_ && len) {
+			loff_t in_offset = static_cast<loff_t>(offset);
+			const ssize_t n = ::copy_file_range(in_fd_, &in_offset, out_fd_, nullptr, len, 0);
+			if (n > 0) {
+				offset += n;
+				len -= n;
+				size_ += n;
+				kernel_copied_ += n;
+			} else if (n == 0 || errno == EXDEV || errno == ENOSYS || errno == EOPNOTSUPP ||
+					   errno == EINVAL)
+				// not supported between these files (e.g. on older kernels)
+				copy_range_ = false;
+			else if (errno != EINTR)
+				throw std::runtime_error("Can't write to " + output_);
+		}
+#endif
+		write_out(in_.data() + offset, len);
+	}
+
+	void close() {
+		flush();
+#ifdef __linux__
+		if (::close(out_fd_) != 0) throw std::runtime_error("Can't write to " + output_);
+		out_fd_ = -1;
+#else
+		if (!out_->flush()) throw std::runtime_error("Can't write to " + output_);
+#endif
+	}
+
+	uint64_t size() const { return size_ + buffer_.size(); }
+	uint64_t copied() const { return copied_; }
+	uint64_t kernel_copied() const { return kernel_copied_; }
+
+private:
+	void flush() {
+		write_out(buffer_.data(), buffer_.size());
+		buffer_.clear();
+	}
+
+	void write_out(const char *data, uint64_t len) {
+#ifdef __linux__
+		while (len) {
+			const ssize_t n = ::write(out_fd_, data, len);
+			if (n < 0 && errno == EINTR) continue;
+			if (n <= 0) throw std::runtime_error("Can't write to " + output_);
+			data += n;
+			len -= n;
+			size_ += n;
+		}
+#else
+		if (len && !out_->write(data, len)) throw std::runtime_error("Can't write to " + output_);
+		size_ += len;
+#endif
+	}
+
+	const mapped_file &in_;
+	const std::string output_;
+	std::string buffer_;
+	uint64_t size_ = 0, copied_ = 0, kernel_copied_ = 0;
+#ifdef __linux__
+	int in_fd_ = -1, out_fd_ = -1;
+	bool copy_range_ = true;
+#else
+	std::unique_ptr<output_file> out_;
+#endif
+};
+} // namespace
+
+extract_report extract_xdf(const std::string &input, const std::string &output, double begin,
+	double end, bool relative) {
+	mapped_file file(input);
+	const char *data = file.data();
+	const uint64_t size = file.size();
+	if (size < 4 || std::memcmp(data, "XDF:", 4) != 0)
+		throw std::runtime_error(input + " is not an XDF file");
+
+	// first walk the chunk headers for the streams, their clock offsets and first timestamps
+	std::map<streamid_t, extract_stream> streams;
+	std::string file_header;
+	chunk_info chunk;
+	uint64_t pos = 4;
+	for (; parse_chunk_header(data, size, pos, chunk); pos = chunk.end) {
+		const char *content = data + chunk.content_offset;
+		const uint64_t content_size = chunk.content_size();
+		if (chunk.tag == chunk_tag_t::fileheader) file_header.assign(content, content_size);
+		if (!chunk.has_streamid()) continue;
+		auto &stream = streams[chunk.streamid];
+		if (chunk.tag == chunk_tag_t::streamheader) {
+			stream.header = parse_stream_header(std::string(content, content_size));
+			stream.has_header = true;
+		} else if (chunk.tag == chunk_tag_t::samples && !stream.has_samples) {
+			// the first sample of a stream always has its timestamp
+			uint64_t n_samples, ts_pos = 0;
+			if (read_varlen_int(content, content_size, ts_pos, n_samples) && n_samples &&
+				ts_pos + 9 <= content_size && content[ts_pos] == 8) {
+				std::memcpy(&stream.first_recorded, content + ts_pos + 1, 8);
+				stream.has_samples = true;
+			}
+		} else if (chunk.tag == chunk_tag_t::clockoffset && content_size >= 16) {
+			double collection_time, offset;
+			std::memcpy(&collection_time, content, 8);
+			std::memcpy(&offset, content + 8, 8);
+			stream.offsets.emplace_back(collection_time, offset);
+		}
+	}
+	const uint64_t intact = pos;
+	if (intact < size)
+		std::cerr << "Warning: " << input << " ends in a partial chunk at " << intact
+				  << ", extracting up to there" << std::endl;
+
+	extract_report report;
+	report.recording_start = std::numeric_limits<double>::infinity();
+	for (const auto &entry : streams)
+		if (entry.second.has_samples)
+			report.recording_start = std::min(report.recording_start,
+				entry.second.first_recorded +
+					clock_offset_at(entry.second.offsets, entry.second.first_recorded));
+	if (!std::isfinite(report.recording_start))
+		throw std::runtime_error(input + " contains no samples");
+	report.begin = relative ? report.recording_start + begin : begin;
+	report.end = relative ? report.recording_start + end : end;
+
+	// the file header, with the time range of the excerpt
+	excerpt_file out(file, input, output);
+	std::ostringstream excerpt;
+	excerpt.precision(16);
+	excerpt << "<excerpt><begin>" << report.begin << "</begin><end>" << report.end
+			<< "</end></excerpt>";
+	const auto info_end = file_header.rfind("</info>");
+	if (info_end != std::string::npos)
+		file_header.insert(info_end, excerpt.str());
+	else
+		file_header = "<?xml version=\"1.0\"?><info><version>1.0</version>" + excerpt.str() +
+					  "</info>";
+	out.write("XDF:");
+	out.write(serialize_chunk(chunk_tag_t::fileheader, file_header));
+
+	// then copy the chunks in the time range
+	bool written_since_boundary = true;
+	std::vector<sample_ref> samples;
+	std::vector<char> included;
+	for (pos = 4; pos < intact; pos = chunk.end) {
+		parse_chunk_header(data, size, pos, chunk);
+		const char *content = data + chunk.content_offset;
+		const uint64_t content_size = chunk.content_size();
+		const uint64_t chunk_size = chunk.end - chunk.offset;
+		if (chunk.tag == chunk_tag_t::boundary) {
+			// only between the chunks of the excerpt
+			if (written_since_boundary) out.copy(chunk.offset, chunk_size);
+			written_since_boundary = false;
+			continue;
+		}
+		if (!chunk.has_streamid()) continue;
+		auto &stream = streams[chunk.streamid];
+		const uint64_t written = out.size();
+		switch (chunk.tag) {
+		case chunk_tag_t::streamheader: {
+			out.copy(chunk.offset, chunk_size);
+			report.streams++;
+			// the last offset before the excerpt
+			const offset_list &offsets = stream.offsets;
+			auto before = std::find_if(offsets.rbegin(), offsets.rend(),
+				[&](const std::pair<double, double> &o) { return o.first < report.begin; });
+			if (before != offsets.rend()) {
+				out.write(offset_chunk(chunk.streamid, *before));
+				stream.written_offsets.push_back(*before);
+			}
+			break;
+		}
+		case chunk_tag_t::clockoffset: {
+			if (content_size < 16) break;
+			double collection_time;
+			std::memcpy(&collection_time, content, 8);
+			if (collection_time < report.begin) break;
+			if (collection_time > report.end) {
+				if (stream.offset_after_written) break;
+				stream.offset_after_written = true;
+			}
+			out.copy(chunk.offset, chunk_size);
+			double offset;
+			std::memcpy(&offset, content + 8, 8);
+			stream.written_offsets.emplace_back(collection_time, offset);
+			break;
+		}
+		case chunk_tag_t::samples: {
+			if (!stream.has_header)
+				throw std::runtime_error(input + ": samples of stream " +
+										 std::to_string(chunk.streamid) + " before its header");
+			if (!decode_samples(
+					content, content_size, stream.header, stream.last_timestamp, samples))
+				throw std::runtime_error(
+					input + ": malformed samples chunk at " + std::to_string(chunk.offset));
+			included.assign(samples.size(), 0);
+			std::size_t n_included = 0;
+			for (std::size_t i = 0; i < samples.size(); ++i) {
+				const double t =
+					samples[i].timestamp + clock_offset_at(stream.offsets, samples[i].timestamp);
+				if (t >= report.begin && t < report.end) {
+					included[i] = 1;
+					n_included++;
+				}
+			}
+			if (!n_included) {
+				stream.previous_written = false;
+				break;
+			}
+			// a deduced timestamp needs the previous sample in the excerpt
+			const bool first_explicit = content[samples.front().offset] == 8;
+			if (n_included == samples.size() && (first_explicit || stream.previous_written)) {
+				out.copy(chunk.offset, chunk_size);
+				report.chunks_copied++;
+			} else {
+				std::ostringstream part;
+				write_varlen_int(part, n_included);
+				bool previous = stream.previous_written;
+				for (std::size_t i = 0; i < samples.size(); previous = included[i++]) {
+					const sample_ref &s = samples[i];
+					if (!included[i]) continue;
+					if (!previous && content[s.offset] == 0) {
+						part.put(8);
+						write_little_endian(part, s.timestamp);
+						part.write(content + s.value_offset, s.end - s.value_offset);
+					} else
+						part.write(content + s.offset, s.end - s.offset);
+				}
+				out.write(serialize_chunk(chunk_tag_t::samples, part.str(), &chunk.streamid));
+				report.chunks_split++;
+			}
+			for (std::size_t i = 0; i < samples.size(); ++i) {
+				if (!included[i]) continue;
+				if (!stream.sample_count) stream.first_timestamp = samples[i].timestamp;
+				stream.last_written = samples[i].timestamp;
+				stream.sample_count++;
+			}
+			report.samples += n_included;
+			stream.previous_written = included.back();
+			break;
+		}
+		default: break; // the footers are written anew
+		}
+		if (out.size() != written) written_since_boundary = true;
+	}
+
+	// and new footers for the excerpt
+	for (const auto &[streamid, stream] : streams) {
+		if (!stream.has_header) continue;
+		out.write(serialize_chunk(chunk_tag_t::streamfooter,
+			stream_footer_xml(stream.first_timestamp, stream.last_written, stream.sample_count,
+				stream.written_offsets),
+			&streamid));
+	}
+	out.close();
+	report.bytes = out.size();
+	report.bytes_copied = out.copied();
+	report.bytes_copied_in_kernel = out.kernel_copied();
+	return report;
+}
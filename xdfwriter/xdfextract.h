@@ -0,0 +1,39 @@
+#pragma once
+
+#include "xdfreader.h"
+
+#include <cstdint>
+#include <string>
+
+// the result of extract_xdf()
+struct extract_report {
+	double recording_start = 0; // the first sample of the recording (recording computer's clock)
+	double begin = 0, end = 0;	// the excerpt (recording computer's clock)
+	std::size_t streams = 0;
+	uint64_t samples = 0;		// samples in the excerpt
+	uint64_t chunks_copied = 0; // samples chunks copied unchanged
+	uint64_t chunks_split = 0;	// edge chunks written anew with a part of their samples
+	uint64_t bytes_copied = 0;	// bytes of all chunks that were copied unchanged
+	uint64_t bytes_copied_in_kernel = 0; // of those, copied without reading them (copy_file_range)
+	uint64_t bytes = 0;					 // size of the excerpt
+};
+
+/**
+ * @brief extract_xdf Write the samples of a time range of a recording into a new XDF file
+ *
+ * The stream headers are copied, and of the samples chunks only those that overlap the time
+ * range: chunks within it unchanged, the chunks at its edges with the samples inside the range.
+ * Each stream gets a new footer for the excerpt, and the clock offsets measured in the range plus
+ * the last one before and the first one after it (so the offsets can be interpolated at the
+ * edges). The time range is in the recording computer's clock, i.e. the samples' timestamps plus
+ * their streams' clock offsets.
+ *
+ * Only the timestamps are read from the memory mapped input. On Linux, the unchanged chunks are
+ * copied with copy_file_range(), so the file system copies (or on some, shares) the data without
+ * it passing through the process; elsewhere they're written from the mapping.
+ * @param begin, end The time range: seconds after the first sample of the recording if relative,
+ * otherwise the recording computer's clock (lsl::local_clock())
+ * @throws std::runtime_error if the input can't be read or the excerpt can't be written
+ */
+extract_report extract_xdf(const std::string &input, const std::string &output, double begin,
+	double end, bool relative = true);
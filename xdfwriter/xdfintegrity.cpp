@@ -0,0 +1,311 @@
+#include "xdfintegrity.h"
+#include "conversions.h"
+#include "xdfreader.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define XDF_CRC32C_SSE42
+#include <nmmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#define XDF_CRC32C_ARM
+#include <arm_acle.h>
+#endif
+
+static const char checksum_magic[] = "XDFCRC1\n";
+static const std::size_t checksum_record_size = 8 + 8 + 4;
+
+std::string checksum_filename(const std::string &filename) { return filename + ".crc32c"; }
+std::string digest_filename(const std::string &filename) { return filename + ".sha256"; }
+
+// === CRC32C ===
+
+// lookup tables for the fallback, processing 8 bytes per step ("slicing-by-8")
+struct crc32c_tables {
+	uint32_t t[8][256];
+	crc32c_tables() {
+		for (uint32_t i = 0; i < 256; ++i) {
+			uint32_t crc = i;
+			for (int bit = 0; bit < 8; ++bit) crc = (crc >> 1) ^ (0x82F63B78 & (0 - (crc & 1)));
+			t[0][i] = crc;
+		}
+		for (uint32_t i = 0; i < 256; ++i)
+			for (int k = 1; k < 8; ++k) t[k][i] = (t[k - 1][i] >> 8) ^ t[0][t[k - 1][i] & 0xFF];
+	}
+};
+
+static uint32_t crc32c_software(uint32_t crc, const unsigned char *p, std::size_t len) {
+	static const crc32c_tables tables;
+	const auto &t = tables.t;
+	for (; len >= 8; p += 8, len -= 8) {
+		uint32_t lo, hi;
+		std::memcpy(&lo, p, 4);
+		std::memcpy(&hi, p + 4, 4);
+		lo ^= crc;
+		crc = t[7][lo & 0xFF] ^ t[6][(lo >> 8) & 0xFF] ^ t[5][(lo >> 16) & 0xFF] ^ t[4][lo >> 24] ^
+			  t[3][hi & 0xFF] ^ t[2][(hi >> 8) & 0xFF] ^ t[1][(hi >> 16) & 0xFF] ^ t[0][hi >> 24];
+	}
+	while (len--) crc = (crc >> 8) ^ t[0][(crc ^ *p++) & 0xFF];
+	return crc;
+}
+
+#if defined(XDF_CRC32C_SSE42)
+#ifdef __GNUC__
+__attribute__((target("sse4.2")))
+#endif
+static uint32_t
+crc32c_instructions(uint32_t crc, const unsigned char *p, std::size_t len) {
+	uint64_t crc64 = crc;
+	for (; len >= 8; p += 8, len -= 8) {
+		uint64_t v;
+		std::memcpy(&v, p, 8);
+		crc64 = _mm_crc32_u64(crc64, v);
+	}
+	crc = static_cast<uint32_t>(crc64);
+	while (len--) crc = _mm_crc32_u8(crc, *p++);
+	return crc;
+}
+
+static bool detect_crc32c_instructions() {
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 1);
+	return (info[2] & (1 << 20)) != 0;
+#else
+	return __builtin_cpu_supports("sse4.2");
+#endif
+}
+#elif defined(XDF_CRC32C_ARM)
+static uint32_t crc32c_instructions(uint32_t crc, const unsigned char *p, std::size_t len) {
+	for (; len >= 8; p += 8, len -= 8) {
+		uint64_t v;
+		std::memcpy(&v, p, 8);
+		crc = __crc32cd(crc, v);
+	}
+	while (len--) crc = __crc32cb(crc, *p++);
+	return crc;
+}
+
+static bool detect_crc32c_instructions() { return true; }
+#endif
+
+bool crc32c_hardware() {
+#if defined(XDF_CRC32C_SSE42) || defined(XDF_CRC32C_ARM)
+	static const bool supported = detect_crc32c_instructions();
+	return supported;
+#else
+	return false;
+#endif
+}
+
+uint32_t crc32c(const char *data, std::size_t len, uint32_t crc) {
+	const auto *p = reinterpret_cast<const unsigned char *>(data);
+	crc = ~crc;
+#if defined(XDF_CRC32C_SSE42) || defined(XDF_CRC32C_ARM)
+	if (crc32c_hardware()) return ~crc32c_instructions(crc, p, len);
+#endif
+	return ~crc32c_software(crc, p, len);
+}
+
+// === SHA-256 (FIPS 180-4) ===
+
+static const uint32_t sha256_k[64] = {0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b,
+	0x59f111f1, 0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74,
+	0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f,
+	0x4a7484aa, 0x5cb0a9dc, 0x76f988da, 0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3,
+	0xd5a79147, 0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354,
+	0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819,
+	0xd6990624, 0xf40e3585, 0x106aa070, 0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3,
+	0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa,
+	0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+static inline uint32_t rotr(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+sha256::sha256()
+	: state_{0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab,
+		  0x5be0cd19} {}
+
+void sha256::transform(const unsigned char *block) {
+	uint32_t w[64];
+	for (int i = 0; i < 16; ++i)
+		w[i] = (uint32_t(block[4 * i]) << 24) | (uint32_t(block[4 * i + 1]) << 16) |
+			   (uint32_t(block[4 * i + 2]) << 8) | uint32_t(block[4 * i + 3]);
+	for (int i = 16; i < 64; ++i) {
+		const uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+		const uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+		w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+	}
+	uint32_t a = state_[0], b = state_[1], c = state_[2], d = state_[3], e = state_[4],
+			 f = state_[5], g = state_[6], h = state_[7];
+	for (int i = 0; i < 64; ++i) {
+		const uint32_t s1 = rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25);
+		const uint32_t t1 = h + s1 + ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+		const uint32_t s0 = rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22);
+		const uint32_t t2 = s0 + ((a & b) ^ (a & c) ^ (b & c));
+		h = g;
+		g = f;
+		f = e;
+		e = d + t1;
+		d = c;
+		c = b;
+		b = a;
+		a = t1 + t2;
+	}
+	state_[0] += a;
+	state_[1] += b;
+	state_[2] += c;
+	state_[3] += d;
+	state_[4] += e;
+	state_[5] += f;
+	state_[6] += g;
+	state_[7] += h;
+}
+
+void sha256::update(const char *data, std::size_t len) {
+	const auto *p = reinterpret_cast<const unsigned char *>(data);
+	std::size_t used = length_ % 64;
+	length_ += len;
+	if (used) {
+		const std::size_t n = std::min(len, 64 - used);
+		std::memcpy(buffer_ + used, p, n);
+		p += n;
+		len -= n;
+		if (used + n < 64) return;
+		transform(buffer_);
+	}
+	for (; len >= 64; p += 64, len -= 64) transform(p);
+	std::memcpy(buffer_, p, len);
+}
+
+std::string sha256::hex_digest() {
+	// padding: 0x80, zeros up to 56 bytes mod 64, the length in bits (big endian)
+	const uint64_t bits = length_ * 8;
+	unsigned char padding[72] = {0x80};
+	const std::size_t used = length_ % 64;
+	const std::size_t pad_len = (used < 56 ? 56 : 120) - used;
+	for (int i = 0; i < 8; ++i)
+		padding[pad_len + i] = static_cast<unsigned char>(bits >> (56 - 8 * i));
+	update(reinterpret_cast<const char *>(padding), pad_len + 8);
+
+	static const char hex[] = "0123456789abcdef";
+	std::string digest;
+	for (uint32_t word : state_)
+		for (int shift = 28; shift >= 0; shift -= 4) digest += hex[(word >> shift) & 0xF];
+	return digest;
+}
+
+// === integrity sidecars ===
+
+integrity_writer::integrity_writer(const std::string &filename)
+	: filename_(filename),
+	  checksums_(checksum_filename(filename), std::ios::binary | std::ios::trunc) {
+	if (!checksums_.write(checksum_magic, sizeof(checksum_magic) - 1))
+		throw std::runtime_error("Can't create " + checksum_filename(filename));
+	// a digest of an earlier recording with the same name would be wrong
+	std::error_code ec;
+	std::filesystem::remove(digest_filename(filename), ec);
+}
+
+void integrity_writer::add(const char *data, std::size_t len, uint64_t offset) {
+	digest_.update(data, len);
+	std::ostringstream records;
+	chunk_info chunk;
+	for (uint64_t pos = offset == 0 ? 4 : 0; parse_chunk_header(data, len, pos, chunk);
+		 pos = chunk.end) {
+		write_little_endian(records, offset + pos);
+		write_little_endian(records, chunk.end - pos);
+		write_little_endian(records, crc32c(data + pos, chunk.end - pos));
+	}
+	const std::string buf = records.str();
+	checksums_.write(buf.data(), buf.size());
+}
+
+bool integrity_writer::flush() { return static_cast<bool>(checksums_.flush()); }
+
+bool integrity_writer::finish() {
+	if (!flush()) return false;
+	const std::string digest = digest_filename(filename_), tmp = digest + ".tmp";
+	{
+		std::ofstream out(tmp, std::ios::trunc);
+		out << digest_.hex_digest() << "  "
+			<< std::filesystem::path(filename_).filename().string() << '\n';
+		if (!out.flush()) return false;
+	}
+	std::error_code ec;
+	std::filesystem::rename(tmp, digest, ec);
+	return !ec;
+}
+
+verify_report verify_xdf(const std::string &filename, unsigned threads) {
+	verify_report report;
+	mapped_file file(filename);
+	const char *data = file.data();
+	report.file_size = file.size();
+
+	// the checksum records
+	std::ifstream in(checksum_filename(filename), std::ios::binary);
+	if (!in) throw std::runtime_error("Can't open " + checksum_filename(filename));
+	std::string records((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+	const std::size_t magic_len = sizeof(checksum_magic) - 1;
+	if (records.compare(0, magic_len, checksum_magic) != 0)
+		throw std::runtime_error(checksum_filename(filename) + " is not a checksum file");
+	// a partial last record (e.g. after a crash) is ignored
+	const std::size_t n_records = (records.size() - magic_len) / checksum_record_size;
+	const char *first_record = records.data() + magic_len;
+
+	// the digest is sequential, so it gets its own thread
+	std::string expected_digest, actual_digest;
+	std::thread digest_thread;
+	{
+		std::ifstream digest_in(digest_filename(filename));
+		if (digest_in >> expected_digest) {
+			report.has_digest = true;
+			digest_thread = std::thread([&]() {
+				sha256 digest;
+				digest.update(data, report.file_size);
+				actual_digest = digest.hex_digest();
+			});
+		}
+	}
+
+	if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+	threads = static_cast<unsigned>(
+		std::min<std::size_t>(threads, std::max<std::size_t>(n_records, 1)));
+	std::vector<std::vector<uint64_t>> bad(threads);
+	std::vector<uint64_t> checked_end(threads, 0);
+	std::vector<std::thread> workers;
+	for (unsigned t = 0; t < threads; ++t)
+		workers.emplace_back([&, t]() {
+			const std::size_t begin = n_records * t / threads, end = n_records * (t + 1) / threads;
+			for (std::size_t i = begin; i < end; ++i) {
+				const char *record = first_record + i * checksum_record_size;
+				uint64_t offset, size;
+				uint32_t crc;
+				std::memcpy(&offset, record, 8);
+				std::memcpy(&size, record + 8, 8);
+				std::memcpy(&crc, record + 16, 4);
+				if (offset > report.file_size || size > report.file_size - offset ||
+					crc32c(data + offset, size) != crc)
+					bad[t].push_back(offset);
+				else
+					checked_end[t] = std::max(checked_end[t], offset + size);
+			}
+		});
+	for (auto &worker : workers) worker.join();
+	if (digest_thread.joinable()) digest_thread.join();
+
+	report.chunks_checked = n_records;
+	for (unsigned t = 0; t < threads; ++t) {
+		report.bad_chunks.insert(report.bad_chunks.end(), bad[t].begin(), bad[t].end());
+		report.bytes_checked = std::max(report.bytes_checked, checked_end[t]);
+	}
+	report.digest_ok = report.has_digest && expected_digest == actual_digest;
+	return report;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+/*
+ * Integrity sidecars, computed while the file is written so archiving doesn't need another pass:
+ *  - recording.xdf.crc32c: a CRC32C of every chunk, to find the damaged chunks of a file.
+ *    Layout: "XDFCRC1\n", then one record per chunk of [uint64 offset][uint64 size][uint32 crc]
+ *    (little endian), appended as the chunks are written.
+ *  - recording.xdf.sha256: the SHA-256 of the whole file, written when the file is closed, in the
+ *    format of sha256sum (so `sha256sum -c recording.xdf.sha256` works, too).
+ */
+
+std::string checksum_filename(const std::string &filename);
+std::string digest_filename(const std::string &filename);
+
+/**
+ * @brief crc32c CRC-32C (Castagnoli) of a buffer, using the CRC32 instructions of SSE 4.2 or
+ * ARMv8 when available
+ * @param crc The CRC of the preceding data, to compute the CRC of a buffer in parts
+ */
+uint32_t crc32c(const char *data, std::size_t len, uint32_t crc = 0);
+/// whether crc32c() uses CPU instructions instead of lookup tables
+bool crc32c_hardware();
+
+// incremental SHA-256
+class sha256 {
+public:
+	sha256();
+	void update(const char *data, std::size_t len);
+	/// the digest as a hex string; no more updates after this
+	std::string hex_digest();
+
+private:
+	void transform(const unsigned char *block);
+
+	uint32_t state_[8];
+	unsigned char buffer_[64];
+	uint64_t length_ = 0; // bytes so far
+};
+
+/**
+ * The checksums of an output file, fed with the data in the order it's written.
+ * Used by the writer thread of an xdf_sink, see XDFWriter::set_integrity().
+ */
+class integrity_writer {
+public:
+	/// truncates the checksum sidecar, throws std::runtime_error if it can't be created
+	explicit integrity_writer(const std::string &filename);
+
+	/**
+	 * @brief add Add written data (whole chunks, or the magic code and whole chunks)
+	 * @param offset The position of the data in the file
+	 */
+	void add(const char *data, std::size_t len, uint64_t offset);
+	/// hand the checksums to the OS, e.g. when the file is flushed; false on I/O errors
+	bool flush();
+	/// flush the checksums and write the digest sidecar (atomically); false on I/O errors
+	bool finish();
+
+private:
+	std::string filename_;
+	std::ofstream checksums_;
+	sha256 digest_;
+};
+
+struct verify_report {
+	uint64_t file_size = 0;
+	uint64_t chunks_checked = 0;
+	uint64_t bytes_checked = 0; // up to the end of the last chunk with a checksum
+	std::vector<uint64_t> bad_chunks; // offsets of the chunks whose CRC doesn't match
+	bool has_digest = false;		  // the digest sidecar exists
+	bool digest_ok = false;
+};
+
+/**
+ * @brief verify_xdf Check the chunk CRCs (and the digest, if the sidecar exists) of a file
+ *
+ * The file is memory mapped and split into ranges of chunks that are checked by separate
+ * threads, while one more thread computes the digest.
+ * @param threads Number of threads for the CRCs (0: one per CPU core)
+ */
+verify_report verify_xdf(const std::string &filename, unsigned threads = 0);
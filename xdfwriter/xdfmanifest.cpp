@@ -0,0 +1,265 @@
+#include "xdfmanifest.h"
+#include "xdfreader.h"
+#include "xdfsink.h"
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+
+static std::string xml_escape(const std::string &str) {
+	std::string escaped;
+	for (char c : str) switch (c) {
+		case '&': escaped += "&amp;"; break;
+		case '<': escaped += "&lt;"; break;
+		case '>': escaped += "&gt;"; break;
+		case '"': escaped += "&quot;"; break;
+		default: escaped += c;
+		}
+	return escaped;
+}
+
+static std::string xml_unescape(const std::string &str) {
+	static const std::pair<const char *, char> entities[] = {
+		{"&amp;", '&'}, {"&lt;", '<'}, {"&gt;", '>'}, {"&quot;", '"'}, {"&apos;", '\''}};
+	std::string unescaped;
+	for (std::size_t i = 0; i < str.size(); ++i) {
+		bool replaced = false;
+		if (str[i] == '&')
+			for (const auto &entity : entities)
+				if (str.compare(i, std::strlen(entity.first), entity.first) == 0) {
+					unescaped += entity.second;
+					i += std::strlen(entity.first) - 1;
+					replaced = true;
+					break;
+				}
+		if (!replaced) unescaped += str[i];
+	}
+	return unescaped;
+}
+
+// the contents of all (non-nested) <tag> elements
+static std::vector<std::string> xml_elements(const std::string &xml, const std::string &tag) {
+	const std::string open = '<' + tag + '>', close = "</" + tag + '>';
+	std::vector<std::string> elements;
+	for (auto start = xml.find(open); start != std::string::npos; start = xml.find(open, start)) {
+		const auto stop = xml.find(close, start + open.size());
+		if (stop == std::string::npos) break;
+		elements.push_back(xml.substr(start + open.size(), stop - start - open.size()));
+		start = stop + close.size();
+	}
+	return elements;
+}
+
+std::string new_session_id() {
+	std::random_device rd;
+	std::mt19937_64 gen((static_cast<uint64_t>(rd()) << 32) ^ rd());
+	std::ostringstream id;
+	id << std::hex << std::setfill('0') << std::setw(16) << gen() << std::setw(16) << gen();
+	return id.str();
+}
+
+std::string shard_header_fields(
+	const std::string &session_id, double session_start, std::size_t shard, std::size_t count) {
+	std::ostringstream fields;
+	fields.precision(16);
+	fields << "<session_id>" << session_id << "</session_id><session_start>" << session_start
+		   << "</session_start><shard>" << shard << "</shard><shard_count>" << count
+		   << "</shard_count>";
+	return fields.str();
+}
+
+void write_manifest(const std::string &filename, const session_manifest &manifest) {
+	std::ostringstream xml;
+	xml.precision(16);
+	xml << "<?xml version=\"1.0\"?>\n<session>\n  <session_id>" << manifest.session_id
+		<< "</session_id>\n  <session_start>" << manifest.session_start << "</session_start>\n";
+	for (const auto &shard : manifest.shards) {
+		xml << "  <shard>\n    <file>" << xml_escape(shard.filename) << "</file>\n";
+		for (const auto &stream : shard.streams)
+			xml << "    <stream><id>" << stream.first << "</id><name>"
+				<< xml_escape(stream.second) << "</name></stream>\n";
+		xml << "  </shard>\n";
+	}
+	xml << "</session>\n";
+
+	// readers never see a partially written manifest
+	const std::string tmp = filename + ".tmp";
+	{
+		std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+		if (!(out << xml.str()) || !out.flush())
+			throw std::runtime_error("Can't write the manifest " + tmp);
+	}
+	std::error_code ec;
+	std::filesystem::rename(tmp, filename, ec);
+	if (ec) throw std::runtime_error("Can't write the manifest " + filename + ": " + ec.message());
+}
+
+session_manifest read_manifest(const std::string &filename) {
+	std::ifstream in(filename, std::ios::binary);
+	if (!in) throw std::runtime_error("Can't open the manifest " + filename);
+	std::stringstream buffer;
+	buffer << in.rdbuf();
+	const std::string xml = buffer.str();
+
+	session_manifest manifest;
+	manifest.session_id = xml_value(xml, "session_id");
+	try {
+		manifest.session_start = std::stod(xml_value(xml, "session_start"));
+		const auto dir = std::filesystem::path(filename).parent_path();
+		for (const auto &shard_xml : xml_elements(xml, "shard")) {
+			shard_info shard;
+			const std::filesystem::path file = xml_unescape(xml_value(shard_xml, "file"));
+			shard.filename = (file.is_absolute() ? file : dir / file).string();
+			for (const auto &stream : xml_elements(shard_xml, "stream"))
+				shard.streams.emplace_back(
+					static_cast<streamid_t>(std::stoul(xml_value(stream, "id"))),
+					xml_unescape(xml_value(stream, "name")));
+			manifest.shards.push_back(std::move(shard));
+		}
+	} catch (std::logic_error &) {
+		throw std::runtime_error("Malformed manifest " + filename);
+	}
+	if (manifest.shards.empty()) throw std::runtime_error("No shards in the manifest " + filename);
+	return manifest;
+}
+
+namespace {
+const double infinity = std::numeric_limits<double>::infinity();
+// interval between the boundary chunks of the merged file, in seconds of recording time
+const double merged_boundary_interval = 10;
+
+// a shard being merged, positioned at its next chunk
+struct merge_input {
+	std::unique_ptr<mapped_file> file;
+	std::string filename;
+	uint64_t pos = 4;
+	chunk_info chunk;
+	bool done = false;
+	double key = 0; // where the chunk goes in the merged file
+	std::string file_header;
+	std::map<streamid_t, stream_header_info> headers;
+	std::map<streamid_t, double> last_timestamps;
+	std::vector<sample_ref> samples;
+
+	/// move to the next chunk that is copied to the merged file
+	void advance() {
+		const char *data = file->data();
+		while (!done) {
+			if (!parse_chunk_header(data, file->size(), pos, chunk)) {
+				if (pos < file->size())
+					std::cerr << "Warning: " << filename << " ends in a partial chunk at " << pos
+							  << ", merged up to there" << std::endl;
+				done = true;
+				return;
+			}
+			pos = chunk.end;
+			const char *content = data + chunk.content_offset;
+			const uint64_t size = chunk.content_size();
+			switch (chunk.tag) {
+			case chunk_tag_t::fileheader: file_header.assign(content, size); continue;
+			case chunk_tag_t::streamheader:
+				headers[chunk.streamid] = parse_stream_header(std::string(content, size));
+				key = -infinity;
+				return;
+			case chunk_tag_t::samples: {
+				const auto header = headers.find(chunk.streamid);
+				if (header == headers.end())
+					throw std::runtime_error(filename + ": samples of stream " +
+											 std::to_string(chunk.streamid) + " before its header");
+				double &last = last_timestamps[chunk.streamid];
+				if (!decode_samples(content, size, header->second, last, samples))
+					throw std::runtime_error(filename + ": malformed samples chunk at " +
+											 std::to_string(chunk.offset));
+				if (samples.empty()) continue;
+				key = samples.front().timestamp;
+				return;
+			}
+			case chunk_tag_t::clockoffset: {
+				// [CollectionTime][OffsetValue]
+				if (size < 16) continue;
+				std::memcpy(&key, content, 8);
+				return;
+			}
+			case chunk_tag_t::streamfooter: key = infinity; return;
+			default: continue; // boundaries are written anew
+			}
+		}
+	}
+};
+
+std::string serialize_chunk(chunk_tag_t tag, const std::string &content) {
+	std::ostringstream out;
+	write_varlen_int(out, content.size() + sizeof(chunk_tag_t));
+	write_little_endian(out, static_cast<uint16_t>(tag));
+	out << content;
+	return out.str();
+}
+} // namespace
+
+merge_report merge_shards(const session_manifest &manifest, const std::string &output) {
+	std::vector<merge_input> inputs(manifest.shards.size());
+	for (std::size_t i = 0; i < inputs.size(); ++i) {
+		auto &in = inputs[i];
+		in.filename = manifest.shards[i].filename;
+		in.file = std::make_unique<mapped_file>(in.filename);
+		if (in.file->size() < 4 || std::memcmp(in.file->data(), "XDF:", 4) != 0)
+			throw std::runtime_error(in.filename + " is not an XDF file");
+		in.advance();
+		const std::string session_id = xml_value(in.file_header, "session_id");
+		if (!manifest.session_id.empty() && session_id != manifest.session_id)
+			throw std::runtime_error(in.filename + " belongs to another session (" + session_id +
+									 ")");
+	}
+
+	merge_report report;
+	output_file out(output);
+	const auto write = [&](const char *data, std::size_t len) {
+		if (!out.write(data, len)) throw std::runtime_error("Can't write to " + output);
+		report.bytes += len;
+	};
+
+	std::ostringstream header;
+	header.precision(16);
+	header << "<?xml version=\"1.0\"?>\n  <info>\n    <version>1.0</version>\n    <datetime>"
+		   << xml_value(inputs.front().file_header, "datetime") << "</datetime>\n    <session_id>"
+		   << manifest.session_id << "</session_id><session_start>" << manifest.session_start
+		   << "</session_start><merged_shards>" << inputs.size() << "</merged_shards>\n  </info>";
+	write("XDF:", 4);
+	const std::string header_chunk = serialize_chunk(chunk_tag_t::fileheader, header.str());
+	write(header_chunk.data(), header_chunk.size());
+	const std::string boundary_chunk = serialize_chunk(chunk_tag_t::boundary,
+		std::string(reinterpret_cast<const char *>(boundary_uuid), sizeof(boundary_uuid)));
+
+	// a k-way merge; there are only a few shards, so a linear scan beats a heap
+	double next_boundary = -infinity;
+	while (true) {
+		merge_input *next = nullptr;
+		for (auto &in : inputs)
+			if (!in.done && (!next || in.key < next->key)) next = &in;
+		if (!next) break;
+
+		if (std::isfinite(next->key)) {
+			if (next_boundary == -infinity)
+				next_boundary = next->key + merged_boundary_interval;
+			else if (next->key >= next_boundary) {
+				write(boundary_chunk.data(), boundary_chunk.size());
+				report.boundaries++;
+				next_boundary = next->key + merged_boundary_interval;
+			}
+		}
+		write(next->file->data() + next->chunk.offset, next->chunk.end - next->chunk.offset);
+		report.chunks++;
+		if (next->chunk.tag == chunk_tag_t::streamheader) report.streams++;
+		next->advance();
+	}
+	if (!out.flush()) throw std::runtime_error("Can't write to " + output);
+	return report;
+}
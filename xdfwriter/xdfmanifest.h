@@ -0,0 +1,64 @@
+#pragma once
+
+#include "xdfwriter.h"
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+/*
+ * A recording striped over several XDF files (shards), e.g. on different disks so each disk only
+ * has to keep up with its part of the streams.
+ *
+ * All shards carry the same <session_id> and <session_start> in their file header, and stream
+ * ids are unique across the session. The manifest (an XML sidecar of the first shard) lists the
+ * shards and the streams in each; merge_shards() combines them into a single XDF file.
+ */
+
+// one file of a striped recording
+struct shard_info {
+	std::string filename; // relative to the manifest's directory if it's not absolute
+	std::vector<std::pair<streamid_t, std::string>> streams; // stream id, stream name
+};
+
+struct session_manifest {
+	std::string session_id;
+	double session_start = 0; // lsl::local_clock() when the recording started
+	std::vector<shard_info> shards;
+};
+
+/// the manifest of a striped recording whose first shard is main_file
+inline std::string manifest_filename(const std::string &main_file) {
+	return main_file + ".manifest";
+}
+
+/// a random id to tell the shards of different recordings apart
+std::string new_session_id();
+
+/// the XML elements that identify a shard in its file header (see XDFWriter's header_fields)
+std::string shard_header_fields(
+	const std::string &session_id, double session_start, std::size_t shard, std::size_t count);
+
+/// write the manifest atomically (via a temporary file), throws std::runtime_error on failure
+void write_manifest(const std::string &filename, const session_manifest &manifest);
+
+/// read a manifest; relative shard filenames are resolved against the manifest's directory
+session_manifest read_manifest(const std::string &filename);
+
+struct merge_report {
+	uint64_t chunks = 0;	 // chunks copied from the shards
+	uint64_t bytes = 0;		 // size of the merged file
+	uint64_t boundaries = 0; // boundary chunks written
+	std::size_t streams = 0;
+};
+
+/**
+ * @brief merge_shards Merge the shards of a recording into a single XDF file
+ *
+ * The shards are read in one pass (memory mapped) and their chunks are copied without decoding
+ * the values: stream headers first, then the samples and clock offset chunks ordered by their
+ * first timestamp, then the footers. The boundary chunks of the shards are replaced by new ones.
+ * Shards that end in a partial chunk (e.g. after a crash) are merged up to their last intact one.
+ */
+merge_report merge_shards(const session_manifest &manifest, const std::string &output);
@@ -0,0 +1,245 @@
+#include "xdfreader.h"
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+mapped_file::mapped_file(const std::string &filename) {
+#ifdef _WIN32
+	file_handle_ = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE,
+		nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file_handle_ == INVALID_HANDLE_VALUE) {
+		file_handle_ = nullptr;
+		throw std::runtime_error("Could not open " + filename);
+	}
+	LARGE_INTEGER size;
+	GetFileSizeEx(file_handle_, &size);
+	size_ = static_cast<uint64_t>(size.QuadPart);
+	if (size_ == 0) return;
+	mapping_handle_ = CreateFileMappingA(file_handle_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping_handle_)
+		data_ = static_cast<const char *>(MapViewOfFile(mapping_handle_, FILE_MAP_READ, 0, 0, 0));
+	if (!data_) {
+		if (mapping_handle_) CloseHandle(mapping_handle_);
+		CloseHandle(file_handle_);
+		throw std::runtime_error("Could not map " + filename);
+	}
+#else
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0) throw std::runtime_error("Could not open " + filename);
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		throw std::runtime_error("Could not stat " + filename);
+	}
+	size_ = static_cast<uint64_t>(st.st_size);
+	if (size_ > 0) {
+		void *addr = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+		if (addr == MAP_FAILED) {
+			close(fd);
+			throw std::runtime_error("Could not map " + filename);
+		}
+		data_ = static_cast<const char *>(addr);
+	}
+	// the mapping stays valid after closing the descriptor
+	close(fd);
+#endif
+}
+
+mapped_file::~mapped_file() {
+#ifdef _WIN32
+	if (data_) UnmapViewOfFile(data_);
+	if (mapping_handle_) CloseHandle(mapping_handle_);
+	if (file_handle_) CloseHandle(file_handle_);
+#else
+	if (data_) munmap(const_cast<char *>(data_), size_);
+#endif
+}
+
+template <typename T> static T read_le(const char *p) {
+	// the supported architectures are little endian (see conversions.h)
+	T val;
+	std::memcpy(&val, p, sizeof(T));
+	return val;
+}
+
+bool read_varlen_int(const char *data, uint64_t size, uint64_t &pos, uint64_t &val) {
+	if (pos >= size) return false;
+	const auto nbytes = static_cast<uint8_t>(data[pos]);
+	if (pos + 1 + nbytes > size) return false;
+	switch (nbytes) {
+	case 1: val = static_cast<uint8_t>(data[pos + 1]); break;
+	case 4: val = read_le<uint32_t>(data + pos + 1); break;
+	case 8: val = read_le<uint64_t>(data + pos + 1); break;
+	default: return false;
+	}
+	pos += 1 + nbytes;
+	return true;
+}
+
+bool parse_chunk_header(const char *data, uint64_t size, uint64_t offset, chunk_info &chunk) {
+	uint64_t pos = offset, len;
+	if (!read_varlen_int(data, size, pos, len)) return false;
+	// the length includes the tag; guard against overflows with garbage lengths
+	if (len < sizeof(chunk_tag_t) || len > size - pos) return false;
+	chunk.offset = offset;
+	chunk.end = pos + len;
+	const auto tag = read_le<uint16_t>(data + pos);
+	if (tag < static_cast<uint16_t>(chunk_tag_t::fileheader) ||
+		tag > static_cast<uint16_t>(chunk_tag_t::streamfooter))
+		return false;
+	chunk.tag = static_cast<chunk_tag_t>(tag);
+	pos += sizeof(chunk_tag_t);
+	chunk.streamid = 0;
+	if (chunk.has_streamid()) {
+		if (len < sizeof(chunk_tag_t) + sizeof(streamid_t)) return false;
+		chunk.streamid = read_le<streamid_t>(data + pos);
+		pos += sizeof(streamid_t);
+	}
+	chunk.content_offset = pos;
+	return true;
+}
+
+// the bytes preceding the UUID in a boundary chunk: 1 length byte, length 18, tag 5
+static const char boundary_header[] = {1, sizeof(boundary_uuid) + sizeof(chunk_tag_t),
+	static_cast<char>(chunk_tag_t::boundary), 0};
+
+static bool is_boundary_at(const char *data, uint64_t uuid_pos) {
+	return uuid_pos >= sizeof(boundary_header) &&
+		   std::memcmp(data + uuid_pos - sizeof(boundary_header), boundary_header,
+			   sizeof(boundary_header)) == 0;
+}
+
+uint64_t find_boundary_before(const char *data, uint64_t before) {
+	const char *uuid = reinterpret_cast<const char *>(boundary_uuid);
+	const char *end = data + before;
+	while (end > data) {
+		// find_end searches backwards from the end for bidirectional iterators
+		const char *hit = std::find_end(data, end, uuid, uuid + sizeof(boundary_uuid));
+		if (hit == end) return 0;
+		if (is_boundary_at(data, hit - data)) return (hit - data) + sizeof(boundary_uuid);
+		end = hit + sizeof(boundary_uuid) - 1;
+	}
+	return 0;
+}
+
+uint64_t find_boundary_after(const char *data, uint64_t size, uint64_t after) {
+	const char *uuid = reinterpret_cast<const char *>(boundary_uuid);
+	const std::boyer_moore_horspool_searcher searcher(uuid, uuid + sizeof(boundary_uuid));
+	const char *begin = data + after, *end = data + size;
+	while (begin < end) {
+		const char *hit = std::search(begin, end, searcher);
+		if (hit == end) return 0;
+		if (is_boundary_at(data, hit - data)) return (hit - data) + sizeof(boundary_uuid);
+		begin = hit + 1;
+	}
+	return 0;
+}
+
+std::string xml_value(const std::string &xml, const std::string &tag) {
+	const std::string open = '<' + tag + '>', close = "</" + tag + '>';
+	const auto start = xml.find(open);
+	if (start == std::string::npos) return std::string();
+	const auto stop = xml.find(close, start + open.size());
+	if (stop == std::string::npos) return std::string();
+	return xml.substr(start + open.size(), stop - start - open.size());
+}
+
+void insert_into_desc(std::string &xml, const std::string &element) {
+	std::size_t pos;
+	if ((pos = xml.rfind("</desc>")) != std::string::npos)
+		xml.insert(pos, element);
+	else if ((pos = xml.find("<desc />")) != std::string::npos)
+		xml.replace(pos, 8, "<desc>" + element + "</desc>");
+	else if ((pos = xml.find("<desc/>")) != std::string::npos)
+		xml.replace(pos, 7, "<desc>" + element + "</desc>");
+	else if ((pos = xml.rfind("</info>")) != std::string::npos)
+		xml.insert(pos, "<desc>" + element + "</desc>");
+}
+
+double clock_offset_at(const std::vector<std::pair<double, double>> &offsets, double timestamp) {
+	if (offsets.empty()) return 0;
+	// the collection time minus the offset is the time of the measurement in the stream's clock
+	const auto it = std::upper_bound(offsets.begin(), offsets.end(), timestamp,
+		[](double ts, const std::pair<double, double> &o) { return ts < o.first - o.second; });
+	return it == offsets.begin() ? it->second : std::prev(it)->second;
+}
+
+int stream_header_info::value_size() const {
+	if (channel_format == "int8") return 1;
+	if (channel_format == "int16") return 2;
+	if (channel_format == "int32" || channel_format == "float32") return 4;
+	if (channel_format == "int64" || channel_format == "double64") return 8;
+	return 0;
+}
+
+stream_header_info parse_stream_header(const std::string &xml) {
+	stream_header_info info;
+	info.name = xml_value(xml, "name");
+	info.type = xml_value(xml, "type");
+	info.source_id = xml_value(xml, "source_id");
+	info.hostname = xml_value(xml, "hostname");
+	info.channel_format = xml_value(xml, "channel_format");
+	try {
+		info.channel_count = static_cast<uint32_t>(std::stoul(xml_value(xml, "channel_count")));
+		info.nominal_srate = std::stod(xml_value(xml, "nominal_srate"));
+	} catch (std::exception &) {
+		throw std::runtime_error("Malformed stream header for stream " + info.name);
+	}
+	return info;
+}
+
+bool read_sample_count(const char *content, uint64_t size, uint64_t &n_samples) {
+	uint64_t pos = 0;
+	return read_varlen_int(content, size, pos, n_samples);
+}
+
+bool decode_samples(const char *content, uint64_t size, const stream_header_info &header,
+	double &last_timestamp, std::vector<sample_ref> &samples) {
+	uint64_t pos = 0, n_samples;
+	if (!read_varlen_int(content, size, pos, n_samples)) return false;
+	const uint64_t value_size = header.value_size();
+	const double interval = header.nominal_srate > 0 ? 1.0 / header.nominal_srate : 0;
+	samples.clear();
+	samples.reserve(n_samples);
+	for (uint64_t i = 0; i < n_samples; ++i) {
+		sample_ref sample;
+		sample.offset = pos;
+		if (pos >= size) return false;
+		const auto ts_bytes = static_cast<uint8_t>(content[pos++]);
+		if (ts_bytes == 8) {
+			if (pos + 8 > size) return false;
+			last_timestamp = read_le<double>(content + pos);
+			pos += 8;
+		} else if (ts_bytes == 0)
+			last_timestamp += interval;
+		else
+			return false;
+		sample.timestamp = last_timestamp;
+		sample.value_offset = pos;
+		if (value_size) {
+			pos += value_size * header.channel_count;
+			if (pos > size) return false;
+		} else {
+			for (uint32_t c = 0; c < header.channel_count; ++c) {
+				uint64_t len;
+				if (!read_varlen_int(content, size, pos, len) || len > size - pos) return false;
+				pos += len;
+			}
+		}
+		sample.end = pos;
+		samples.push_back(sample);
+	}
+	return true;
+}
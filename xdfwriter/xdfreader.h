@@ -0,0 +1,105 @@
+#pragma once
+
+#include "xdfwriter.h"
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * A read-only memory mapping of a whole file.
+ * Only the touched pages are read, so walking the chunk headers of a large file is cheap.
+ */
+class mapped_file {
+public:
+	/// Map the file, throws std::runtime_error on failure
+	explicit mapped_file(const std::string &filename);
+	~mapped_file();
+	mapped_file(const mapped_file &) = delete;
+	mapped_file &operator=(const mapped_file &) = delete;
+
+	const char *data() const { return data_; }
+	uint64_t size() const { return size_; }
+
+private:
+	const char *data_ = nullptr;
+	uint64_t size_ = 0;
+#ifdef _WIN32
+	void *file_handle_ = nullptr, *mapping_handle_ = nullptr;
+#endif
+};
+
+// position and type of a chunk in an XDF file
+struct chunk_info {
+	uint64_t offset = 0;		 // start of the chunk, i.e. its length field
+	uint64_t content_offset = 0; // start of the content (after the tag and stream id)
+	uint64_t end = 0;			 // first byte after the chunk
+	chunk_tag_t tag = chunk_tag_t::undefined;
+	streamid_t streamid = 0; // only set for stream-specific chunks
+
+	uint64_t content_size() const { return end - content_offset; }
+	bool has_streamid() const {
+		return tag == chunk_tag_t::streamheader || tag == chunk_tag_t::samples ||
+			   tag == chunk_tag_t::clockoffset || tag == chunk_tag_t::streamfooter;
+	}
+};
+
+/// read a variable-length integer at pos and advance pos, returns false if it's malformed
+bool read_varlen_int(const char *data, uint64_t size, uint64_t &pos, uint64_t &val);
+
+/**
+ * @brief parse_chunk_header Parse the header of the chunk starting at offset
+ * @return false if the header is invalid or the chunk is incomplete (i.e. extends past size)
+ */
+bool parse_chunk_header(const char *data, uint64_t size, uint64_t offset, chunk_info &chunk);
+
+/// the offset right after the last boundary chunk before `before`, or 0 if there is none
+uint64_t find_boundary_before(const char *data, uint64_t before);
+/// the offset right after the first boundary chunk after `after`, or 0 if there is none
+uint64_t find_boundary_after(const char *data, uint64_t size, uint64_t after);
+
+/// the content of the first <tag> element in an XML string (enough for LSL stream headers)
+std::string xml_value(const std::string &xml, const std::string &tag);
+
+/// append an element to the <desc> of a stream header (which is added if there is none)
+void insert_into_desc(std::string &xml, const std::string &element);
+
+/**
+ * @brief clock_offset_at The clock offset of a stream at a timestamp in its clock: the latest one
+ * measured before it (the first one for earlier timestamps, 0 if there are none)
+ * @param offsets (collection time, offset value) pairs as in the ClockOffset chunks, in order
+ */
+double clock_offset_at(const std::vector<std::pair<double, double>> &offsets, double timestamp);
+
+// the fields of a stream header that are needed to decode its samples
+struct stream_header_info {
+	std::string name, type, source_id, hostname, channel_format;
+	uint32_t channel_count = 0;
+	double nominal_srate = 0;
+
+	/// bytes per value, or 0 for strings (which are stored with individual lengths)
+	int value_size() const;
+};
+
+stream_header_info parse_stream_header(const std::string &xml);
+
+// a single sample in the content of a samples chunk
+struct sample_ref {
+	double timestamp;	   // deduced timestamps are already filled in
+	uint64_t offset;	   // start of the sample's timestamp field, relative to the content
+	uint64_t value_offset; // start of the sample's values, relative to the content
+	uint64_t end;		   // first byte after the sample, relative to the content
+};
+
+/// read the number of samples in a samples chunk, returns false if it's malformed
+bool read_sample_count(const char *content, uint64_t size, uint64_t &n_samples);
+
+/**
+ * @brief decode_samples Locate all samples in the content of a samples chunk
+ * @param last_timestamp  The previous sample's timestamp, needed to fill in deduced timestamps
+ * and updated to the last timestamp in this chunk
+ * @return false if the content is malformed
+ */
+bool decode_samples(const char *content, uint64_t size, const stream_header_info &header,
+	double &last_timestamp, std::vector<sample_ref> &samples);
@@ -0,0 +1,128 @@
+#include "xdfrecover.h"
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <limits>
+#include <map>
+#include <stdexcept>
+
+// per-stream state while scanning
+struct scanned_stream {
+	recovered_stream result;
+	stream_header_info header;
+	bool has_header = false;
+	std::vector<uint64_t> samples_chunks; // offsets of all samples chunks
+};
+
+// the last timestamp of a stream; deduced timestamps may depend on earlier chunks
+static double last_timestamp(const char *data, uint64_t size, const scanned_stream &stream) {
+	const double nan = std::numeric_limits<double>::quiet_NaN();
+	const double interval =
+		stream.header.nominal_srate > 0 ? 1.0 / stream.header.nominal_srate : 0;
+	uint64_t deduced_after = 0; // samples after the last explicit timestamp in later chunks
+	std::vector<sample_ref> samples;
+	for (auto it = stream.samples_chunks.rbegin(); it != stream.samples_chunks.rend(); ++it) {
+		chunk_info chunk;
+		if (!parse_chunk_header(data, size, *it, chunk)) break;
+		// with a NaN start, only explicit timestamps (and none deduced from them) are numbers
+		double ts = nan;
+		if (!decode_samples(data + chunk.content_offset, chunk.content_size(), stream.header, ts,
+				samples))
+			break;
+		for (auto s = samples.rbegin(); s != samples.rend(); ++s, ++deduced_after)
+			if (!std::isnan(s->timestamp)) return s->timestamp + deduced_after * interval;
+	}
+	return 0;
+}
+
+recovery_report recover_xdf(const std::string &filename, bool dry_run) {
+	recovery_report report;
+	std::map<streamid_t, scanned_stream> streams;
+	{
+		mapped_file file(filename);
+		const char *data = file.data();
+		const uint64_t size = file.size();
+		report.original_size = size;
+		if (size < 4 || std::string(data, 4) != "XDF:")
+			throw std::runtime_error(filename + " is not an XDF file");
+
+		// everything up to the last boundary chunk was written completely, so the file is cut
+		// at the first invalid chunk after it (the interrupted write)
+		uint64_t last_boundary = find_boundary_before(data, size);
+		if (!last_boundary) last_boundary = 4;
+
+		// a single walk over the chunk headers, skipping over the payloads
+		chunk_info chunk;
+		uint64_t pos = 4;
+		while (pos < size) {
+			const bool before_boundary = pos < last_boundary;
+			if (!parse_chunk_header(data, before_boundary ? last_boundary : size, pos, chunk)) {
+				if (!before_boundary) break;
+				// damaged region, resume after the next boundary chunk
+				uint64_t next = find_boundary_after(data, last_boundary, pos);
+				if (!next) next = last_boundary;
+				report.skipped_bytes += next - pos;
+				pos = next;
+				continue;
+			}
+			report.chunks++;
+			pos = chunk.end;
+			if (!chunk.has_streamid()) continue;
+
+			const char *content = data + chunk.content_offset;
+			auto &stream = streams[chunk.streamid];
+			stream.result.streamid = chunk.streamid;
+			if (chunk.streamid > report.max_streamid) report.max_streamid = chunk.streamid;
+			switch (chunk.tag) {
+			case chunk_tag_t::streamheader:
+				stream.header = parse_stream_header(std::string(content, chunk.content_size()));
+				stream.result.name = stream.header.name;
+				stream.has_header = true;
+				break;
+			case chunk_tag_t::samples: {
+				uint64_t n_samples, ts_pos = 0;
+				if (!read_varlen_int(content, chunk.content_size(), ts_pos, n_samples)) break;
+				// the first sample of a stream always has its timestamp
+				if (stream.samples_chunks.empty() && n_samples &&
+					ts_pos + 9 <= chunk.content_size() && content[ts_pos] == 8)
+					std::memcpy(&stream.result.first_timestamp, content + ts_pos + 1, 8);
+				stream.result.sample_count += n_samples;
+				stream.samples_chunks.push_back(chunk.offset);
+				break;
+			}
+			case chunk_tag_t::clockoffset:
+				if (chunk.content_size() >= 16) {
+					double collection_time, offset;
+					std::memcpy(&collection_time, content, 8);
+					std::memcpy(&offset, content + 8, 8);
+					stream.result.clock_offsets.emplace_back(collection_time, offset);
+				}
+				break;
+			case chunk_tag_t::streamfooter: stream.result.had_footer = true; break;
+			default: break;
+			}
+		}
+		const uint64_t end = report.intact_size = pos;
+
+		for (auto &[id, stream] : streams) {
+			if (stream.has_header)
+				stream.result.last_timestamp = last_timestamp(data, end, stream);
+			report.streams.push_back(stream.result);
+		}
+	}
+	if (dry_run) return report;
+
+	if (report.intact_size < report.original_size)
+		std::filesystem::resize_file(filename, report.intact_size);
+
+	// the report already has the stream ids, so the file isn't scanned again
+	XDFWriter writer(filename, report);
+	for (const auto &stream : report.streams) {
+		if (stream.had_footer || !streams[stream.streamid].has_header) continue;
+		writer.write_stream_footer(stream.streamid,
+			stream_footer_xml(stream.first_timestamp, stream.last_timestamp, stream.sample_count,
+				stream.clock_offsets));
+		report.footers_written++;
+	}
+	return report;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "xdfreader.h"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+// a stream found while recovering an interrupted recording
+struct recovered_stream {
+	streamid_t streamid = 0;
+	std::string name;
+	uint64_t sample_count = 0;
+	double first_timestamp = 0, last_timestamp = 0;
+	std::vector<std::pair<double, double>> clock_offsets; // (collection time, offset value)
+	bool had_footer = false; // the recording wrote a footer, no need to synthesize one
+};
+
+// the result of recover_xdf()
+struct recovery_report {
+	uint64_t original_size = 0;
+	uint64_t intact_size = 0;	// the file ends after the last intact chunk here
+	uint64_t chunks = 0;		// number of intact chunks
+	uint64_t skipped_bytes = 0; // damaged regions before the end, skipped up to the next boundary
+	streamid_t max_streamid = 0;
+	uint32_t footers_written = 0;
+	std::vector<recovered_stream> streams;
+};
+
+/**
+ * @brief recover_xdf Repair an XDF file whose recording was interrupted (e.g. by a crash)
+ *
+ * The file is scanned backwards for the last boundary chunk (see
+ * XDFWriter::write_boundary_chunk()), the partial chunk after the last intact one is cut off
+ * and footers are synthesized for all streams that don't have one.
+ * The chunk headers are walked once and the footers are computed from them, so only the sample
+ * counts and first timestamps of samples chunks and the last samples chunk of each stream are
+ * read, not the whole file.
+ * @param dry_run Only analyze the file, don't modify it
+ */
+recovery_report recover_xdf(const std::string &filename, bool dry_run = false);
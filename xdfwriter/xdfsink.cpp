@@ -0,0 +1,404 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include "xdfsink.h"
+#include "xdfreader.h"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#ifdef XDFZ_SUPPORT
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/iostreams/device/file_descriptor.hpp>
+#include <boost/iostreams/filter/zlib.hpp>
+#endif
+
+using Clock = std::chrono::steady_clock;
+
+durability_mode parse_durability_mode(const std::string &mode) {
+	if (mode == "none") return durability_mode::none;
+	if (mode == "periodic") return durability_mode::periodic;
+	if (mode == "group_commit") return durability_mode::group_commit;
+	throw std::invalid_argument("Unknown durability mode " + mode);
+}
+
+std::string watermark_filename(const std::string &filename) { return filename + ".committed"; }
+
+output_file::output_file(const std::string &filename, bool append) {
+#ifdef XDFZ_SUPPORT
+	if (boost::iends_with(filename, ".xdfz")) {
+		if (append) throw std::runtime_error("Can't append to compressed file " + filename);
+		zfile_ = std::make_unique<boost::iostreams::filtering_ostream>();
+		zfile_->push(boost::iostreams::zlib_compressor());
+		zfile_->push(boost::iostreams::file_descriptor_sink(
+			filename, std::ios::binary | std::ios::trunc));
+		return;
+	}
+#endif
+	fp_ = std::fopen(filename.c_str(), append ? "ab" : "wb");
+	if (!fp_) throw std::runtime_error("Could not open " + filename + " for writing");
+}
+
+output_file::~output_file() { close(); }
+
+bool output_file::close() {
+#ifdef XDFZ_SUPPORT
+	if (zfile_) {
+		const bool ok = static_cast<bool>(zfile_->flush());
+		zfile_.reset();
+		return ok;
+	}
+#endif
+	if (!fp_) return true;
+	const bool ok = std::fclose(fp_) == 0;
+	fp_ = nullptr;
+	return ok;
+}
+
+bool output_file::write(const char *data, std::size_t len) {
+#ifdef XDFZ_SUPPORT
+	if (zfile_) return static_cast<bool>(zfile_->write(data, len));
+#endif
+	return std::fwrite(data, 1, len, fp_) == len;
+}
+
+bool output_file::flush() {
+#ifdef XDFZ_SUPPORT
+	if (zfile_) return static_cast<bool>(zfile_->flush());
+#endif
+	return std::fflush(fp_) == 0;
+}
+
+bool output_file::compressed() const {
+#ifdef XDFZ_SUPPORT
+	if (zfile_) return true;
+#endif
+	return false;
+}
+
+bool output_file::sync() {
+	if (!flush()) return false;
+#ifdef XDFZ_SUPPORT
+	// the compressor doesn't expose its file descriptor, so this is as far as it goes
+	if (zfile_) return true;
+#endif
+#if defined(_WIN32)
+	return _commit(_fileno(fp_)) == 0;
+#elif defined(__APPLE__)
+	return fsync(fileno(fp_)) == 0;
+#else
+	return fdatasync(fileno(fp_)) == 0;
+#endif
+}
+
+xdf_sink::xdf_sink(const std::string &filename, std::size_t max_queued_bytes, bool required,
+	bool append, const durability_policy &durability)
+	: required_(required), max_queued_bytes_(max_queued_bytes),
+	  alarm_queued_bytes_(max_queued_bytes / 8), alarm_latency_(1.0), opened_(Clock::now()),
+	  durability_(durability),
+	  next_sync_(opened_ + std::chrono::duration_cast<Clock::duration>(
+							   std::chrono::duration<double>(durability.interval))) {
+	stats_.filename = filename;
+	if (append) {
+		std::error_code ec;
+		start_offset_ = std::filesystem::file_size(filename, ec);
+		if (ec) start_offset_ = 0;
+		committed_ = published_ = start_offset_;
+	}
+	try {
+		file_ = std::make_unique<output_file>(filename, append);
+	} catch (std::exception &e) {
+		if (required) throw;
+		std::cerr << "Warning: " << e.what() << ", the output is disabled." << std::endl;
+		stats_.failed = true;
+		error_ = e.what();
+		return;
+	}
+	thread_ = std::thread(&xdf_sink::writer_loop, this);
+}
+
+xdf_sink::~xdf_sink() {
+	try {
+		close();
+	} catch (std::exception &) {
+		// already logged when it happened
+	}
+}
+
+void xdf_sink::close() {
+	{
+		std::lock_guard<std::mutex> lock(mut_);
+		if (closed_) return;
+		closed_ = shutdown_ = true;
+		if (stats_.bytes_queued > alarm_queued_bytes_)
+			std::cout << "Writing " << stats_.bytes_queued / 1024 << " KiB of buffered data to "
+					  << stats_.filename << std::endl;
+	}
+	cv_.notify_all();
+	if (thread_.joinable()) thread_.join();
+	if (file_ && !file_->close()) {
+		std::lock_guard<std::mutex> lock(mut_);
+		if (!stats_.failed) fail("Could not close " + stats_.filename);
+	}
+	if (stats_.syncs)
+		std::cout << stats_.filename << ": " << stats_.syncs << " syncs, "
+				  << stats_.mean_sync_latency() * 1000 << " ms on average, "
+				  << stats_.max_sync_latency * 1000 << " ms max" << std::endl;
+	if (stats_.chunks_dropped)
+		std::cerr << "Lost " << stats_.chunks_dropped << " chunks (" << stats_.bytes_dropped
+				  << " bytes) in " << stats_.filename << std::endl;
+	if (required_ && stats_.failed) throw std::runtime_error(error_);
+}
+
+void xdf_sink::fail(const std::string &error) {
+	std::cerr << "Error: " << error << ", the output is disabled." << std::endl;
+	stats_.failed = true;
+	error_ = error;
+}
+
+void xdf_sink::set_limits(
+	std::size_t max_queued_bytes, std::size_t alarm_queued_bytes, double alarm_latency) {
+	std::lock_guard<std::mutex> lock(mut_);
+	max_queued_bytes_ = max_queued_bytes;
+	alarm_queued_bytes_ = alarm_queued_bytes;
+	alarm_latency_ = alarm_latency;
+}
+
+void xdf_sink::set_watermark(double interval) {
+	std::unique_lock<std::mutex> lock(mut_);
+	if (!file_ || file_->compressed()) {
+		std::cerr << "Warning: no watermark for " << stats_.filename
+				  << ", it's disabled or compressed." << std::endl;
+		return;
+	}
+	watermark_file_ = watermark_filename(stats_.filename);
+	watermark_interval_ = interval;
+	// replace a sidecar left over from an earlier recording right away
+	publish_watermark(lock);
+}
+
+void xdf_sink::set_integrity() {
+	std::unique_lock<std::mutex> lock(mut_);
+	if (!file_ || file_->compressed()) {
+		std::cerr << "Warning: no checksums for " << stats_.filename
+				  << ", it's disabled or compressed." << std::endl;
+		return;
+	}
+	integrity_pending_ = true;
+	lock.unlock();
+	cv_.notify_one();
+}
+
+bool xdf_sink::push(chunk_buffer_p buf, bool droppable, bool sync_point) {
+	std::unique_lock<std::mutex> lock(mut_);
+	if (stats_.failed && required_) throw std::runtime_error(error_);
+	if (stats_.failed ||
+		(droppable && stats_.bytes_queued + buf->size() > max_queued_bytes_)) {
+		stats_.chunks_dropped++;
+		stats_.bytes_dropped += buf->size();
+		if (!stats_.failed && !dropping_)
+			std::cerr << "Error: the spill budget of " << max_queued_bytes_ / (1024 * 1024)
+					  << " MiB for " << stats_.filename << " is exhausted, dropping data!"
+					  << std::endl;
+		dropping_ = true;
+		return false;
+	}
+	if (dropping_)
+		std::cerr << "Spill buffer for " << stats_.filename << " has room again, "
+				  << stats_.chunks_dropped << " chunks lost so far." << std::endl;
+	dropping_ = false;
+	stats_.bytes_queued += buf->size();
+	if (stats_.bytes_queued > stats_.max_bytes_queued) stats_.max_bytes_queued = stats_.bytes_queued;
+	if (!spilling_ && stats_.bytes_queued > alarm_queued_bytes_) {
+		spilling_ = true;
+		std::cerr << "Warning: writes to " << stats_.filename << " are stalling, "
+				  << stats_.bytes_queued / 1024 << " KiB buffered in memory." << std::endl;
+	}
+	queue_.push_back(queued_chunk{std::move(buf), sync_point});
+	lock.unlock();
+	cv_.notify_one();
+	return true;
+}
+
+sink_stats xdf_sink::stats() const {
+	std::lock_guard<std::mutex> lock(mut_);
+	sink_stats result(stats_);
+	const auto now = Clock::now();
+	result.elapsed_seconds = std::chrono::duration<double>(now - opened_).count();
+	if (writing_)
+		result.stalled_seconds = std::chrono::duration<double>(now - write_started_).count();
+	result.alarm = stats_.failed || dropping_ || stats_.bytes_queued > alarm_queued_bytes_ ||
+				   result.stalled_seconds > alarm_latency_;
+	return result;
+}
+
+void xdf_sink::writer_loop() {
+	std::unique_lock<std::mutex> lock(mut_);
+	const auto has_work = [this]() { return shutdown_ || !queue_.empty() || integrity_pending_; };
+	while (true) {
+		const bool syncing = durability_.mode != durability_mode::none;
+		const bool sync_pending = syncing && stats_.unsynced_bytes;
+		const bool publish_pending = !watermark_file_.empty() && committed_ != published_;
+		if (sync_pending || publish_pending)
+			cv_.wait_until(lock,
+				sync_pending && publish_pending ? std::min(next_sync_, next_publish_)
+				: sync_pending					? next_sync_
+												: next_publish_,
+				has_work);
+		else
+			cv_.wait(lock, has_work);
+		if (integrity_pending_) start_integrity(lock);
+		if (queue_.empty()) {
+			if (shutdown_) break; // shut down and drained
+			// the sync interval or the watermark interval passed without new data
+			const auto now = Clock::now();
+			if (publish_pending && now >= next_publish_) publish_watermark(lock);
+			if (!sync_pending || now < next_sync_ || sync(lock)) continue;
+			fail("Could not sync " + stats_.filename);
+			break;
+		}
+		queued_chunk chunk = std::move(queue_.front());
+		queue_.pop_front();
+		const bool last = queue_.empty();
+		const uint64_t offset = start_offset_ + stats_.bytes_written;
+		writing_ = true;
+		write_started_ = Clock::now();
+		lock.unlock();
+
+		const std::string &buf = *chunk.buf;
+		bool ok = file_->write(buf.data(), buf.size());
+		// the queue is the write buffer, so hand everything to the OS once it's empty
+		if (ok && last) ok = file_->flush();
+		if (ok && integrity_) {
+			integrity_->add(buf.data(), buf.size(), offset);
+			if (last && !integrity_->flush()) {
+				std::cerr << "Warning: could not write the checksums of " << stats_.filename
+						  << ", they're disabled." << std::endl;
+				integrity_.reset();
+			}
+		}
+		const double latency = std::chrono::duration<double>(Clock::now() - write_started_).count();
+
+		lock.lock();
+		writing_ = false;
+		stats_.bytes_queued -= buf.size();
+		stats_.write_seconds += latency;
+		if (latency > stats_.max_write_latency) stats_.max_write_latency = latency;
+		if (ok) {
+			stats_.bytes_written += buf.size();
+			stats_.unsynced_bytes += buf.size();
+			stats_.chunks_written++;
+			// sync points (boundary chunks) are preferred, so synced data ends with a restart
+			// marker; the interval and size limits bound the data at risk in between
+			const bool sync_due = chunk.sync_point || Clock::now() >= next_sync_ ||
+								  (durability_.mode == durability_mode::group_commit &&
+									  durability_.max_unsynced_bytes &&
+									  stats_.unsynced_bytes >= durability_.max_unsynced_bytes);
+			if (syncing && sync_due) ok = sync(lock);
+			// the file ends with a complete chunk after each flush
+			if (ok && (last || (syncing && sync_due))) {
+				committed_ = start_offset_ + stats_.bytes_written;
+				if (!watermark_file_.empty() && Clock::now() >= next_publish_)
+					publish_watermark(lock);
+			}
+		}
+		if (!ok) {
+			fail("Could not write to " + stats_.filename);
+			stats_.chunks_dropped += queue_.size() + 1;
+			stats_.bytes_dropped += stats_.bytes_queued + buf.size();
+			stats_.bytes_queued = 0;
+			queue_.clear();
+			break;
+		}
+		if (spilling_ && stats_.bytes_queued == 0) {
+			spilling_ = false;
+			std::cerr << "Writes to " << stats_.filename << " caught up, the spill buffer peaked at "
+					  << stats_.max_bytes_queued / 1024 << " KiB." << std::endl;
+		}
+	}
+	// with a durability policy, everything is on the disk once the file is closed
+	if (durability_.mode != durability_mode::none && !stats_.failed && stats_.unsynced_bytes &&
+		!sync(lock))
+		fail("Could not sync " + stats_.filename);
+	if (!watermark_file_.empty()) publish_watermark(lock, true);
+	if (integrity_ && !stats_.failed && !integrity_->finish())
+		std::cerr << "Warning: could not write the digest of " << stats_.filename << std::endl;
+	else if (integrity_ && stats_.failed)
+		std::cerr << "No digest for " << stats_.filename << ", writing it failed." << std::endl;
+}
+
+void xdf_sink::start_integrity(std::unique_lock<std::mutex> &lock) {
+	integrity_pending_ = false;
+	const uint64_t written = start_offset_ + stats_.bytes_written;
+	const std::string filename = stats_.filename;
+	lock.unlock();
+	// the data written so far (just the file header, unless appending) is read back once
+	std::unique_ptr<integrity_writer> integrity;
+	try {
+		if (!file_->flush()) throw std::runtime_error("could not flush the file");
+		integrity = std::make_unique<integrity_writer>(filename);
+		if (written) {
+			mapped_file existing(filename);
+			integrity->add(existing.data(), std::min(written, existing.size()), 0);
+		}
+	} catch (std::exception &e) {
+		std::cerr << "Warning: no checksums for " << filename << ": " << e.what() << std::endl;
+		integrity.reset();
+	}
+	lock.lock();
+	integrity_ = std::move(integrity);
+}
+
+void xdf_sink::publish_watermark(std::unique_lock<std::mutex> &lock, bool closed) {
+	const uint64_t committed = committed_;
+	const std::string filename = watermark_file_, tmpname = watermark_file_ + ".tmp";
+	lock.unlock();
+	bool ok;
+	{
+		// set_watermark() and the writer thread might publish at the same time
+		std::lock_guard<std::mutex> publish_lock(watermark_mut_);
+		{
+			std::ofstream out(tmpname, std::ios::trunc);
+			out << committed << (closed ? " closed" : "") << '\n';
+			ok = static_cast<bool>(out.flush());
+		}
+		// renaming replaces the old sidecar atomically, readers never see a partial file
+		std::error_code ec;
+		if (ok) std::filesystem::rename(tmpname, filename, ec);
+		ok = ok && !ec;
+	}
+	lock.lock();
+	if (!ok) {
+		std::cerr << "Warning: could not update the watermark " << filename
+				  << ", it's disabled." << std::endl;
+		watermark_file_.clear();
+	}
+	published_ = committed;
+	next_publish_ = Clock::now() + std::chrono::duration_cast<Clock::duration>(
+									   std::chrono::duration<double>(watermark_interval_));
+}
+
+bool xdf_sink::sync(std::unique_lock<std::mutex> &lock) {
+	writing_ = true;
+	write_started_ = Clock::now();
+	lock.unlock();
+	const bool ok = file_->sync();
+	const auto now = Clock::now();
+	const double latency = std::chrono::duration<double>(now - write_started_).count();
+	lock.lock();
+	writing_ = false;
+	next_sync_ = now + std::chrono::duration_cast<Clock::duration>(
+						   std::chrono::duration<double>(durability_.interval));
+	if (!ok) return false;
+	stats_.syncs++;
+	stats_.unsynced_bytes = 0;
+	stats_.sync_seconds += latency;
+	if (latency > stats_.max_sync_latency) stats_.max_sync_latency = latency;
+	return true;
+}
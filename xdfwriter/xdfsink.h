@@ -0,0 +1,206 @@
+#pragma once
+
+#include "xdfintegrity.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef XDFZ_SUPPORT
+#include <boost/iostreams/filtering_stream.hpp>
+#endif
+
+// a fully serialized chunk (header and content), shared between all sinks writing it
+using chunk_buffer_p = std::shared_ptr<const std::string>;
+
+// when data is forced from the page cache to the disk
+enum class durability_mode {
+	none,		 // leave it to the operating system
+	periodic,	 // sync at boundary chunks and at least every `interval` seconds
+	group_commit // like periodic, and also as soon as `max_unsynced_bytes` are written
+};
+
+// how much data may be lost on a power failure
+struct durability_policy {
+	durability_mode mode = durability_mode::none;
+	double interval = 1.0;				// maximum time between syncs, in seconds
+	std::size_t max_unsynced_bytes = 0; // group_commit only: maximum data between syncs
+};
+
+/// parse "none", "periodic" or "group_commit", throws std::invalid_argument otherwise
+durability_mode parse_durability_mode(const std::string &mode);
+
+/**
+ * The sidecar file with the committed offset of an XDF file that's being written.
+ *
+ * It holds a single line with the size of the file up to the end of the last chunk handed to the
+ * operating system, followed by " closed" once the file is complete. It's replaced atomically, so
+ * readers always see a consistent value, and everything before the offset consists of complete
+ * chunks.
+ */
+std::string watermark_filename(const std::string &filename);
+
+// throughput and health counters of a single output sink
+struct sink_stats {
+	std::string filename;
+	uint64_t bytes_written = 0;
+	uint64_t chunks_written = 0;
+	uint64_t chunks_dropped = 0;
+	uint64_t bytes_dropped = 0;
+	uint64_t bytes_queued = 0;	   // data waiting in memory (the spill buffer)
+	uint64_t max_bytes_queued = 0; // the largest the spill buffer has been
+	double write_seconds = 0;	   // total time spent in write calls
+	double max_write_latency = 0;  // longest single write call, in seconds
+	double stalled_seconds = 0;	   // duration of the write call currently in progress
+	double elapsed_seconds = 0;	   // time since the sink was opened
+	uint64_t syncs = 0;			   // number of completed syncs to the disk
+	uint64_t unsynced_bytes = 0;   // data written since the last sync
+	double sync_seconds = 0;	   // total time spent syncing
+	double max_sync_latency = 0;   // longest single sync, in seconds
+	bool failed = false;		   // an I/O error occurred, the sink doesn't write anymore
+	bool alarm = false; // the output is stalled, spilling a lot of data or losing data
+
+	/// average write throughput in bytes per second since the sink was opened
+	double throughput() const { return elapsed_seconds > 0 ? bytes_written / elapsed_seconds : 0; }
+	/// average duration of a sync in seconds
+	double mean_sync_latency() const { return syncs ? sync_seconds / syncs : 0; }
+};
+
+/**
+ * A binary output file. Plain files are written with stdio, files ending in .xdfz
+ * are zlib-compressed if XDFZ_SUPPORT is enabled.
+ */
+class output_file {
+public:
+	/// Open (and truncate, unless appending) the file, throws std::runtime_error on failure
+	explicit output_file(const std::string &filename, bool append = false);
+	~output_file();
+	output_file(const output_file &) = delete;
+	output_file &operator=(const output_file &) = delete;
+
+	/// write len bytes, returns false on an I/O error
+	bool write(const char *data, std::size_t len);
+	/// hand buffered data to the operating system
+	bool flush();
+	/// flush and close the file, returns false on an I/O error
+	bool close();
+	/// whether the data is compressed, i.e. offsets in the file don't match the written data
+	bool compressed() const;
+	/// flush and wait until the data is on the disk (fdatasync)
+	bool sync();
+
+private:
+	std::FILE *fp_ = nullptr;
+#ifdef XDFZ_SUPPORT
+	std::unique_ptr<boost::iostreams::filtering_ostream> zfile_;
+#endif
+};
+
+/**
+ * An output file with its own queue and writer thread, so callers never wait for the disk.
+ *
+ * Chunks are queued as shared buffers, so the serialization work is shared with all other sinks.
+ * When the disk stalls, the queue acts as a spill buffer in memory and is drained in order once
+ * writes go through again. Only when the queue exceeds its budget are droppable (i.e. samples)
+ * chunks discarded, which keeps the file parseable and is logged. An I/O error disables the sink;
+ * for a required sink (the main file) it's also rethrown by every later push() and by close().
+ */
+class xdf_sink {
+public:
+	/**
+	 * @param filename  File to write to
+	 * @param max_queued_bytes  Spill budget, i.e. the queue size before chunks are dropped
+	 * @param required  Throw if the file can't be opened or written instead of disabling the sink
+	 * @param append  Append to an existing file instead of truncating it
+	 * @param durability  When data is synced to the disk
+	 */
+	xdf_sink(const std::string &filename, std::size_t max_queued_bytes, bool required = false,
+		bool append = false, const durability_policy &durability = durability_policy());
+	/// Writes all queued chunks and closes the file (errors are only logged)
+	~xdf_sink();
+
+	/**
+	 * @brief close Write all queued chunks and close the file, the sink can't be used afterwards
+	 * @throws std::runtime_error if the sink is required and an I/O error occurred
+	 */
+	void close();
+
+	/**
+	 * @brief push Queue a buffer for writing
+	 * @param droppable Whether the buffer may be dropped when the spill budget is exhausted
+	 * @param sync_point Whether the buffer ends at a good place to sync (e.g. a boundary chunk)
+	 * @return false if the buffer was dropped
+	 * @throws std::runtime_error if the sink is required and an I/O error occurred
+	 */
+	bool push(chunk_buffer_p buf, bool droppable = true, bool sync_point = false);
+	/**
+	 * @brief set_limits Change the spill budget and the watchdog thresholds
+	 * @param max_queued_bytes Queue size before droppable chunks are dropped
+	 * @param alarm_queued_bytes Queue size that raises the alarm
+	 * @param alarm_latency Duration of a single write (in seconds) that raises the alarm
+	 */
+	void set_limits(
+		std::size_t max_queued_bytes, std::size_t alarm_queued_bytes, double alarm_latency);
+	/**
+	 * @brief set_watermark Publish the committed offset in the watermark_filename() sidecar
+	 * @param interval Minimum time between updates of the sidecar, in seconds
+	 */
+	void set_watermark(double interval);
+	/// compute the checksums of the written data, starting with what's already in the file
+	void set_integrity();
+	sink_stats stats() const;
+
+private:
+	struct queued_chunk {
+		chunk_buffer_p buf;
+		bool sync_point;
+	};
+
+	void writer_loop();
+	/// disable the sink after an I/O error, with the lock held
+	void fail(const std::string &error);
+	/// sync the file with the lock held on entry and exit, returns false on I/O errors
+	bool sync(std::unique_lock<std::mutex> &lock);
+	/// update the watermark sidecar with the lock held on entry and exit
+	void publish_watermark(std::unique_lock<std::mutex> &lock, bool closed = false);
+	/// start the checksums (with the lock held on entry and exit) on the writer thread
+	void start_integrity(std::unique_lock<std::mutex> &lock);
+
+	std::unique_ptr<output_file> file_;
+	const bool required_;
+	std::size_t max_queued_bytes_;
+	std::size_t alarm_queued_bytes_;
+	double alarm_latency_;
+	const std::chrono::steady_clock::time_point opened_;
+
+	mutable std::mutex mut_;
+	std::condition_variable cv_;
+	std::deque<queued_chunk> queue_;
+	const durability_policy durability_;
+	std::chrono::steady_clock::time_point next_sync_;
+	std::mutex watermark_mut_;	 // serializes updates of the sidecar
+	std::string watermark_file_; // empty if the watermark is disabled
+	double watermark_interval_ = 0;
+	uint64_t start_offset_ = 0; // the file size when it was opened (when appending)
+	uint64_t committed_ = 0;	// the file size up to the last flushed chunk
+	uint64_t published_ = 0;	// the offset in the sidecar
+	std::chrono::steady_clock::time_point next_publish_;
+	bool integrity_pending_ = false; // set_integrity() was called, the writer thread starts it
+	std::unique_ptr<integrity_writer> integrity_; // only used by the writer thread
+	bool shutdown_ = false;
+	bool closed_ = false;
+	std::string error_; // the I/O error that disabled the sink
+	bool dropping_ = false; // currently dropping chunks, used to log only once per overflow
+	bool spilling_ = false; // the queue is above the alarm threshold
+	std::chrono::steady_clock::time_point write_started_; // start of the current write call
+	bool writing_ = false;
+	sink_stats stats_;
+	std::thread thread_;
+};
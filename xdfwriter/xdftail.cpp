@@ -0,0 +1,137 @@
+#include "xdftail.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+#include <thread>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+using Clock = std::chrono::steady_clock;
+
+// the most data read into memory at once (unless a single chunk is larger)
+const uint64_t max_read_size = 16 * 1024 * 1024;
+
+xdf_tail_reader::xdf_tail_reader(const std::string &filename)
+	: filename_(filename), watermark_file_(watermark_filename(filename)) {
+#ifdef __linux__
+	// watch the directory, the sidecar is replaced by a rename and the file might not exist yet
+	inotify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (inotify_fd_ >= 0) {
+		auto dir = std::filesystem::path(filename).parent_path();
+		if (dir.empty()) dir = ".";
+		if (inotify_add_watch(inotify_fd_, dir.string().c_str(),
+				IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0) {
+			close(inotify_fd_);
+			inotify_fd_ = -1;
+		}
+	}
+#endif
+}
+
+xdf_tail_reader::~xdf_tail_reader() {
+#ifdef __linux__
+	if (inotify_fd_ >= 0) close(inotify_fd_);
+#endif
+}
+
+bool xdf_tail_reader::next(tail_chunk &chunk, double timeout) {
+	const auto deadline = Clock::now() + std::chrono::duration_cast<Clock::duration>(
+											 std::chrono::duration<double>(timeout));
+	while (true) {
+		if (parse_buffered(chunk)) return true;
+		if (refresh()) continue;
+		if (finished()) return false;
+		const double remaining = std::chrono::duration<double>(deadline - Clock::now()).count();
+		if (remaining <= 0) return false;
+		wait(remaining);
+	}
+}
+
+bool xdf_tail_reader::refresh() {
+	{
+		std::ifstream watermark(watermark_file_);
+		uint64_t committed;
+		std::string flag;
+		if (watermark >> committed) {
+			have_watermark_ = true;
+			committed_ = committed;
+			closed_ = watermark >> flag && flag == "closed";
+		}
+	}
+	if (!have_watermark_) {
+		// without a watermark, everything in the file is read, but only complete chunks are parsed
+		std::error_code ec;
+		const uint64_t size = std::filesystem::file_size(filename_, ec);
+		if (ec) return false;
+		committed_ = size;
+	}
+	const uint64_t buffered_end = offset_ + (buffer_.size() - buffer_pos_);
+	if (committed_ <= buffered_end) return false;
+	if (!file_.is_open()) {
+		file_.open(filename_, std::ios::binary);
+		if (!file_.is_open()) return false;
+	}
+	// drop the returned chunks before reading more
+	buffer_.erase(0, buffer_pos_);
+	buffer_pos_ = 0;
+	const auto old_size = buffer_.size();
+	buffer_.resize(old_size + std::min(committed_ - buffered_end, max_read_size));
+	file_.clear();
+	file_.seekg(static_cast<std::streamoff>(buffered_end));
+	file_.read(&buffer_[old_size], static_cast<std::streamsize>(buffer_.size() - old_size));
+	buffer_.resize(old_size + static_cast<std::size_t>(file_.gcount()));
+	return buffer_.size() > old_size;
+}
+
+bool xdf_tail_reader::parse_buffered(tail_chunk &chunk) {
+	const char *data = buffer_.data() + buffer_pos_;
+	const uint64_t size = buffer_.size() - buffer_pos_;
+	if (offset_ == 0) {
+		// [MagicCode]
+		if (size < 4) return false;
+		if (std::memcmp(data, "XDF:", 4) != 0)
+			throw std::runtime_error(filename_ + " is not an XDF file");
+		buffer_pos_ += 4;
+		offset_ = 4;
+		return parse_buffered(chunk);
+	}
+	chunk_info info;
+	if (!parse_chunk_header(data, size, 0, info)) {
+		// with a watermark, the committed data consists of complete chunks
+		if (have_watermark_ && size > 0 && offset_ + size >= committed_)
+			throw std::runtime_error(
+				"Malformed chunk at offset " + std::to_string(offset_) + " in " + filename_);
+		return false;
+	}
+	chunk.content.assign(data + info.content_offset, info.content_size());
+	chunk.info = info;
+	chunk.info.offset += offset_;
+	chunk.info.content_offset += offset_;
+	chunk.info.end += offset_;
+	buffer_pos_ += info.end;
+	offset_ += info.end;
+	return true;
+}
+
+void xdf_tail_reader::wait(double timeout) {
+	// wake up at least once a second, e.g. for network file systems without change notifications
+	timeout = std::min(timeout, 1.0);
+#ifdef __linux__
+	if (inotify_fd_ >= 0) {
+		pollfd pfd{inotify_fd_, POLLIN, 0};
+		if (poll(&pfd, 1, static_cast<int>(timeout * 1000) + 1) > 0) {
+			// the events themselves don't matter, refresh() checks what changed
+			char events[4096];
+			while (read(inotify_fd_, events, sizeof(events)) > 0) {}
+		}
+		return;
+	}
+#endif
+	std::this_thread::sleep_for(std::chrono::duration<double>(std::min(timeout, 0.1)));
+}
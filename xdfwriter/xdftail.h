@@ -0,0 +1,62 @@
+#pragma once
+
+#include "xdfreader.h"
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+// a complete chunk read from a file that's still being written
+struct tail_chunk {
+	chunk_info info;	 // the offsets are relative to the start of the file
+	std::string content; // the chunk content, i.e. without the length, tag and stream id
+};
+
+/**
+ * Follows an XDF file while it's being written (like `tail -f`) and yields only complete chunks.
+ *
+ * If the writer publishes a watermark (see XDFWriter::set_watermark()), only data up to the
+ * committed offset is read and the end of the recording is detected. Otherwise, chunks are
+ * returned as soon as they are completely in the file.
+ * On Linux, the reader sleeps until inotify reports a change to the file or the watermark;
+ * elsewhere it checks for new data every 100 ms.
+ */
+class xdf_tail_reader {
+public:
+	/// Follow the file, which doesn't have to exist yet
+	explicit xdf_tail_reader(const std::string &filename);
+	~xdf_tail_reader();
+	xdf_tail_reader(const xdf_tail_reader &) = delete;
+	xdf_tail_reader &operator=(const xdf_tail_reader &) = delete;
+
+	/**
+	 * @brief next Read the next complete chunk, waiting for it if necessary
+	 * @param timeout Maximum time to wait, in seconds
+	 * @return false on a timeout or if the recording is finished and all chunks have been read
+	 * @throws std::runtime_error if the file isn't an XDF file or contains a malformed chunk
+	 */
+	bool next(tail_chunk &chunk, double timeout);
+
+	/// whether the writer closed the file and all chunks have been read
+	bool finished() const { return closed_ && offset_ >= committed_; }
+	/// the offset of the next chunk
+	uint64_t offset() const { return offset_; }
+
+private:
+	/// check the watermark and the file size, returns true if there's new data
+	bool refresh();
+	/// wait until the file or the watermark changes or the timeout (in seconds) passes
+	void wait(double timeout);
+	/// try to parse a complete chunk from the buffer
+	bool parse_buffered(tail_chunk &chunk);
+
+	const std::string filename_, watermark_file_;
+	std::ifstream file_;
+	std::string buffer_;		 // data read from the file but not returned yet (from buffer_pos_)
+	std::size_t buffer_pos_ = 0; // the position of offset_ in the buffer
+	uint64_t offset_ = 0;		 // file offset of the next chunk
+	uint64_t committed_ = 0;	 // readable part of the file
+	bool have_watermark_ = false;
+	bool closed_ = false;
+	int inotify_fd_ = -1;
+};
@@ -0,0 +1,290 @@
+#include "xdftap.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <thread>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "the tap needs lock-free atomics");
+
+static const char tap_magic[8] = {'X', 'D', 'F', 'T', 'A', 'P', '1', 0};
+// the length of a padding record, the next record starts at the beginning of the ring
+static const uint64_t padding_record = ~0ull;
+
+static uint64_t align8(uint64_t n) { return (n + 7) & ~7ull; }
+static uint64_t catalog_offset() { return (sizeof(tap_header) + 63) & ~63ull; }
+
+static uint32_t current_pid() {
+#ifdef _WIN32
+	return static_cast<uint32_t>(GetCurrentProcessId());
+#else
+	return static_cast<uint32_t>(getpid());
+#endif
+}
+
+/// whether the process that attached a slot is gone, e.g. because it crashed
+static bool process_gone(uint32_t pid) {
+#ifdef _WIN32
+	HANDLE process = OpenProcess(SYNCHRONIZE, FALSE, pid);
+	if (!process) return true;
+	const bool gone = WaitForSingleObject(process, 0) == WAIT_OBJECT_0;
+	CloseHandle(process);
+	return gone;
+#else
+	return kill(static_cast<pid_t>(pid), 0) != 0 && errno == ESRCH;
+#endif
+}
+
+shared_memory::shared_memory(const std::string &name, uint64_t size, bool create)
+	: owner_(create) {
+#ifdef _WIN32
+	name_ = "Local\\" + name;
+	if (create)
+		mapping_handle_ = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+			static_cast<DWORD>(size >> 32), static_cast<DWORD>(size), name_.c_str());
+	else
+		mapping_handle_ = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, name_.c_str());
+	if (!mapping_handle_) throw std::runtime_error("Could not open shared memory " + name);
+	data_ = static_cast<char *>(MapViewOfFile(mapping_handle_, FILE_MAP_ALL_ACCESS, 0, 0, 0));
+	if (!data_) {
+		CloseHandle(mapping_handle_);
+		throw std::runtime_error("Could not map shared memory " + name);
+	}
+	MEMORY_BASIC_INFORMATION info;
+	VirtualQuery(data_, &info, sizeof(info));
+	size_ = create ? size : static_cast<uint64_t>(info.RegionSize);
+#else
+	name_ = '/' + name;
+	int fd;
+	if (create) {
+		// readers still attached to an earlier tap keep their (unlinked) copy
+		shm_unlink(name_.c_str());
+		fd = shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+		if (fd >= 0 && ftruncate(fd, static_cast<off_t>(size)) != 0) {
+			close(fd);
+			shm_unlink(name_.c_str());
+			fd = -1;
+		}
+	} else
+		fd = shm_open(name_.c_str(), O_RDWR, 0);
+	if (fd < 0) throw std::runtime_error("Could not open shared memory " + name);
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		throw std::runtime_error("Could not stat shared memory " + name);
+	}
+	size_ = static_cast<uint64_t>(st.st_size);
+	void *addr = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (addr == MAP_FAILED) {
+		if (create) shm_unlink(name_.c_str());
+		throw std::runtime_error("Could not map shared memory " + name);
+	}
+	data_ = static_cast<char *>(addr);
+#endif
+}
+
+shared_memory::~shared_memory() {
+#ifdef _WIN32
+	UnmapViewOfFile(data_);
+	CloseHandle(mapping_handle_);
+#else
+	munmap(data_, size_);
+	if (owner_) shm_unlink(name_.c_str());
+#endif
+}
+
+static uint64_t ring_capacity(uint64_t capacity) {
+	uint64_t result = 64 * 1024;
+	while (result < capacity) result *= 2;
+	return result;
+}
+
+shm_tap_writer::shm_tap_writer(const std::string &name, uint64_t capacity)
+	: name_(name), shm_(name, catalog_offset() + tap_catalog_size + ring_capacity(capacity), true) {
+	header_ = new (shm_.data()) tap_header();
+	header_->capacity = ring_capacity(capacity);
+	header_->catalog_capacity = tap_catalog_size;
+	catalog_ = shm_.data() + catalog_offset();
+	ring_ = catalog_ + tap_catalog_size;
+	// readers only attach once the magic code is there
+	std::atomic_thread_fence(std::memory_order_release);
+	std::memcpy(header_->magic, tap_magic, sizeof(tap_magic));
+}
+
+shm_tap_writer::~shm_tap_writer() { header_->closed.store(1, std::memory_order_release); }
+
+void shm_tap_writer::add_stream(uint32_t streamid, const std::string &header) {
+	const uint64_t used = header_->catalog_used.load(std::memory_order_relaxed);
+	const uint64_t len = header.size(), need = 8 + align8(len);
+	if (used + need > header_->catalog_capacity) return;
+	const auto len32 = static_cast<uint32_t>(len);
+	std::memcpy(catalog_ + used, &streamid, 4);
+	std::memcpy(catalog_ + used + 4, &len32, 4);
+	std::memcpy(catalog_ + used + 8, header.data(), len);
+	header_->catalog_used.store(used + need, std::memory_order_release);
+}
+
+void shm_tap_writer::publish(const std::string &chunk) {
+	const uint64_t capacity = header_->capacity, len = chunk.size(), need = 8 + align8(len);
+	if (need > capacity / 2) {
+		++chunks_skipped_;
+		return;
+	}
+	uint64_t head = header_->head.load(std::memory_order_relaxed);
+	uint64_t offset = head & (capacity - 1);
+	const uint64_t padding = offset + need > capacity ? capacity - offset : 0;
+	const uint64_t end = head + padding + need;
+	if (end > capacity && end - capacity > header_->tail.load(std::memory_order_relaxed)) {
+		// announce which data is about to be overwritten before touching it
+		header_->tail.store(end - capacity, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		drop_overrun_consumers(end - capacity);
+	}
+	if (padding) {
+		std::memcpy(ring_ + offset, &padding_record, 8);
+		head += padding;
+		offset = 0;
+	}
+	std::memcpy(ring_ + offset, &len, 8);
+	std::memcpy(ring_ + offset + 8, chunk.data(), len);
+	header_->head.store(head + need, std::memory_order_release);
+	header_->chunks_published.fetch_add(1, std::memory_order_relaxed);
+	bytes_published_ += len;
+}
+
+void shm_tap_writer::drop_overrun_consumers(uint64_t tail) {
+	for (auto &slot : header_->slots) {
+		uint32_t active = tap_slot_active;
+		if (slot.cursor.load(std::memory_order_acquire) < tail &&
+			slot.state.compare_exchange_strong(active, tap_slot_dropped))
+			header_->consumers_dropped.fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+tap_stats shm_tap_writer::stats() const {
+	tap_stats result;
+	result.name = name_;
+	result.chunks_published = header_->chunks_published.load(std::memory_order_relaxed);
+	result.bytes_published = bytes_published_;
+	result.chunks_skipped = chunks_skipped_;
+	result.consumers_dropped = header_->consumers_dropped.load(std::memory_order_relaxed);
+	const uint64_t head = header_->head.load(std::memory_order_relaxed);
+	for (const auto &slot : header_->slots) {
+		if (slot.state.load(std::memory_order_relaxed) != tap_slot_active) continue;
+		++result.consumers;
+		result.max_lag = std::max(result.max_lag, head - slot.cursor.load(std::memory_order_relaxed));
+	}
+	return result;
+}
+
+shm_tap_reader::shm_tap_reader(const std::string &name) : shm_(name, 0, false) {
+	header_ = reinterpret_cast<tap_header *>(shm_.data());
+	if (shm_.size() < catalog_offset() || std::memcmp(header_->magic, tap_magic, 8) != 0)
+		throw std::runtime_error("Shared memory " + name + " is not an XDF tap");
+	std::atomic_thread_fence(std::memory_order_acquire);
+	catalog_ = shm_.data() + catalog_offset();
+	ring_ = catalog_ + header_->catalog_capacity;
+
+	// take a free slot, or one left behind by a reader that crashed after it was dropped
+	for (int pass = 0; pass < 2 && !slot_; ++pass)
+		for (auto &slot : header_->slots) {
+			uint32_t state = pass == 0 ? tap_slot_free : tap_slot_dropped;
+			if (pass == 1 && !process_gone(slot.pid.load())) continue;
+			if (slot.state.compare_exchange_strong(state, tap_slot_claimed)) {
+				slot_ = &slot;
+				break;
+			}
+		}
+	if (!slot_)
+		throw std::runtime_error("All " + std::to_string(tap_max_consumers) + " readers of " +
+								 name + " are taken");
+	slot_->pid.store(current_pid());
+	resync();
+}
+
+shm_tap_reader::~shm_tap_reader() { slot_->state.store(tap_slot_free); }
+
+void shm_tap_reader::resync() {
+	// the newest data is the start, a live tap has no history
+	pos_ = current_ = header_->head.load(std::memory_order_acquire);
+	slot_->cursor.store(pos_, std::memory_order_release);
+	slot_->state.store(tap_slot_active);
+}
+
+bool shm_tap_reader::dropped() const { return slot_->state.load() == tap_slot_dropped; }
+
+bool shm_tap_reader::valid() const {
+	std::atomic_thread_fence(std::memory_order_acquire);
+	return header_->tail.load(std::memory_order_relaxed) <= current_ && !dropped();
+}
+
+uint64_t shm_tap_reader::lag() const {
+	return header_->head.load(std::memory_order_relaxed) - pos_;
+}
+
+bool shm_tap_reader::next(const char *&data, uint64_t &size, double timeout) {
+	const uint64_t capacity = header_->capacity;
+	const auto deadline = std::chrono::steady_clock::now() +
+						  std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+							  std::chrono::duration<double>(timeout));
+	auto backoff = std::chrono::microseconds(50);
+	while (true) {
+		if (dropped()) throw std::runtime_error("The tap reader fell behind and was dropped");
+		const uint64_t head = header_->head.load(std::memory_order_acquire);
+		if (pos_ == head) {
+			if (header_->closed.load(std::memory_order_acquire) ||
+				std::chrono::steady_clock::now() >= deadline)
+				return false;
+			std::this_thread::sleep_for(backoff);
+			backoff = std::min(backoff * 2, std::chrono::microseconds(2000));
+			continue;
+		}
+		const uint64_t offset = pos_ & (capacity - 1);
+		uint64_t len;
+		std::memcpy(&len, ring_ + offset, 8);
+		// the record might have been overwritten while reading its length
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (header_->tail.load(std::memory_order_relaxed) > pos_) {
+			uint32_t active = tap_slot_active;
+			if (slot_->state.compare_exchange_strong(active, tap_slot_dropped))
+				header_->consumers_dropped.fetch_add(1, std::memory_order_relaxed);
+			continue;
+		}
+		if (len == padding_record) {
+			pos_ += capacity - offset;
+			continue;
+		}
+		data = ring_ + offset + 8;
+		size = len;
+		current_ = pos_;
+		pos_ += 8 + align8(len);
+		slot_->cursor.store(current_, std::memory_order_release);
+		return true;
+	}
+}
+
+std::vector<std::pair<uint32_t, std::string>> shm_tap_reader::streams() {
+	const uint64_t used = header_->catalog_used.load(std::memory_order_acquire);
+	while (catalog_read_ < used) {
+		uint32_t streamid, len;
+		std::memcpy(&streamid, catalog_ + catalog_read_, 4);
+		std::memcpy(&len, catalog_ + catalog_read_ + 4, 4);
+		streams_.emplace_back(streamid, std::string(catalog_ + catalog_read_ + 8, len));
+		catalog_read_ += 8 + align8(len);
+	}
+	return streams_;
+}
@@ -0,0 +1,160 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+/*
+ * A live tap of the recording in shared memory, so local programs get the serialized chunks
+ * without opening their own inlets.
+ *
+ * Layout of the shared memory: [tap_header][catalog][ring]
+ * The catalog holds the stream headers (needed to decode the samples), the ring the serialized
+ * samples chunks as records of [uint64 length][chunk, padded to 8 bytes]. A record that doesn't
+ * fit before the end of the ring is preceded by a padding record and starts at the beginning.
+ *
+ * There's one writer, which never waits for readers: it overwrites the oldest records and
+ * advances `tail` before it does. Readers check `tail` after reading a record to detect that it
+ * was overwritten (like a seqlock), and a reader that fell behind that far is marked as dropped.
+ */
+
+const uint32_t tap_max_consumers = 16;
+const uint64_t tap_catalog_size = 1024 * 1024;
+
+enum tap_slot_state : uint32_t {
+	tap_slot_free = 0,
+	tap_slot_active = 1,
+	tap_slot_dropped = 2, // the reader fell too far behind, see shm_tap_reader::resync()
+	tap_slot_claimed = 3  // a reader is attaching
+};
+
+// a reader's position in the ring, so the writer can report its lag
+struct tap_consumer_slot {
+	std::atomic<uint32_t> state;
+	std::atomic<uint32_t> pid;
+	std::atomic<uint64_t> cursor; // the position of the record the reader is at
+};
+
+struct tap_header {
+	char magic[8];
+	uint64_t capacity; // size of the ring, a power of 2
+	uint64_t catalog_capacity;
+	std::atomic<uint64_t> head;			// end of the last complete record
+	std::atomic<uint64_t> tail;			// records before this position may be overwritten
+	std::atomic<uint64_t> catalog_used; // bytes of complete catalog entries
+	std::atomic<uint64_t> chunks_published;
+	std::atomic<uint64_t> consumers_dropped;
+	std::atomic<uint32_t> closed; // the recording is finished, no more records will follow
+	tap_consumer_slot slots[tap_max_consumers];
+};
+
+// counters of the writing side of a tap
+struct tap_stats {
+	std::string name;
+	uint64_t chunks_published = 0;
+	uint64_t bytes_published = 0;
+	uint64_t chunks_skipped = 0; // chunks larger than half the ring
+	uint32_t consumers = 0;		 // currently attached readers
+	uint64_t max_lag = 0;		 // bytes the slowest reader is behind
+	uint64_t consumers_dropped = 0;
+};
+
+// a shared memory mapping, created by the writer and opened by the readers
+class shared_memory {
+public:
+	/// create (replacing an existing one) or open a shared memory object, throws on failure
+	shared_memory(const std::string &name, uint64_t size, bool create);
+	~shared_memory();
+	shared_memory(const shared_memory &) = delete;
+	shared_memory &operator=(const shared_memory &) = delete;
+
+	char *data() const { return data_; }
+	uint64_t size() const { return size_; }
+
+private:
+	std::string name_;
+	char *data_ = nullptr;
+	uint64_t size_ = 0;
+	bool owner_;
+#ifdef _WIN32
+	void *mapping_handle_ = nullptr;
+#endif
+};
+
+/**
+ * The writing side of a tap, see XDFWriter::enable_tap().
+ * Not thread safe, the XDFWriter calls it with its write lock held.
+ */
+class shm_tap_writer {
+public:
+	/**
+	 * @param name Name of the shared memory object; readers use the same name
+	 * @param capacity Size of the ring (rounded up to a power of 2)
+	 */
+	shm_tap_writer(const std::string &name, uint64_t capacity);
+	/// marks the tap as closed and removes the name, attached readers can finish reading
+	~shm_tap_writer();
+
+	/// publish a stream header in the catalog
+	void add_stream(uint32_t streamid, const std::string &header);
+	/// publish a serialized chunk, overwriting the oldest records if necessary
+	void publish(const std::string &chunk);
+	tap_stats stats() const;
+
+private:
+	/// mark readers that are behind the tail as dropped
+	void drop_overrun_consumers(uint64_t tail);
+
+	std::string name_;
+	shared_memory shm_;
+	tap_header *header_;
+	char *catalog_, *ring_;
+	uint64_t bytes_published_ = 0, chunks_skipped_ = 0;
+};
+
+/**
+ * A reader attached to a tap. Chunks are returned as pointers into the shared memory, i.e.
+ * without copying; since the writer never waits, check valid() after using the data.
+ *
+ * A reader that falls more than the size of the ring behind is dropped: next() then throws until
+ * resync() is called, which skips to the newest data.
+ */
+class shm_tap_reader {
+public:
+	/// attach to a tap, throws std::runtime_error if it doesn't exist or all slots are taken
+	explicit shm_tap_reader(const std::string &name);
+	~shm_tap_reader();
+	shm_tap_reader(const shm_tap_reader &) = delete;
+	shm_tap_reader &operator=(const shm_tap_reader &) = delete;
+
+	/**
+	 * @brief next Wait for the next chunk
+	 * @param data, size Set to the complete serialized chunk (length, tag, stream id, content)
+	 * @param timeout Maximum time to wait, in seconds
+	 * @return false on a timeout or if the tap is closed and all chunks have been read
+	 * @throws std::runtime_error if the reader was dropped for being too slow
+	 */
+	bool next(const char *&data, uint64_t &size, double timeout);
+	/// whether the chunk returned by the last call to next() is still intact
+	bool valid() const;
+	/// after being dropped, continue with the newest data
+	void resync();
+
+	/// the stream headers (streamid, XML) published so far
+	std::vector<std::pair<uint32_t, std::string>> streams();
+	/// bytes between this reader and the newest data
+	uint64_t lag() const;
+	bool dropped() const;
+
+private:
+	shared_memory shm_;
+	tap_header *header_;
+	const char *catalog_, *ring_;
+	tap_consumer_slot *slot_ = nullptr;
+	uint64_t pos_ = 0;	   // the position of the next record
+	uint64_t current_ = 0; // the position of the record returned by next()
+	uint64_t catalog_read_ = 0;
+	std::vector<std::pair<uint32_t, std::string>> streams_;
+};
@@ -0,0 +1,275 @@
+#include "xdfvalidate.h"
+#include "jsonformat.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <sstream>
+#include <thread>
+
+bool xdf_validation::ok() const {
+	if (!problems.empty()) return false;
+	for (const auto &stream : streams)
+		if (!stream.problems.empty()) return false;
+	return true;
+}
+
+namespace {
+const double no_timestamp = std::numeric_limits<double>::quiet_NaN();
+// minimum number of samples chunks decoded by one task
+const std::size_t min_chunks_per_task = 16;
+
+// per-stream state while walking the chunk headers
+struct scanned_stream {
+	stream_validation result;
+	stream_header_info header;
+	std::vector<const chunk_info *> samples_chunks;
+};
+
+// a range of consecutive samples chunks of a stream, decoded by one thread
+struct decode_task {
+	scanned_stream *stream;
+	std::size_t begin, end; // indices into samples_chunks
+	// results; the range is decoded without knowing the timestamp before it, so deduced
+	// timestamps before the first explicit one are only counted
+	bool malformed = false;
+	uint64_t samples = 0;
+	uint64_t leading_deduced = 0;
+	double first = no_timestamp, last = no_timestamp;
+	uint64_t gaps = 0, backwards = 0;
+	double max_gap = 0;
+};
+
+void decode_range(const char *data, double gap_threshold, decode_task &task) {
+	const auto &stream = *task.stream;
+	std::vector<sample_ref> samples;
+	double ts = no_timestamp;
+	for (std::size_t i = task.begin; i < task.end; ++i) {
+		const chunk_info &chunk = *stream.samples_chunks[i];
+		if (!decode_samples(data + chunk.content_offset, chunk.content_size(), stream.header, ts,
+				samples)) {
+			task.malformed = true;
+			return;
+		}
+		for (const auto &sample : samples) {
+			if (std::isnan(sample.timestamp))
+				task.leading_deduced++;
+			else if (std::isnan(task.first))
+				task.first = sample.timestamp;
+			else {
+				const double interval = sample.timestamp - task.last;
+				if (interval < 0) task.backwards++;
+				if (gap_threshold > 0 && interval > gap_threshold) task.gaps++;
+				task.max_gap = std::max(task.max_gap, interval);
+			}
+			if (!std::isnan(sample.timestamp)) task.last = sample.timestamp;
+		}
+		task.samples += samples.size();
+	}
+}
+
+std::string json_problems(const std::vector<std::string> &problems) {
+	std::string list = "[";
+	for (std::size_t i = 0; i < problems.size(); ++i)
+		(list += i ? "," : "") += json_string(problems[i]);
+	return list += ']';
+}
+} // namespace
+
+xdf_validation validate_xdf(const std::string &filename, unsigned threads, double gap_factor) {
+	xdf_validation report;
+	mapped_file file(filename);
+	const char *data = file.data();
+	const uint64_t size = report.file_size = file.size();
+	if (size < 4 || std::memcmp(data, "XDF:", 4) != 0) {
+		report.problems.push_back("not an XDF file");
+		return report;
+	}
+
+	// walk the chunk headers
+	std::vector<chunk_info> chunks;
+	uint64_t pos = 4;
+	while (pos < size) {
+		chunk_info chunk;
+		if (parse_chunk_header(data, size, pos, chunk)) {
+			chunks.push_back(chunk);
+			pos = chunk.end;
+			continue;
+		}
+		const uint64_t next = find_boundary_after(data, size, pos);
+		if (!next) {
+			report.truncated_bytes = size - pos;
+			break;
+		}
+		report.skipped_bytes += next - pos;
+		pos = next;
+	}
+	report.chunks = chunks.size();
+	if (report.truncated_bytes)
+		report.problems.push_back("the file ends in a partial chunk (" +
+								  std::to_string(report.truncated_bytes) + " bytes)");
+	if (report.skipped_bytes)
+		report.problems.push_back(
+			std::to_string(report.skipped_bytes) + " bytes of damaged chunks were skipped");
+
+	// headers, footers and clock offsets are few, so they are read right away
+	std::map<streamid_t, scanned_stream> streams;
+	for (const auto &chunk : chunks) {
+		const char *content = data + chunk.content_offset;
+		if (chunk.tag == chunk_tag_t::fileheader) report.has_file_header = true;
+		if (chunk.tag == chunk_tag_t::boundary) report.boundaries++;
+		if (!chunk.has_streamid()) continue;
+		auto &stream = streams[chunk.streamid];
+		stream.result.streamid = chunk.streamid;
+		switch (chunk.tag) {
+		case chunk_tag_t::streamheader:
+			try {
+				stream.header = parse_stream_header(std::string(content, chunk.content_size()));
+				stream.result.has_header = true;
+			} catch (std::exception &e) {
+				stream.result.problems.push_back(e.what());
+			}
+			stream.result.name = stream.header.name;
+			stream.result.type = stream.header.type;
+			stream.result.channel_format = stream.header.channel_format;
+			stream.result.channel_count = stream.header.channel_count;
+			stream.result.nominal_srate = stream.header.nominal_srate;
+			break;
+		case chunk_tag_t::samples:
+			stream.samples_chunks.push_back(&chunk);
+			stream.result.chunks++;
+			break;
+		case chunk_tag_t::clockoffset: stream.result.clock_offsets++; break;
+		case chunk_tag_t::streamfooter: {
+			const std::string footer(content, chunk.content_size());
+			stream.result.has_footer = true;
+			auto &result = stream.result;
+			try {
+				result.footer_sample_count = std::stoull(xml_value(footer, "sample_count"));
+				result.footer_first_timestamp = std::stod(xml_value(footer, "first_timestamp"));
+				result.footer_last_timestamp = std::stod(xml_value(footer, "last_timestamp"));
+			} catch (std::exception &) {
+				result.problems.push_back("malformed footer");
+			}
+			break;
+		}
+		default: break;
+		}
+	}
+	if (!report.has_file_header) report.problems.push_back("no file header");
+
+	// split the samples chunks of each stream into tasks and decode them in parallel
+	if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+	std::size_t total_chunks = 0;
+	for (const auto &stream : streams) total_chunks += stream.second.samples_chunks.size();
+	const std::size_t chunks_per_task =
+		std::max(min_chunks_per_task, total_chunks / (threads * 8) + 1);
+	std::vector<decode_task> tasks;
+	for (auto &entry : streams) {
+		auto &stream = entry.second;
+		if (!stream.result.has_header) continue;
+		for (std::size_t begin = 0; begin < stream.samples_chunks.size();
+			 begin += chunks_per_task) {
+			decode_task task;
+			task.stream = &stream;
+			task.begin = begin;
+			task.end = std::min(begin + chunks_per_task, stream.samples_chunks.size());
+			tasks.push_back(task);
+		}
+	}
+	std::atomic<std::size_t> next_task{0};
+	std::vector<std::thread> workers;
+	for (unsigned t = 0; t < std::min<std::size_t>(threads, tasks.size()); ++t)
+		workers.emplace_back([&]() {
+			for (std::size_t i; (i = next_task++) < tasks.size();) {
+				const double srate = tasks[i].stream->header.nominal_srate;
+				decode_range(data, srate > 0 ? gap_factor / srate : 0, tasks[i]);
+			}
+		});
+	for (auto &worker : workers) worker.join();
+
+	// stitch the ranges of each stream together (tasks are in stream and chunk order)
+	double last = no_timestamp;
+	for (std::size_t i = 0; i < tasks.size(); ++i) {
+		const auto &task = tasks[i];
+		auto &result = task.stream->result;
+		const double srate = task.stream->header.nominal_srate;
+		const double interval = srate > 0 ? 1.0 / srate : 0;
+		if (i == 0 || tasks[i - 1].stream != task.stream) last = no_timestamp;
+		if (task.malformed) {
+			result.problems.push_back("malformed samples chunk at offset " +
+				std::to_string(task.stream->samples_chunks[task.begin]->offset) + " or after it");
+			last = no_timestamp;
+			continue;
+		}
+		result.sample_count += task.samples;
+		if (task.samples == 0) continue;
+		// deduced timestamps at the start of the range continue the previous range
+		const double lead_end = last + task.leading_deduced * interval;
+		if (std::isnan(last)) {
+			// the first range of the stream
+			if (result.sample_count == task.samples) result.first_timestamp = task.first;
+		} else if (!std::isnan(task.first)) {
+			const double gap = task.first - lead_end;
+			if (gap < 0) result.backwards++;
+			if (interval > 0 && gap > gap_factor * interval) result.gaps++;
+			result.max_gap = std::max(result.max_gap, gap);
+		}
+		result.gaps += task.gaps;
+		result.backwards += task.backwards;
+		result.max_gap = std::max(result.max_gap, task.max_gap);
+		last = std::isnan(task.last) ? lead_end : task.last;
+		if (!std::isnan(last)) result.last_timestamp = last;
+	}
+
+	for (auto &entry : streams) {
+		auto &result = entry.second.result;
+		if (!result.has_header) result.problems.push_back("no stream header");
+		if (!result.has_footer)
+			result.problems.push_back("no stream footer");
+		else if (result.footer_sample_count != result.sample_count)
+			result.problems.push_back("the footer says " +
+									  std::to_string(result.footer_sample_count) + " samples, " +
+									  std::to_string(result.sample_count) + " found");
+		if (result.sample_count > 1 && result.last_timestamp > result.first_timestamp)
+			result.effective_srate =
+				(result.sample_count - 1) / (result.last_timestamp - result.first_timestamp);
+		report.streams.push_back(std::move(result));
+	}
+	return report;
+}
+
+std::string validation_to_json(const xdf_validation &v) {
+	std::ostringstream out;
+	out << "{\"ok\":" << (v.ok() ? "true" : "false") << ",\"file_size\":" << v.file_size
+		<< ",\"chunks\":" << v.chunks << ",\"boundaries\":" << v.boundaries
+		<< ",\"skipped_bytes\":" << v.skipped_bytes << ",\"truncated_bytes\":" << v.truncated_bytes
+		<< ",\"problems\":" << json_problems(v.problems) << ",\"streams\":[";
+	for (std::size_t i = 0; i < v.streams.size(); ++i) {
+		const auto &s = v.streams[i];
+		if (i) out << ',';
+		out << "{\"id\":" << s.streamid << ",\"name\":" << json_string(s.name)
+			<< ",\"type\":" << json_string(s.type)
+			<< ",\"channel_format\":" << json_string(s.channel_format)
+			<< ",\"channel_count\":" << s.channel_count
+			<< ",\"nominal_srate\":" << json_number(s.nominal_srate)
+			<< ",\"effective_srate\":" << json_number(s.effective_srate)
+			<< ",\"chunks\":" << s.chunks << ",\"samples\":" << s.sample_count
+			<< ",\"first_timestamp\":" << json_number(s.first_timestamp)
+			<< ",\"last_timestamp\":" << json_number(s.last_timestamp)
+			<< ",\"clock_offsets\":" << s.clock_offsets << ",\"footer\":";
+		if (s.has_footer)
+			out << "{\"samples\":" << s.footer_sample_count
+				<< ",\"first_timestamp\":" << json_number(s.footer_first_timestamp)
+				<< ",\"last_timestamp\":" << json_number(s.footer_last_timestamp) << '}';
+		else
+			out << "null";
+		out << ",\"gaps\":" << s.gaps << ",\"max_gap\":" << json_number(s.max_gap)
+			<< ",\"backwards\":" << s.backwards << ",\"problems\":" << json_problems(s.problems)
+			<< '}';
+	}
+	out << "]}";
+	return out.str();
+}
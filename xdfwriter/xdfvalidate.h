@@ -0,0 +1,57 @@
+#pragma once
+
+#include "xdfreader.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// what validate_xdf() found out about a stream
+struct stream_validation {
+	streamid_t streamid = 0;
+	std::string name, type, channel_format;
+	uint32_t channel_count = 0;
+	double nominal_srate = 0;
+	bool has_header = false, has_footer = false;
+	uint64_t chunks = 0, sample_count = 0, clock_offsets = 0;
+	double first_timestamp = 0, last_timestamp = 0;
+	double effective_srate = 0; // from the first and last timestamp, 0 if unknown
+	// the footer's values (only if has_footer)
+	uint64_t footer_sample_count = 0;
+	double footer_first_timestamp = 0, footer_last_timestamp = 0;
+	// time stamp intervals longer than the gap threshold (only for regular streams)
+	uint64_t gaps = 0;
+	double max_gap = 0;		// the longest interval between two samples, in seconds
+	uint64_t backwards = 0; // time stamps that are earlier than the previous one
+	std::vector<std::string> problems;
+};
+
+struct xdf_validation {
+	uint64_t file_size = 0;
+	uint64_t chunks = 0;
+	uint64_t boundaries = 0;
+	uint64_t skipped_bytes = 0;	  // damaged regions, skipped up to the next boundary chunk
+	uint64_t truncated_bytes = 0; // a partial chunk at the end
+	bool has_file_header = false;
+	std::vector<stream_validation> streams;
+	std::vector<std::string> problems; // file level problems
+
+	/// no problems in the file or any stream
+	bool ok() const;
+};
+
+/**
+ * @brief validate_xdf Check a recording for completeness and summarize its streams
+ *
+ * The chunk headers are walked first (the payloads are skipped using the chunk lengths, so only
+ * the touched pages of the memory mapped file are read). Then the samples chunks are decoded in
+ * parallel in ranges of consecutive chunks per stream to count the samples and find timestamp
+ * gaps; the results of the ranges are stitched together afterwards.
+ * @param threads Number of decoding threads (0: one per CPU core)
+ * @param gap_factor An interval longer than gap_factor / nominal_srate counts as a gap
+ */
+xdf_validation validate_xdf(
+	const std::string &filename, unsigned threads = 0, double gap_factor = 2.0);
+
+/// the validation as a single JSON object
+std::string validation_to_json(const xdf_validation &validation);
@@ -1,5 +1,12 @@
 #define _CRT_SECURE_NO_WARNINGS
 #include "xdfwriter.h"
+#include "xdfreader.h"
+#include "xdfrecover.h"
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
 #include <iostream>
 #include <iomanip>
 #include <chrono>
@@ -17,76 +24,338 @@ void write_timestamp(std::ostream &out, double ts) {
 	}
 }
 
-XDFWriter::XDFWriter(const std::string &filename)
-#ifndef XDFZ_SUPPORT
-	: file_(filename, std::ios::binary | std::ios::trunc)
-#endif
-{
-	// open file stream
-#ifdef XDFZ_SUPPORT
-	if (boost::iends_with(filename, ".xdfz")) file_.push(boost::iostreams::zlib_compressor());
-	file_.push(
-		boost::iostreams::file_descriptor_sink(filename, std::ios::binary | std::ios::trunc));
-#endif
+XDFWriter::XDFWriter(const std::string &filename, const std::vector<std::string> &mirrors,
+	open_mode mode, const std::string &header_fields, const durability_policy &durability) {
+	std::error_code ec;
+	const bool existing =
+		mode != open_mode::truncate && std::filesystem::file_size(filename, ec) > 0 && !ec;
+	if (existing && mode == open_mode::resume) {
+		const recovery_report report = recover_xdf(filename);
+		max_streamid_ = report.max_streamid;
+		std::cout << "Resuming " << filename << " after " << report.chunks << " chunks ("
+				  << report.original_size - report.intact_size << " bytes cut off, "
+				  << report.footers_written << " footers written)" << std::endl;
+	} else if (existing)
+		max_streamid_ = recover_xdf(filename, true).max_streamid;
+	_open(filename, mirrors, existing, header_fields, durability);
+}
+
+XDFWriter::XDFWriter(const std::string &filename, const recovery_report &recovered,
+	const std::vector<std::string> &mirrors, const std::string &header_fields,
+	const durability_policy &durability)
+	: max_streamid_(recovered.max_streamid) {
+	_open(filename, mirrors, true, header_fields, durability);
+}
+
+void XDFWriter::_open(const std::string &filename, const std::vector<std::string> &mirrors,
+	bool existing, const std::string &header_fields, const durability_policy &durability) {
+	sinks_.emplace_back(new xdf_sink(filename, default_spill_budget, true, existing, durability));
+	for (const auto &mirror : mirrors)
+		sinks_.emplace_back(new xdf_sink(mirror, mirror_queue_limit, false, false, durability));
+
 	// [MagicCode]
-	file_ << "XDF:";
+	auto magic = std::make_shared<const std::string>("XDF:");
 	// [FileHeader] chunk
 	std::stringstream header;
 	header << "<?xml version=\"1.0\"?>\n  <info>\n    <version>1.0</version>";
 	// datetime
 	std::time_t now = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
 	header << "\n    <datetime>" << std::put_time(std::localtime(&now), "%FT%T%z") << "</datetime>";
+	if (!header_fields.empty()) header << "\n    " << header_fields;
 	header << "\n  </info>";
-	_write_chunk(chunk_tag_t::fileheader, header.str());
+	if (existing) {
+		// the existing file already has a header, new mirrors need one
+		for (std::size_t i = 1; i < sinks_.size(); ++i) sinks_[i]->push(magic, false);
+		auto header_chunk = _serialize_chunk(chunk_tag_t::fileheader, header.str());
+		for (std::size_t i = 1; i < sinks_.size(); ++i) sinks_[i]->push(header_chunk, false);
+		// mark where the appended part starts
+		write_boundary_chunk();
+	} else {
+		_write_buffer(magic);
+		_write_chunk(chunk_tag_t::fileheader, header.str());
+	}
 }
 
-void XDFWriter::_write_chunk(
+XDFWriter::~XDFWriter() {
+	try {
+		close();
+	} catch (std::exception &e) {
+		std::cerr << "Error closing the XDF file: " << e.what() << std::endl;
+	}
+}
+
+void XDFWriter::close() {
+	std::lock_guard<std::mutex> lock(write_mut);
+	if (closed_) return;
+	closed_ = true;
+	try {
+		_release_chunks(true);
+	} catch (std::exception &) {
+		// the main file failed, close() below reports it
+	}
+	if (interleave_window_ > 0) {
+		const auto &stats = interleave_stats_;
+		std::cout << "Interleaved " << stats.chunks_written << " chunks (" << stats.chunks_late
+				  << " late), added latency " << stats.mean_delay() * 1000 << " ms on average, "
+				  << stats.max_delay * 1000 << " ms max, reorder buffer "
+				  << stats.max_bytes_buffered / 1024 << " KiB max" << std::endl;
+	}
+	// the mirrors only log their errors, the main file's error is thrown
+	for (std::size_t i = sinks_.size(); i-- > 1;) sinks_[i]->close();
+	sinks_.front()->close();
+}
+
+chunk_buffer_p XDFWriter::_serialize_chunk(
 	chunk_tag_t tag, const std::string &content, const streamid_t *streamid_p) {
-	// Write the chunk header
-	_write_chunk_header(tag, content.length(), streamid_p);
+	// the header is at most 15 bytes, the content is copied once into the final buffer
+	std::string chunk;
+	chunk.reserve(15 + content.size());
+	_write_chunk_header(chunk, tag, content.size(), streamid_p);
 	// [Content]
-	file_ << content;
+	chunk += content;
+	return std::make_shared<const std::string>(std::move(chunk));
+}
+
+void XDFWriter::_write_chunk(
+	chunk_tag_t tag, const std::string &content, const streamid_t *streamid_p) {
+	// Serialize the chunk once, all outputs share the buffer
+	// only samples can be dropped, everything else is needed to read the file
+	_write_buffer(_serialize_chunk(tag, content, streamid_p),
+		tag == chunk_tag_t::samples, tag == chunk_tag_t::boundary);
+}
+
+void XDFWriter::_write_buffer(chunk_buffer_p buf, bool droppable, bool sync_point) {
+	for (auto &sink : sinks_) sink->push(buf, droppable, sync_point);
 }
 
 void XDFWriter::_write_chunk_header(
-	chunk_tag_t tag, std::size_t len, const streamid_t *streamid_p) {
+	std::string &out, chunk_tag_t tag, std::size_t len, const streamid_t *streamid_p) {
+	// little endian, independent of the platform's byte order
+	const auto append_int = [&out](uint64_t val, std::size_t bytes) {
+		for (std::size_t i = 0; i < bytes; ++i) out += static_cast<char>(val >> (8 * i));
+	};
 	len += sizeof(chunk_tag_t);
 	if (streamid_p) len += sizeof(streamid_t);
 
 	// [Length] (variable-length integer, content + 2 bytes for the tag
 	// + 4 bytes if the streamid is being written
-	write_varlen_int(file_, len);
+	const std::size_t length_bytes = len < 256 ? 1 : len <= 4294967295 ? 4 : 8;
+	out += static_cast<char>(length_bytes);
+	append_int(len, length_bytes);
 	// [Tag]
-	write_little_endian(file_, static_cast<uint16_t>(tag));
+	append_int(static_cast<uint16_t>(tag), sizeof(uint16_t));
 	// Optional: [StreamId]
-	if (streamid_p) write_little_endian(file_, *streamid_p);
+	if (streamid_p) append_int(*streamid_p, sizeof(streamid_t));
+}
+
+void XDFWriter::_write_samples(
+	streamid_t streamid, const std::vector<double> &timestamps, const std::string &content) {
+	// follow the stream's time axis, filling in deduced timestamps like a reader would
+	auto &clock = stream_clocks_[streamid];
+	const double first_timestamp = timestamps.front() != 0
+									   ? timestamps.front()
+									   : clock.last_timestamp + clock.sample_interval;
+	for (double ts : timestamps)
+		clock.last_timestamp = ts != 0 ? ts : clock.last_timestamp + clock.sample_interval;
+	clock.watermark = std::max(clock.watermark, clock.last_timestamp);
+
+	auto buf = _serialize_chunk(chunk_tag_t::samples, content, &streamid);
+	// local readers get the data right away, even if it's held back for the file
+	if (tap_) tap_->publish(*buf);
+	if (interleave_window_ <= 0 || !std::isfinite(first_timestamp)) {
+		_write_buffer(std::move(buf), true);
+		return;
+	}
+	if (first_timestamp < last_released_) {
+		// later chunks were already written, so the order can't be kept anymore
+		++interleave_stats_.chunks_late;
+		++interleave_stats_.chunks_written;
+		_write_buffer(std::move(buf), true);
+		_release_chunks();
+		return;
+	}
+	interleave_stats_.bytes_buffered += buf->size();
+	interleave_stats_.max_bytes_buffered =
+		std::max(interleave_stats_.max_bytes_buffered, interleave_stats_.bytes_buffered);
+	++interleave_stats_.chunks_buffered;
+	++clock.pending;
+	pending_.push(pending_chunk{first_timestamp, pending_seq_++, streamid, std::move(buf),
+		std::chrono::steady_clock::now()});
+	_release_chunks();
+}
+
+void XDFWriter::_release_chunks(bool all, const streamid_t *streamid_p) {
+	if (pending_.empty()) return;
+	const auto now = std::chrono::steady_clock::now();
+	// all regular streams have delivered their data up to this time; irregular streams (e.g.
+	// markers) are ignored, they might not send anything for a long time
+	double complete = std::numeric_limits<double>::infinity();
+	for (const auto &clock : stream_clocks_)
+		if (clock.second.sample_interval > 0)
+			complete = std::min(complete, clock.second.watermark);
+	const auto window = std::chrono::duration<double>(interleave_window_);
+
+	while (!pending_.empty()) {
+		const pending_chunk &next = pending_.top();
+		const bool release = all || next.first_timestamp <= complete ||
+							 now - next.arrival >= window ||
+							 interleave_stats_.bytes_buffered > interleave_max_bytes_ ||
+							 (streamid_p && stream_clocks_[*streamid_p].pending > 0);
+		if (!release) break;
+		const double delay = std::chrono::duration<double>(now - next.arrival).count();
+		interleave_stats_.delay_seconds += delay;
+		interleave_stats_.max_delay = std::max(interleave_stats_.max_delay, delay);
+		interleave_stats_.bytes_buffered -= next.buf->size();
+		--interleave_stats_.chunks_buffered;
+		++interleave_stats_.chunks_written;
+		--stream_clocks_[next.streamid].pending;
+		last_released_ = std::max(last_released_, next.first_timestamp);
+		_write_buffer(next.buf, true);
+		pending_.pop();
+	}
 }
 
 void XDFWriter::write_stream_header(streamid_t streamid, const std::string &content) {
 	std::lock_guard<std::mutex> lock(write_mut);
 	_write_chunk(chunk_tag_t::streamheader, content, &streamid);
+	if (tap_) tap_->add_stream(streamid, content);
+	// the sampling rate is needed to fill in deduced timestamps
+	double srate = 0;
+	try {
+		srate = std::stod(xml_value(content, "nominal_srate"));
+	} catch (std::exception &) {}
+	stream_clocks_[streamid].sample_interval = srate > 0 ? 1.0 / srate : 0;
 }
 
 void XDFWriter::write_stream_footer(streamid_t streamid, const std::string &content) {
 	std::lock_guard<std::mutex> lock(write_mut);
+	// the stream's samples have to come before its footer
+	_release_chunks(false, &streamid);
+	stream_clocks_.erase(streamid);
 	_write_chunk(chunk_tag_t::streamfooter, content, &streamid);
 }
 
-void XDFWriter::write_stream_offset(streamid_t streamid, double now, double offset) {
+void XDFWriter::write_stream_footer(streamid_t streamid, footer_builder &footer,
+	double first_timestamp, double last_timestamp, uint64_t sample_count,
+	const std::string &extra_xml) {
+	auto chunk = footer.finish(streamid, first_timestamp, last_timestamp, sample_count, extra_xml);
 	std::lock_guard<std::mutex> lock(write_mut);
-	const auto len = sizeof(now) + sizeof(offset);
-	_write_chunk_header(chunk_tag_t::clockoffset, len, &streamid);
+	_release_chunks(false, &streamid);
+	stream_clocks_.erase(streamid);
+	_write_buffer(std::move(chunk));
+}
+
+void XDFWriter::write_stream_offset(streamid_t streamid, double now, double offset) {
+	std::ostringstream content;
 	// [CollectionTime]
-	write_little_endian(file_, now - offset);
+	write_little_endian(content, now - offset);
 	// [OffsetValue]
-	write_little_endian(file_, offset);
+	write_little_endian(content, offset);
+	std::lock_guard<std::mutex> lock(write_mut);
+	_write_chunk(chunk_tag_t::clockoffset, content.str(), &streamid);
 }
 
 void XDFWriter::write_boundary_chunk() {
 	std::lock_guard<std::mutex> lock(write_mut);
-	// the signature of the boundary chunk (next chunk begins right after this)
-	const uint8_t boundary_uuid[] = {0x43, 0xA5, 0x46, 0xDC, 0xCB, 0xF5, 0x41, 0x0F, 0xB3, 0x0E,
-		0xD5, 0x46, 0x73, 0x83, 0xCB, 0xE4};
-	_write_chunk_header(chunk_tag_t::boundary, sizeof(boundary_uuid));
-	write_sample_values(file_, boundary_uuid, sizeof(boundary_uuid));
+	// also flushes held back chunks when no stream delivers data
+	_release_chunks();
+	_write_chunk(chunk_tag_t::boundary,
+		std::string(reinterpret_cast<const char *>(boundary_uuid), sizeof(boundary_uuid)));
+}
+
+void XDFWriter::set_spill_budget(
+	std::size_t max_bytes, std::size_t alarm_bytes, double alarm_latency) {
+	sinks_.front()->set_limits(max_bytes, alarm_bytes, alarm_latency);
+}
+
+void XDFWriter::set_watermark(double interval) { sinks_.front()->set_watermark(interval); }
+
+void XDFWriter::set_integrity() {
+	for (auto &sink : sinks_) sink->set_integrity();
+}
+
+void XDFWriter::set_interleaving(double window, std::size_t max_bytes) {
+	std::lock_guard<std::mutex> lock(write_mut);
+	interleave_window_ = window;
+	interleave_max_bytes_ = max_bytes;
+	if (window <= 0) _release_chunks(true);
+}
+
+void XDFWriter::enable_tap(const std::string &name, std::size_t capacity) {
+	std::lock_guard<std::mutex> lock(write_mut);
+	tap_ = std::make_unique<shm_tap_writer>(name, capacity);
+}
+
+tap_stats XDFWriter::tap_statistics() {
+	std::lock_guard<std::mutex> lock(write_mut);
+	return tap_ ? tap_->stats() : tap_stats();
+}
+
+interleave_stats XDFWriter::interleave_statistics() {
+	std::lock_guard<std::mutex> lock(write_mut);
+	return interleave_stats_;
+}
+
+std::vector<sink_stats> XDFWriter::sink_statistics() const {
+	std::vector<sink_stats> result;
+	for (const auto &sink : sinks_) result.push_back(sink->stats());
+	return result;
+}
+
+namespace {
+// [NumLengthBytes 8][Length][Tag][StreamId]
+const std::size_t footer_header_size = 1 + 8 + sizeof(chunk_tag_t) + sizeof(streamid_t);
+const char footer_xml_start[] = "<?xml version=\"1.0\"?><info><clock_offsets>";
+// the longest <offset> element: two numbers of up to 24 characters and the tags
+const std::size_t max_offset_size = 96;
+} // namespace
+
+footer_builder::footer_builder(std::size_t expected_offsets) {
+	chunk_.reserve(
+		footer_header_size + sizeof(footer_xml_start) + 256 + expected_offsets * max_offset_size);
+	chunk_.assign(footer_header_size, '\0');
+	chunk_ += footer_xml_start;
+}
+
+void footer_builder::add_offset(double collection_time, double offset) {
+	// std::to_chars is independent of the locale and doesn't allocate
+	char buf[max_offset_size], *pos = buf;
+	const auto append = [&](const char *text) {
+		const std::size_t len = std::strlen(text);
+		std::memcpy(pos, text, len);
+		pos += len;
+	};
+	const auto append_number = [&](double v) {
+		pos = std::to_chars(pos, buf + sizeof(buf), v, std::chars_format::general, 16).ptr;
+	};
+	append("<offset><time>");
+	append_number(collection_time);
+	append("</time><value>");
+	append_number(offset);
+	append("</value></offset>");
+	chunk_.append(buf, pos);
+	offsets_++;
+}
+
+chunk_buffer_p footer_builder::finish(streamid_t streamid, double first_timestamp,
+	double last_timestamp, uint64_t sample_count, const std::string &extra_xml) {
+	std::ostringstream rest;
+	rest.precision(16);
+	rest << "</clock_offsets><first_timestamp>" << first_timestamp
+		 << "</first_timestamp><last_timestamp>" << last_timestamp
+		 << "</last_timestamp><sample_count>" << sample_count << "</sample_count>" << extra_xml
+		 << "</info>";
+	chunk_ += rest.str();
+
+	// fill in the chunk header in front of the content
+	std::ostringstream header;
+	write_fixlen_int(header, static_cast<uint64_t>(chunk_.size() - 1 - 8));
+	write_little_endian(header, static_cast<uint16_t>(chunk_tag_t::streamfooter));
+	write_little_endian(header, streamid);
+	chunk_.replace(0, footer_header_size, header.str());
+
+	auto chunk = std::make_shared<const std::string>(std::move(chunk_));
+	chunk_.clear();
+	offsets_ = 0;
+	return chunk;
 }
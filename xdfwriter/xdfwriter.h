@@ -1,24 +1,27 @@
 #pragma once
 
 #include "conversions.h"
+#include "xdfsink.h"
+#include "xdftap.h"
 
 #include <cassert>
+#include <chrono>
+#include <limits>
+#include <map>
 #include <mutex>
+#include <queue>
 #include <sstream>
 #include <thread>
 #include <type_traits>
 #include <vector>
 
-#ifdef XDFZ_SUPPORT
-#include <boost/iostreams/filtering_stream.hpp>
-using outfile_t = boost::iostreams::filtering_ostream;
-#else
-#include <fstream>
-using outfile_t = std::ofstream;
-#endif
-
 using streamid_t = uint32_t;
 
+// maximum amount of data queued for a mirror before it starts dropping chunks
+const std::size_t mirror_queue_limit = 256 * 1024 * 1024;
+// default memory budget for buffering data while the main file's disk stalls
+const std::size_t default_spill_budget = 1024 * 1024 * 1024;
+
 // the currently defined chunk tags
 enum class chunk_tag_t : uint16_t {
 	fileheader = 1,   // FileHeader chunk
@@ -30,23 +33,142 @@ enum class chunk_tag_t : uint16_t {
 	undefined = 0
 };
 
+// how XDFWriter treats an existing file
+enum class open_mode {
+	truncate, // start a new file
+	append,	  // append to an intact XDF file (e.g. after recover_xdf())
+	resume	  // repair an interrupted XDF file with recover_xdf() and append to it
+};
+
+// the signature of the boundary chunk (next chunk begins right after this)
+inline constexpr uint8_t boundary_uuid[] = {0x43, 0xA5, 0x46, 0xDC, 0xCB, 0xF5, 0x41, 0x0F, 0xB3,
+	0x0E, 0xD5, 0x46, 0x73, 0x83, 0xCB, 0xE4};
+
+// reorder buffer counters of the time-ordered chunk interleaving, see XDFWriter::set_interleaving()
+struct interleave_stats {
+	uint64_t chunks_buffered = 0;	 // samples chunks currently held back
+	uint64_t bytes_buffered = 0;	 // memory used by the held back chunks
+	uint64_t max_bytes_buffered = 0; // the largest the reorder buffer has been
+	uint64_t chunks_written = 0;	 // chunks that went through the reorder buffer
+	uint64_t chunks_late = 0; // chunks that arrived too late to be written in timestamp order
+	double delay_seconds = 0; // total time chunks were held back
+	double max_delay = 0;	  // longest time a single chunk was held back, in seconds
+
+	/// average time a chunk was held back, i.e. the latency added by the interleaving
+	double mean_delay() const { return chunks_written ? delay_seconds / chunks_written : 0; }
+};
+
+class footer_builder;
+struct recovery_report;
+
 class XDFWriter {
 private:
-	outfile_t file_;
-	void _write_chunk_header(
-		chunk_tag_t tag, std::size_t length, const streamid_t *streamid_p = nullptr);
+	// the main file (first entry) and the mirrors, each with its own queue and writer thread
+	std::vector<std::unique_ptr<xdf_sink>> sinks_;
 	std::mutex write_mut;
 
+	// append the [Length][Tag][StreamId] header of a chunk
+	void _write_chunk_header(std::string &out, chunk_tag_t tag, std::size_t length,
+		const streamid_t *streamid_p = nullptr);
+
+	// serialize a chunk with its header
+	chunk_buffer_p _serialize_chunk(
+		chunk_tag_t tag, const std::string &content, const streamid_t *streamid_p = nullptr);
+
 	// write a generic chunk
 	void _write_chunk(
 		chunk_tag_t tag, const std::string &content, const streamid_t *streamid_p = nullptr);
 
+	// the highest stream id in the file when it was opened
+	streamid_t max_streamid_ = 0;
+
+	// open the files and write the file header (or a boundary chunk when appending)
+	void _open(const std::string &filename, const std::vector<std::string> &mirrors,
+		bool existing, const std::string &header_fields, const durability_policy &durability);
+
+	// hand serialized data to the main file and all mirrors
+	void _write_buffer(chunk_buffer_p buf, bool droppable = false, bool sync_point = false);
+
+	// write a samples chunk or hold it back in the reorder buffer (with write_mut held)
+	void _write_samples(streamid_t streamid, const std::vector<double> &timestamps,
+		const std::string &content);
+
+	// a samples chunk held back in the reorder buffer
+	struct pending_chunk {
+		double first_timestamp;
+		uint64_t seq; // arrival order, keeps chunks with equal timestamps in order
+		streamid_t streamid;
+		chunk_buffer_p buf;
+		std::chrono::steady_clock::time_point arrival;
+		// std::priority_queue puts the largest element first, so this orders by ascending time
+		bool operator<(const pending_chunk &other) const {
+			return first_timestamp != other.first_timestamp
+					   ? first_timestamp > other.first_timestamp
+					   : seq > other.seq;
+		}
+	};
+	// the time axis of a stream, needed to fill in deduced timestamps
+	struct stream_clock {
+		double sample_interval = 0; // 0 for irregular streams
+		double last_timestamp = std::numeric_limits<double>::quiet_NaN();
+		double watermark = -std::numeric_limits<double>::infinity(); // end of the newest chunk
+		uint64_t pending = 0;
+	};
+
+	// write all held back chunks that can't be overtaken anymore (with write_mut held)
+	void _release_chunks(bool all = false, const streamid_t *streamid_p = nullptr);
+
+	// live copy of the samples chunks in shared memory, see enable_tap()
+	std::unique_ptr<shm_tap_writer> tap_;
+
+	bool closed_ = false;
+
+	double interleave_window_ = 0;
+	std::size_t interleave_max_bytes_ = 0;
+	std::priority_queue<pending_chunk> pending_;
+	std::map<streamid_t, stream_clock> stream_clocks_;
+	uint64_t pending_seq_ = 0;
+	double last_released_ = -std::numeric_limits<double>::infinity();
+	interleave_stats interleave_stats_;
+
 public:
 	/**
 	 * @brief XDFWriter Construct a XDFWriter object
 	 * @param filename  Filename to write to
+	 * @param mirrors   Additional files that receive a copy of everything written.
+	 * A slow or failing mirror drops data instead of stalling the main file.
+	 *
+	 * @param mode  What to do if the file exists. When appending, the file starts with a boundary
+	 * chunk and the mirrors start as new files.
+	 * @param header_fields  Additional XML elements for the file header, e.g. a session id
+	 * @param durability  When data is synced to the disk (main file and mirrors). Syncs happen on
+	 * the writer threads, preferably right after boundary chunks.
+	 *
+	 * All writes are queued and written by a background thread per file, so a stalling disk
+	 * doesn't block the caller; see set_spill_budget(). Once writing the main file failed, all
+	 * further writes and close() throw std::runtime_error.
+	 */
+	XDFWriter(const std::string &filename, const std::vector<std::string> &mirrors = {},
+		open_mode mode = open_mode::truncate, const std::string &header_fields = std::string(),
+		const durability_policy &durability = durability_policy());
+	/**
+	 * @brief XDFWriter Append to a file that recover_xdf() has just analyzed, without
+	 * scanning it again
+	 * @param recovered  The report of the recovery, for the stream ids already in the file
+	 */
+	XDFWriter(const std::string &filename, const recovery_report &recovered,
+		const std::vector<std::string> &mirrors = {},
+		const std::string &header_fields = std::string(),
+		const durability_policy &durability = durability_policy());
+	/// Closes the files, errors are only logged (call close() to handle them)
+	~XDFWriter();
+
+	/**
+	 * @brief close Write the chunks held back for interleaving and everything queued, and close
+	 * the files. The writer can't be used afterwards.
+	 * @throws std::runtime_error if writing the main file failed
 	 */
-	XDFWriter(const std::string &filename);
+	void close();
 
 	template <typename T>
 	void write_data_chunk(streamid_t streamid, const std::vector<double> &timestamps,
@@ -73,6 +195,13 @@ public:
 	 * @see https://github.com/sccn/xdf/wiki/Specifications#streamfooter-chunk
 	 */
 	void write_stream_footer(streamid_t streamid, const std::string &content);
+	/**
+	 * @brief write_stream_footer Write a footer that was built while recording, without
+	 * copying its clock offsets
+	 * @param extra_xml Additional elements for the footer's <info> element
+	 */
+	void write_stream_footer(streamid_t streamid, footer_builder &footer, double first_timestamp,
+		double last_timestamp, uint64_t sample_count, const std::string &extra_xml = std::string());
 	/**
 	 * @brief write_stream_offset Record the time discrepancy between the
 	 * streaming and the recording PC
@@ -84,6 +213,121 @@ public:
 	 * to recover from errors in XDF files by providing a restart marker.
 	 */
 	void write_boundary_chunk();
+
+	/**
+	 * @brief set_spill_budget Configure how much data is buffered in memory when the disk of the
+	 * main file stalls. Samples chunks beyond the budget are dropped (and logged).
+	 * @param max_bytes Spill budget
+	 * @param alarm_bytes Buffered amount that raises the alarm in sink_statistics()
+	 * @param alarm_latency A single write taking longer (in seconds) raises the alarm
+	 */
+	void set_spill_budget(std::size_t max_bytes, std::size_t alarm_bytes, double alarm_latency);
+
+	/**
+	 * @brief set_watermark Publish how much of the main file consists of complete chunks in a
+	 * sidecar file (see watermark_filename()), so it can be read while it's being written.
+	 * @param interval Minimum time between updates of the sidecar, in seconds
+	 */
+	void set_watermark(double interval = 0.1);
+
+	/**
+	 * @brief set_integrity Compute a CRC32C of every chunk and the SHA-256 of the whole file
+	 * (main file and mirrors) on the writer threads, see xdfintegrity.h for the sidecar files.
+	 */
+	void set_integrity();
+
+	/**
+	 * @brief set_interleaving Write samples chunks of all streams ordered by their first timestamp
+	 *
+	 * Chunks are held back in a reorder buffer and merged by their first timestamp. A chunk is
+	 * written as soon as all other streams have delivered data up to its timestamp, or at the
+	 * latest once it's `window` seconds old or the buffer exceeds `max_bytes`. Chunks arriving
+	 * later than that are written right away (and counted as late), so the file order is only
+	 * approximately monotonic in time.
+	 * @param window Maximum added latency in seconds, 0 disables the interleaving (the default)
+	 * @param max_bytes Memory for the reorder buffer
+	 */
+	void set_interleaving(double window, std::size_t max_bytes);
+
+	/**
+	 * @brief enable_tap Publish all stream headers and samples chunks in a shared memory ring
+	 * that local programs can read with shm_tap_reader, without their own inlets.
+	 * Readers that fall behind by more than the ring size are dropped, the writer never waits.
+	 * Has to be called before the first stream header is written.
+	 * @param name Name of the shared memory object
+	 * @param capacity Size of the ring in bytes
+	 */
+	void enable_tap(const std::string &name, std::size_t capacity);
+
+	/**
+	 * @brief tap_statistics Published data and reader lag of the tap (if enabled)
+	 */
+	tap_stats tap_statistics();
+
+	/**
+	 * @brief interleave_statistics Reorder buffer size and added latency of the interleaving
+	 */
+	interleave_stats interleave_statistics();
+
+	/**
+	 * @brief max_streamid The highest stream id already in the file when it was opened, so
+	 * appended streams can get unique ids
+	 */
+	streamid_t max_streamid() const { return max_streamid_; }
+
+	/**
+	 * @brief sink_statistics Throughput counters for the main file (first entry) and each mirror
+	 */
+	std::vector<sink_stats> sink_statistics() const;
+};
+
+/**
+ * @brief stream_footer_xml The XML content of a StreamFooter chunk
+ * @param clock_offsets (collection time, offset value) pairs
+ */
+template <typename Container>
+std::string stream_footer_xml(double first_timestamp, double last_timestamp,
+	uint64_t sample_count, const Container &clock_offsets) {
+	std::ostringstream footer;
+	footer.precision(16);
+	footer << "<?xml version=\"1.0\"?><info><first_timestamp>" << first_timestamp
+		   << "</first_timestamp><last_timestamp>" << last_timestamp
+		   << "</last_timestamp><sample_count>" << sample_count << "</sample_count>";
+	footer << "<clock_offsets>";
+	for (const auto &pair : clock_offsets)
+		footer << "<offset><time>" << pair.first << "</time><value>" << pair.second
+			   << "</value></offset>";
+	footer << "</clock_offsets></info>";
+	return footer.str();
+}
+
+/**
+ * A StreamFooter chunk that's built while recording.
+ *
+ * The clock offsets are appended to one preallocated buffer as they are measured, so there's no
+ * per-offset allocation and writing the footer costs the same after an hour or a week: finish()
+ * only appends the summary and fills in the chunk header, and the buffer becomes the chunk that
+ * is handed to the writer threads. To allow this, the offsets come first in the footer XML and
+ * the chunk length is always written as an 8 byte integer.
+ */
+class footer_builder {
+public:
+	/// @param expected_offsets Number of offsets to preallocate for (the buffer grows beyond)
+	explicit footer_builder(std::size_t expected_offsets = 1024);
+
+	void add_offset(double collection_time, double offset);
+	uint64_t offset_count() const { return offsets_; }
+
+	/**
+	 * @brief finish Complete the chunk, the builder can't be used afterwards
+	 * @param extra_xml Additional elements for the footer's <info> element
+	 */
+	chunk_buffer_p finish(streamid_t streamid, double first_timestamp, double last_timestamp,
+		uint64_t sample_count, const std::string &extra_xml = std::string());
+
+private:
+	std::string chunk_; // the space for the chunk header, the start of the XML and the offsets
+	uint64_t offsets_ = 0;
 };
 
 inline void write_ts(std::ostream &out, double ts) {
@@ -125,7 +369,7 @@ void XDFWriter::write_data_chunk(streamid_t streamid, const std::vector<double>
 	std::copy(reinterpret_cast<char *>(&s), reinterpret_cast<char *>(&s + 1), outstr.begin() + 1);
 
 	std::lock_guard<std::mutex> lock(write_mut);
-	_write_chunk(chunk_tag_t::samples, outstr, &streamid);
+	_write_samples(streamid, timestamps, outstr);
 }
 
 template <typename T>
@@ -154,5 +398,5 @@ void XDFWriter::write_data_chunk_nested(streamid_t streamid, const std::vector<d
 	auto s = static_cast<uint32_t>(n_samples);
 	std::copy(reinterpret_cast<char *>(&s), reinterpret_cast<char *>(&s + 1), outstr.begin() + 1);
 	std::lock_guard<std::mutex> lock(write_mut);
-	_write_chunk(chunk_tag_t::samples, outstr, &streamid);
+	_write_samples(streamid, timestamps, outstr);
 }